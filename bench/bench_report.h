@@ -0,0 +1,62 @@
+#ifndef BENCH_REPORT_H
+#define BENCH_REPORT_H
+
+// Machine-readable benchmark results. With BENCH_JSON=<file> in the
+// environment, every measurement is appended to the file as one JSON
+// object per line (`make bench` collects all programs into one file), so
+// two releases can be compared case by case. Times are per sample: what
+// one sample is (a frame, a URB, a pass over a buffer) depends on the
+// case; throughput is taken from the median.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "latency_hist.h"
+
+typedef struct {
+    const char *bench;          // program
+    const char *name;           // case
+    uint64_t samples;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+    double mb_s;                // 0: not meaningful for this case
+    double fps;
+} BenchResult;
+
+static inline void bench_result_from_hist(BenchResult *r, const LatencyHistogram *h,
+                                          double bytes_per_sample, double frames_per_sample) {
+    r->samples = h->total;
+    r->p50_ms = latency_hist_percentile(h, 50) / 1e6;
+    r->p90_ms = latency_hist_percentile(h, 90) / 1e6;
+    r->p99_ms = latency_hist_percentile(h, 99) / 1e6;
+    r->max_ms = h->max / 1e6;
+    double secs = r->p50_ms / 1e3;
+    r->mb_s = secs > 0 && bytes_per_sample > 0 ? bytes_per_sample / (1 << 20) / secs : 0;
+    r->fps = secs > 0 && frames_per_sample > 0 ? frames_per_sample / secs : 0;
+}
+
+static inline void bench_report(const BenchResult *r) {
+    const char *path = getenv("BENCH_JSON");
+    if (!path || !*path) return;
+    FILE *fp = fopen(path, "a");
+    if (!fp) return;
+    fprintf(fp, "{\"bench\":\"%s\",\"case\":\"%s\",\"samples\":%llu,"
+            "\"p50_ms\":%.4f,\"p90_ms\":%.4f,\"p99_ms\":%.4f,\"max_ms\":%.4f",
+            r->bench, r->name, (unsigned long long)r->samples,
+            r->p50_ms, r->p90_ms, r->p99_ms, r->max_ms);
+    if (r->mb_s > 0) fprintf(fp, ",\"mb_s\":%.2f", r->mb_s);
+    if (r->fps > 0) fprintf(fp, ",\"fps\":%.2f", r->fps);
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+// The common case: a histogram of sample times
+static inline void bench_report_hist(const char *bench, const char *name, const LatencyHistogram *h,
+                                     double bytes_per_sample, double frames_per_sample) {
+    BenchResult r = { .bench = bench, .name = name };
+    bench_result_from_hist(&r, h, bytes_per_sample, frames_per_sample);
+    bench_report(&r);
+}
+
+#endif // BENCH_REPORT_H
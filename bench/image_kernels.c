@@ -0,0 +1,533 @@
+// Image kernel benchmark: conformance of every SIMD set against the scalar
+// reference (tolerances as documented in image_kernels.h), then ms per
+// 1920x1080 RGB frame for each operation.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "cpu_features.h"
+#include "image_kernels.h"
+#include "image_processing.h"
+#include "point_ops.h"
+#include "overlay.h"
+#include "latency_hist.h"
+#include "bench_report.h"
+
+#define BENCH_WIDTH     1920
+#define BENCH_HEIGHT    1080
+#define BENCH_ROUNDS    20
+#define GRAY_ROW        4093    // pixels per row in the exhaustive test: not a multiple of 16/32
+#define DRAW_WIDTH      203     // drawing checks: shapes cross every edge
+#define DRAW_HEIGHT     151
+#define DRAW_SHAPES     300
+#define BENCH_BOXES     200     // overlay timing: detection boxes + lines per frame
+#define BENCH_LINES     50
+
+static const ImageKernels *sets[] = {
+    &image_kernels_scalar,
+#if defined(__x86_64__) || defined(__i386__)
+    &image_kernels_ssse3,
+    &image_kernels_avx2,
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    &image_kernels_neon,
+#endif
+};
+#define NUM_SETS ((int)(sizeof(sets) / sizeof(sets[0])))
+
+static const float contrast_factors[] = { 0.0f, 0.25f, 0.5f, 1.0f, 1.2f, 1.5f, 2.0f, 3.7f, 10.0f, 63.0f, -1.0f, -2.5f, 100.0f };
+#define NUM_FACTORS ((int)(sizeof(contrast_factors) / sizeof(contrast_factors[0])))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Largest |a - b| over n bytes; *exact counts equal bytes
+static int max_diff(const uint8_t *a, const uint8_t *b, size_t n, size_t *exact) {
+    int worst = 0;
+    for (size_t i = 0; i < n; i++) {
+        int d = a[i] > b[i] ? a[i] - b[i] : b[i] - a[i];
+        if (d > worst) worst = d;
+        if (!d) (*exact)++;
+    }
+    return worst;
+}
+
+// Every 24-bit RGB value, in rows of GRAY_ROW pixels
+static int check_gray(const ImageKernels *k) {
+    const size_t total = 1 << 24;
+    uint8_t *ref = malloc(total * 3);
+    uint8_t *out = malloc(total * 3);
+    for (size_t i = 0; i < total; i++) {
+        ref[i * 3] = i >> 16;
+        ref[i * 3 + 1] = i >> 8;
+        ref[i * 3 + 2] = i;
+    }
+    memcpy(out, ref, total * 3);
+
+    for (size_t x = 0; x < total; x += GRAY_ROW) {
+        int n = total - x < GRAY_ROW ? (int)(total - x) : GRAY_ROW;
+        image_kernels_scalar.gray_rgb(ref + x * 3, n);
+        k->gray_rgb(out + x * 3, n);
+    }
+
+    size_t exact = 0;
+    int worst = max_diff(ref, out, total * 3, &exact);
+    printf("  %-7s grayscale   max diff %d, %.2f%% exact\n", k->name, worst, 100.0 * exact / (total * 3));
+    free(ref);
+    free(out);
+    return worst <= 1;
+}
+
+// Every byte value at every offset into a 16/32-byte block, for all deltas
+static int check_brightness(const ImageKernels *k) {
+    uint8_t src[256 + 37], ref[sizeof(src)], out[sizeof(src)];
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = (uint8_t)(i * 7);
+
+    for (int delta = -300; delta <= 300; delta++) {
+        memcpy(ref, src, sizeof(src));
+        memcpy(out, src, sizeof(src));
+        image_kernels_scalar.brightness(ref, sizeof(src), delta);
+        k->brightness(out, sizeof(src), delta);
+        if (memcmp(ref, out, sizeof(src)) != 0) {
+            printf("  %-7s brightness  mismatch at delta %d\n", k->name, delta);
+            return 0;
+        }
+    }
+    printf("  %-7s brightness  bit-exact\n", k->name);
+    return 1;
+}
+
+static int check_contrast(const ImageKernels *k) {
+    uint8_t src[256 + 37], ref[sizeof(src)], out[sizeof(src)];
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = (uint8_t)(i * 7);
+
+    int worst = 0;
+    size_t exact = 0;
+    for (int f = 0; f < NUM_FACTORS; f++) {
+        memcpy(ref, src, sizeof(src));
+        memcpy(out, src, sizeof(src));
+        image_kernels_scalar.contrast(ref, sizeof(src), contrast_factors[f]);
+        k->contrast(out, sizeof(src), contrast_factors[f]);
+        int d = max_diff(ref, out, sizeof(src), &exact);
+        if (d > worst) worst = d;
+    }
+    printf("  %-7s contrast    max diff %d, %.2f%% exact\n", k->name, worst,
+           100.0 * exact / (sizeof(src) * NUM_FACTORS));
+    return worst <= 1;
+}
+
+// Random table, every byte value at every block offset
+static int check_lut(const ImageKernels *k) {
+    uint8_t table[256], src[1024 + 37], ref[sizeof(src)], out[sizeof(src)];
+    for (int i = 0; i < 256; i++) table[i] = (uint8_t)rand();
+    for (size_t i = 0; i < sizeof(src); i++) src[i] = (uint8_t)(i * 7 + i / 256);
+
+    memcpy(ref, src, sizeof(src));
+    memcpy(out, src, sizeof(src));
+    image_kernels_scalar.lut(ref, sizeof(src), table);
+    k->lut(out, sizeof(src), table);
+    if (memcmp(ref, out, sizeof(src)) != 0) {
+        printf("  %-7s lut         mismatch\n", k->name);
+        return 0;
+    }
+    printf("  %-7s lut         bit-exact\n", k->name);
+    return 1;
+}
+
+// Every length up to a few vectors, gray (memset) and colored
+static int check_fill(const ImageKernels *k) {
+    uint8_t ref[80 * 3 + 8], out[sizeof(ref)];
+    for (int n = 0; n <= 80; n++) {
+        for (int c = 0; c < 2; c++) {
+            uint8_t r = 10, g = c ? 20 : 10, b = c ? 30 : 10;
+            memset(ref, 0xAA, sizeof(ref));
+            memset(out, 0xAA, sizeof(out));
+            image_kernels_scalar.fill_rgb(ref + 1, n, r, g, b);
+            k->fill_rgb(out + 1, n, r, g, b);
+            if (memcmp(ref, out, sizeof(ref)) != 0) {
+                printf("  %-7s fill_rgb    mismatch at %d pixels\n", k->name, n);
+                return 0;
+            }
+        }
+    }
+    printf("  %-7s fill_rgb    bit-exact\n", k->name);
+    return 1;
+}
+
+// Every pair of byte values, at every block offset
+static int check_average(const ImageKernels *k) {
+    uint8_t a[256 + 37], b[sizeof(a)], ref[sizeof(a)], out[sizeof(a)];
+    for (int shift = 0; shift < 256; shift++) {
+        for (size_t i = 0; i < sizeof(a); i++) {
+            a[i] = (uint8_t)i;
+            b[i] = (uint8_t)(i + shift);
+        }
+        image_kernels_scalar.average(a, b, ref, sizeof(a));
+        k->average(a, b, out, sizeof(a));
+        if (memcmp(ref, out, sizeof(a)) != 0) {
+            printf("  %-7s average     mismatch\n", k->name);
+            return 0;
+        }
+    }
+    printf("  %-7s average     bit-exact\n", k->name);
+    return 1;
+}
+
+// The drawing code before spans: every pixel through a checked setter
+__attribute__((noinline))
+static void ref_set_pixel(Image *img, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
+    if (!img->valid || x < 0 || x >= img->width || y < 0 || y >= img->height) return;
+    if (img->channels != 3) return;
+    uint8_t *p = img->data + (size_t)y * img->step + x * 3;
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+}
+
+static void ref_draw_rect(Image *img, int x, int y, int w, int h,
+                          uint8_t r, uint8_t g, uint8_t b, int thickness) {
+    for (int t = 0; t < thickness; t++) {
+        for (int i = x; i < x + w; i++) {
+            ref_set_pixel(img, i, y + t, r, g, b);
+            ref_set_pixel(img, i, y + h - t - 1, r, g, b);
+        }
+        for (int i = y; i < y + h; i++) {
+            ref_set_pixel(img, x + t, i, r, g, b);
+            ref_set_pixel(img, x + w - t - 1, i, r, g, b);
+        }
+    }
+}
+
+static void ref_fill_rect(Image *img, int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b) {
+    for (int j = y; j < y + h; j++) {
+        for (int i = x; i < x + w; i++) ref_set_pixel(img, i, j, r, g, b);
+    }
+}
+
+static void ref_draw_line(Image *img, int x1, int y1, int x2, int y2,
+                          uint8_t r, uint8_t g, uint8_t b) {
+    if (!img->valid) return;
+
+    // Bresenham's line algorithm
+    int dx = x2 - x1;
+    int dy = y2 - y1;
+
+    if (dx < 0) dx = -dx;
+    if (dy < 0) dy = -dy;
+
+    int sx = (x1 < x2) ? 1 : -1;
+    int sy = (y1 < y2) ? 1 : -1;
+    int err = dx - dy;
+
+    while (1) {
+        ref_set_pixel(img, x1, y1, r, g, b);
+
+        if (x1 == x2 && y1 == y2) break;
+
+        int e2 = 2 * err;
+        if (e2 > -dy) {
+            err -= dy;
+            x1 += sx;
+        }
+        if (e2 < dx) {
+            err += dx;
+            y1 += sy;
+        }
+    }
+}
+
+typedef struct {
+    int type, x1, y1, x2, y2, thickness;
+    uint8_t r, g, b;
+} TestShape;
+
+// Random rects, fills and lines, many of them crossing the image edges.
+// Some rects are thicker than their smaller side, so their bands spill
+// past it.
+static void random_shapes(TestShape *s, int n, int width, int height, int max_size) {
+    for (int i = 0; i < n; i++) {
+        s[i].type = rand() % 3;
+        s[i].x1 = rand() % (width + 100) - 50;
+        s[i].y1 = rand() % (height + 100) - 50;
+        s[i].thickness = 1;
+        if (s[i].type == OVERLAY_LINE) {
+            s[i].x2 = rand() % (width + 100) - 50;
+            s[i].y2 = rand() % (height + 100) - 50;
+        } else {
+            s[i].x2 = 1 + rand() % max_size;
+            s[i].y2 = 1 + rand() % max_size;
+            int side = s[i].x2 < s[i].y2 ? s[i].x2 : s[i].y2;
+            s[i].thickness = i % 5 ? 1 + rand() % (side < 8 ? side : 8) : side + 1 + rand() % 8;
+        }
+        s[i].r = (uint8_t)rand();
+        s[i].g = (uint8_t)rand();
+        s[i].b = i % 4 ? (uint8_t)rand() : s[i].r;     // some gray: memset path
+        if (i % 4 == 0) s[i].g = s[i].r;
+    }
+}
+
+// per_pixel: the reference code; top_down: lines from their top end, as
+// the overlay batch walks them
+static void draw_shapes(Image *img, const TestShape *s, int n, int per_pixel, int top_down) {
+    for (int i = 0; i < n; i++) {
+        const TestShape *t = &s[i];
+        if (t->type == OVERLAY_LINE) {
+            int flip = top_down && t->y2 < t->y1;
+            int x1 = flip ? t->x2 : t->x1, y1 = flip ? t->y2 : t->y1;
+            int x2 = flip ? t->x1 : t->x2, y2 = flip ? t->y1 : t->y2;
+            if (per_pixel) ref_draw_line(img, x1, y1, x2, y2, t->r, t->g, t->b);
+            else image_draw_line(img, x1, y1, x2, y2, t->r, t->g, t->b);
+        } else if (t->type == OVERLAY_FILL) {
+            if (per_pixel) ref_fill_rect(img, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b);
+            else image_fill_rect(img, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b);
+        } else {
+            if (per_pixel) ref_draw_rect(img, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b, t->thickness);
+            else image_draw_rect(img, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b, t->thickness);
+        }
+    }
+}
+
+static int batch_shapes(OverlayBatch *ov, const TestShape *s, int n) {
+    overlay_clear(ov);
+    for (int i = 0; i < n; i++) {
+        const TestShape *t = &s[i];
+        int rc;
+        if (t->type == OVERLAY_LINE) rc = overlay_add_line(ov, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b);
+        else if (t->type == OVERLAY_FILL) rc = overlay_add_fill(ov, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b);
+        else rc = overlay_add_rect(ov, t->x1, t->y1, t->x2, t->y2, t->r, t->g, t->b, t->thickness);
+        if (rc < 0) return -1;
+    }
+    return 0;
+}
+
+// Span drawing and the overlay batch must set exactly the pixels the
+// per-pixel code sets, overlaps included; the batch's reference walks
+// lines from their top end, as the batch does
+static int check_drawing(void) {
+    size_t size = image_buffer_size(DRAW_WIDTH, DRAW_HEIGHT, 3);
+    uint8_t *mem = aligned_alloc(IMAGE_ALIGN, size * 4);
+    Image ref, spans, batch_ref, batch;
+    image_init(&ref, DRAW_WIDTH, DRAW_HEIGHT, 3, mem, size);
+    image_init(&spans, DRAW_WIDTH, DRAW_HEIGHT, 3, mem + size, size);
+    image_init(&batch_ref, DRAW_WIDTH, DRAW_HEIGHT, 3, mem + 2 * size, size);
+    image_init(&batch, DRAW_WIDTH, DRAW_HEIGHT, 3, mem + 3 * size, size);
+
+    TestShape shapes[DRAW_SHAPES];
+    OverlayBatch ov;
+    overlay_init(&ov, DRAW_SHAPES);
+    random_shapes(shapes, DRAW_SHAPES, DRAW_WIDTH, DRAW_HEIGHT, 120);
+    draw_shapes(&ref, shapes, DRAW_SHAPES, 1, 0);
+    draw_shapes(&spans, shapes, DRAW_SHAPES, 0, 0);
+    draw_shapes(&batch_ref, shapes, DRAW_SHAPES, 1, 1);
+    batch_shapes(&ov, shapes, DRAW_SHAPES);
+    overlay_render(&ov, &batch);
+
+    int spans_ok = memcmp(ref.data, spans.data, size) == 0;
+    int batch_ok = memcmp(batch_ref.data, batch.data, size) == 0;
+    printf("  drawing spans     %s\n", spans_ok ? "match the per-pixel code" : "MISMATCH");
+    printf("  overlay batch     %s\n", batch_ok ? "matches drawing in order" : "MISMATCH");
+    overlay_destroy(&ov);
+    free(mem);
+    return spans_ok && batch_ok;
+}
+
+// A compiled chain must equal the scalar steps run one after the other
+static int check_point_ops(void) {
+    static uint8_t ref_mem[64 * 64 * 3] __attribute__((aligned(IMAGE_ALIGN)));
+    static uint8_t out_mem[sizeof(ref_mem)] __attribute__((aligned(IMAGE_ALIGN)));
+    Image ref, out;
+    image_init(&ref, 64, 64, 3, ref_mem, sizeof(ref_mem));
+    image_init(&out, 64, 64, 3, out_mem, sizeof(out_mem));
+    for (int i = 0; i < 64 * 64 * 3; i++) ref_mem[i] = out_mem[i] = (uint8_t)(i * 13);
+
+    PointOpPipeline p;
+    point_ops_init(&p);
+    point_ops_brightness(&p, 25);
+    point_ops_contrast(&p, 1.4f);
+    point_ops_brightness(&p, -10);
+    point_ops_apply(&p, &out);
+
+    for (int y = 0; y < 64; y++) {
+        image_kernels_scalar.brightness(ref.data + y * ref.step, 64 * 3, 25);
+        image_kernels_scalar.contrast(ref.data + y * ref.step, 64 * 3, 1.4f);
+        image_kernels_scalar.brightness(ref.data + y * ref.step, 64 * 3, -10);
+    }
+    int ok = memcmp(ref_mem, out_mem, sizeof(ref_mem)) == 0;
+    printf("  point_ops chain   %s\n", ok ? "matches the scalar steps" : "MISMATCH");
+    return ok;
+}
+
+enum { OP_GRAY, OP_BRIGHTNESS, OP_CONTRAST, OP_LUT, NUM_OPS };
+static const char *op_names[NUM_OPS] = { "grayscale", "brightness", "contrast", "lut" };
+static uint8_t bench_table[256];
+static LatencyHistogram hist[3];            // one per variant timed side by side
+
+// Best of BENCH_ROUNDS, ms per frame, each round on a fresh copy
+static double time_op(const ImageKernels *k, int op, const uint8_t *frame, uint8_t *work) {
+    size_t row = (size_t)BENCH_WIDTH * 3;
+    uint64_t best = UINT64_MAX;
+    latency_hist_reset(&hist[0]);
+
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        memcpy(work, frame, row * BENCH_HEIGHT);
+        uint64_t t0 = now_ns();
+        for (int y = 0; y < BENCH_HEIGHT; y++) {
+            uint8_t *p = work + y * row;
+            if (op == OP_GRAY) k->gray_rgb(p, BENCH_WIDTH);
+            else if (op == OP_BRIGHTNESS) k->brightness(p, row, 20);
+            else if (op == OP_CONTRAST) k->contrast(p, row, 1.3f);
+            else k->lut(p, row, bench_table);
+        }
+        uint64_t dt = now_ns() - t0;
+        if (dt < best) best = dt;
+        latency_hist_record(&hist[0], dt);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s %s", op_names[op], k->name);
+    bench_report_hist("image_kernels", name, &hist[0], (double)row * BENCH_HEIGHT, 1);
+    return best / 1e6;
+}
+
+// brightness + contrast + gamma: three passes vs one compiled table
+static void bench_chain(const uint8_t *frame) {
+    ImageArena arena;
+    Image img;
+    image_arena_init(&arena, image_buffer_size(BENCH_WIDTH, BENCH_HEIGHT, 3));
+    image_arena_alloc(&arena, &img, BENCH_WIDTH, BENCH_HEIGHT, 3);
+
+    PointOpPipeline p;
+    point_ops_init(&p);
+    point_ops_brightness(&p, 20);
+    point_ops_contrast(&p, 1.3f);
+    point_ops_gamma(&p, 2.2f);
+    point_ops_compile(&p);
+
+    PointOpPipeline gamma;
+    point_ops_init(&gamma);
+    point_ops_gamma(&gamma, 2.2f);
+    point_ops_compile(&gamma);
+
+    uint64_t best_seq = UINT64_MAX, best_fused = UINT64_MAX;
+    latency_hist_reset(&hist[0]);
+    latency_hist_reset(&hist[1]);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int y = 0; y < BENCH_HEIGHT; y++) memcpy(img.data + (size_t)y * img.step, frame + (size_t)y * BENCH_WIDTH * 3, BENCH_WIDTH * 3);
+        uint64_t t0 = now_ns();
+        image_adjust_brightness(&img, 20);
+        image_adjust_contrast(&img, 1.3f);
+        point_ops_apply(&gamma, &img);
+        uint64_t t1 = now_ns();
+        point_ops_apply(&p, &img);
+        uint64_t t2 = now_ns();
+        if (t1 - t0 < best_seq) best_seq = t1 - t0;
+        if (t2 - t1 < best_fused) best_fused = t2 - t1;
+        latency_hist_record(&hist[0], t1 - t0);
+        latency_hist_record(&hist[1], t2 - t1);
+    }
+    size_t bytes = (size_t)BENCH_WIDTH * BENCH_HEIGHT * 3;
+    bench_report_hist("image_kernels", "point_ops chain 3 passes", &hist[0], bytes, 1);
+    bench_report_hist("image_kernels", "point_ops chain fused", &hist[1], bytes, 1);
+    printf("  brightness+contrast+gamma: 3 passes %.3f ms, fused %.3f ms  %5.2fx\n",
+           best_seq / 1e6, best_fused / 1e6, (double)best_seq / best_fused);
+    image_arena_destroy(&arena);
+}
+
+// Boxes and lines on a 1080p frame: per-pixel, spans, one batched pass
+static void bench_overlay(void) {
+    ImageArena arena;
+    Image img;
+    image_arena_init(&arena, image_buffer_size(BENCH_WIDTH, BENCH_HEIGHT, 3));
+    image_arena_alloc(&arena, &img, BENCH_WIDTH, BENCH_HEIGHT, 3);
+
+    TestShape shapes[BENCH_BOXES + BENCH_LINES];
+    int n = BENCH_BOXES + BENCH_LINES;
+    random_shapes(shapes, n, BENCH_WIDTH, BENCH_HEIGHT, 400);
+    for (int i = 0; i < n; i++) {
+        shapes[i].type = i < BENCH_BOXES ? OVERLAY_RECT : OVERLAY_LINE;
+        if (shapes[i].type == OVERLAY_RECT) shapes[i].thickness = 3;
+        else {
+            shapes[i].x2 = rand() % BENCH_WIDTH;
+            shapes[i].y2 = rand() % BENCH_HEIGHT;
+        }
+    }
+    OverlayBatch ov;
+    overlay_init(&ov, n);
+
+    uint64_t best[3] = { UINT64_MAX, UINT64_MAX, UINT64_MAX };
+    for (int m = 0; m < 3; m++) latency_hist_reset(&hist[m]);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int m = 0; m < 3; m++) {
+            uint64_t t0 = now_ns();
+            if (m < 2) draw_shapes(&img, shapes, n, m == 0, 0);
+            else {
+                batch_shapes(&ov, shapes, n);
+                overlay_render(&ov, &img);
+            }
+            uint64_t dt = now_ns() - t0;
+            if (dt < best[m]) best[m] = dt;
+            latency_hist_record(&hist[m], dt);
+        }
+    }
+    bench_report_hist("image_kernels", "overlay per-pixel", &hist[0], 0, 1);
+    bench_report_hist("image_kernels", "overlay spans", &hist[1], 0, 1);
+    bench_report_hist("image_kernels", "overlay batch", &hist[2], 0, 1);
+    printf("  %d boxes + %d lines: per-pixel %.3f ms, spans %.3f ms  %5.2fx, batch %.3f ms  %5.2fx\n",
+           BENCH_BOXES, BENCH_LINES, best[0] / 1e6, best[1] / 1e6, (double)best[0] / best[1],
+           best[2] / 1e6, (double)best[0] / best[2]);
+    overlay_destroy(&ov);
+    image_arena_destroy(&arena);
+}
+
+int main(void) {
+    unsigned features = cpu_features();
+    printf("Image kernels: CPU features: %s, dispatch: %s\n", cpu_features_string(), image_kernels()->name);
+
+    int failed = 0;
+    int usable[NUM_SETS];
+    for (int s = 0; s < NUM_SETS; s++) {
+        usable[s] = (features & sets[s]->needs) == sets[s]->needs;
+        if (!usable[s]) {
+            printf("  %-7s skipped (not supported)\n", sets[s]->name);
+            continue;
+        }
+        if (s == 0) continue;   // the reference itself
+        if (!check_gray(sets[s]) || !check_brightness(sets[s]) || !check_contrast(sets[s]) ||
+            !check_lut(sets[s]) || !check_fill(sets[s]) || !check_average(sets[s])) {
+            usable[s] = 0;
+            failed = 1;
+        }
+    }
+
+    if (!check_point_ops()) failed = 1;
+    if (!check_drawing()) failed = 1;
+
+    size_t bytes = (size_t)BENCH_WIDTH * BENCH_HEIGHT * 3;
+    uint8_t *frame = malloc(bytes);
+    uint8_t *work = malloc(bytes);
+    srand(1);
+    for (size_t i = 0; i < bytes; i++) frame[i] = (uint8_t)rand();
+    for (int i = 0; i < 256; i++) bench_table[i] = (uint8_t)(255 - i);
+
+    printf("  %dx%d RGB, ms/frame:\n", BENCH_WIDTH, BENCH_HEIGHT);
+    for (int op = 0; op < NUM_OPS; op++) {
+        double scalar_ms = 0;
+        for (int s = 0; s < NUM_SETS; s++) {
+            if (!usable[s]) continue;
+            double ms = time_op(sets[s], op, frame, work);
+            if (s == 0) scalar_ms = ms;
+            printf("  %-11s %-7s %7.3f ms  %5.2fx\n", op_names[op], sets[s]->name, ms, scalar_ms / ms);
+        }
+    }
+
+    bench_chain(frame);
+    bench_overlay();
+
+    free(frame);
+    free(work);
+    if (failed) printf("Image kernels: FAILED\n");
+    return failed;
+}
@@ -0,0 +1,360 @@
+// JPEG decode benchmark: ms per frame, decode plus hand-off to a sink
+// (/dev/null), for the old per-frame path against JpegDecoder. The old
+// path creates and destroys a decompressor per frame, reads one scanline
+// at a time and writes every row separately. Checks first that both
+// produce the same RGB bytes. Then the preview decodes: the same JPEG at
+// 1/2, 1/4 and 1/8 size, and the 1/8 luma-only "dc" mode. Last, frames
+// with a restart marker every MCU row, decoded whole and split into
+// strips (jpeg_strips.h); the strips must give the same pixels.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include "frame_pool.h"
+#include "jpeg_decoder.h"
+#include "jpeg_strips.h"
+#include "latency_hist.h"
+#include "bench_report.h"
+
+#define BENCH_FRAMES    30      // decodes per round
+#define BENCH_ROUNDS    5
+#define BENCH_QUALITY   80
+#define BENCH_STRIPS    4
+
+static const int sizes[][2] = { { 640, 480 }, { 1280, 720 }, { 1920, 1080 } };
+#define NUM_SIZES ((int)(sizeof(sizes) / sizeof(sizes[0])))
+
+static LatencyHistogram hist[3];            // per frame, one per path timed side by side
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 4:2:2 like a UVC camera, with some noise so entropy decoding has work;
+// restart_rows > 0 adds a restart marker every so many MCU rows
+static uint8_t *make_jpeg(int width, int height, int restart_rows, unsigned long *size) {
+    struct jpeg_compress_struct c;
+    struct jpeg_error_mgr err;
+    uint8_t *out = NULL;
+
+    c.err = jpeg_std_error(&err);
+    jpeg_create_compress(&c);
+    *size = 0;
+    jpeg_mem_dest(&c, &out, size);
+    c.image_width = width;
+    c.image_height = height;
+    c.input_components = 3;
+    c.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, BENCH_QUALITY, TRUE);
+    c.comp_info[0].v_samp_factor = 1;
+    c.restart_in_rows = restart_rows;
+    jpeg_start_compress(&c, TRUE);
+
+    uint8_t *row = malloc((size_t)width * 3);
+    srand(1);
+    while (c.next_scanline < c.image_height) {
+        int y = c.next_scanline;
+        for (int x = 0; x < width; x++) {
+            row[x * 3] = (uint8_t)(x + (rand() & 15));
+            row[x * 3 + 1] = (uint8_t)(y * 2 + (rand() & 15));
+            row[x * 3 + 2] = (uint8_t)((x ^ y) + (rand() & 15));
+        }
+        jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+    jpeg_destroy_compress(&c);
+    free(row);
+    return out;
+}
+
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+} OldErrorMgr;
+
+static void old_error_exit(j_common_ptr cinfo) {
+    longjmp(((OldErrorMgr *)cinfo->err)->setjmp_buffer, 1);
+}
+
+// The decode stage as it was: everything per frame, one row per call.
+// Rows go to out, or into copy (width * 3 per row) for the check.
+static int old_decode(const uint8_t *jpeg, unsigned long size, FILE *out, uint8_t *copy) {
+    struct jpeg_decompress_struct cinfo;
+    OldErrorMgr jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = old_error_exit;
+    if (setjmp(jerr.setjmp_buffer)) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, jpeg, size);
+    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_destroy_decompress(&cinfo);
+        return -1;
+    }
+    jpeg_start_decompress(&cinfo);
+
+    size_t row_size = (size_t)cinfo.output_width * 3;
+    uint8_t *row = malloc(row_size);
+    while (cinfo.output_scanline < cinfo.output_height) {
+        int y = cinfo.output_scanline;
+        jpeg_read_scanlines(&cinfo, &row, 1);
+        if (copy) memcpy(copy + y * row_size, row, row_size);
+        else fwrite(row, 1, row_size, out);
+    }
+    free(row);
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+
+// JpegDecoder into a pool frame, then the whole frame in one write
+static int new_decode(JpegDecoder *d, FramePool *pool, const uint8_t *jpeg, unsigned long size,
+                      FrameFormat format, FILE *out, uint8_t *sink_buf) {
+    Frame *f = frame_pool_acquire(pool);
+    f->jpeg = (uint8_t *)jpeg;
+    f->jpeg_size = (int)size;
+    int ret = jpeg_decoder_decode(d, f, format);
+    if (ret == 0) fwrite(frame_packed(f, sink_buf), 1, frame_packed_size(f), out);
+    f->jpeg = NULL;
+    frame_release(f);
+    return ret;
+}
+
+static int check(JpegDecoder *d, FramePool *pool, const uint8_t *jpeg, unsigned long size,
+                 int width, int height) {
+    size_t bytes = (size_t)width * height * 3;
+    uint8_t *ref = malloc(bytes);
+    uint8_t *buf = malloc(bytes);
+    old_decode(jpeg, size, NULL, ref);
+
+    Frame *f = frame_pool_acquire(pool);
+    f->jpeg = (uint8_t *)jpeg;
+    f->jpeg_size = (int)size;
+    int ok = jpeg_decoder_decode(d, f, FRAME_RGB24) == 0 &&
+             frame_packed_size(f) == bytes && memcmp(frame_packed(f, buf), ref, bytes) == 0;
+    f->jpeg = NULL;
+    frame_release(f);
+
+    free(ref);
+    free(buf);
+    return ok;
+}
+
+// Preview decodes, as the preview stage runs them: into a separate frame
+typedef struct {
+    const char *name;
+    int scale_denom;
+    int fast;
+    FrameFormat format;
+} PreviewMode;
+
+static const PreviewMode preview_modes[] = {
+    { "full",  1, 0, FRAME_RGB24 },
+    { "1/2",   2, 0, FRAME_RGB24 },
+    { "1/4",   4, 0, FRAME_RGB24 },
+    { "1/8",   8, 0, FRAME_RGB24 },
+    { "dc",    8, 1, FRAME_GRAY8 },
+};
+#define NUM_PREVIEW_MODES ((int)(sizeof(preview_modes) / sizeof(preview_modes[0])))
+
+static int bench_preview(FramePool *pool, const uint8_t *jpeg, unsigned long size, int width, int height) {
+    Frame src = { .jpeg = (uint8_t *)jpeg, .jpeg_size = (int)size };
+    printf("  %4dx%-4d ", width, height);
+    for (int m = 0; m < NUM_PREVIEW_MODES; m++) {
+        const PreviewMode *mode = &preview_modes[m];
+        JpegDecoder d;
+        jpeg_decoder_init(&d);
+        jpeg_decoder_set_scale(&d, mode->scale_denom, mode->fast);
+
+        Frame *out = frame_pool_acquire(pool);
+        uint64_t best = UINT64_MAX;
+        int ok = 1;
+        latency_hist_reset(&hist[0]);
+        for (int r = 0; r < BENCH_ROUNDS && ok; r++) {
+            uint64_t t0 = now_ns();
+            for (int i = 0; i < BENCH_FRAMES && ok; i++) {
+                uint64_t t1 = now_ns();
+                ok = jpeg_decoder_decode_into(&d, &src, out, mode->format) == 0;
+                latency_hist_record(&hist[0], now_ns() - t1);
+            }
+            uint64_t dt = (now_ns() - t0) / BENCH_FRAMES;
+            if (dt < best) best = dt;
+        }
+        int expect_w = (width + mode->scale_denom - 1) / mode->scale_denom;
+        int expect_h = (height + mode->scale_denom - 1) / mode->scale_denom;
+        if (!ok || out->width != expect_w || out->height != expect_h) {
+            printf("\n  %dx%d: %s decode failed or has the wrong size\n", width, height, mode->name);
+            frame_release(out);
+            jpeg_decoder_destroy(&d);
+            return 0;
+        }
+        printf("  %s %6.2f", mode->name, best / 1e6);
+        char name[64];
+        snprintf(name, sizeof(name), "%dx%d preview %s", width, height, mode->name);
+        bench_report_hist("jpeg_decode", name, &hist[0], size, 1);
+        frame_release(out);
+        jpeg_decoder_destroy(&d);
+    }
+    printf("\n");
+    return 1;
+}
+
+// One frame each way into its own pool frame, compared plane by plane
+static int strips_match(JpegDecoder *d, StripDecoder *sd, FramePool *pool, const uint8_t *jpeg,
+                        unsigned long size, FrameFormat format) {
+    Frame *a = frame_pool_acquire(pool);
+    Frame *b = frame_pool_acquire(pool);
+    a->jpeg = b->jpeg = (uint8_t *)jpeg;
+    a->jpeg_size = b->jpeg_size = (int)size;
+    int ok = jpeg_decoder_decode(d, a, format) == 0 && strip_decoder_decode(sd, b, format) == 0 &&
+             a->width == b->width && a->height == b->height;
+    for (int p = 0; ok && p < frame_num_planes(format); p++) {
+        int w, h;
+        frame_plane_size(a, p, &w, &h);
+        for (int y = 0; ok && y < h; y++) {
+            ok = memcmp(a->planes[p] + (size_t)y * a->plane_stride[p],
+                        b->planes[p] + (size_t)y * b->plane_stride[p], w) == 0;
+        }
+    }
+    a->jpeg = b->jpeg = NULL;
+    frame_release(a);
+    frame_release(b);
+    return ok;
+}
+
+static int bench_strips(JpegDecoder *d, FramePool *pool, const uint8_t *jpeg, unsigned long size,
+                        int width, int height) {
+    StripDecoder sd;
+    if (strip_decoder_init(&sd, BENCH_STRIPS, -1) < 0) return 0;
+    int ok = strips_match(d, &sd, pool, jpeg, size, FRAME_RGB24) &&
+             strips_match(d, &sd, pool, jpeg, size, FRAME_YUV420P) && sd.split_frames == 2;
+    if (!ok) {
+        printf("  %dx%d: strip decode differs from the whole-frame decode\n", width, height);
+        strip_decoder_destroy(&sd);
+        return 0;
+    }
+
+    uint64_t best[2] = { UINT64_MAX, UINT64_MAX };
+    for (int m = 0; m < 2; m++) latency_hist_reset(&hist[m]);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        for (int m = 0; m < 2; m++) {
+            Frame *f = frame_pool_acquire(pool);
+            f->jpeg = (uint8_t *)jpeg;
+            f->jpeg_size = (int)size;
+            uint64_t t0 = now_ns();
+            for (int i = 0; i < BENCH_FRAMES; i++) {
+                uint64_t t1 = now_ns();
+                if (m == 0) jpeg_decoder_decode(d, f, FRAME_YUV420P);
+                else strip_decoder_decode(&sd, f, FRAME_YUV420P);
+                latency_hist_record(&hist[m], now_ns() - t1);
+            }
+            uint64_t dt = (now_ns() - t0) / BENCH_FRAMES;
+            if (dt < best[m]) best[m] = dt;
+            f->jpeg = NULL;
+            frame_release(f);
+        }
+    }
+    static const char *paths[2] = { "restart whole yuv420p", "restart strips yuv420p" };
+    for (int m = 0; m < 2; m++) {
+        char name[64];
+        snprintf(name, sizeof(name), "%dx%d %s", width, height, paths[m]);
+        bench_report_hist("jpeg_decode", name, &hist[m], size, 1);
+    }
+    printf("  %4dx%-4d  whole %6.2f   %d strips %6.2f  %5.2fx\n", width, height,
+           best[0] / 1e6, BENCH_STRIPS, best[1] / 1e6, (double)best[0] / best[1]);
+    strip_decoder_destroy(&sd);
+    return 1;
+}
+
+int main(void) {
+    FILE *out = fopen("/dev/null", "w");
+    if (!out) return 1;
+
+    // Pixel slabs are sized by the first decode: start with the largest
+    FramePool pool;
+    frame_pool_init(&pool, 2, 0, POOL_BLOCK);     // two for the strip check
+    JpegDecoder d;
+    jpeg_decoder_init(&d);
+    uint8_t *sink_buf = malloc((size_t)sizes[NUM_SIZES - 1][0] * sizes[NUM_SIZES - 1][1] * 3);
+    unsigned long big_size;
+    uint8_t *big = make_jpeg(sizes[NUM_SIZES - 1][0], sizes[NUM_SIZES - 1][1], 0, &big_size);
+    new_decode(&d, &pool, big, big_size, FRAME_RGB24, out, sink_buf);
+    free(big);
+
+    printf("JPEG decode: 4:2:2, quality %d, ms/frame (decode + write to /dev/null):\n", BENCH_QUALITY);
+    int failed = 0;
+    for (int s = 0; s < NUM_SIZES; s++) {
+        int width = sizes[s][0], height = sizes[s][1];
+        unsigned long size;
+        uint8_t *jpeg = make_jpeg(width, height, 0, &size);
+
+        if (!check(&d, &pool, jpeg, size, width, height)) {
+            printf("  %dx%d: JpegDecoder output differs from the per-frame decode\n", width, height);
+            failed = 1;
+            free(jpeg);
+            continue;
+        }
+
+        uint64_t best[3] = { UINT64_MAX, UINT64_MAX, UINT64_MAX };
+        for (int m = 0; m < 3; m++) latency_hist_reset(&hist[m]);
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            for (int m = 0; m < 3; m++) {
+                uint64_t t0 = now_ns();
+                for (int i = 0; i < BENCH_FRAMES; i++) {
+                    uint64_t t1 = now_ns();
+                    if (m == 0) old_decode(jpeg, size, out, NULL);
+                    else new_decode(&d, &pool, jpeg, size, m == 1 ? FRAME_RGB24 : FRAME_YUV420P, out, sink_buf);
+                    latency_hist_record(&hist[m], now_ns() - t1);
+                }
+                uint64_t dt = (now_ns() - t0) / BENCH_FRAMES;
+                if (dt < best[m]) best[m] = dt;
+            }
+        }
+        static const char *paths[3] = { "per-frame rgb24", "JpegDecoder rgb24", "JpegDecoder yuv420p" };
+        for (int m = 0; m < 3; m++) {
+            char name[64];
+            snprintf(name, sizeof(name), "%dx%d %s", width, height, paths[m]);
+            bench_report_hist("jpeg_decode", name, &hist[m], size, 1);
+        }
+        printf("  %4dx%-4d  per-frame rgb24 %6.2f   JpegDecoder rgb24 %6.2f  %5.2fx   yuv420p %6.2f  %5.2fx\n",
+               width, height, best[0] / 1e6, best[1] / 1e6, (double)best[0] / best[1],
+               best[2] / 1e6, (double)best[0] / best[2]);
+        free(jpeg);
+    }
+
+    // Full-size RGB is the largest output: the slab sized above fits all modes
+    printf("Preview decode, ms/frame (decode only):\n");
+    for (int s = 0; s < NUM_SIZES; s++) {
+        int width = sizes[s][0], height = sizes[s][1];
+        unsigned long size;
+        uint8_t *jpeg = make_jpeg(width, height, 0, &size);
+        if (!bench_preview(&pool, jpeg, size, width, height)) failed = 1;
+        free(jpeg);
+    }
+
+    printf("Restart strips, %d threads, ms/frame (decode only):\n", BENCH_STRIPS);
+    for (int s = 0; s < NUM_SIZES; s++) {
+        int width = sizes[s][0], height = sizes[s][1];
+        unsigned long size;
+        uint8_t *jpeg = make_jpeg(width, height, 1, &size);
+        if (!bench_strips(&d, &pool, jpeg, size, width, height)) failed = 1;
+        free(jpeg);
+    }
+
+    jpeg_decoder_destroy(&d);
+    frame_pool_destroy(&pool);
+    free(sink_buf);
+    fclose(out);
+    if (failed) printf("JPEG decode: FAILED\n");
+    return failed;
+}
@@ -0,0 +1,179 @@
+// Marker scanner benchmark: checks every kernel against the scalar loop on
+// synthetic entropy-coded data, then reports the throughput of each.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "cpu_features.h"
+#include "jpeg_markers.h"
+#include "latency_hist.h"
+#include "bench_report.h"
+
+#define DATA_SIZE       (16 * 1024 * 1024)
+#define RST_INTERVAL    4096        // bytes between RSTn markers
+#define MARKER_INTERVAL 65536       // bytes between real markers (SOI/EOI/DHT...)
+#define BENCH_ROUNDS    20
+
+typedef long (*find_fn)(const uint8_t *data, size_t len);
+
+typedef struct {
+    const char *name;
+    find_fn fn;
+    unsigned needs;
+} Kernel;
+
+static const Kernel kernels[] = {
+    { "scalar", jpeg_find_marker_scalar, 0 },
+#if defined(__x86_64__) || defined(__i386__)
+    { "sse2",   jpeg_find_marker_sse2,   CPU_FEATURE_SSE2 },
+    { "avx2",   jpeg_find_marker_avx2,   CPU_FEATURE_AVX2 },
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    { "neon",   jpeg_find_marker_neon,   CPU_FEATURE_NEON },
+#endif
+};
+#define NUM_KERNELS ((int)(sizeof(kernels) / sizeof(kernels[0])))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Looks like a scan: random bytes with every 0xFF stuffed, periodic RSTn,
+// the occasional 0xFFFF fill and a real marker every MARKER_INTERVAL
+static void fill_entropy(uint8_t *data, size_t len, unsigned seed) {
+    static const uint8_t real[] = { 0xD8, 0xD9, 0xC4, 0xDB, 0xDA, 0xE0 };
+    int rst = 0;
+
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        data[i] = (uint8_t)rand();
+        if (data[i] == 0xFF && i + 1 < len) data[++i] = 0x00;
+    }
+    for (size_t i = RST_INTERVAL; i + 1 < len; i += RST_INTERVAL) {
+        data[i] = 0xFF;
+        data[i + 1] = 0xD0 + (rst++ & 7);
+    }
+    for (size_t i = 1000; i + 2 < len; i += 7919) {
+        data[i] = 0xFF;
+        data[i + 1] = 0xFF;
+        data[i + 2] = 0x00;
+    }
+    for (size_t i = MARKER_INTERVAL - 3; i + 1 < len; i += MARKER_INTERVAL) {
+        data[i] = 0xFF;
+        data[i + 1] = real[(i / MARKER_INTERVAL) % sizeof(real)];
+    }
+}
+
+// Walks all markers in the buffer, returns how many there are
+static long count_markers(find_fn fn, const uint8_t *data, size_t len, long *offsets, long max) {
+    size_t pos = 0;
+    long n = 0;
+
+    while (pos + 1 < len) {
+        long m = fn(data + pos, len - pos);
+        if (m < 0) break;
+        pos += m;
+        if (offsets && n < max) offsets[n] = (long)pos;
+        n++;
+        pos += 2;
+    }
+    return n;
+}
+
+static int check_kernel(const Kernel *k, const uint8_t *data, size_t len) {
+    long max = len / 1024 + 16;
+    long *want = malloc(max * sizeof(long));
+    long *got = malloc(max * sizeof(long));
+    int ok = 1;
+
+    // Full walk over the whole buffer
+    long nw = count_markers(jpeg_find_marker_scalar, data, len, want, max);
+    long ng = count_markers(k->fn, data, len, got, max);
+    if (nw != ng || memcmp(want, got, nw * sizeof(long)) != 0) {
+        printf("  %s: marker walk differs (%ld vs %ld markers)\n", k->name, ng, nw);
+        ok = 0;
+    }
+
+    // Short spans at every alignment, so the block tails get exercised
+    for (size_t start = 0; ok && start < 256; start++) {
+        for (size_t n = 0; n < 80; n++) {
+            long a = jpeg_find_marker_scalar(data + RST_INTERVAL - 40 + start, n);
+            long b = k->fn(data + RST_INTERVAL - 40 + start, n);
+            if (a != b) {
+                printf("  %s: offset %zu len %zu: got %ld, want %ld\n", k->name, start, n, b, a);
+                ok = 0;
+                break;
+            }
+        }
+    }
+
+    // A marker in the very last position, and a 0xFF with no code byte
+    uint8_t edge[70];
+    for (size_t n = 2; ok && n <= sizeof(edge); n++) {
+        memset(edge, 0x11, sizeof(edge));
+        edge[n - 2] = 0xFF;
+        edge[n - 1] = JPEG_MARKER_EOI;
+        if (k->fn(edge, n) != (long)(n - 2) || k->fn(edge, n - 1) != -1) {
+            printf("  %s: edge case at len %zu failed\n", k->name, n);
+            ok = 0;
+        }
+    }
+
+    free(want);
+    free(got);
+    return ok;
+}
+
+int main(void) {
+    uint8_t *data = malloc(DATA_SIZE);
+    if (!data) {
+        perror("malloc");
+        return 1;
+    }
+    fill_entropy(data, DATA_SIZE, 1);
+
+    unsigned features = cpu_features();
+    printf("Marker scan: %d MB, CPU features: %s, dispatch: %s\n",
+           DATA_SIZE >> 20, cpu_features_string(), jpeg_find_marker_impl());
+
+    static LatencyHistogram hist;      // per pass over the data
+    int failed = 0;
+    double scalar_mbps = 0;
+    long markers = count_markers(jpeg_find_marker_scalar, data, DATA_SIZE, NULL, 0);
+
+    for (int k = 0; k < NUM_KERNELS; k++) {
+        const Kernel *kn = &kernels[k];
+        if ((features & kn->needs) != kn->needs) {
+            printf("  %-8s skipped (not supported)\n", kn->name);
+            continue;
+        }
+        if (!check_kernel(kn, data, DATA_SIZE)) {
+            failed = 1;
+            continue;
+        }
+
+        uint64_t best = UINT64_MAX;
+        latency_hist_reset(&hist);
+        for (int r = 0; r < BENCH_ROUNDS; r++) {
+            uint64_t t0 = now_ns();
+            long n = count_markers(kn->fn, data, DATA_SIZE, NULL, 0);
+            uint64_t dt = now_ns() - t0;
+            if (n != markers) failed = 1;
+            if (dt < best) best = dt;
+            latency_hist_record(&hist, dt);
+        }
+        bench_report_hist("marker_scan", kn->name, &hist, DATA_SIZE, 0);
+
+        double mbps = (double)DATA_SIZE / (1 << 20) / (best / 1e9);
+        if (k == 0) scalar_mbps = mbps;
+        printf("  %-8s %8.0f MB/s  %5.2fx  (%ld markers)\n",
+               kn->name, mbps, mbps / scalar_mbps, markers);
+    }
+
+    free(data);
+    if (failed) printf("Marker scan: FAILED\n");
+    return failed;
+}
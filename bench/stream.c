@@ -0,0 +1,292 @@
+// Stream benchmark: synthetic UVC streams (stream_gen.h) through the
+// packet path. First MJPEGParser alone, fed URB by URB as the event loop
+// feeds it; it must find every frame of a clean stream. Then the whole
+// program on recordings of the same streams: FID/EOF framing with the
+// frames archived to /dev/null (no decode), and the full pipeline into
+// the null sink, once at full speed for throughput and once at the
+// recorded pace for per-frame latency (capture to output, PTS-based).
+// One stream loses 1% of its packets to injected errors; one has restart
+// markers and runs the pipeline with its frames split into strips. Last,
+// the clean streams are replayed together on two shared event loops.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "mjpeg_parser.h"
+#include "latency_hist.h"
+#include "stream_gen.h"
+#include "bench_report.h"
+
+#define BENCH_FRAMES    60
+#define BENCH_ROUNDS    5       // parser passes over each stream
+#define ERROR_RATE      0.01
+#define MULTI_STREAMS   3       // the first clean cases, replayed together
+#define MULTI_LOOPS     2
+
+typedef struct {
+    int width;
+    int height;
+    double error_rate;
+    int restart_rows;
+    const char *args;           // for the pipeline runs
+} StreamCase;
+
+static const StreamCase cases[] = {
+    { 640, 480, 0, 0, "" },
+    { 1280, 720, 0, 0, "" },
+    { 1920, 1080, 0, 0, "" },
+    { 1280, 720, ERROR_RATE, 0, "" },
+    { 1920, 1080, 0, 1, "--decode-strips 4" },
+};
+#define NUM_CASES ((int)(sizeof(cases) / sizeof(cases[0])))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// SOI/EOI framing over every good payload, as --marker runs it, URB by
+// URB; a frame's time is that of the URBs it took to come out. Returns
+// the frames found in one pass, -1 if the passes disagree.
+static int bench_parser(const StreamGen *g, const char *name, LatencyHistogram *h) {
+    MJPEGParser *parser = malloc(sizeof(MJPEGParser));
+    uint8_t *frame = malloc(MAX_JPEG_SIZE);
+    int hle = g->cfg.pts ? 12 : 2;
+    int found = 0, consistent = 1;
+    uint64_t best = UINT64_MAX;
+
+    latency_hist_reset(h);
+    for (int r = 0; r < BENCH_ROUNDS; r++) {
+        mjpeg_parser_init(parser);
+        int frames = 0, size;
+        uint64_t start = now_ns(), frame_ns = 0;
+        for (int u = 0; u < g->num_urbs; u++) {
+            const struct usbdevfs_urb *urb = g->urbs[u];
+            int done = 0;
+            uint64_t t0 = now_ns();
+            for (int p = 0; p < urb->number_of_packets; p++) {
+                const struct usbdevfs_iso_packet_desc *d = &urb->iso_frame_desc[p];
+                if (d->status != 0 || (int)d->actual_length <= hle) continue;
+                const uint8_t *pkt = (const uint8_t *)urb->buffer + (size_t)p * g->cfg.packet_size;
+                if (mjpeg_parser_add_data(parser, pkt + hle, d->actual_length - hle) < 0) continue;
+                while (mjpeg_parser_get_frame(parser, frame, &size) == 1) done++;
+            }
+            frame_ns += now_ns() - t0;
+            if (done) {
+                latency_hist_record(h, frame_ns / done);
+                frames += done;
+                frame_ns = 0;
+            }
+        }
+        uint64_t dt = now_ns() - start;
+        if (dt < best) best = dt;
+        if (r == 0) found = frames;
+        else if (frames != found) consistent = 0;
+    }
+
+    double secs = best / 1e9;
+    printf("  %-12s parser   %8.1f MB/s %7.0f fps   frame p50 %.3f p99 %.3f ms\n",
+           name, g->payload_bytes / (double)(1 << 20) / secs, found / secs,
+           latency_hist_percentile(h, 50) / 1e6, latency_hist_percentile(h, 99) / 1e6);
+    free(parser);
+    free(frame);
+    return consistent ? found : -1;
+}
+
+typedef struct {
+    int frames;
+    double secs;                // wall time, process start to exit
+    int assembled;
+    unsigned long long dropped;
+    unsigned long long decode_errors;
+    double p50_ms, p90_ms, p99_ms, max_ms;
+} RunResult;
+
+// Runs the program on a recording and picks its summary lines apart
+static int run_camera(const char *camera, const char *path, const char *args, RunResult *res) {
+    char cmd[1024];
+    snprintf(cmd, sizeof(cmd), "%s --replay %s --frames 0 %s 2>&1", camera, path, args);
+    memset(res, 0, sizeof(*res));
+    uint64_t t0 = now_ns();
+    FILE *fp = popen(cmd, "r");
+    if (!fp) return -1;
+
+    int seen = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        const char *p;
+        if ((p = strstr(line, "[Done] ")) && sscanf(p, "[Done] %d frames", &res->frames) == 1) seen |= 1;
+        if ((p = strstr(line, "[Pipeline] ")) &&
+            sscanf(p, "[Pipeline] %d assembled, %llu dropped at handoff, %llu decode errors",
+                   &res->assembled, &res->dropped, &res->decode_errors) == 3) seen |= 2;
+        if ((p = strstr(line, "[Latency total ] ")) &&
+            sscanf(p, "[Latency total ] p50 %lf p90 %lf p99 %lf p99.9 %*f max %lf",
+                   &res->p50_ms, &res->p90_ms, &res->p99_ms, &res->max_ms) == 4) seen |= 4;
+    }
+    int status = pclose(fp);
+    res->secs = (now_ns() - t0) / 1e9;
+    return status == 0 && seen == 7 ? 0 : -1;
+}
+
+static void report_run(const char *name, const char *mode, const StreamGen *g,
+                       const RunResult *speed, const RunResult *paced) {
+    char label[64];
+    snprintf(label, sizeof(label), "%s %s", name, mode);
+    BenchResult r = {
+        .bench = "stream", .name = label, .samples = paced->frames,
+        .p50_ms = paced->p50_ms, .p90_ms = paced->p90_ms, .p99_ms = paced->p99_ms, .max_ms = paced->max_ms,
+        .mb_s = g->payload_bytes / (double)(1 << 20) / speed->secs, .fps = speed->frames / speed->secs,
+    };
+    bench_report(&r);
+    printf("  %-12s %-8s %8.1f MB/s %7.0f fps   frame p50 %.2f p99 %.2f ms%s\n",
+           name, mode, r.mb_s, r.fps, r.p50_ms, r.p99_ms, paced == speed ? "" : " (recorded pace)");
+}
+
+// Replays MULTI_STREAMS recordings at once on MULTI_LOOPS loop threads, so
+// at least two streams share an epoll loop and its timerfds. Every stream
+// must come out whole and every loop must have run.
+static int bench_multi(const char *camera, const char *dir) {
+    char paths[MULTI_STREAMS][64];
+    char cmd[1024];
+    int n = snprintf(cmd, sizeof(cmd), "%s", camera);
+    int written = 0, failed = 0;
+
+    for (; written < MULTI_STREAMS; written++) {
+        const StreamCase *sc = &cases[written];
+        StreamGenConfig cfg;
+        stream_gen_defaults(&cfg, sc->width, sc->height, BENCH_FRAMES);
+        cfg.pts = 1;
+        StreamGen g;
+        if (stream_gen_build(&g, &cfg) < 0) break;
+        snprintf(paths[written], sizeof(paths[written]), "%s/multi_%d.uvcs", dir, written);
+        int ret = stream_gen_write(&g, paths[written]);
+        stream_gen_free(&g);
+        if (ret < 0) break;
+        n += snprintf(cmd + n, sizeof(cmd) - n, " --replay %s", paths[written]);
+    }
+    snprintf(cmd + n, sizeof(cmd) - n, " --frames 0 --loop-threads %d --null 2>&1", MULTI_LOOPS);
+
+    int frames[MULTI_STREAMS] = { 0 };
+    int loops = 0, total = 0;
+    double secs = 0;
+    FILE *fp = written == MULTI_STREAMS ? popen(cmd, "r") : NULL;
+    if (!fp) failed = 1;
+    else {
+        uint64_t t0 = now_ns();
+        int cur = -1, id;
+        char line[1024];
+        while (fgets(line, sizeof(line), fp)) {
+            const char *p;
+            if ((p = strstr(line, "[Stream ")) && sscanf(p, "[Stream %d]", &id) == 1) cur = id;
+            if ((p = strstr(line, "[Done] ")) && cur >= 0 && cur < MULTI_STREAMS)
+                sscanf(p, "[Done] %d frames", &frames[cur]);
+            if ((p = strstr(line, "[Loop ")) && sscanf(p, "[Loop %d]", &id) == 1) loops++;
+        }
+        if (pclose(fp) != 0) failed = 1;
+        secs = (now_ns() - t0) / 1e9;
+    }
+
+    for (int i = 0; i < MULTI_STREAMS; i++) {
+        total += frames[i];
+        if (frames[i] != BENCH_FRAMES) failed = 1;
+    }
+    if (loops != MULTI_LOOPS) failed = 1;
+
+    char label[64];
+    snprintf(label, sizeof(label), "%d streams, %d loops", MULTI_STREAMS, MULTI_LOOPS);
+    if (failed) {
+        printf("  %s: %s failed:", label, camera);
+        for (int i = 0; i < MULTI_STREAMS; i++) printf(" %d", frames[i]);
+        printf(" of %d frames, %d loops ran\n", BENCH_FRAMES, loops);
+    }
+    else {
+        BenchResult r = { .bench = "stream", .name = label, .samples = total, .fps = total / secs };
+        bench_report(&r);
+        printf("  %-21s %7.0f fps   all %d streams whole\n", label, r.fps, MULTI_STREAMS);
+    }
+
+    for (int i = 0; i < written; i++) unlink(paths[i]);
+    return failed ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+    const char *camera = argc > 1 ? argv[1] : "./uvc_camera";
+    int have_camera = access(camera, X_OK) == 0;
+    char dir[] = "/tmp/uvc_bench_XXXXXX";
+    if (have_camera && !mkdtemp(dir)) have_camera = 0;
+
+    printf("Stream: synthetic UVC streams, %d frames at 30 fps, PTS/SCR headers, "
+           "3072 B packets x 32 per URB:\n", BENCH_FRAMES);
+    if (!have_camera) printf("  (%s not built: pipeline runs skipped)\n", camera);
+
+    static LatencyHistogram hist;
+    int failed = 0;
+    for (int c = 0; c < NUM_CASES; c++) {
+        const StreamCase *sc = &cases[c];
+        StreamGenConfig cfg;
+        stream_gen_defaults(&cfg, sc->width, sc->height, BENCH_FRAMES);
+        cfg.pts = 1;
+        cfg.error_rate = sc->error_rate;
+        cfg.restart_rows = sc->restart_rows;
+        StreamGen g;
+        if (stream_gen_build(&g, &cfg) < 0) {
+            printf("  %dx%d: stream generation failed\n", sc->width, sc->height);
+            failed = 1;
+            continue;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "%dx%d%s", sc->width, sc->height,
+                 sc->error_rate > 0 ? "+err" : sc->restart_rows ? "+rst" : "");
+        char label[64];
+        snprintf(label, sizeof(label), "%s parser", name);
+        int found = bench_parser(&g, name, &hist);
+        bench_report_hist("stream", label, &hist, found > 0 ? (double)g.payload_bytes / found : 0, 1);
+        if (found < 0 || (sc->error_rate == 0 && found != BENCH_FRAMES)) {
+            printf("  %s: parser found %d of %d frames\n", name, found, BENCH_FRAMES);
+            failed = 1;
+        }
+        if (sc->error_rate > 0) {
+            printf("  %-12s %d of %d packets in error, %d frames hit\n",
+                   name, g.error_packets, g.packets, g.frames_hit);
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "%s/%s.uvcs", dir, name);
+        if (have_camera && stream_gen_write(&g, path) == 0) {
+            RunResult framing, speed, paced;
+            char null_args[128], paced_args[128];
+            snprintf(null_args, sizeof(null_args), "--null %s", sc->args);
+            snprintf(paced_args, sizeof(paced_args), "--null --realtime %s", sc->args);
+            if (run_camera(camera, path, "--mkv /dev/null", &framing) < 0 ||
+                run_camera(camera, path, null_args, &speed) < 0 ||
+                run_camera(camera, path, paced_args, &paced) < 0) {
+                printf("  %s: %s failed on the recording\n", name, camera);
+                failed = 1;
+            }
+            else {
+                report_run(name, "framing", &g, &framing, &framing);
+                report_run(name, "pipeline", &g, &speed, &paced);
+                // A clean stream comes out whole; a lossy one loses at most the frames hit
+                int expect = BENCH_FRAMES - (sc->error_rate > 0 ? g.frames_hit : 0);
+                if (framing.frames < expect || (sc->error_rate == 0 && speed.decode_errors > 0)) {
+                    printf("  %s: %d of %d frames framed, %llu decode errors\n",
+                           name, framing.frames, BENCH_FRAMES, speed.decode_errors);
+                    failed = 1;
+                }
+            }
+            unlink(path);
+        }
+        stream_gen_free(&g);
+    }
+
+    if (have_camera) {
+        if (bench_multi(camera, dir) < 0) failed = 1;
+        rmdir(dir);
+    }
+    if (failed) printf("Stream: FAILED\n");
+    return failed;
+}
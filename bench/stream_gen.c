@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <jpeglib.h>
+#include "stream_gen.h"
+#include "stream_record.h"
+
+#define GEN_START_NS        1000000000ull   // first packet, on the recording's clock
+#define GEN_PACKET_NS       125000ull       // high-speed microframe
+#define GEN_ENDPOINT        0x81
+
+// 4:2:2 like a UVC camera. Noise keeps the entropy decoder busy; the
+// pattern moves with the variant, so consecutive frames differ in size.
+static uint8_t *make_jpeg(const StreamGenConfig *cfg, int variant, unsigned long *size) {
+    int width = cfg->width, height = cfg->height;
+    struct jpeg_compress_struct c;
+    struct jpeg_error_mgr err;
+    uint8_t *out = NULL;
+
+    c.err = jpeg_std_error(&err);
+    jpeg_create_compress(&c);
+    *size = 0;
+    jpeg_mem_dest(&c, &out, size);
+    c.image_width = width;
+    c.image_height = height;
+    c.input_components = 3;
+    c.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&c);
+    jpeg_set_quality(&c, cfg->quality, TRUE);
+    c.comp_info[0].v_samp_factor = 1;
+    c.restart_in_rows = cfg->restart_rows;
+    jpeg_start_compress(&c, TRUE);
+
+    uint8_t *row = malloc((size_t)width * 3);
+    unsigned noise = 1 + variant;
+    while (c.next_scanline < c.image_height) {
+        int y = c.next_scanline;
+        for (int x = 0; x < width; x++) {
+            noise = noise * 1103515245 + 12345;
+            int n = (noise >> 16) % (2 << variant % 2);
+            row[x * 3] = (uint8_t)(x + variant * 16 + n);
+            row[x * 3 + 1] = (uint8_t)(y * 2 + n);
+            row[x * 3 + 2] = (uint8_t)(((x + variant * 8) ^ y) + n);
+        }
+        jpeg_write_scanlines(&c, &row, 1);
+    }
+    jpeg_finish_compress(&c);
+    jpeg_destroy_compress(&c);
+    free(row);
+    return out;
+}
+
+// Device clock at a point on the generator's timeline
+static uint32_t device_clock(uint64_t ns) {
+    return (uint32_t)(ns * (STREAM_GEN_CLOCK_HZ / 1000000) / 1000);
+}
+
+typedef struct {
+    StreamGen *g;
+    struct usbdevfs_urb *urb;   // being filled
+    int capacity;
+    uint64_t now_ns;            // when the next packet goes out
+    unsigned rng;
+    int frame_hit;
+} Builder;
+
+static double next_random(Builder *b) {
+    b->rng ^= b->rng << 13;
+    b->rng ^= b->rng >> 17;
+    b->rng ^= b->rng << 5;
+    return (b->rng & 0xffffff) / (double)0x1000000;
+}
+
+static int emit_packet(Builder *b, uint8_t flags, uint32_t pts, const uint8_t *data, int len) {
+    StreamGen *g = b->g;
+    const StreamGenConfig *cfg = &g->cfg;
+
+    if (!b->urb) {
+        if (g->num_urbs == b->capacity) {
+            int capacity = b->capacity ? b->capacity * 2 : 256;
+            struct usbdevfs_urb **urbs = realloc(g->urbs, capacity * sizeof(*urbs));
+            uint64_t *timestamps = realloc(g->timestamps, capacity * sizeof(*timestamps));
+            if (urbs) g->urbs = urbs;
+            if (timestamps) g->timestamps = timestamps;
+            if (!urbs || !timestamps) return -1;
+            b->capacity = capacity;
+        }
+        b->urb = calloc(1, sizeof(struct usbdevfs_urb) +
+                           cfg->packets_per_urb * sizeof(struct usbdevfs_iso_packet_desc));
+        if (!b->urb) return -1;
+        b->urb->type = USBDEVFS_URB_TYPE_ISO;
+        b->urb->endpoint = GEN_ENDPOINT;
+        b->urb->buffer_length = cfg->packets_per_urb * cfg->packet_size;
+        b->urb->buffer = malloc(b->urb->buffer_length);
+        if (!b->urb->buffer) return -1;
+        g->urbs[g->num_urbs] = b->urb;
+        g->num_urbs++;
+    }
+
+    struct usbdevfs_urb *urb = b->urb;
+    int p = urb->number_of_packets++;
+    uint8_t *pkt = (uint8_t *)urb->buffer + (size_t)p * cfg->packet_size;
+    int hle = cfg->pts ? 12 : 2;
+    pkt[0] = hle;
+    pkt[1] = 0x80 | flags;
+    if (cfg->pts) {
+        uint32_t stc = device_clock(b->now_ns);
+        pkt[1] |= 0x0c;
+        memcpy(pkt + 2, &pts, 4);
+        memcpy(pkt + 6, &stc, 4);
+        uint16_t sof = (uint16_t)((b->now_ns / GEN_PACKET_NS / 8) & 0x7ff);
+        memcpy(pkt + 10, &sof, 2);
+    }
+    if (len > 0) memcpy(pkt + hle, data, len);
+
+    struct usbdevfs_iso_packet_desc *d = &urb->iso_frame_desc[p];
+    d->length = cfg->packet_size;
+    d->actual_length = hle + len;
+    d->status = 0;
+    if (cfg->error_rate > 0 && next_random(b) < cfg->error_rate) {
+        // The controller reports the slot, the data is gone
+        d->status = g->error_packets % 2 ? -EPROTO : -EXDEV;
+        d->actual_length = 0;
+        g->error_packets++;
+        if (len > 0) b->frame_hit = 1;
+    }
+    g->packets++;
+    g->payload_bytes += d->actual_length;
+
+    if (urb->number_of_packets == cfg->packets_per_urb) {
+        g->timestamps[g->num_urbs - 1] = b->now_ns;
+        b->urb = NULL;
+    }
+    b->now_ns += GEN_PACKET_NS;
+    return 0;
+}
+
+void stream_gen_defaults(StreamGenConfig *cfg, int width, int height, int frames) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->width = width;
+    cfg->height = height;
+    cfg->quality = 80;
+    cfg->frames = frames;
+    cfg->fps = 30;
+    cfg->packet_size = 3072;
+    cfg->packets_per_urb = 32;
+    cfg->seed = 1;
+}
+
+int stream_gen_build(StreamGen *g, const StreamGenConfig *cfg) {
+    memset(g, 0, sizeof(*g));
+    g->cfg = *cfg;
+
+    uint8_t *jpegs[STREAM_GEN_VARIANTS];
+    unsigned long sizes[STREAM_GEN_VARIANTS];
+    for (int v = 0; v < STREAM_GEN_VARIANTS; v++) {
+        jpegs[v] = make_jpeg(cfg, v, &sizes[v]);
+    }
+
+    Builder b = { .g = g, .now_ns = GEN_START_NS, .rng = cfg->seed ? cfg->seed : 1 };
+    int chunk_max = cfg->packet_size - (cfg->pts ? 12 : 2);
+    int ret = 0;
+    for (int f = 0; f < cfg->frames && ret == 0; f++) {
+        // Idle until the frame clock says the next frame is ready
+        uint64_t start = cfg->fps ? GEN_START_NS + (uint64_t)f * 1000000000ull / cfg->fps : b.now_ns;
+        while (ret == 0 && b.now_ns < start) ret = emit_packet(&b, (f - 1) & 1, 0, NULL, 0);
+
+        const uint8_t *jpeg = jpegs[f % STREAM_GEN_VARIANTS];
+        unsigned long size = sizes[f % STREAM_GEN_VARIANTS];
+        uint32_t pts = device_clock(start);
+        b.frame_hit = 0;
+        for (unsigned long off = 0; off < size && ret == 0;) {
+            int chunk = size - off < (unsigned long)chunk_max ? (int)(size - off) : chunk_max;
+            uint8_t flags = (f & 1) | (off + chunk == size ? 0x02 : 0);
+            ret = emit_packet(&b, flags, pts, jpeg + off, chunk);
+            off += chunk;
+        }
+        g->jpeg_bytes += size;
+        g->frames_hit += b.frame_hit;
+    }
+    // Pad out the last URB, as the device keeps sending
+    while (ret == 0 && b.urb) ret = emit_packet(&b, (cfg->frames - 1) & 1, 0, NULL, 0);
+
+    for (int v = 0; v < STREAM_GEN_VARIANTS; v++) free(jpegs[v]);
+    if (ret < 0) stream_gen_free(g);
+    return ret;
+}
+
+void stream_gen_free(StreamGen *g) {
+    for (int i = 0; i < g->num_urbs; i++) {
+        free(g->urbs[i]->buffer);
+        free(g->urbs[i]);
+    }
+    free(g->urbs);
+    free(g->timestamps);
+    g->urbs = NULL;
+    g->timestamps = NULL;
+    g->num_urbs = 0;
+}
+
+int stream_gen_write(const StreamGen *g, const char *path) {
+    StreamRecorder rec;
+    if (stream_recorder_open(&rec, path, g->cfg.packet_size, GEN_ENDPOINT) < 0) return -1;
+    int ret = 0;
+    for (int i = 0; i < g->num_urbs && ret == 0; i++) {
+        ret = stream_recorder_write_urb(&rec, g->urbs[i], g->timestamps[i]);
+    }
+    stream_recorder_close(&rec);
+    return ret;
+}
@@ -0,0 +1,56 @@
+#ifndef STREAM_GEN_H
+#define STREAM_GEN_H
+
+#include <stdint.h>
+#include <linux/usbdevice_fs.h>
+
+// Synthetic UVC isochronous stream: real 4:2:2 JPEGs cut into payloads
+// with UVC headers (FID toggling per frame, EOF on the last payload,
+// optionally PTS/SCR on a 48 MHz device clock), laid out in URBs exactly
+// as usbfs returns them. Frames start on a fixed frame clock with
+// header-only packets in between, as a camera sends them. A fraction of
+// the packets can complete with an error status, which loses their
+// payload. The URBs can be fed to the packet path directly or written
+// as a recording for --replay.
+
+#define STREAM_GEN_CLOCK_HZ     48000000
+#define STREAM_GEN_VARIANTS     4       // distinct JPEGs, cycled through
+
+typedef struct {
+    int width;
+    int height;
+    int quality;
+    int frames;
+    int fps;                    // frame clock; 0 sends frames back to back
+    int packet_size;            // iso packet stride, payload header included
+    int packets_per_urb;
+    int pts;                    // 12-byte headers with PTS/SCR instead of 2-byte
+    double error_rate;          // fraction of packets completed with an error
+    int restart_rows;           // DRI: a restart marker every n MCU rows, 0: none
+    unsigned seed;
+} StreamGenConfig;
+
+typedef struct {
+    StreamGenConfig cfg;
+    struct usbdevfs_urb **urbs;
+    uint64_t *timestamps;       // when each URB completes (its last packet)
+    int num_urbs;
+
+    uint64_t payload_bytes;     // sum of actual_length, headers included
+    uint64_t jpeg_bytes;        // of all frames, as encoded
+    int packets;
+    int error_packets;
+    int frames_hit;             // frames that lost a packet to an error
+} StreamGen;
+
+// Fills cfg with the defaults for a high-speed camera: 3072-byte packets,
+// 32 per URB, 30 fps, quality 80, no errors
+void stream_gen_defaults(StreamGenConfig *cfg, int width, int height, int frames);
+
+int stream_gen_build(StreamGen *g, const StreamGenConfig *cfg);
+void stream_gen_free(StreamGen *g);
+
+// As a stream_record.h recording
+int stream_gen_write(const StreamGen *g, const char *path);
+
+#endif // STREAM_GEN_H
@@ -1,37 +1,222 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <math.h>
 #include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <setjmp.h>
+#include <signal.h>
+#include <errno.h>
+#include <stdatomic.h>
 #include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
 #include <linux/usbdevice_fs.h>
-#include <jpeglib.h>
+#include <pthread.h>
+#include "frame.h"
+#include "frame_queue.h"
+#include "frame_pool.h"
+#include "frame_slices.h"
+#include "mjpeg_parser.h"
+#include "stream_record.h"
+#include "stream_manager.h"
+#include "urb_manager.h"
+#include "uvc_clock.h"
+#include "latency_hist.h"
+#include "metrics.h"
+#include "mkv_writer.h"
+#include "segment_ring.h"
+#include "image_processing.h"
+#include "jpeg_decoder.h"
+#include "decoder_pool.h"
+#include "jpeg_strips.h"
+#include "scene_detect.h"
+#include "log.h"
+#include "trace.h"
+
+// config.h sizes the library buffers; the capture loop here uses its own
+// frame size. URB defaults (NUM_URBS, MAX_ISO_PACKETS) come from config.h.
+#undef  MAX_FRAME_SIZE
 
 #define VIDEO_STREAMING_INTERFACE 1
 #define VIDEO_ENDPOINT            0x81
-#define NUM_URBS                  5
-#define PACKETS_PER_URB           32
-#define MAX_FRAME_SIZE            (1024 * 1024) 
+#define MAX_FRAME_SIZE            (1024 * 1024)
 #define TARGET_FRAMES             300
+#define POOL_FRAMES               8
+#define ENCODE_QUEUE_DEPTH        4
+#define ZERO_COPY_URBS            32    // extra URBs: frames pin theirs until decoded
+#define REPLAY_MAX_PACKETS        128
+#define REPLAY_BATCH_URBS         8     // per wakeup, so replayed streams interleave
+#define REPLAY_PACKET_NS          125000    // recordings do not say; assume high speed
+#define PROGRESS_INTERVAL_NS      500000000ull
+#define PREVIEW_QUEUE_DEPTH       2
+#define PREVIEW_PATH              "preview.raw"
+#define OUTPUT_PATH               "output.mp4"
+#define RING_SEGMENTS             8
+#define RING_SEGMENT_MB           64
+#define MAX_STREAMS               8
+#define STREAM_PATH_LEN           256
+#define STATIC_THRESHOLD          2.0   // mean luma difference of the DC thumbnails
+#define STATIC_KEEPALIVE_SECS     1.0
 
-// --- Global State ---
-uint8_t *g_jpeg_buffer = NULL;
-int g_jpeg_pos = 0;
-int g_frames_processed = 0;
-int g_last_fid = -1;
-FILE *g_ffmpeg_pipe = NULL;
-
-// Error handling for libjpeg
-struct my_error_mgr {
-    struct jpeg_error_mgr pub;
-    jmp_buf setjmp_buffer;
-};
-void my_error_exit(j_common_ptr cinfo) {
-    struct my_error_mgr *myerr = (struct my_error_mgr *)cinfo->err;
-    longjmp(myerr->setjmp_buffer, 1);
-}
+// --- Capture options (shared by every stream) ---
+int g_null_sink = 0;            // decode only, never start ffmpeg
+int g_marker_framing = 0;       // frame on SOI/EOI with MJPEGParser instead of FID/EOF
+FrameFormat g_format = FRAME_RGB24;     // what the decode stage produces
+int g_target_frames = TARGET_FRAMES;    // per stream, --frames; 0: until Ctrl-C
+int g_lossless = 0;             // block the producer instead of dropping (offline replay)
+PoolPolicy g_pool_policy = POOL_DROP_OLDEST;
+int g_pool_frames = POOL_FRAMES;
+int g_zero_copy = 0;            // decode straight from the URB buffers
+int g_urb_depth = NUM_URBS;     // --urbs: URBs in flight per camera
+int g_urb_autotune = 0;         // --urbs auto: start at g_urb_depth, then adapt
+int g_urb_packets = MAX_ISO_PACKETS;    // --urb-packets
+int g_loop_threads = 1;         // --loop-threads: event loop threads for the streams
+int g_decode_threads = 1;       // --decode-threads: full-size decode workers per stream
+int g_decode_in_flight = 0;     // --decode-inflight: frames in the decoder pool, 0: 2 per worker
+int g_decode_cpu = -1;          // --decode-pin: pin decode worker i to CPU n + i
+int g_decode_strips = 1;        // --decode-strips: split frames at restart markers
+volatile sig_atomic_t g_stop = 0;
+uint64_t g_start_ns = 0;
+volatile sig_atomic_t g_trace_dump = 0;     // SIGUSR1: dump the trace ring
+const char *g_trace_path = NULL;            // --trace: where it goes (default stderr)
+const char *g_latency_prefix = NULL;        // --latency-out: .hgrm files per stage
+const char *g_metrics_addr = NULL;          // --metrics: port or Unix socket path
+MetricsServer g_metrics;
+
+// Which stage's output counts towards g_target_frames; the full-size decode
+// and encode only run for OUTPUT_ENCODE
+typedef enum {
+    OUTPUT_ENCODE,              // decoded and piped to ffmpeg (default)
+    OUTPUT_PREVIEW,             // --preview-only
+    OUTPUT_ARCHIVE              // --mkv / --ring: JPEGs muxed as they are
+} OutputStage;
+OutputStage g_output = OUTPUT_ENCODE;
+
+// --static: what the sink gets for a frame found unchanged (scene_detect.h),
+// which is never decoded
+typedef enum {
+    STATIC_OFF,
+    STATIC_DUP,                 // the previous frame again: constant frame rate
+    STATIC_VFR                  // nothing; a timestamps file gives the frames written their times
+} StaticMode;
+StaticMode g_static_mode = STATIC_OFF;
+double g_static_threshold = STATIC_THRESHOLD;
+double g_static_keepalive = STATIC_KEEPALIVE_SECS;     // at least one frame this often
+
+// Per-frame latency, split at the Frame stage times
+typedef enum {
+    LAT_USB,                    // capture -> assembled: exposure, readout, USB, reaping
+    LAT_DECODE,                 // assembled -> decoded, queueing included
+    LAT_SINK,                   // decoded (or assembled) -> written, queueing included
+    LAT_TOTAL,                  // capture -> written
+    LAT_NUM_STAGES
+} LatencyStage;
+const char *g_latency_names[LAT_NUM_STAGES] = { "usb", "decode", "sink", "total" };
+
+// Output names; with several streams each gets _<n> (see stream_path())
+const char *g_record_path = NULL;
+const char *g_archive_path = NULL;
+const char *g_ring_prefix = NULL;   // --ring: segment ring instead of (or as well as) --mkv
+int g_ring_segments = RING_SEGMENTS;
+int g_ring_segment_mb = RING_SEGMENT_MB;
+
+// Preview: every frame decoded again at reduced size, to its own sink
+int g_preview_denom = 0;        // 0: off, else 2, 4 or 8
+int g_preview_dc = 0;           // 1/8 luma only: DC terms of the Y blocks, fastest
+int g_preview_only = 0;         // OUTPUT_PREVIEW: no full-size decode or encode
+const char *g_preview_path = PREVIEW_PATH;
+
+// --- One camera (or recording) and its own pipeline ---
+//
+// event loop (assembly) -> decode_thread -> encode_thread
+//                                        -> preview_thread
+// With --decode-threads n, decode_thread hands the full-size decode to a
+// DecoderPool, whose workers pass the frames on to encode_thread in order.
+// With --decode-strips n, it splits each frame it decodes over n threads.
+typedef struct {
+    int index;
+    const char *name;               // device or recording
+
+    // Source, driven by the event loop
+    StreamSource src;
+    int usb_fd;                     // live camera, -1 on replay
+    URBManager urbs;
+    StreamReplay replay;
+    int replaying;
+    struct usbdevfs_urb *pending;   // replay: read but not due yet
+    FrameQueue replay_free;         // idle stand-in URBs for zero-copy replay
+    StreamRecorder recorder;
+    int recording;
+
+    // Stage 1 (event loop): assembly into pool frames
+    int packet_size;
+    MJPEGParser parser;
+    Frame *cur;                     // frame being assembled
+    int skip_frame;                 // pool was exhausted: drop payload until the next frame
+    int last_fid;
+    int eof_seen;                   // the previous frame ended with EOF, not a toggle
+    int frame_oversized;            // did not fit the frame buffer: reject it
+    uint64_t urb_ts_ns;             // when the URB being processed was reaped
+    uint64_t packet_ns;             // ...and, estimated, the packet being handled
+    uint64_t packet_interval_ns;    // bus time per iso packet
+    UvcClock clock;                 // device clock (PTS/SCR) -> host
+    uint64_t frame_first_ns;        // first packet of the frame being assembled
+    uint32_t frame_pts;
+    int frame_has_pts;
+    uint64_t frames_with_pts;
+    URBRef *cur_ref;                // URB process_urb() is walking (zero-copy)
+    int frames_submitted;
+
+    // Stages 2 and 3
+    FramePool pool;
+    FrameQueue decode_queue;
+    FrameQueue encode_queue;
+    pthread_t decode_thread;
+    pthread_t encode_thread;
+    JpegDecoder decoder;            // owned by the decode thread, reused for every frame
+    DecoderPool decoders;           // ...or, with --decode-threads, one per worker
+    StripDecoder strips;            // ...or, with --decode-strips, one per strip
+    SceneDetector scene;            // --static, run by the decode thread
+    volatile int frames_processed;
+    char output_path[STREAM_PATH_LEN];
+    FILE *ffmpeg_pipe;
+    uint8_t *sink_buf;              // packed copy of a padded frame, one fwrite per frame
+    size_t sink_buf_size;
+    Frame *last_written;            // --static dup: repeated for unchanged frames
+    char timestamps_path[STREAM_PATH_LEN + 16];
+    FILE *timestamps;               // --static vfr: when each frame written was captured
+    uint64_t first_written_ns;
+    uint64_t static_frames;         // unchanged frames that reached the sink
+
+    // Archive: the assembled JPEGs muxed into Matroska, never decoded
+    char archive_path[STREAM_PATH_LEN];
+    MkvWriter archive;              // written by the decode thread
+    char ring_prefix[STREAM_PATH_LEN];
+    SegmentRing ring;               // written and closed by the decode thread
+
+    // Preview
+    char preview_path[STREAM_PATH_LEN];
+    FILE *preview_out;
+    uint8_t *preview_buf;
+    size_t preview_buf_size;
+    FrameQueue preview_queue;
+    pthread_t preview_thread;
+    JpegDecoder preview_decoder;    // owned by the preview thread
+    FramePool preview_pool;         // holds the one frame previews are decoded into
+    int preview_frames;
+
+    // Recorded by whichever stage writes the output, read at exit
+    LatencyHistogram latency[LAT_NUM_STAGES];
+
+    // Counters, one shard per stage thread; scraped by --metrics
+    StreamMetrics metrics;
+    char metric_labels[64 + STREAM_PATH_LEN];
+} Stream;
+
+Stream *g_streams[MAX_STREAMS];
+int g_num_streams = 0;
+StreamManager g_manager;
 
 struct __attribute__((packed)) uvc_streaming_control {
     uint16_t bmHint; uint8_t bFormatIndex; uint8_t bFrameIndex;
@@ -42,96 +227,904 @@ struct __attribute__((packed)) uvc_streaming_control {
     uint8_t bMinVersion; uint8_t bMaxVersion;
 };
 
-void decode_and_encode() {
-    if (g_jpeg_pos < 100) return; // Ignore tiny fragments
+// A single stream keeps the name as given; with several, stream n writes
+// name_n.ext (prefix_n for a ring prefix, which has no extension)
+void stream_path(char *out, const char *base, int index, int has_ext) {
+    if (g_num_streams == 1) {
+        snprintf(out, STREAM_PATH_LEN, "%s", base);
+        return;
+    }
+    const char *slash = strrchr(base, '/');
+    const char *dot = has_ext ? strrchr(base, '.') : NULL;
+    if (!dot || dot == base || (slash && dot < slash + 2)) dot = base + strlen(base);
+    snprintf(out, STREAM_PATH_LEN, "%.*s_%d%s", (int)(dot - base), base, index, dot);
+}
+
+// --- Stage 1 (event loop): assemble into pool frames, hand them to decode ---
 
-    struct jpeg_decompress_struct cinfo;
-    struct my_error_mgr jerr;
-    
-    cinfo.err = jpeg_std_error(&jerr.pub);
-    jerr.pub.error_exit = my_error_exit;
+// Acquired lazily so frame boundaries cost nothing while the pool is dry
+Frame *current_frame(Stream *s) {
+    if (!s->cur && !s->skip_frame) {
+        s->cur = frame_pool_acquire(&s->pool);
+        if (!s->cur) {
+            s->skip_frame = 1;
+            metrics_add(&s->metrics, METRICS_LOOP, METRIC_DROP_POOL, 1);
+        }
+    }
+    return s->cur;
+}
 
-    if (setjmp(jerr.setjmp_buffer)) {
-        // If we get here, libjpeg found a corrupt frame
-        jpeg_destroy_decompress(&cinfo);
-        return; 
+// Start assembling the next frame, dropping whatever was not submitted
+void reset_frame(Stream *s) {
+    s->skip_frame = 0;
+    s->frame_first_ns = 0;
+    s->frame_has_pts = 0;
+    s->frame_oversized = 0;
+    if (s->cur) {
+        s->cur->jpeg_size = 0;
+        slice_list_release(&s->cur->slices);
     }
+}
+
+// Capture and assembly times. The packet path runs on the URB clock
+// (recorded times on replay); the USB delay measured there is carried
+// over to now, where the later stages are timed.
+void stamp_capture(Stream *s, Frame *f) {
+    uint64_t capture = s->frame_has_pts ? uvc_clock_to_host(&s->clock, s->frame_pts) : 0;
+    if (capture) s->frames_with_pts++;
+    else capture = s->frame_first_ns ? s->frame_first_ns : s->urb_ts_ns;
+
+    f->assembled_ns = stream_now_ns();
+    uint64_t usb_ns = s->urb_ts_ns > capture ? s->urb_ts_ns - capture : 0;
+    f->capture_ns = f->assembled_ns - usb_ns;
+}
 
-    jpeg_create_decompress(&cinfo);
-    jpeg_mem_src(&cinfo, g_jpeg_buffer, g_jpeg_pos);
+void submit_frame(Stream *s) {
+    Frame *f = s->cur;
+    if (!f) return;
 
-    if (jpeg_read_header(&cinfo, TRUE) != JPEG_HEADER_OK) {
-        jpeg_destroy_decompress(&cinfo);
+    int size = g_zero_copy ? f->slices.total_size : f->jpeg_size;
+    if (s->frame_oversized || size < 100) {
+        // Truncated JPEGs would only fail to decode; tiny fragments are not frames
+        metrics_add(&s->metrics, METRICS_LOOP,
+                    s->frame_oversized ? METRIC_REJECT_OVERSIZED : METRIC_REJECT_FRAGMENT, 1);
         return;
     }
 
-    jpeg_start_decompress(&cinfo);
-    
-    if (!g_ffmpeg_pipe) {
-        char cmd[512];
-        sprintf(cmd, "ffmpeg -y -f rawvideo -pixel_format rgb24 -video_size %dx%d "
-                     "-framerate 30 -i - -c:v libx264 -pix_fmt yuv420p output.mp4", 
-                     cinfo.output_width, cinfo.output_height);
-        g_ffmpeg_pipe = popen(cmd, "w");
-    }
+    f->jpeg_size = size;
+    f->seq = s->frames_submitted++;
+    f->timestamp_ns = s->urb_ts_ns;     // URB the frame ended in
+    stamp_capture(s, f);
+    s->cur = NULL;          // ownership moves to the decode stage
+    trace_event(TRACE_FRAME_SUBMIT, f->seq, size);
+    metrics_add(&s->metrics, METRICS_LOOP, METRIC_FRAMES_ASSEMBLED, 1);
 
-    uint8_t *row = malloc(cinfo.output_width * 3);
-    while (cinfo.output_scanline < cinfo.output_height) {
-        jpeg_read_scanlines(&cinfo, &row, 1);
-        fwrite(row, 1, cinfo.output_width * 3, g_ffmpeg_pipe);
+    if (g_lossless) {
+        frame_queue_push(&s->decode_queue, f);
+    }
+    else if (frame_queue_try_push(&s->decode_queue, f) < 0) {
+        // Never block the event loop: URBs must be resubmitted on time
+        trace_event(TRACE_FRAME_DROP, f->seq, 0);
+        frame_release(f);
+        metrics_add(&s->metrics, METRICS_LOOP, METRIC_DROP_HANDOFF, 1);
     }
-    free(row);
+}
+
+// One more frame out of the stream's pipeline (encoded, archived, or
+// previewed with --preview-only, see OutputStage); the stream stops at
+// g_target_frames
+int output_done(const Stream *s) {
+    return g_target_frames > 0 && s->frames_processed >= g_target_frames;
+}
+
+// Once per output frame, on the thread that wrote it
+void record_latency(Stream *s, const Frame *f) {
+    latency_hist_record(&s->latency[LAT_USB], f->assembled_ns - f->capture_ns);
+    if (f->decoded_ns) latency_hist_record(&s->latency[LAT_DECODE], f->decoded_ns - f->assembled_ns);
+    uint64_t before_sink = f->decoded_ns ? f->decoded_ns : f->assembled_ns;
+    latency_hist_record(&s->latency[LAT_SINK], f->written_ns - before_sink);
+    latency_hist_record(&s->latency[LAT_TOTAL], f->written_ns - f->capture_ns);
+}
 
-    jpeg_finish_decompress(&cinfo);
-    jpeg_destroy_decompress(&cinfo);
+// Progress line at a fixed rate, not per frame; every stream's stage
+// threads print it
+void print_progress(int force) {
+    static atomic_uint_fast64_t last_progress_ns;
+    uint64_t now = stream_now_ns();
+    uint_fast64_t last = atomic_load(&last_progress_ns);
+    if (!force && now - last < PROGRESS_INTERVAL_NS) return;
+    if (!atomic_compare_exchange_strong(&last_progress_ns, &last, now)) return;
 
-    g_frames_processed++;
-    printf("\r[Capture] Frame %d/300  ", g_frames_processed);
+    printf("\r[Capture] Frame");
+    for (int i = 0; i < g_num_streams; i++) {
+        printf(i ? " | %d" : " %d", g_streams[i]->frames_processed);
+        if (g_target_frames > 0) printf("/%d", g_target_frames);
+    }
+    printf("  ");
     fflush(stdout);
+}
+
+void count_output(Stream *s) {
+    s->frames_processed++;
+    print_progress(output_done(s));
+    if (output_done(s)) s->src.stop = 1;
+}
+
+// --- Stage 2 (decode thread): JPEG -> RGB24 or planar YUV (jpeg_decoder.c) ---
+
+// The preview stage decodes the same JPEG in parallel. Best effort: when it
+// falls behind, frames skip the preview rather than hold up the full decode.
+void send_preview(Stream *s, Frame *f) {
+    frame_ref(f);
+    frame_add_jpeg_reader(f);
+    int ret = g_lossless ? frame_queue_push(&s->preview_queue, f)
+                         : frame_queue_try_push(&s->preview_queue, f);
+    if (ret < 0) {
+        metrics_add(&s->metrics, METRICS_DECODE, METRIC_PREVIEW_SKIPPED, 1);
+        frame_jpeg_done(f);
+        frame_release(f);
+    }
+}
+
+// Archive mode: the frame's bytes (buffer or URB slices) go into the MKV
+// in one writev(), straight from where assembly put them, and/or into
+// the segment ring, which copies them to its staging ring and returns
+void archive_frame(Stream *s, Frame *f) {
+    struct iovec parts[MKV_MAX_PARTS];
+    int n = 0;
+    if (f->slices.num_slices > 0) {
+        for (; n < f->slices.num_slices && n < MKV_MAX_PARTS; n++) {
+            parts[n].iov_base = (void *)f->slices.slices[n].data;
+            parts[n].iov_len = f->slices.slices[n].length;
+        }
+    }
+    else {
+        parts[0].iov_base = f->jpeg;
+        parts[0].iov_len = f->jpeg_size;
+        n = 1;
+    }
+
+    uint64_t t0 = stream_now_ns();
+    int errors = 0;
+    if (g_archive_path && mkv_writer_add_frame(&s->archive, parts, n, f->timestamp_ns) < 0) errors++;
+    if (g_ring_prefix && segment_ring_add_frame(&s->ring, parts, n, f->timestamp_ns) < 0) errors++;
+    if (errors) metrics_add(&s->metrics, METRICS_DECODE, METRIC_ARCHIVE_ERRORS, errors);
+    f->written_ns = stream_now_ns();
+    trace_event(TRACE_FRAME_ARCHIVED, f->seq, f->written_ns - t0);
+    record_latency(s, f);
+    count_output(s);
+}
+
+// Decoder pool callback: frames come out in capture order, one at a time
+void deliver_decoded(Frame *f, int ret, void *ctx) {
+    Stream *s = ctx;
+    if (ret < 0) {
+        metrics_add(&s->metrics, METRICS_DELIVER, METRIC_DECODE_ERRORS, 1);
+        frame_release(f);
+        return;
+    }
+    if (frame_queue_push(&s->encode_queue, f) < 0) frame_release(f);
+}
+
+// Marks f duplicate if the scene has not changed since the last frame kept;
+// it then skips the decode but keeps its place on the way to the sink
+void check_static(Stream *s, Frame *f) {
+    uint64_t t0 = stream_now_ns();
+    if (scene_detect(&s->scene, f) != SCENE_STATIC) return;
+    f->duplicate = 1;
+    f->decoded_ns = stream_now_ns();
+    trace_event(TRACE_FRAME_STATIC, f->seq, f->decoded_ns - t0);
+    frame_jpeg_done(f);
+    metrics_add(&s->metrics, METRICS_DECODE, METRIC_STATIC_SKIPPED, 1);
+}
+
+void *decode_thread(void *arg) {
+    Stream *s = arg;
+    Frame *f;
+    while ((f = frame_queue_pop(&s->decode_queue)) != NULL) {
+        if (g_preview_denom) send_preview(s, f);
+        if (g_output == OUTPUT_ARCHIVE && !output_done(s)) archive_frame(s, f);
+        if (g_output != OUTPUT_ENCODE) {
+            frame_jpeg_done(f);
+            frame_release(f);
+            continue;
+        }
+        if (g_static_mode != STATIC_OFF) check_static(s, f);
+        if (g_decode_threads > 1) {
+            if (decoder_pool_submit(&s->decoders, f) < 0) frame_release(f);
+            continue;
+        }
+        if (f->duplicate) {
+            if (frame_queue_push(&s->encode_queue, f) < 0) frame_release(f);
+            continue;
+        }
+
+        uint64_t t0 = stream_now_ns();
+        int ret = g_decode_strips > 1 ? strip_decoder_decode(&s->strips, f, g_format)
+                                      : jpeg_decoder_decode(&s->decoder, f, g_format);
+        f->decoded_ns = stream_now_ns();
+        trace_event(TRACE_FRAME_DECODED, f->seq, f->decoded_ns - t0);
+        frame_jpeg_done(f);         // URBs can go back to the kernel now
+        if (ret < 0) {
+            metrics_add(&s->metrics, METRICS_DECODE, METRIC_DECODE_ERRORS, 1);
+            frame_release(f);
+            continue;
+        }
+        if (frame_queue_push(&s->encode_queue, f) < 0) frame_release(f);
+    }
+    if (g_decode_threads > 1) decoder_pool_stop(&s->decoders);
+    if (g_decode_strips > 1) strip_decoder_destroy(&s->strips);
+    if (g_static_mode != STATIC_OFF) scene_detect_destroy(&s->scene);
+    frame_queue_close(&s->encode_queue);
+    frame_queue_close(&s->preview_queue);
+    // io_uring cancels a thread's writes when it exits: finish them here
+    if (g_ring_prefix) segment_ring_close(&s->ring);
+    return NULL;
+}
+
+// --- Stage 3 (encode thread): frames -> ffmpeg ---
 
-    if (g_frames_processed >= TARGET_FRAMES) {
-        printf("\n[Done] 300 frames captured to output.mp4\n");
-        pclose(g_ffmpeg_pipe);
-        exit(0);
+// The input format matches what the decode stage produces. YUV input is
+// full range (yuvj*) and stays full range, so ffmpeg at most halves the
+// chroma rows of 4:2:2 and never converts color.
+FILE *open_ffmpeg(const Stream *s, const Frame *f) {
+    char cmd[512 + STREAM_PATH_LEN];
+    snprintf(cmd, sizeof(cmd), "ffmpeg -y -f rawvideo -pixel_format %s -video_size %dx%d "
+             "-framerate 30 -i - -c:v libx264 -pix_fmt %s %s",
+             frame_format_ffmpeg(f->format), f->width, f->height,
+             f->format == FRAME_RGB24 ? "yuv420p" : "yuvj420p", s->output_path);
+    return popen(cmd, "w");
+}
+
+// rawvideo is unpadded planes, one after the other: the whole frame goes
+// out in one write, packed first (into *buf, grown as needed) only if its
+// rows are padded
+void write_frame(const Frame *f, FILE *out, uint8_t **buf, size_t *buf_size) {
+    size_t size = frame_packed_size(f);
+    if (size > *buf_size) {
+        uint8_t *grown = realloc(*buf, size);
+        if (!grown) return;
+        *buf = grown;
+        *buf_size = size;
+    }
+    fwrite(frame_packed(f, *buf), 1, size, out);
+}
+
+// --static vfr: ffmpeg encodes a constant rate, so the frames' real times go
+// to a timestamps file next to the output, in ms (mkvmerge's v2 format:
+// mkvmerge -o out.mkv --timestamps 0:<file> <output>), from the first frame's
+FILE *open_timestamps(Stream *s, const Frame *first) {
+    snprintf(s->timestamps_path, sizeof(s->timestamps_path), "%s.timestamps.txt", s->output_path);
+    FILE *fp = fopen(s->timestamps_path, "w");
+    if (!fp) {
+        LOG_ERROR("open_timestamps: cannot open %s", s->timestamps_path);
+        return NULL;
+    }
+    fprintf(fp, "# timestamp format v2\n");
+    s->first_written_ns = first->timestamp_ns;
+    return fp;
+}
+
+void write_timestamp(Stream *s, const Frame *f) {
+    fprintf(s->timestamps, "%.3f\n", (f->timestamp_ns - s->first_written_ns) / 1e6);
+}
+
+void encode_frame(Stream *s, Frame *f) {
+    if (output_done(s)) return;
+
+    // An unchanged frame: with dup the last one written goes out again,
+    // with vfr it is left out and counts only towards --frames
+    const Frame *out = f;
+    if (f->duplicate) {
+        if (g_static_mode == STATIC_VFR) {
+            s->static_frames++;
+            count_output(s);
+            return;
+        }
+        if (!s->last_written) return;   // the frame before it failed to decode
+        out = s->last_written;
+        s->static_frames++;
+    }
+    else if (g_static_mode == STATIC_DUP) {
+        frame_ref(f);
+        frame_release(s->last_written);
+        s->last_written = f;
+    }
+
+    uint64_t t0 = stream_now_ns();
+    if (!s->ffmpeg_pipe && !g_null_sink) {
+        s->ffmpeg_pipe = open_ffmpeg(s, out);
+        if (s->ffmpeg_pipe && g_static_mode == STATIC_VFR) s->timestamps = open_timestamps(s, f);
+    }
+    if (s->ffmpeg_pipe) write_frame(out, s->ffmpeg_pipe, &s->sink_buf, &s->sink_buf_size);
+    if (s->timestamps) write_timestamp(s, f);
+
+    f->written_ns = stream_now_ns();
+    trace_event(TRACE_FRAME_ENCODED, f->seq, f->written_ns - t0);
+    record_latency(s, f);
+    count_output(s);
+}
+
+void *encode_thread(void *arg) {
+    Stream *s = arg;
+    Frame *f;
+    while ((f = frame_queue_pop(&s->encode_queue)) != NULL) {
+        encode_frame(s, f);
+        frame_release(f);
+    }
+    frame_release(s->last_written);
+    s->last_written = NULL;
+    return NULL;
+}
+
+// --- Preview stage: JPEG -> 1/2, 1/4 or 1/8 size frames -> raw file ---
+
+// rawvideo has no header: the first frame announces what the file holds
+FILE *open_preview(const Stream *s, const Frame *out) {
+    FILE *fp = fopen(s->preview_path, "wb");
+    if (!fp) {
+        LOG_ERROR("open_preview: cannot open %s", s->preview_path);
+        return NULL;
+    }
+    printf("[Preview] %dx%d %s -> %s\n", out->width, out->height,
+           frame_format_name(out->format), s->preview_path);
+    return fp;
+}
+
+void *preview_thread(void *arg) {
+    Stream *s = arg;
+    FrameFormat format = g_preview_dc ? FRAME_GRAY8 : g_format;
+    Frame *out = frame_pool_acquire(&s->preview_pool);     // reused for every preview
+    int tried_open = 0;
+    Frame *f;
+    while ((f = frame_queue_pop(&s->preview_queue)) != NULL) {
+        uint64_t t0 = stream_now_ns();
+        int ret = jpeg_decoder_decode_into(&s->preview_decoder, f, out, format);
+        // With --preview-only this is the output: its times are the frame's
+        out->capture_ns = f->capture_ns;
+        out->assembled_ns = f->assembled_ns;
+        out->decoded_ns = stream_now_ns();
+        trace_event(TRACE_PREVIEW_DECODED, f->seq, out->decoded_ns - t0);
+        frame_jpeg_done(f);
+        frame_release(f);
+        if (ret < 0) metrics_add(&s->metrics, METRICS_PREVIEW, METRIC_PREVIEW_ERRORS, 1);
+        if (ret < 0 || (g_output == OUTPUT_PREVIEW && output_done(s))) continue;
+
+        if (!tried_open) {
+            s->preview_out = open_preview(s, out);
+            tried_open = 1;
+        }
+        if (s->preview_out) write_frame(out, s->preview_out, &s->preview_buf, &s->preview_buf_size);
+        s->preview_frames++;
+        if (g_output == OUTPUT_PREVIEW) {
+            out->written_ns = stream_now_ns();
+            record_latency(s, out);
+            count_output(s);
+        }
+    }
+    frame_release(out);
+    return NULL;
+}
+
+// "auto", or a fixed depth
+int parse_urbs(const char *arg) {
+    if (strcmp(arg, "auto") == 0) {
+        g_urb_autotune = 1;
+        return 0;
     }
+    int depth = atoi(arg);
+    if (depth < 1 || depth > URB_MAX_DEPTH) return -1;
+    g_urb_depth = depth;
+    return 0;
+}
+
+// "dup" or "vfr"
+int parse_static(const char *arg) {
+    if (strcmp(arg, "dup") == 0) g_static_mode = STATIC_DUP;
+    else if (strcmp(arg, "vfr") == 0) g_static_mode = STATIC_VFR;
+    else return -1;
+    return 0;
+}
+
+// "1/2", "1/4", "1/8", or "dc" (1/8, luma only, fast IDCT)
+int parse_preview(const char *arg) {
+    if (strcmp(arg, "dc") == 0) {
+        g_preview_denom = 8;
+        g_preview_dc = 1;
+        return 0;
+    }
+    if (strcmp(arg, "1/2") == 0) g_preview_denom = 2;
+    else if (strcmp(arg, "1/4") == 0) g_preview_denom = 4;
+    else if (strcmp(arg, "1/8") == 0) g_preview_denom = 8;
+    else return -1;
+    return 0;
+}
+
+int preview_start(Stream *s) {
+    if (frame_pool_init(&s->preview_pool, 1, 0, POOL_BLOCK) < 0) return -1;
+    if (frame_queue_init(&s->preview_queue, "preview", PREVIEW_QUEUE_DEPTH) < 0) return -1;
+    if (jpeg_decoder_init(&s->preview_decoder) < 0) return -1;
+    if (jpeg_decoder_set_scale(&s->preview_decoder, g_preview_denom, g_preview_dc) < 0) return -1;
+    if (pthread_create(&s->preview_thread, NULL, preview_thread, s) != 0) {
+        LOG_ERROR("preview_start: failed to create thread");
+        return -1;
+    }
+    return 0;
+}
+
+int pipeline_start(Stream *s) {
+    if (frame_pool_init(&s->pool, g_pool_frames, g_zero_copy ? 0 : MAX_FRAME_SIZE, g_pool_policy) < 0) return -1;
+    frame_pool_set_victim(&s->pool, &s->decode_queue);
+    if (frame_queue_init(&s->decode_queue, "decode", g_pool_frames) < 0) return -1;
+    if (frame_queue_init(&s->encode_queue, "encode", ENCODE_QUEUE_DEPTH) < 0) return -1;
+    if (jpeg_decoder_init(&s->decoder) < 0) return -1;
+    if (g_output == OUTPUT_ENCODE && g_decode_threads > 1 &&
+        decoder_pool_start(&s->decoders, g_decode_threads, g_decode_in_flight, g_decode_cpu,
+                           g_format, deliver_decoded, s) < 0) return -1;
+    if (g_output == OUTPUT_ENCODE && g_decode_strips > 1 &&
+        strip_decoder_init(&s->strips, g_decode_strips, g_decode_cpu) < 0) return -1;
+    if (g_static_mode != STATIC_OFF &&
+        scene_detect_init(&s->scene, g_static_threshold, g_static_keepalive) < 0) return -1;
+    if (g_archive_path && mkv_writer_open(&s->archive, s->archive_path) < 0) return -1;
+    if (g_ring_prefix && segment_ring_open(&s->ring, s->ring_prefix, g_ring_segments,
+                                           (uint64_t)g_ring_segment_mb << 20) < 0) return -1;
+    s->ring.block = g_lossless;
+    if (g_preview_denom && preview_start(s) < 0) return -1;
+    if (pthread_create(&s->decode_thread, NULL, decode_thread, s) != 0 ||
+        pthread_create(&s->encode_thread, NULL, encode_thread, s) != 0) {
+        LOG_ERROR("pipeline_start: failed to create threads");
+        return -1;
+    }
+    return 0;
 }
 
-void handle_packet(uint8_t *ptr, int actual_len) {
-    if (actual_len < 2) return;
+// Let the decode and encode stages drain what was already handed off
+void pipeline_stop(Stream *s) {
+    frame_queue_close(&s->decode_queue);
+    pthread_join(s->decode_thread, NULL);
+    pthread_join(s->encode_thread, NULL);
+    if (g_preview_denom) pthread_join(s->preview_thread, NULL);
+}
+
+void print_latency(Stream *s) {
+    if (s->frames_with_pts) {
+        printf("[Clock] %llu of %d frames timed by PTS, device clock %.3f MHz (%s)\n",
+               (unsigned long long)s->frames_with_pts, s->frames_submitted,
+               uvc_clock_frequency(&s->clock) / 1e6, s->clock.clock_hz ? "negotiated" : "fitted");
+    }
+    else {
+        printf("[Clock] no PTS/SCR in the payload headers: capture time is the first packet's arrival\n");
+    }
+    for (int i = 0; i < LAT_NUM_STAGES; i++) {
+        if (s->latency[i].total) latency_hist_print(&s->latency[i], g_latency_names[i]);
+    }
+    if (!g_latency_prefix) return;
+    for (int i = 0; i < LAT_NUM_STAGES; i++) {
+        char base[STREAM_PATH_LEN], path[STREAM_PATH_LEN + 16];
+        stream_path(base, g_latency_prefix, s->index, 0);
+        snprintf(path, sizeof(path), "%s_%s.hgrm", base, g_latency_names[i]);
+        latency_hist_write_hgrm(&s->latency[i], path);
+    }
+}
 
-    uint8_t hle = ptr[0];      // Header Length
-    uint8_t bitfield = ptr[1]; // Bitfield (FID, EOF, etc.)
+// Time the full decode took over the frames it decoded, whichever way ran
+void full_decode_time(const Stream *s, uint64_t *frames, uint64_t *total_ns) {
+    *frames = *total_ns = 0;
+    if (g_decode_threads > 1) {
+        for (int i = 0; i < s->decoders.num_workers; i++) {
+            *frames += s->decoders.workers[i].decoder.frames;
+            *total_ns += s->decoders.workers[i].decoder.total_ns;
+        }
+    }
+    else if (g_decode_strips > 1) {
+        *frames = s->strips.frames;
+        *total_ns = s->strips.total_ns;
+    }
+    else {
+        *frames = s->decoder.frames;
+        *total_ns = s->decoder.total_ns;
+    }
+}
 
-    if (hle > actual_len || hle < 2) return;
+// The skipped frames would have cost the average decode time each; the
+// detector ran on every frame, and the encoder got fewer (vfr) frames
+void print_static_stats(const Stream *s) {
+    scene_detect_print_stats(&s->scene);
+    uint64_t frames, total_ns;
+    full_decode_time(s, &frames, &total_ns);
+    if (frames == 0) return;
+    double avg_ns = (double)total_ns / frames;
+    double without = total_ns + avg_ns * s->scene.skipped;
+    double with = total_ns + (double)s->scene.detect_ns;
+    printf("[Static] decode %.1f ms with the detector, about %.1f ms without (%.0f%% %s); "
+           "%llu unchanged frames %s\n",
+           with / 1e6, without / 1e6, 100.0 * fabs(without - with) / without, with <= without ? "saved" : "more",
+           (unsigned long long)s->static_frames,
+           g_static_mode == STATIC_VFR ? "left out of the encode" : "repeated to the encoder");
+    if (s->timestamps) printf("[Static] frame timestamps -> %s\n", s->timestamps_path);
+}
 
-    int fid = bitfield & 0x01;
-    int eof = (bitfield >> 1) & 0x01;
+void print_stream_stats(Stream *s, double secs) {
+    if (g_num_streams > 1) printf("[Stream %d] %s\n", s->index, s->name);
+    printf("[Done] %d frames, %.1f MB in %.2f s (%.1f fps, %.1f MB/s)\n",
+           s->frames_processed, metrics_get(&s->metrics, METRIC_BYTES) / 1e6, secs,
+           secs > 0 ? s->frames_processed / secs : 0.0,
+           secs > 0 ? metrics_get(&s->metrics, METRIC_BYTES) / 1e6 / secs : 0.0);
+    printf("[Pipeline] %d assembled, %llu dropped at handoff, %llu decode errors\n",
+           s->frames_submitted, (unsigned long long)metrics_get(&s->metrics, METRIC_DROP_HANDOFF),
+           (unsigned long long)metrics_get(&s->metrics, METRIC_DECODE_ERRORS));
+    if (g_output == OUTPUT_ENCODE && g_decode_threads > 1) decoder_pool_print_stats(&s->decoders, "full");
+    else if (g_output == OUTPUT_ENCODE && g_decode_strips > 1) strip_decoder_print_stats(&s->strips, "full");
+    else if (g_output == OUTPUT_ENCODE) jpeg_decoder_print_stats(&s->decoder, "full");
+    if (g_static_mode != STATIC_OFF) print_static_stats(s);
+    if (g_preview_denom) {
+        printf("[Preview] %d frames, %llu skipped (preview stage busy)\n",
+               s->preview_frames, (unsigned long long)metrics_get(&s->metrics, METRIC_PREVIEW_SKIPPED));
+        jpeg_decoder_print_stats(&s->preview_decoder, "preview");
+    }
+    frame_pool_print_stats(&s->pool);
+    frame_queue_print_stats(&s->decode_queue);
+    frame_queue_print_stats(&s->encode_queue);
+    if (g_preview_denom) frame_queue_print_stats(&s->preview_queue);
+
+    if (s->usb_fd >= 0) urb_manager_print_stats(&s->urbs);
+    if (s->replaying) {
+        printf("[Replay] %llu URBs replayed\n", (unsigned long long)s->replay.urbs_read);
+        stream_replay_close(&s->replay);
+    }
+    if (s->recording) {
+        printf("[Record] %llu URBs, %llu payload bytes\n",
+               (unsigned long long)s->recorder.urbs_written,
+               (unsigned long long)s->recorder.bytes_written);
+        stream_recorder_close(&s->recorder);
+    }
+    if (g_archive_path) {
+        printf("[Archive] %llu frames, %.1f MB, %d index entries, %llu write errors -> %s\n",
+               (unsigned long long)s->archive.frames, s->archive.bytes / 1e6,
+               s->archive.num_cues, (unsigned long long)metrics_get(&s->metrics, METRIC_ARCHIVE_ERRORS),
+               s->archive_path);
+        mkv_writer_close(&s->archive);
+    }
+    if (g_ring_prefix) segment_ring_print_stats(&s->ring);      // closed by the decode thread
+    print_latency(s);
+    if (s->ffmpeg_pipe) pclose(s->ffmpeg_pipe);
+    if (s->timestamps) fclose(s->timestamps);
+    if (s->preview_out) fclose(s->preview_out);
+}
+
+// --metrics: the stream counters, plus gauges read off the pipeline as it runs
+void collect_metrics(FILE *fp, void *ctx) {
+    (void)ctx;
+    StreamMetrics *metrics[MAX_STREAMS];
+    const char *labels[MAX_STREAMS];
+    for (int i = 0; i < g_num_streams; i++) {
+        metrics[i] = &g_streams[i]->metrics;
+        labels[i] = g_streams[i]->metric_labels;
+    }
+    metrics_write_counters(fp, metrics, labels, g_num_streams);
+
+    metrics_write_family(fp, "uvc_frames_output_total", "counter", "Frames through the stream's output stage");
+    for (int i = 0; i < g_num_streams; i++) {
+        metrics_write_sample(fp, "uvc_frames_output_total", labels[i], NULL, g_streams[i]->frames_processed);
+    }
+
+    metrics_write_family(fp, "uvc_queue_depth", "gauge", "Frames waiting between pipeline stages");
+    for (int i = 0; i < g_num_streams; i++) {
+        Stream *s = g_streams[i];
+        metrics_write_sample(fp, "uvc_queue_depth", labels[i], "queue=\"decode\"", frame_queue_depth(&s->decode_queue));
+        metrics_write_sample(fp, "uvc_queue_depth", labels[i], "queue=\"encode\"", frame_queue_depth(&s->encode_queue));
+        if (g_preview_denom) {
+            metrics_write_sample(fp, "uvc_queue_depth", labels[i], "queue=\"preview\"", frame_queue_depth(&s->preview_queue));
+        }
+    }
+
+    metrics_write_family(fp, "uvc_pool_frames_in_use", "gauge", "Pool frames held by the pipeline");
+    for (int i = 0; i < g_num_streams; i++) {
+        Stream *s = g_streams[i];
+        metrics_write_sample(fp, "uvc_pool_frames_in_use", labels[i], NULL,
+                             s->pool.count - frame_queue_depth(&s->pool.free_list));
+    }
+
+    metrics_write_family(fp, "uvc_urbs_in_flight", "gauge", "URBs submitted to the kernel (cameras only)");
+    for (int i = 0; i < g_num_streams; i++) {
+        if (g_streams[i]->usb_fd >= 0) metrics_write_sample(fp, "uvc_urbs_in_flight", labels[i], NULL, g_streams[i]->urbs.in_flight);
+    }
+    metrics_write_family(fp, "uvc_urb_depth", "gauge", "URBs the queue aims to keep in flight (cameras only)");
+    for (int i = 0; i < g_num_streams; i++) {
+        if (g_streams[i]->usb_fd >= 0) metrics_write_sample(fp, "uvc_urb_depth", labels[i], NULL, g_streams[i]->urbs.depth);
+    }
+}
+
+void finish(void) {
+    if (g_metrics_addr) metrics_server_stop(&g_metrics);
+    for (int i = 0; i < g_num_streams; i++) pipeline_stop(g_streams[i]);
+
+    double secs = (stream_now_ns() - g_start_ns) / 1e9;
+    printf("\n");
+    for (int i = 0; i < g_num_streams; i++) print_stream_stats(g_streams[i], secs);
+    stream_manager_print_stats(&g_manager);
+    stream_manager_destroy(&g_manager);
+    if (g_metrics_addr) printf("[Metrics] %llu scrapes\n", (unsigned long long)g_metrics.scrapes);
+    if (g_trace_path) trace_dump_file(g_trace_path);
+}
+
+// SOI/EOI framing: let MJPEGParser find frame boundaries in the payload
+void handle_payload_marker(Stream *s, uint8_t *payload, int len) {
+    if (mjpeg_parser_add_data(&s->parser, payload, len) < 0) return;
+
+    int frame_size = 0;
+    for (;;) {
+        Frame *f = current_frame(s);
+        if (!f) {
+            s->skip_frame = 0;  // The parser keeps the data; retry on the next payload
+            return;
+        }
+        int ret = mjpeg_parser_get_frame(&s->parser, f->jpeg, &frame_size);
+        if (ret < 0) metrics_add(&s->metrics, METRICS_LOOP, METRIC_REJECT_OVERSIZED, 1);
+        if (ret != 1) return;
+        f->jpeg_size = frame_size;
+        submit_frame(s);
+        reset_frame(s);
+    }
+}
+
+// The frame being assembled starts (or goes on) with this packet
+void note_frame_packet(Stream *s, const UvcPayloadHeader *h) {
+    if (!s->frame_first_ns) s->frame_first_ns = s->packet_ns;
+    if (h->has_pts && !s->frame_has_pts) {
+        s->frame_pts = h->pts;
+        s->frame_has_pts = 1;
+    }
+}
+
+void handle_packet(Stream *s, uint8_t *ptr, int actual_len) {
+    UvcPayloadHeader h;
+    if (uvc_header_parse(ptr, actual_len, &h) < 0) return;
+    int hle = h.length;
+
+    if (h.has_scr) uvc_clock_add_scr(&s->clock, h.scr_stc, s->packet_ns);
+
+    if (g_marker_framing) {
+        note_frame_packet(s, &h);
+        if (actual_len > hle) handle_payload_marker(s, ptr + hle, actual_len - hle);
+        return;
+    }
+
+    int fid = h.flags & UVC_HDR_FID;
+    int eof = h.flags & UVC_HDR_EOF;
 
     // 1. If FID toggled, we definitely missed the EOF of the last frame or started a new one
-    if (g_last_fid != -1 && fid != g_last_fid) {
-        decode_and_encode();
-        g_jpeg_pos = 0;
+    if (s->last_fid != -1 && fid != s->last_fid) {
+        if (!s->eof_seen) metrics_add(&s->metrics, METRICS_LOOP, METRIC_FID_NO_EOF, 1);
+        s->eof_seen = 0;
+        submit_frame(s);
+        reset_frame(s);
     }
-    g_last_fid = fid;
+    s->last_fid = fid;
+    note_frame_packet(s, &h);
 
     // 2. Append payload data (skipping the header)
     int payload_len = actual_len - hle;
-    if (payload_len > 0 && (g_jpeg_pos + payload_len < MAX_FRAME_SIZE)) {
-        memcpy(g_jpeg_buffer + g_jpeg_pos, ptr + hle, payload_len);
-        g_jpeg_pos += payload_len;
+    Frame *f = payload_len > 0 ? current_frame(s) : NULL;
+    if (f && g_zero_copy) {
+        // More packets than the slice table holds: the tail would be lost
+        if (slice_list_append(&f->slices, s->cur_ref, ptr + hle, payload_len) < 0) s->frame_oversized = 1;
+    }
+    else if (f && (f->jpeg_size + payload_len < f->jpeg_capacity)) {
+        memcpy(f->jpeg + f->jpeg_size, ptr + hle, payload_len);
+        f->jpeg_size += payload_len;
+    }
+    else if (f) {
+        s->frame_oversized = 1;
     }
 
     // 3. If EOF bit is set, this frame is complete
     if (eof) {
-        decode_and_encode();
-        g_jpeg_pos = 0;
+        s->eof_seen = 1;
+        submit_frame(s);
+        reset_frame(s);
     }
 }
 
-int main(int argc, char *argv[]) {
-    if (argc < 2) return 1;
-    int fd = open(argv[1], O_RDWR);
-    
+MetricId packet_status_metric(const struct usbdevfs_iso_packet_desc *d) {
+    switch (d->status) {
+    case 0:             return d->actual_length > 0 ? METRIC_PACKETS_OK : METRIC_PACKETS_EMPTY;
+    case -EXDEV:        return METRIC_PACKETS_MISSED;
+    case -EOVERFLOW:    return METRIC_PACKETS_OVERFLOW;
+    case -EPROTO:
+    case -EILSEQ:       return METRIC_PACKETS_PROTO;
+    default:            return METRIC_PACKETS_OTHER;
+    }
+}
+
+// Feed every good iso packet of a reaped (or replayed) URB into the packet path
+// In zero-copy mode the URB is recycled once neither this walk nor any
+// frame slice references it any more
+void process_urb(Stream *s, struct usbdevfs_urb *urb, uint64_t timestamp_ns) {
+    uint32_t bytes = 0;
+    uint64_t packets[METRIC_PACKETS_OTHER - METRIC_PACKETS_OK + 1] = { 0 };
+
+    s->urb_ts_ns = timestamp_ns;
+    if (g_zero_copy) {
+        s->cur_ref = urb->usercontext;
+        urb_ref_get(s->cur_ref);
+    }
+
+    int n = urb->number_of_packets;
+    for (int p = 0; p < n; p++) {
+        struct usbdevfs_iso_packet_desc *d = &urb->iso_frame_desc[p];
+        // The URB completed with its last packet; earlier ones came a bus interval apart
+        s->packet_ns = timestamp_ns - (uint64_t)(n - 1 - p) * s->packet_interval_ns;
+        packets[packet_status_metric(d) - METRIC_PACKETS_OK]++;
+        if (d->status == 0 && d->actual_length > 0) {
+            bytes += d->actual_length;
+            handle_packet(s, (uint8_t*)urb->buffer + (p * s->packet_size), d->actual_length);
+        }
+    }
+
+    // Counted once per URB, not per packet
+    metrics_add(&s->metrics, METRICS_LOOP, METRIC_URBS, 1);
+    metrics_add(&s->metrics, METRICS_LOOP, METRIC_BYTES, bytes);
+    for (int i = 0; i <= METRIC_PACKETS_OTHER - METRIC_PACKETS_OK; i++) {
+        if (packets[i]) metrics_add(&s->metrics, METRICS_LOOP, METRIC_PACKETS_OK + i, packets[i]);
+    }
+    trace_event(TRACE_URB_REAP, urb->number_of_packets, bytes);
+
+    if (g_zero_copy) urb_ref_put(s->cur_ref);
+}
+
+// URBRef recycle callbacks (ctx is the Stream): live URBs go back to the
+// kernel, replayed ones back to the free list
+void recycle_submit(URBRef *ref) {
+    Stream *s = ref->ctx;
+    urb_manager_resubmit(&s->urbs, ref->urb);
+}
+
+void recycle_replay(URBRef *ref) {
+    Stream *s = ref->ctx;
+    frame_queue_push(&s->replay_free, ref);
+}
+
+// --- Sources: called by the event loop when a stream's fd is ready ---
+
+// usbfs: POLLOUT means completed URBs are waiting. Reap them all without
+// blocking, resubmitting each right away; zero-copy URBs go back when
+// their frames are decoded, and spares keep the queue at depth meanwhile.
+int usb_ready(StreamSource *src) {
+    Stream *s = src->ctx;
+    struct usbdevfs_urb *reaped;
+    int n = 0;
+    while ((reaped = urb_manager_reap(&s->urbs)) != NULL) {
+        uint64_t now = stream_now_ns();
+        urb_manager_reaped(&s->urbs, reaped, now);
+        if (s->recording) stream_recorder_write_urb(&s->recorder, reaped, now);
+        process_urb(s, reaped, now);
+        if (!g_zero_copy) urb_manager_resubmit(&s->urbs, reaped);
+        n++;
+    }
+    if (errno != EAGAIN && errno != EINTR) {
+        LOG_ERROR("%s: reap URB: %s", s->name, strerror(errno));
+        src->stop = 1;
+    }
+    urb_manager_fill(&s->urbs);
+    return n;
+}
+
+// Zero-copy waits for a stand-in URB while frames hold them all
+struct usbdevfs_urb *replay_next(Stream *s) {
+    if (!g_zero_copy) return stream_replay_next_urb(&s->replay);
+
+    URBRef *ref = frame_queue_pop(&s->replay_free);
+    if (!ref) return NULL;
+    if (stream_replay_read_urb(&s->replay, ref->urb, ref->urb->buffer, REPLAY_MAX_PACKETS) < 0) {
+        frame_queue_push(&s->replay_free, ref);
+        return NULL;
+    }
+    return ref->urb;
+}
+
+void arm_timer(int fd, uint64_t due_ns) {
+    struct itimerspec its = { .it_value = { .tv_sec = due_ns / 1000000000ull,
+                                            .tv_nsec = due_ns % 1000000000ull } };
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// Replay: a timerfd stands in for the device. At max speed it fires once
+// and is never read, so it stays ready; at the recorded pace it is armed
+// for the next URB's due time. A bounded batch per wakeup lets the
+// streams on a loop take turns.
+int replay_ready(StreamSource *src) {
+    Stream *s = src->ctx;
+    uint64_t expirations;
+    if (s->replay.realtime && read(src->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        src->stop = 1;
+        return 0;
+    }
+
+    int n = 0;
+    while (n < REPLAY_BATCH_URBS) {
+        if (!s->pending && !(s->pending = replay_next(s))) {
+            src->stop = 1;      // end of the recording
+            return n;
+        }
+        uint64_t due = stream_replay_due_ns(&s->replay);
+        if (due > stream_now_ns()) {
+            arm_timer(src->fd, due);
+            return n;
+        }
+        process_urb(s, s->pending, s->replay.last_ts);
+        s->pending = NULL;
+        n++;
+    }
+    if (s->replay.realtime) arm_timer(src->fd, 1);      // already past: ready again at once
+    return n;
+}
+
+int open_replay(Stream *s, int realtime) {
+    if (stream_replay_open(&s->replay, s->name, realtime) < 0) return -1;
+    s->replay.no_sleep = 1;
+    s->replaying = 1;
+    s->packet_size = s->replay.packet_size;
+    s->packet_interval_ns = REPLAY_PACKET_NS;
+    printf("[Replay] %s, packet_size=%d, %s\n", s->name, s->packet_size,
+           realtime ? "recorded pace" : "max speed");
+
+    if (g_zero_copy) {
+        // A pool of stand-in URBs that frames can hold on to like real ones
+        size_t urb_size = sizeof(struct usbdevfs_urb) +
+                          REPLAY_MAX_PACKETS * sizeof(struct usbdevfs_iso_packet_desc);
+        if (frame_queue_init(&s->replay_free, "replay", ZERO_COPY_URBS) < 0) return -1;
+        for (int i = 0; i < ZERO_COPY_URBS; i++) {
+            URBRef *ref = malloc(sizeof(URBRef));
+            struct usbdevfs_urb *urb = calloc(1, urb_size);
+            uint8_t *buffer = malloc((size_t)REPLAY_MAX_PACKETS * s->packet_size);
+            if (!ref || !urb || !buffer) {
+                LOG_ERROR("open_replay: out of memory for stand-in URBs");
+                free(ref);
+                free(urb);
+                free(buffer);
+                return -1;
+            }
+            urb->buffer = buffer;
+            urb_ref_init(ref, urb, recycle_replay, s);
+            if (frame_queue_push(&s->replay_free, ref) < 0) {
+                free(ref);
+                free(urb);
+                free(buffer);
+                return -1;
+            }
+        }
+    }
+
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd < 0) {
+        LOG_ERROR("open_replay: timerfd_create: %s", strerror(errno));
+        return -1;
+    }
+    arm_timer(fd, 1);
+    s->src.fd = fd;
+    s->src.events = EPOLLIN;
+    s->src.ready = replay_ready;
+    return 0;
+}
+
+int init_zero_copy_urb(struct usbdevfs_urb *urb, void *ctx) {
+    URBRef *ref = malloc(sizeof(URBRef));
+    if (!ref) {
+        LOG_ERROR("init_zero_copy_urb: out of memory");
+        return -1;
+    }
+    urb_ref_init(ref, urb, recycle_submit, ctx);
+    return 0;
+}
+
+int open_camera(Stream *s) {
+    int fd = open(s->name, O_RDWR);
+    if (fd < 0) {
+        LOG_ERROR("open_camera: %s: %s", s->name, strerror(errno));
+        return -1;
+    }
+
     // Detach and Claim
     struct usbdevfs_ioctl detach = { .ifno = VIDEO_STREAMING_INTERFACE, .ioctl_code = USBDEVFS_DISCONNECT };
     ioctl(fd, USBDEVFS_IOCTL, &detach);
@@ -140,12 +1133,12 @@ int main(int argc, char *argv[]) {
 
     // Negotiation
     struct uvc_streaming_control ctrl = { .bFormatIndex = 2, .bFrameIndex = 1, .dwFrameInterval = 333333 };
-    struct usbdevfs_ctrltransfer xfer = { .bRequestType = 0x21, .bRequest = 0x01, .wValue = 0x0100, 
+    struct usbdevfs_ctrltransfer xfer = { .bRequestType = 0x21, .bRequest = 0x01, .wValue = 0x0100,
                                           .wIndex = VIDEO_STREAMING_INTERFACE, .wLength = 26, .data = &ctrl };
     ioctl(fd, USBDEVFS_CONTROL, &xfer);
     xfer.bRequestType = 0xA1; xfer.bRequest = 0x81;
     ioctl(fd, USBDEVFS_CONTROL, &xfer);
-    
+
     int packet_size = ctrl.dwMaxPayloadTransferSize;
     struct usbdevfs_setinterface set_intf = { .interface = VIDEO_STREAMING_INTERFACE, .altsetting = 7 };
     ioctl(fd, USBDEVFS_SETINTERFACE, &set_intf);
@@ -153,33 +1146,270 @@ int main(int argc, char *argv[]) {
     xfer.bRequestType = 0x21; xfer.bRequest = 0x01; xfer.wValue = 0x0200; xfer.data = &ctrl;
     ioctl(fd, USBDEVFS_CONTROL, &xfer);
 
-    g_jpeg_buffer = malloc(MAX_FRAME_SIZE);
-
-    // Submit URBs
-    for (int i = 0; i < NUM_URBS; i++) {
-        size_t sz = sizeof(struct usbdevfs_urb) + (PACKETS_PER_URB * sizeof(struct usbdevfs_iso_packet_desc));
-        struct usbdevfs_urb *urb = malloc(sz);
-        memset(urb, 0, sz);
-        urb->type = USBDEVFS_URB_TYPE_ISO;
-        urb->endpoint = VIDEO_ENDPOINT;
-        urb->buffer = malloc(packet_size * PACKETS_PER_URB);
-        urb->buffer_length = packet_size * PACKETS_PER_URB;
-        urb->number_of_packets = PACKETS_PER_URB;
-        for (int j = 0; j < PACKETS_PER_URB; j++) urb->iso_frame_desc[j].length = packet_size;
-        ioctl(fd, USBDEVFS_SUBMITURB, urb);
-    }
-
-    while (1) {
-        struct usbdevfs_urb *reaped;
-        if (ioctl(fd, USBDEVFS_REAPURB, &reaped) == 0) {
-            for (int p = 0; p < reaped->number_of_packets; p++) {
-                struct usbdevfs_iso_packet_desc *d = &reaped->iso_frame_desc[p];
-                if (d->status == 0 && d->actual_length > 0) {
-                    handle_packet((uint8_t*)reaped->buffer + (p * packet_size), d->actual_length);
-                }
-            }
-            ioctl(fd, USBDEVFS_SUBMITURB, reaped);
+    s->packet_size = packet_size;
+    if (g_record_path) {
+        char path[STREAM_PATH_LEN];
+        stream_path(path, g_record_path, s->index, 1);
+        if (stream_recorder_open(&s->recorder, path, packet_size, VIDEO_ENDPOINT) < 0) return -1;
+        s->recording = 1;
+    }
+
+    // Submit URBs (spares beyond the depth when frames keep URBs pinned)
+    s->usb_fd = fd;
+    int max_urbs = URB_MAX_DEPTH + (g_zero_copy ? ZERO_COPY_URBS : 0);
+    if (urb_manager_init(&s->urbs, fd, VIDEO_ENDPOINT, packet_size, g_urb_packets, max_urbs) < 0) return -1;
+    if (g_zero_copy) {
+        s->urbs.init_urb = init_zero_copy_urb;
+        s->urbs.ctx = s;
+    }
+    if (urb_manager_start(&s->urbs, g_urb_depth, g_urb_autotune) < 0) return -1;
+    s->packet_interval_ns = s->urbs.urb_ns / g_urb_packets;
+    uvc_clock_init(&s->clock, ctrl.dwClockFrequency);
+
+    // usbfs reports reapable URBs as POLLOUT
+    s->src.fd = fd;
+    s->src.events = EPOLLOUT;
+    s->src.ready = usb_ready;
+    return 0;
+}
+
+Stream *stream_create(const char *name) {
+    // Aligned, so the metric shards really get cache lines of their own
+    Stream *s = aligned_alloc(_Alignof(Stream), sizeof(Stream));
+    if (!s) return NULL;
+    memset(s, 0, sizeof(*s));
+    s->index = g_num_streams;
+    s->name = name;
+    s->usb_fd = -1;
+    s->last_fid = -1;
+    s->src.name = name;
+    s->src.ctx = s;
+    mjpeg_parser_init(&s->parser);
+    uvc_clock_init(&s->clock, 0);
+    for (int i = 0; i < LAT_NUM_STAGES; i++) latency_hist_reset(&s->latency[i]);
+    char source[STREAM_PATH_LEN];
+    metrics_escape(source, sizeof(source), name);
+    snprintf(s->metric_labels, sizeof(s->metric_labels), "stream=\"%d\",source=\"%s\"", s->index, source);
+    g_streams[g_num_streams++] = s;
+    return s;
+}
+
+// After every stream is created: the names depend on how many there are
+void stream_set_paths(Stream *s) {
+    stream_path(s->output_path, OUTPUT_PATH, s->index, 1);
+    stream_path(s->preview_path, g_preview_path, s->index, 1);
+    if (g_archive_path) stream_path(s->archive_path, g_archive_path, s->index, 1);
+    if (g_ring_prefix) stream_path(s->ring_prefix, g_ring_prefix, s->index, 0);
+}
+
+void on_signal(int sig) {
+    if (sig == SIGUSR1) g_trace_dump = 1;
+    else g_stop = 1;
+}
+
+// Called from the event loop; dumping is too slow for a signal handler
+void check_trace_dump(void) {
+    if (!g_trace_dump) return;
+    g_trace_dump = 0;
+    if (g_trace_path) trace_dump_file(g_trace_path);
+    else trace_dump(stderr);
+}
+
+void usage(const char *prog) {
+    printf("Usage: %s <device>... [options]    capture from /dev/bus/usb/BBB/DDD\n"
+           "       %s --replay <file> [--replay <file>...] [options]\n"
+           "Every device and recording is a stream, all served by one event loop;\n"
+           "with several streams, stream n writes its files as <name>_n.<ext>.\n"
+           "Options:\n"
+           "  --record <file>   write every reaped URB to <file>\n"
+           "  --realtime        replay at the recorded pace (default: as fast as possible)\n"
+           "  --loop-threads <n>  spread the streams over n event loop threads (default 1)\n"
+           "  --decode-threads <n>  decode each stream's frames on n threads at once,\n"
+           "                    delivered to the encoder in capture order (default 1)\n"
+           "  --decode-inflight <n>  frames decoding or waiting for an older one at most\n"
+           "                    (default 2 per decode thread); bounds the added latency\n"
+           "  --decode-pin <cpu>  pin decode thread i to CPU <cpu> + i\n"
+           "  --decode-strips <n>  split each frame with restart markers (DRI) into up to\n"
+           "                    n strips decoded at once, for lower per-frame latency;\n"
+           "                    frames without them decode as usual\n"
+           "  --static <dup|vfr>  skip the decode of frames whose scene has not changed\n"
+           "                    (JPEG size, then a 1/8 DC thumbnail); dup repeats the\n"
+           "                    previous frame to ffmpeg, vfr leaves it out and writes\n"
+           "                    the frame times to <output>.timestamps.txt\n"
+           "  --static-threshold <t>  mean luma difference (0-255) of the thumbnails\n"
+           "                    that counts as a change (default %.1f)\n"
+           "  --static-keepalive <s>  keep a frame at least every s seconds (default %.1f,\n"
+           "                    0: never)\n"
+           "  --urbs <n|auto>   URBs kept in flight per camera (default %d); auto grows\n"
+           "                    the queue when packets are lost and shrinks it to the\n"
+           "                    smallest depth that loses none\n"
+           "  --urb-packets <n> iso packets per URB, up to %d (default %d)\n"
+           "  --marker          frame on JPEG SOI/EOI (MJPEGParser) instead of UVC FID/EOF\n"
+           "  --null            decode only, do not encode %s\n"
+           "  --zero-copy       decode straight from the URB buffers (FID/EOF framing only)\n"
+           "  --format <f>      decode to rgb24 (default), yuv422p, yuv420p or gray; the\n"
+           "                    YUV formats skip libjpeg's color conversion\n"
+           "  --preview <s>     also decode every frame at 1/2, 1/4 or 1/8 size, or dc\n"
+           "                    (1/8 luma, cheapest), as raw frames to the preview file\n"
+           "  --preview-out <f> preview file (default %s)\n"
+           "  --preview-only    decode only the preview, skip the full-size output\n"
+           "  --mkv <file>      archive the MJPEG frames into a Matroska file as they\n"
+           "                    arrive, with timestamps and an index; no decode or ffmpeg\n"
+           "  --mkv-recover <file>  finish an --mkv file left incomplete by a crash\n"
+           "  --ring <prefix>   record the MJPEG frames into a ring of preallocated\n"
+           "                    <prefix>_NNN.mkv segments, overwriting the oldest;\n"
+           "                    disk writes are asynchronous (io_uring when available)\n"
+           "  --ring-segments <n>  segments in the ring (default %d)\n"
+           "  --ring-size <MB>  size of each segment (default %d)\n"
+           "  --frames <n>      stop each stream after n output frames, 0 for no limit\n"
+           "                    (default %d, 0 with --ring)\n"
+           "  --pool-frames <n> frames preallocated in the frame pool (default %d)\n"
+           "  --pool-policy <p> when the pool is empty: drop-oldest (default), drop-newest, block\n"
+           "  --trace <file>    dump the event trace to <file> at exit and on SIGUSR1\n"
+           "                    (without it, SIGUSR1 dumps to stderr)\n"
+           "  --latency-out <prefix>  write the latency histograms as\n"
+           "                    <prefix>_<stage>.hgrm (HdrHistogram percentile format)\n"
+           "  --metrics <addr>  serve Prometheus metrics on 127.0.0.1:<addr> if it is a\n"
+           "                    port number, else on a Unix socket at that path\n",
+           prog, prog, STATIC_THRESHOLD, STATIC_KEEPALIVE_SECS, NUM_URBS, URB_MAX_PACKETS, MAX_ISO_PACKETS, OUTPUT_PATH, PREVIEW_PATH, RING_SEGMENTS, RING_SEGMENT_MB, TARGET_FRAMES, POOL_FRAMES);
+}
+
+int main(int argc, char *argv[]) {
+    const char *devices[MAX_STREAMS];
+    const char *replays[MAX_STREAMS];
+    int num_devices = 0, num_replays = 0;
+    const char *recover_path = NULL;
+    int target_frames = -1;
+    int realtime = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) g_record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc &&
+                 num_devices + num_replays < MAX_STREAMS) replays[num_replays++] = argv[++i];
+        else if (strcmp(argv[i], "--realtime") == 0) realtime = 1;
+        else if (strcmp(argv[i], "--loop-threads") == 0 && i + 1 < argc) g_loop_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--decode-threads") == 0 && i + 1 < argc) g_decode_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--decode-inflight") == 0 && i + 1 < argc) g_decode_in_flight = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--decode-pin") == 0 && i + 1 < argc) g_decode_cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--decode-strips") == 0 && i + 1 < argc) g_decode_strips = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--static") == 0 && i + 1 < argc && parse_static(argv[i + 1]) == 0) i++;
+        else if (strcmp(argv[i], "--static-threshold") == 0 && i + 1 < argc) g_static_threshold = atof(argv[++i]);
+        else if (strcmp(argv[i], "--static-keepalive") == 0 && i + 1 < argc) g_static_keepalive = atof(argv[++i]);
+        else if (strcmp(argv[i], "--urbs") == 0 && i + 1 < argc && parse_urbs(argv[i + 1]) == 0) i++;
+        else if (strcmp(argv[i], "--urb-packets") == 0 && i + 1 < argc) g_urb_packets = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--marker") == 0) g_marker_framing = 1;
+        else if (strcmp(argv[i], "--null") == 0) g_null_sink = 1;
+        else if (strcmp(argv[i], "--zero-copy") == 0) g_zero_copy = 1;
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) g_trace_path = argv[++i];
+        else if (strcmp(argv[i], "--latency-out") == 0 && i + 1 < argc) g_latency_prefix = argv[++i];
+        else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) g_metrics_addr = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc &&
+                 frame_format_parse(argv[i + 1], &g_format) == 0) i++;
+        else if (strcmp(argv[i], "--preview") == 0 && i + 1 < argc &&
+                 parse_preview(argv[i + 1]) == 0) i++;
+        else if (strcmp(argv[i], "--preview-out") == 0 && i + 1 < argc) g_preview_path = argv[++i];
+        else if (strcmp(argv[i], "--preview-only") == 0) g_preview_only = 1;
+        else if (strcmp(argv[i], "--mkv") == 0 && i + 1 < argc) g_archive_path = argv[++i];
+        else if (strcmp(argv[i], "--mkv-recover") == 0 && i + 1 < argc) recover_path = argv[++i];
+        else if (strcmp(argv[i], "--ring") == 0 && i + 1 < argc) g_ring_prefix = argv[++i];
+        else if (strcmp(argv[i], "--ring-segments") == 0 && i + 1 < argc) g_ring_segments = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--ring-size") == 0 && i + 1 < argc) g_ring_segment_mb = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) target_frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pool-frames") == 0 && i + 1 < argc) g_pool_frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--pool-policy") == 0 && i + 1 < argc &&
+                 frame_pool_parse_policy(argv[i + 1], &g_pool_policy) == 0) i++;
+        else if (argv[i][0] != '-' && num_devices + num_replays < MAX_STREAMS) devices[num_devices++] = argv[i];
+        else {
+            usage(argv[0]);
+            return 1;
         }
     }
+    if (recover_path) {
+        long frames = mkv_recover(recover_path);
+        if (frames < 0) return 1;
+        printf("[Archive] %s: %ld frames, index and sizes written\n", recover_path, frames);
+        return 0;
+    }
+    if (num_devices + num_replays == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (g_preview_only && !g_preview_denom) {
+        printf("--preview-only needs --preview; previewing at 1/4\n");
+        g_preview_denom = 4;
+    }
+    // A DVR ring records until stopped
+    if (target_frames >= 0) g_target_frames = target_frames;
+    else if (g_ring_prefix) g_target_frames = 0;
+    if (g_archive_path || g_ring_prefix) g_output = OUTPUT_ARCHIVE;
+    else if (g_preview_only) g_output = OUTPUT_PREVIEW;
+    if (g_urb_packets < 1 || g_urb_packets > URB_MAX_PACKETS) {
+        printf("--urb-packets must be 1..%d\n", URB_MAX_PACKETS);
+        return 1;
+    }
+    if (g_static_mode != STATIC_OFF && g_output != OUTPUT_ENCODE) {
+        printf("--static only applies to the full-size output; ignoring it\n");
+        g_static_mode = STATIC_OFF;
+    }
+    if (g_zero_copy && g_marker_framing) {
+        printf("--zero-copy needs FID/EOF framing; ignoring --marker\n");
+        g_marker_framing = 0;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;      // no SA_RESTART: lets epoll_wait return EINTR
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    if (g_pool_frames < 2) g_pool_frames = 2;
+    if (g_decode_threads > DECODER_POOL_MAX_WORKERS) g_decode_threads = DECODER_POOL_MAX_WORKERS;
+    if (g_decode_strips > JPEG_STRIPS_MAX) g_decode_strips = JPEG_STRIPS_MAX;
+    if (g_decode_strips > 1 && g_decode_threads > 1) {
+        printf("--decode-strips needs a single decode thread; ignoring it\n");
+        g_decode_strips = 1;
+    }
+    if (g_decode_threads > 1) {
+        if (g_decode_in_flight <= 0) g_decode_in_flight = 2 * g_decode_threads;
+        if (g_decode_in_flight < g_decode_threads) g_decode_in_flight = g_decode_threads;
+        // Frames in the decoder pool hold pool frames, as do the encode queue,
+        // the frame being assembled and the one --static dup repeats: leave
+        // room for all of them
+        int needed = g_decode_in_flight + ENCODE_QUEUE_DEPTH + 2 + (g_static_mode == STATIC_DUP);
+        if (g_pool_frames < needed) {
+            printf("--decode-threads %d: raising --pool-frames to %d\n", g_decode_threads, needed);
+            g_pool_frames = needed;
+        }
+    }
+
+    // Max-speed replay has no USB deadline, so it may wait on the decoder
+    // (holding up the other streams on its loop thread meanwhile)
+    g_lossless = num_devices == 0 && !realtime;
+    if (g_lossless) g_pool_policy = POOL_BLOCK;
+
+    for (int i = 0; i < num_devices; i++) {
+        if (!stream_create(devices[i])) return 1;
+    }
+    for (int i = 0; i < num_replays; i++) {
+        if (!stream_create(replays[i])) return 1;
+    }
+    if (stream_manager_init(&g_manager, g_loop_threads) < 0) return 1;
+    g_manager.tick = check_trace_dump;
+
+    for (int i = 0; i < g_num_streams; i++) {
+        Stream *s = g_streams[i];
+        stream_set_paths(s);
+        int ret = i < num_devices ? open_camera(s) : open_replay(s, realtime);
+        if (ret < 0 || pipeline_start(s) < 0 || stream_manager_add(&g_manager, &s->src) < 0) return 1;
+    }
+
+    g_start_ns = stream_now_ns();
+    if (g_metrics_addr) {
+        if (metrics_server_start(&g_metrics, g_metrics_addr, collect_metrics, NULL) < 0) return 1;
+        printf("[Metrics] serving on %s\n", g_metrics_addr);
+    }
+    stream_manager_run(&g_manager, &g_stop);
+    finish();
     return 0;
 }
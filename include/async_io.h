@@ -0,0 +1,118 @@
+#ifndef ASYNC_IO_H
+#define ASYNC_IO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+// File writes issued off the calling thread. async_io_write() copies the
+// data into a staging ring and returns; the caller's buffers (pool frames,
+// URB slices) are free again right away and a slow disk only fills the
+// staging ring. Two backends:
+//
+//   io_uring  the caller submits, a completion thread reaps (raw
+//             syscalls, no liburing)
+//   thread    a writer thread runs pwritev() in queue order, used when
+//             io_uring is unavailable or UVC_NO_IO_URING=1 is set
+//
+// io_uring cancels the requests of a thread that exits, so the thread
+// that queues must outlive them: async_io_wait_idle() or
+// async_io_destroy() before it returns.
+//
+// Writes to different offsets may complete in any order. An "ordered"
+// request waits for everything queued before it and holds back everything
+// after it; use it when rewriting bytes written earlier.
+
+#define ASYNC_IO_SLOTS      256     // requests in flight, power of two
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+typedef enum {
+    ASYNC_IO_URING,
+    ASYNC_IO_THREAD
+} AsyncIoBackend;
+
+typedef enum {
+    ASYNC_OP_WRITE,
+    ASYNC_OP_ZERO,                  // fallocate(ZERO_RANGE): reads back as zeros, stays allocated
+    ASYNC_OP_STOP                   // shuts the worker down
+} AsyncOp;
+
+typedef struct {
+    AsyncOp op;
+    int fd;
+    int ordered;
+    uint64_t offset;
+    uint64_t length;
+    uint8_t *data;                  // in the staging ring
+    size_t staged;                  // staging bytes held, wrap padding included
+    uint64_t submit_ns;
+    atomic_int done;
+} AsyncRequest;
+
+typedef struct {
+    AsyncIoBackend backend;
+
+    // Staging ring and request slots. head/tail are free-running counters,
+    // advanced by the submitting thread only; completions set slot->done.
+    uint8_t *staging;
+    size_t staging_size;
+    uint64_t staging_head;
+    uint64_t staging_tail;
+    AsyncRequest slots[ASYNC_IO_SLOTS];
+    uint32_t head;                  // next slot to fill
+    uint32_t tail;                  // oldest slot not yet reclaimed
+
+    pthread_t thread;               // writer thread, or io_uring completion thread
+    pthread_mutex_t lock;
+    pthread_cond_t cond;            // work queued (thread) / requests done (both)
+    uint32_t published;             // thread backend: slots handed to the writer
+
+    // io_uring rings (mmap'd)
+    int ring_fd;
+    void *sq_ring;
+    void *cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    _Atomic uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    _Atomic uint32_t *cq_head;
+    _Atomic uint32_t *cq_tail;
+    uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // Stats
+    atomic_uint_fast64_t completed;
+    atomic_uint_fast64_t bytes;
+    atomic_uint_fast64_t errors;
+    atomic_uint_fast64_t latency_total_ns;  // queued -> completed
+    atomic_uint_fast64_t latency_max_ns;
+    size_t queued_max;              // staging bytes
+} AsyncIo;
+
+int async_io_init(AsyncIo *io, size_t staging_size);
+// Waits for every queued request, then stops the backend
+void async_io_destroy(AsyncIo *io);
+
+// Queue a write of the iovecs at offset. Blocks only if the staging ring
+// or the slots are full; check async_io_can_queue() first to drop instead.
+int async_io_write(AsyncIo *io, int fd, uint64_t offset, const struct iovec *iov, int n, int ordered);
+// Zero the first length bytes of fd, keeping the blocks (ordered)
+int async_io_zero(AsyncIo *io, int fd, uint64_t length);
+
+// True if `requests` writes totalling `bytes` would be queued without blocking
+int async_io_can_queue(AsyncIo *io, size_t bytes, int requests);
+// Staging bytes of requests not yet completed
+size_t async_io_queued_bytes(AsyncIo *io);
+void async_io_wait_idle(AsyncIo *io);
+
+const char *async_io_backend_name(const AsyncIo *io);
+void async_io_print_stats(AsyncIo *io, const char *name);
+
+#endif // ASYNC_IO_H
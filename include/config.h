@@ -8,14 +8,15 @@
 #define MAX_FRAME_SIZE      (MAX_FRAME_WIDTH * MAX_FRAME_HEIGHT * MAX_FRAME_CHANNELS)
 
 // MJPEG parser configuration
-#define MJPEG_BUFFER_SIZE   (128 * 1024)  // 128KB for incoming data
-#define MAX_JPEG_SIZE       (100 * 1024)  // 100KB max per JPEG frame
+#define MJPEG_BUFFER_SIZE   (512 * 1024)  // 512KB ring for incoming data (power of two)
+#define MAX_JPEG_SIZE       (400 * 1024)  // 400KB max per JPEG frame
 
-// URB configuration
-#define NUM_URBS            4
-#define MAX_ISO_PACKETS     32
+// URB configuration (defaults; --urbs and --urb-packets set them at runtime)
+#define NUM_URBS            5       // URBs kept in flight
+#define MAX_ISO_PACKETS     32      // iso packets per URB
+#define URB_MAX_DEPTH       32
+#define URB_MAX_PACKETS     128     // usbfs limit per URB
 #define MAX_PACKET_SIZE     3072
-#define URB_BUFFER_SIZE     (MAX_ISO_PACKETS * MAX_PACKET_SIZE)
 
 // Video configuration
 #define DEFAULT_FPS         30
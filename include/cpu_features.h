@@ -0,0 +1,16 @@
+#ifndef CPU_FEATURES_H
+#define CPU_FEATURES_H
+
+// SIMD extensions the kernels can dispatch on
+#define CPU_FEATURE_SSE2    (1u << 0)
+#define CPU_FEATURE_SSSE3   (1u << 1)
+#define CPU_FEATURE_AVX2    (1u << 2)
+#define CPU_FEATURE_NEON    (1u << 3)
+
+// Detected once and cached. x86 features are probed at runtime; NEON is a
+// compile-time property (always present on AArch64, -mfpu=neon on ARMv7).
+// Setting UVC_NO_SIMD=1 in the environment forces the scalar paths.
+unsigned cpu_features(void);
+const char *cpu_features_string(void);
+
+#endif // CPU_FEATURES_H
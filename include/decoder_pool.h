@@ -0,0 +1,78 @@
+#ifndef DECODER_POOL_H
+#define DECODER_POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include "frame.h"
+#include "frame_queue.h"
+#include "jpeg_decoder.h"
+
+// Frame-parallel decode: every JPEG is independent, so N worker threads,
+// each with its own JpegDecoder, decode whole frames side by side. Frames
+// finish out of order; a reorder buffer hands them to the deliver
+// callback strictly in submission order, one at a time (whichever worker
+// completes the oldest outstanding frame delivers it, and any that are
+// ready behind it). At most max_in_flight frames are between submit and
+// delivery: submit blocks beyond that, which bounds the latency a slow
+// frame adds to the ones behind it. Frames marked duplicate (unchanged,
+// see scene_detect.h) are not decoded, only delivered in their turn.
+
+#define DECODER_POOL_MAX_WORKERS    16
+
+// ret is jpeg_decoder_decode()'s: a frame that failed is delivered too,
+// in its place, so the callback sees every submitted frame once
+typedef void (*DecoderPoolDeliverFn)(Frame *f, int ret, void *ctx);
+
+typedef struct {
+    Frame *frame;
+    int ret;
+    int done;                       // decoded, waiting for its turn
+} DecoderPoolSlot;
+
+struct DecoderPool;
+
+typedef struct {
+    struct DecoderPool *pool;
+    int index;
+    int cpu;                        // pinned to, -1: not pinned
+    pthread_t thread;
+    JpegDecoder decoder;            // owned by the worker
+} DecoderPoolWorker;
+
+typedef struct DecoderPool {
+    DecoderPoolWorker workers[DECODER_POOL_MAX_WORKERS];
+    int num_workers;
+    FrameFormat format;
+    DecoderPoolDeliverFn deliver;
+    void *ctx;
+
+    FrameQueue jobs;                // slots waiting for a worker
+    DecoderPoolSlot *slots;         // reorder buffer, indexed by ticket % max_in_flight
+    int max_in_flight;
+    pthread_mutex_t lock;
+    pthread_cond_t space;           // a frame was delivered
+    uint64_t next_ticket;           // submit order
+    uint64_t next_deliver;          // oldest frame not delivered yet
+    int delivering;                 // a worker is running the deliver callback
+
+    // Statistics, read by decoder_pool_print_stats()
+    uint64_t held;                  // frames that finished before an older one
+    int max_held;
+    int max_in_flight_seen;
+    uint64_t submit_stall_ns;       // submit waiting for the in-flight bound
+} DecoderPool;
+
+// first_cpu >= 0 pins worker i to CPU first_cpu + i (modulo the CPUs online)
+int decoder_pool_start(DecoderPool *p, int num_workers, int max_in_flight, int first_cpu,
+                       FrameFormat format, DecoderPoolDeliverFn deliver, void *ctx);
+
+// From one thread, in the order frames must come out
+int decoder_pool_submit(DecoderPool *p, Frame *f);
+
+// Decodes and delivers everything submitted, then stops the workers
+void decoder_pool_stop(DecoderPool *p);
+
+// "[Decode <name>] ..." over all workers, and a "[Decoder pool] ..." line
+void decoder_pool_print_stats(const DecoderPool *p, const char *name);
+
+#endif // DECODER_POOL_H
@@ -0,0 +1,53 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "frame_slices.h"
+
+struct FramePool;
+
+// Pixel layout produced by the decode stage
+typedef enum {
+    FRAME_RGB24,            // interleaved RGB (libjpeg color conversion)
+    FRAME_YUV422P,          // planar Y, Cb, Cr; chroma half width (native MJPEG)
+    FRAME_YUV420P,          // chroma half width, half height
+    FRAME_GRAY8             // luma only; libjpeg skips the chroma (analytics)
+} FrameFormat;
+
+// One captured frame as it moves through the capture pipeline:
+// reaper (JPEG bytes) -> decode (pixels) -> encode (written to the sink).
+// Frames live in a FramePool; buffers are preallocated and never freed.
+typedef struct {
+    int seq;                // capture order, starting at 0
+    uint64_t timestamp_ns;  // CLOCK_MONOTONIC, when its last URB was reaped
+
+    // Stage times on CLOCK_MONOTONIC, 0 for stages that did not run
+    uint64_t capture_ns;    // capture began: PTS through the SCR clock model,
+                            // else when the first packet was reaped
+    uint64_t assembled_ns;  // last packet in, handed to the decode stage
+    uint64_t decoded_ns;
+    uint64_t written_ns;    // sink write done
+    int duplicate;          // unchanged (scene_detect.h): not decoded, the
+                            // sink repeats the previous frame
+
+    uint8_t *jpeg;          // compressed frame as assembled from the stream
+    int jpeg_size;
+    int jpeg_capacity;
+    SliceList slices;       // ...or, in zero-copy mode, the URB payloads it spans
+    atomic_int jpeg_readers;    // stages yet to decode it, see frame_jpeg_done()
+
+    uint8_t *pixels;        // decoded image, valid once the decode stage ran
+    FrameFormat format;
+    int width;
+    int height;
+    int stride;             // bytes per row, padded like image_stride()
+    uint8_t *planes[3];     // Y, Cb, Cr for planar formats; planes[0] == pixels
+    int plane_stride[3];
+
+    atomic_int refs;
+    struct FramePool *pool;
+} Frame;
+
+#endif // FRAME_H
@@ -0,0 +1,67 @@
+#ifndef FRAME_POOL_H
+#define FRAME_POOL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "frame.h"
+#include "frame_queue.h"
+
+// What frame_pool_acquire() does when every frame is in use
+typedef enum {
+    POOL_DROP_OLDEST,   // reclaim the oldest frame still waiting in the victim queue
+    POOL_DROP_NEWEST,   // fail; the caller discards the incoming frame
+    POOL_BLOCK          // wait until a frame is released
+} PoolPolicy;
+
+// Fixed set of Frames allocated once at init. Frames are reference counted
+// and return to the pool when the last holder calls frame_release().
+typedef struct FramePool {
+    Frame *frames;
+    int count;
+    uint8_t *jpeg_storage;      // count * jpeg_capacity, one slab
+    int jpeg_capacity;
+    uint8_t *pixel_storage;     // count * pixel_capacity, see frame_pool_reserve_pixels()
+    size_t pixel_capacity;
+    pthread_mutex_t reserve_lock;
+
+    FrameQueue free_list;
+    FrameQueue *victim;         // where POOL_DROP_OLDEST finds the oldest frames
+    PoolPolicy policy;
+
+    // Counters
+    atomic_uint_fast64_t acquired;
+    atomic_uint_fast64_t dropped_oldest;
+    atomic_uint_fast64_t dropped_newest;
+    atomic_uint_fast64_t blocked;
+    atomic_uint_fast64_t block_ns;
+} FramePool;
+
+// jpeg_capacity may be 0 when frames only carry URB slices
+int frame_pool_init(FramePool *pool, int count, int jpeg_capacity, PoolPolicy policy);
+void frame_pool_destroy(FramePool *pool);
+void frame_pool_set_victim(FramePool *pool, FrameQueue *victim);
+
+// Decoded size is unknown until the first frame header is parsed, so pixel
+// buffers for every frame are allocated by the first call (one slab). Later
+// calls only check the size fit; returns -1 if it does not.
+int frame_pool_reserve_pixels(FramePool *pool, size_t bytes);
+
+// Returns a cleared frame holding one reference, or NULL (POOL_DROP_NEWEST)
+Frame *frame_pool_acquire(FramePool *pool);
+void frame_ref(Frame *f);
+void frame_release(Frame *f);
+
+// A frame may be decoded by more than one stage (full size and preview).
+// Each stage that takes a reference to decode it also registers as a
+// reader; the last frame_jpeg_done() releases the URB slices early, before
+// the frame itself is released.
+void frame_add_jpeg_reader(Frame *f);
+void frame_jpeg_done(Frame *f);
+
+const char *frame_pool_policy_name(PoolPolicy policy);
+int frame_pool_parse_policy(const char *name, PoolPolicy *policy);
+void frame_pool_print_stats(FramePool *pool);
+
+#endif // FRAME_POOL_H
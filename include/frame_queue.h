@@ -0,0 +1,62 @@
+#ifndef FRAME_QUEUE_H
+#define FRAME_QUEUE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define FRAME_QUEUE_CACHELINE 64
+
+// Bounded lock-free queue of pointers (Vyukov's sequence-per-cell ring).
+// Safe for any number of producers and consumers, so the same type serves the
+// SPSC reaper->decode handoff and the MPSC decode->encode handoff.
+// Blocking calls spin and yield for a moment, then sleep on a condition
+// variable; pushes and pops only take the lock when a thread is asleep.
+typedef struct {
+    atomic_size_t seq;
+    void *item;
+} FrameQueueCell;
+
+typedef struct {
+    _Alignas(FRAME_QUEUE_CACHELINE) atomic_size_t enqueue_pos;
+    _Alignas(FRAME_QUEUE_CACHELINE) atomic_size_t dequeue_pos;
+
+    _Alignas(FRAME_QUEUE_CACHELINE) FrameQueueCell *cells;
+    size_t mask;
+    const char *name;
+    atomic_int closed;
+
+    // Blocked callers past their spin, see queue_park()
+    _Alignas(FRAME_QUEUE_CACHELINE) atomic_int pop_waiters;
+    atomic_int push_waiters;
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+
+    // Statistics, read by frame_queue_print_stats()
+    atomic_size_t max_depth;
+    atomic_uint_fast64_t pushes;
+    atomic_uint_fast64_t push_full;      // pushes that found the queue full
+    atomic_uint_fast64_t push_stall_ns;  // time blocked in frame_queue_push()
+    atomic_uint_fast64_t pop_stall_ns;   // time blocked in frame_queue_pop()
+} FrameQueue;
+
+// capacity is rounded up to a power of two
+int frame_queue_init(FrameQueue *q, const char *name, size_t capacity);
+void frame_queue_destroy(FrameQueue *q);
+
+// Non-blocking: return 0 / the item on success, -1 / NULL if full / empty
+int frame_queue_try_push(FrameQueue *q, void *item);
+void *frame_queue_try_pop(FrameQueue *q);
+
+// Blocking: wait (spin, then sleep) while full / empty. Push fails with -1
+// once the queue is closed; pop returns NULL once it is closed and drained.
+int frame_queue_push(FrameQueue *q, void *item);
+void *frame_queue_pop(FrameQueue *q);
+
+void frame_queue_close(FrameQueue *q);
+size_t frame_queue_depth(FrameQueue *q);
+void frame_queue_print_stats(FrameQueue *q);
+
+#endif // FRAME_QUEUE_H
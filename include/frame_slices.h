@@ -0,0 +1,53 @@
+#ifndef FRAME_SLICES_H
+#define FRAME_SLICES_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <jpeglib.h>
+#include <linux/usbdevice_fs.h>
+
+// Enough (URB, offset, length) slices for a 1MB frame in 2KB+ packets
+#define MAX_FRAME_SLICES    512
+
+// A reaped URB whose buffer is still referenced by frames. The reaper holds
+// one reference while it walks the packets and every slice holds another;
+// when the last one is dropped the URB is handed back via recycle()
+// (resubmitted to the kernel, or returned to the replay free list).
+typedef struct URBRef {
+    struct usbdevfs_urb *urb;
+    atomic_int refs;
+    void (*recycle)(struct URBRef *ref);
+    void *ctx;
+} URBRef;
+
+typedef struct {
+    URBRef *ref;
+    const uint8_t *data;    // points into ref->urb->buffer
+    int length;
+} FrameSlice;
+
+typedef struct {
+    FrameSlice slices[MAX_FRAME_SLICES];
+    int num_slices;
+    int total_size;
+} SliceList;
+
+void urb_ref_init(URBRef *ref, struct usbdevfs_urb *urb, void (*recycle)(URBRef *), void *ctx);
+void urb_ref_get(URBRef *ref);
+void urb_ref_put(URBRef *ref);
+
+// Append a slice (takes a reference on ref); -1 when the list is full
+int slice_list_append(SliceList *list, URBRef *ref, const uint8_t *data, int length);
+// Drop every slice and its URB reference
+void slice_list_release(SliceList *list);
+// Transfer all slices (and their references) from src to dst; src ends empty
+void slice_list_move(SliceList *dst, SliceList *src);
+// Flatten into dst; returns bytes copied or -1 if it does not fit
+int slice_list_copy(const SliceList *list, uint8_t *dst, int capacity);
+
+// libjpeg source manager reading the slices in place, no reassembly copy.
+// The list must stay alive until jpeg_finish/abort_decompress.
+void jpeg_slice_src(j_decompress_ptr cinfo, const SliceList *list);
+
+#endif // FRAME_SLICES_H
@@ -0,0 +1,42 @@
+#ifndef IMAGE_KERNELS_H
+#define IMAGE_KERNELS_H
+
+#include <stdint.h>
+
+// Row kernels behind image_to_grayscale(), image_adjust_brightness(),
+// image_adjust_contrast(), point_ops_apply(), the span fills and the
+// 4:2:0 chroma downsample in jpeg_decoder.c. The scalar set is the
+// reference; the SIMD sets use fixed point and are checked against it by
+// bench/image_kernels:
+//   brightness  bit-exact (saturating add/sub)
+//   grayscale   within +-1 (Q14 weights, ~99.8% of all RGB values exact)
+//   contrast    within +-1 (factor in Q9), for -64 <= factor < 64;
+//               other factors use the scalar code
+//   lut         bit-exact (16 vpshufb / 4 tbl lookups per vector; SSSE3
+//               uses the scalar walk, which measured faster)
+//   fill_rgb    bit-exact (memset when r == g == b)
+//   average     bit-exact, (a + b + 1) / 2 (pavgb / vrhadd)
+typedef struct {
+    const char *name;
+    unsigned needs;         // CPU_FEATURE_* bits the set requires
+    void (*gray_rgb)(uint8_t *rgb, int pixels);
+    void (*brightness)(uint8_t *p, int n, int delta);
+    void (*contrast)(uint8_t *p, int n, float factor);
+    void (*lut)(uint8_t *p, int n, const uint8_t table[256]);
+    void (*fill_rgb)(uint8_t *p, int pixels, uint8_t r, uint8_t g, uint8_t b);
+    void (*average)(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n);
+} ImageKernels;
+
+// Fastest set for this CPU, chosen on first use
+const ImageKernels *image_kernels(void);
+
+extern const ImageKernels image_kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+extern const ImageKernels image_kernels_ssse3;     // brightness/contrast only need SSE2
+extern const ImageKernels image_kernels_avx2;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+extern const ImageKernels image_kernels_neon;
+#endif
+
+#endif // IMAGE_KERNELS_H
@@ -2,34 +2,92 @@
 #define IMAGE_PROCESSING_H
 
 #include <stdint.h>
+#include <stddef.h>
 #include "config.h"
 
-// Fixed size image structure
+// Row starts of images set up by image_init() are aligned to this, and the
+// stride is padded to a multiple of it, so SIMD kernels can use aligned loads
+#define IMAGE_ALIGN     64
+
+// Image header over pixel memory it does not own. The memory comes from
+// the caller (image_init), an ImageArena, or another image (image_view).
 typedef struct {
-    uint8_t data[MAX_FRAME_SIZE];
+    uint8_t *data;  // first pixel of the first row
     int width;
     int height;
     int channels;
-    int step;
+    int step;       // bytes from one row to the next (>= width * channels)
     int valid;      // to indicate if image is valid
+    int is_view;    // sub-rectangle of another image: data/step may be unaligned
 } Image;
 
-// Initialize image structures
-void image_init(Image *img, int width, int height, int channels);
+// Preallocated, aligned slab that images are carved out of. Allocation
+// is a pointer bump; everything is freed at once with image_arena_reset().
+typedef struct {
+    uint8_t *base;
+    size_t size;
+    size_t used;
+} ImageArena;
+
+// Padded stride and buffer size for a width x height x channels image
+int image_stride(int width, int channels);
+size_t image_buffer_size(int width, int height, int channels);
+
+// Initialize image structures. mem must be IMAGE_ALIGN-aligned and hold
+// image_buffer_size() bytes; it is zeroed. Returns 0 or -1.
+int image_init(Image *img, int width, int height, int channels, uint8_t *mem, size_t mem_size);
 void image_clear(Image *img);
-void image_copy(const Image *src, Image *dst);
+int image_copy(const Image *src, Image *dst);
+
+// Non-owning view of the rectangle (x, y, w, h) of src, which must lie
+// inside it. Writes through the view land in src. Returns 0 or -1.
+int image_view(const Image *src, Image *view, int x, int y, int w, int h);
+
+// True if every row start is IMAGE_ALIGN-aligned
+int image_is_aligned(const Image *img);
+
+int image_arena_init(ImageArena *arena, size_t size);
+void image_arena_destroy(ImageArena *arena);
+int image_arena_alloc(ImageArena *arena, Image *img, int width, int height, int channels);
+void image_arena_reset(ImageArena *arena);
 
 // Basic operations
 void image_to_grayscale(Image *img);
 void image_adjust_brightness(Image *img, int delta);
 void image_adjust_contrast(Image *img, float factor);
 
-// Drawing functions
+// Solid fills, clipped to the image (RGB only). Rows are filled with the
+// fill_rgb kernel, so a span costs one bounds check, not one per pixel.
+void image_fill_hspan(Image *img, int x, int y, int len, uint8_t r, uint8_t g, uint8_t b);
+void image_fill_vspan(Image *img, int x, int y, int len, uint8_t r, uint8_t g, uint8_t b);
+void image_fill_rect(Image *img, int x, int y, int w, int h, uint8_t r, uint8_t g, uint8_t b);
+
+// Drawing functions (built on the fills; see overlay.h to batch many shapes).
+// A rect's outline is thickness pixels inward on each side; thicker than
+// the rect, it spills past the opposite side. A line is walked from
+// (x1, y1) to (x2, y2).
 void image_draw_rect(Image *img, int x, int y, int w, int h,
                     uint8_t r, uint8_t g, uint8_t b, int thickness);
 void image_draw_line(Image *img, int x1, int y1, int x2, int y2,
                     uint8_t r, uint8_t g, uint8_t b);
 
+// Bresenham walk over a line from its top end down, so drawing can stop at
+// a row and resume later (overlay.c renders lines band by band this way).
+// For a line given bottom end first, the pixels can differ from
+// image_draw_line()'s where the walk hits a tie.
+typedef struct {
+    int x, y;               // next pixel
+    int x_end, y_end;
+    int dx, dy, sx, err;
+    int run_x;              // first pixel of the current row's run
+    int done;
+} ImageLineWalk;
+
+void image_line_begin(ImageLineWalk *l, int x1, int y1, int x2, int y2);
+// Draw the rows above y_limit (clipped). Returns 1 while rows remain.
+int image_line_draw(ImageLineWalk *l, Image *img, int y_limit,
+                    uint8_t r, uint8_t g, uint8_t b);
+
 // Utility functions
 void image_set_pixel(Image *img, int x, int y, uint8_t r, uint8_t g, uint8_t b);
 void image_get_pixel(const Image *img, int x, int y, uint8_t *r, uint8_t *g, uint8_t *b);
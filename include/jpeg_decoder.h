@@ -0,0 +1,97 @@
+#ifndef JPEG_DECODER_H
+#define JPEG_DECODER_H
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#include "frame.h"
+
+// libjpeg error manager: corrupt frames longjmp back into the decode call
+typedef struct {
+    struct jpeg_error_mgr pub;
+    jmp_buf setjmp_buffer;
+} JpegErrorMgr;
+
+// Decoder for one stream, created once. The decompressor, its memory
+// pools and the row pointer table live across frames; a corrupt frame
+// only aborts the current decompression.
+typedef struct {
+    struct jpeg_decompress_struct cinfo;
+    JpegErrorMgr jerr;
+    JSAMPROW *rows;         // one pointer per output row
+    int rows_capacity;
+    uint8_t *scratch;       // YCbCr scanlines for the fallback path
+    size_t scratch_size;
+    uint8_t *strip_scratch; // discard and staging rows of strip decodes
+    size_t strip_scratch_size;
+    int slice_source;       // cinfo.src is jpeg_slice_src()'s
+    int scale_denom;        // output is 1/scale_denom of the stream size
+    int fast;               // fast integer IDCT, no fancy upsampling
+
+    // Per-frame timing (jpeg_decoder_decode() calls, successful or not)
+    uint64_t frames;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} JpegDecoder;
+
+int jpeg_decoder_init(JpegDecoder *d);
+void jpeg_decoder_destroy(JpegDecoder *d);
+
+// Decode at 1/2, 1/4 or 1/8 size (1: full size, the default). libjpeg
+// scales inside the IDCT, so a smaller output costs less than decoding
+// and downscaling; at 1/8 each 8x8 block is reduced to its DC term.
+// fast trades a little accuracy for speed (integer IDCT, box upsampling).
+int jpeg_decoder_set_scale(JpegDecoder *d, int scale_denom, int fast);
+
+// Decode f's JPEG (f->jpeg, or f->slices in zero-copy mode) into its pool
+// pixel buffer in the requested format, filling width/height/planes.
+// Scanlines are read in as large batches as libjpeg hands out (at least
+// rec_outbuf_height rows) straight into the frame.
+//
+// FRAME_RGB24 lets libjpeg convert YCbCr to RGB. The YUV formats skip the
+// color conversion: libjpeg's raw-data path hands over the Y, Cb and Cr
+// planes as stored in the stream (4:2:2 for UVC MJPEG cameras), written
+// straight into the frame. 4:2:0 halves the chroma rows with the average
+// row kernel. Other samplings fall back to YCbCr scanlines, converted to
+// planes here. FRAME_GRAY8 only decodes the luma. Scaled YUV output also
+// goes through YCbCr scanlines. Returns 0, or -1 on a corrupt frame.
+int jpeg_decoder_decode(JpegDecoder *d, Frame *f, FrameFormat format);
+
+// Same, but the pixels go to dst (a frame from another pool) and src keeps
+// its own: lets a second decoder read a frame another stage is decoding
+int jpeg_decoder_decode_into(JpegDecoder *d, const Frame *src, Frame *dst, FrameFormat format);
+
+// Lays f out for a width x height image as a decode to format would:
+// pool pixels reserved, planes and strides set, nothing decoded
+int jpeg_decoder_layout(Frame *f, FrameFormat format, int width, int height);
+
+// Decodes a JPEG that holds rows row0 .. row0 + its height of f, which
+// jpeg_decoder_layout() laid out for the whole image, in f's format. Lets
+// several decoders fill horizontal strips of one frame at once
+// (jpeg_strips.h). Full size only: -1 with a scaled decoder.
+int jpeg_decoder_decode_strip(JpegDecoder *d, const uint8_t *jpeg, size_t size, Frame *f, int row0);
+
+// "[Decode <name>] ..." line
+void jpeg_decoder_print_stats(const JpegDecoder *d, const char *name);
+
+// Plane size of a decoded frame: plane 0 is luma (or RGB), 1 and 2 chroma
+void frame_plane_size(const Frame *f, int plane, int *width, int *height);
+int frame_num_planes(FrameFormat format);
+
+// Size of the frame as unpadded planes back to back (the rawvideo layout),
+// and a pointer to it in that layout: the pixels themselves when no row is
+// padded, else a copy packed into buf (frame_packed_size() bytes). Lets a
+// sink hand over a whole frame in one write.
+size_t frame_packed_size(const Frame *f);
+const uint8_t *frame_packed(const Frame *f, uint8_t *buf);
+
+// "rgb24", "yuv422p", "yuv420p", "gray"
+const char *frame_format_name(FrameFormat format);
+int frame_format_parse(const char *name, FrameFormat *format);
+
+// ffmpeg -pixel_format for piping frames as rawvideo. JPEG YCbCr is full
+// range, so YUV maps to the yuvj* formats.
+const char *frame_format_ffmpeg(FrameFormat format);
+
+#endif // JPEG_DECODER_H
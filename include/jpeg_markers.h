@@ -0,0 +1,43 @@
+#ifndef JPEG_MARKERS_H
+#define JPEG_MARKERS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define JPEG_MARKER_SOI     0xD8
+#define JPEG_MARKER_EOI     0xD9
+
+// True for a byte following 0xFF that makes it a marker. Excluded are the
+// 0xFF00 byte stuffing and 0xFFFF fill inside entropy-coded data, and RST0-7,
+// which only occur inside a scan and never delimit a frame.
+static inline int jpeg_is_marker_code(uint8_t code) {
+    return code != 0x00 && code != 0xFF && (code & 0xF8) != 0xD0;
+}
+
+// Offset of the first 0xFF in data[0 .. len-2] that starts a marker (see
+// above), or -1. The last byte is never reported since its code byte is not
+// in the buffer. Dispatches to the fastest kernel for this CPU.
+long jpeg_find_marker(const uint8_t *data, size_t len);
+
+// Same, but only returns the marker with the given code
+long jpeg_find_marker_code(const uint8_t *data, size_t len, uint8_t code);
+
+const char *jpeg_find_marker_impl(void);
+
+// Image size from the SOFn header, walking the marker segments from SOI.
+// The header part of the JPEG is enough (SOF comes before the scan).
+// Returns 0, or -1 if there is no complete SOF in data.
+int jpeg_frame_size(const uint8_t *data, size_t len, int *width, int *height);
+
+// Individual kernels, exposed for the benchmark. The SIMD ones exist only
+// on their architecture and must only be called if cpu_features() has them.
+long jpeg_find_marker_scalar(const uint8_t *data, size_t len);
+#if defined(__x86_64__) || defined(__i386__)
+long jpeg_find_marker_sse2(const uint8_t *data, size_t len);
+long jpeg_find_marker_avx2(const uint8_t *data, size_t len);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+long jpeg_find_marker_neon(const uint8_t *data, size_t len);
+#endif
+
+#endif // JPEG_MARKERS_H
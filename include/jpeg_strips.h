@@ -0,0 +1,125 @@
+#ifndef JPEG_STRIPS_H
+#define JPEG_STRIPS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "frame.h"
+#include "jpeg_decoder.h"
+
+// Intra-frame parallel decode. With a restart interval (DRI) the scan is
+// cut into pieces by RST0-7 markers, and the entropy decoder and the DC
+// predictors start afresh after each one. Where a restart falls at the
+// start of an MCU row the frame can be split into horizontal strips. Each
+// strip becomes a JPEG of its own: the headers with the SOF height set to
+// the strip's, then its intervals with the RST markers renumbered from
+// RST0. Each strip is decoded on its own thread straight into its rows of
+// the output frame. This cuts the latency of a single frame, which
+// frame-parallel decode (decoder_pool.h) cannot.
+//
+// Frames that cannot be split decode serially, the same as
+// jpeg_decoder_decode(). That covers frames with no DRI, restarts that
+// never fall on an MCU row, and progressive or multi-scan JPEGs. It also
+// covers zero-copy frames, whose bytes are scattered over URBs, and output
+// where libjpeg upsamples chroma vertically (RGB from 4:2:0), because that
+// would not be bit-exact at the strip edges.
+
+#define JPEG_STRIPS_MAX     8
+
+// Where the headers and restart markers of one JPEG are
+typedef struct {
+    int width;
+    int height;
+    int num_components;
+    int h_samp[3];
+    int v_samp[3];
+    int mcu_width;                  // pixels
+    int mcu_height;
+    int mcus_per_row;
+    int mcu_rows;
+    int restart_interval;           // MCUs per interval, 0: no DRI
+    size_t sof_height_pos;          // SOF height field, patched per strip
+    size_t scan_pos;                // first entropy-coded byte, after SOS
+    size_t scan_end;                // the marker ending the scan (EOI)
+    uint32_t *restarts;             // offset of every RSTn in the scan
+    int num_restarts;
+    int restarts_capacity;
+} JpegRestartMap;
+
+// Fills map from a complete JPEG, reusing its restart table. Returns -1
+// unless the JPEG is sequential Huffman-coded with a single scan over all
+// of its components. restart_interval is 0 when there is no DRI.
+int jpeg_restart_map(JpegRestartMap *map, const uint8_t *jpeg, size_t size);
+void jpeg_restart_map_free(JpegRestartMap *map);
+
+// Splits the frame into at most max_strips strips of about equal height,
+// cut only where an interval starts an MCU row. first_row[i] is strip
+// i's first MCU row. Returns the number of strips; 1 means no split.
+int jpeg_strips_plan(const JpegRestartMap *map, int max_strips, int *first_row);
+
+// One strip, rebuilt as a JPEG of its own by whichever thread decodes it
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    int first_row;                  // MCU rows
+    int end_row;
+    int ret;
+} JpegStrip;
+
+struct StripDecoder;
+
+typedef struct {
+    struct StripDecoder *sd;
+    int index;
+    int cpu;                        // pinned to, -1: not pinned
+    pthread_t thread;
+    JpegDecoder decoder;
+    JpegStrip strip;
+} StripWorker;
+
+// The calling thread decodes the first strip; max_strips - 1 workers
+// decode the rest and are idle between frames
+typedef struct StripDecoder {
+    JpegDecoder decoder;            // the caller's: serial frames
+    JpegStrip strip;                // ...and strip 0
+    StripWorker workers[JPEG_STRIPS_MAX - 1];
+    int num_workers;
+    JpegRestartMap map;
+
+    // The frame being split
+    const uint8_t *jpeg;
+    Frame *frame;
+    int first_row[JPEG_STRIPS_MAX + 1];
+    int num_strips;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start;           // a new frame (generation) to split
+    pthread_cond_t done;
+    uint64_t generation;
+    int pending;                    // worker strips not decoded yet
+    int stop;
+
+    // Statistics, per frame, read by strip_decoder_print_stats()
+    uint64_t frames;
+    uint64_t errors;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t split_frames;
+    uint64_t strips;
+    uint64_t no_restarts;           // serial: no DRI
+    uint64_t not_splittable;        // serial: DRI, but no split (see above)
+} StripDecoder;
+
+// first_cpu >= 0 pins worker i to CPU first_cpu + 1 + i (modulo the CPUs
+// online), leaving first_cpu to the calling thread
+int strip_decoder_init(StripDecoder *sd, int max_strips, int first_cpu);
+void strip_decoder_destroy(StripDecoder *sd);
+
+// As jpeg_decoder_decode(), strips in parallel where the frame allows
+int strip_decoder_decode(StripDecoder *sd, Frame *f, FrameFormat format);
+
+// "[Decode <name>] ..." per frame, and a "[Strips] ..." line
+void strip_decoder_print_stats(const StripDecoder *sd, const char *name);
+
+#endif // JPEG_STRIPS_H
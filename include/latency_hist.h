@@ -0,0 +1,38 @@
+#ifndef LATENCY_HIST_H
+#define LATENCY_HIST_H
+
+#include <stdint.h>
+
+// HdrHistogram-style latency histogram: every power of two is split into
+// 2^LATENCY_HIST_SUB_BITS linear steps, so any value is kept to within
+// 1/64 (1.6%) from 1 ns up to 2^LATENCY_HIST_MAX_BITS ns (18 minutes) in a
+// fixed 18 KB of counters. Recording is an index computation and one add;
+// one thread records, anyone reads after it is done.
+
+#define LATENCY_HIST_SUB_BITS   6
+#define LATENCY_HIST_MAX_BITS   40
+#define LATENCY_HIST_BUCKETS    ((LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1) << LATENCY_HIST_SUB_BITS)
+
+typedef struct {
+    uint64_t counts[LATENCY_HIST_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    double sum_sq;
+} LatencyHistogram;
+
+void latency_hist_reset(LatencyHistogram *h);
+void latency_hist_record(LatencyHistogram *h, uint64_t ns);
+
+// Highest value equivalent to the percentile's bucket (percent 0..100)
+uint64_t latency_hist_percentile(const LatencyHistogram *h, double percent);
+
+// One line: p50, p90, p99, p99.9 and max in ms
+void latency_hist_print(const LatencyHistogram *h, const char *name);
+
+// Percentile distribution in HdrHistogram's .hgrm text format (values in
+// ms), which the HdrHistogram plotters read
+int latency_hist_write_hgrm(const LatencyHistogram *h, const char *path);
+
+#endif // LATENCY_HIST_H
@@ -0,0 +1,29 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+#define LOG_LEVEL_NONE      0
+#define LOG_LEVEL_ERROR     1
+#define LOG_LEVEL_WARN      2
+#define LOG_LEVEL_INFO      3
+#define LOG_LEVEL_DEBUG     4
+#define LOG_LEVEL_TRACE     5
+
+// Build with `make LOG_LEVEL=4` to get debug messages. Anything above the
+// level is compiled out, but its format string is still type-checked.
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+#define LOG_AT(level, tag, fmt, ...) do { \
+        if (LOG_LEVEL >= (level)) printf(tag fmt "\n", ##__VA_ARGS__); \
+    } while (0)
+
+#define LOG_ERROR(fmt, ...) LOG_AT(LOG_LEVEL_ERROR, "[E] ", fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  LOG_AT(LOG_LEVEL_WARN,  "[W] ", fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  LOG_AT(LOG_LEVEL_INFO,  "",     fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(fmt, ...) LOG_AT(LOG_LEVEL_DEBUG, "[D] ", fmt, ##__VA_ARGS__)
+#define LOG_TRACE(fmt, ...) LOG_AT(LOG_LEVEL_TRACE, "[T] ", fmt, ##__VA_ARGS__)
+
+#endif // LOG_H
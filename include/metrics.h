@@ -0,0 +1,101 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#define METRICS_CACHELINE   64
+
+// Per-stream pipeline counters. Every thread that counts something owns
+// one shard, on cache lines of its own; it is the only writer, so a count
+// is a relaxed load and store (no locked add, no line bouncing between
+// cores). Readers sum the shards and may see a count a moment late.
+//
+// Counters with the same name are one Prometheus family told apart by the
+// label in the table in metrics.c, so they stay next to each other here.
+typedef enum {
+    METRIC_URBS,                // URBs reaped (or replayed)
+    METRIC_PACKETS_OK,          // iso packets, by completion status
+    METRIC_PACKETS_EMPTY,
+    METRIC_PACKETS_MISSED,      // -EXDEV: the controller skipped the slot
+    METRIC_PACKETS_OVERFLOW,
+    METRIC_PACKETS_PROTO,       // -EPROTO / -EILSEQ: bus errors
+    METRIC_PACKETS_OTHER,
+    METRIC_BYTES,               // good packets, headers included
+    METRIC_FID_NO_EOF,          // frames ended by an FID toggle, EOF lost
+    METRIC_FRAMES_ASSEMBLED,
+    METRIC_REJECT_OVERSIZED,    // larger than the frame buffer / MAX_JPEG_SIZE
+    METRIC_REJECT_FRAGMENT,     // too short to be a frame
+    METRIC_DROP_POOL,           // no free frame to assemble into
+    METRIC_DROP_HANDOFF,        // decode queue full
+    METRIC_PREVIEW_SKIPPED,
+    METRIC_STATIC_SKIPPED,      // unchanged, not decoded (--static)
+    METRIC_DECODE_ERRORS,       // libjpeg errors, full decode
+    METRIC_PREVIEW_ERRORS,      // ... and preview decode
+    METRIC_ARCHIVE_ERRORS,
+    METRIC_NUM_COUNTERS
+} MetricId;
+
+// The threads that write a stream's counters
+typedef enum {
+    METRICS_LOOP,               // event loop: packets and assembly
+    METRICS_DECODE,
+    METRICS_ENCODE,
+    METRICS_PREVIEW,
+    METRICS_DELIVER,            // decoder pool: whichever worker delivers, one at a time
+    METRICS_NUM_SHARDS
+} MetricsShardId;
+
+typedef struct {
+    _Alignas(METRICS_CACHELINE) atomic_uint_fast64_t counts[METRIC_NUM_COUNTERS];
+} MetricsShard;
+
+typedef struct {
+    MetricsShard shards[METRICS_NUM_SHARDS];
+} StreamMetrics;
+
+// Only from the thread that owns the shard
+static inline void metrics_add(StreamMetrics *m, MetricsShardId shard, MetricId id, uint64_t n) {
+    atomic_uint_fast64_t *c = &m->shards[shard].counts[id];
+    atomic_store_explicit(c, atomic_load_explicit(c, memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+uint64_t metrics_get(const StreamMetrics *m, MetricId id);
+
+// --- Prometheus text exposition format (0.0.4) ---
+
+// Label value with \, " and newlines escaped
+void metrics_escape(char *out, size_t size, const char *value);
+
+// # HELP and # TYPE lines, once per family
+void metrics_write_family(FILE *fp, const char *name, const char *type, const char *help);
+
+// name{labels,extra} value; labels and extra are name="value" lists, either may be NULL
+void metrics_write_sample(FILE *fp, const char *name, const char *labels, const char *extra, uint64_t value);
+
+// Every counter of n streams; labels[i] tells stream i apart
+void metrics_write_counters(FILE *fp, StreamMetrics *const *m, const char *const *labels, int n);
+
+// Writes the whole exposition; called on the server thread for every scrape
+typedef void (*MetricsCollectFn)(FILE *fp, void *ctx);
+
+// Serves the collected text to anyone who connects, on its own thread.
+// addr is a TCP port (bound to 127.0.0.1 only) or a Unix socket path.
+// HTTP GETs get an HTTP response, so Prometheus can scrape the port
+// directly; a client that sends nothing gets the bare text.
+typedef struct {
+    int listen_fd;
+    char unix_path[108];        // removed again by metrics_server_stop()
+    pthread_t thread;
+    volatile int stop;
+    MetricsCollectFn collect;
+    void *ctx;
+    uint64_t scrapes;
+} MetricsServer;
+
+int metrics_server_start(MetricsServer *srv, const char *addr, MetricsCollectFn collect, void *ctx);
+void metrics_server_stop(MetricsServer *srv);
+
+#endif // METRICS_H
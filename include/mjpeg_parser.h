@@ -4,16 +4,47 @@
 #include <stdint.h>
 #include "config.h"
 
+#define MJPEG_RING_MASK     (MJPEG_BUFFER_SIZE - 1)
+
+typedef enum {
+    MJPEG_SEARCH_SOI,   // discarding bytes until 0xFFD8
+    MJPEG_IN_FRAME,     // SOI seen, looking for 0xFFD9
+    MJPEG_FOUND_EOI     // complete frame waiting to be consumed
+} MJPEGState;
+
+// A frame inside the ring: one segment, or two when it wraps around the end
+typedef struct {
+    const uint8_t *seg[2];
+    int len[2];
+    int size;
+} MJPEGFrameView;
+
+// Circular buffer parser. Positions are free-running byte counters, masked
+// into buffer[]; data is never moved once written, and the marker scan
+// resumes where the previous call stopped.
 typedef struct {
     uint8_t buffer[MJPEG_BUFFER_SIZE];
-    uint8_t jpeg_frame[MAX_JPEG_SIZE];
-    int buffer_head;
-    int buffer_size;
+    uint32_t head;          // oldest byte still needed
+    uint32_t tail;          // next byte to write
+    uint32_t scan;          // where the marker scan resumes
+    uint32_t frame_start;   // SOI position (IN_FRAME / FOUND_EOI)
+    uint32_t frame_end;     // one past EOI (FOUND_EOI)
+    MJPEGState state;
     int frame_count;
+    int dropped_frames;     // partial frames overwritten or oversized
 } MJPEGParser;
 
 void mjpeg_parser_init(MJPEGParser *parser);
 int mjpeg_parser_add_data(MJPEGParser *parser, const uint8_t *data, int length);
+
+// Zero-copy interface: returns 1 and fills view when a complete frame is
+// buffered. The view stays valid until mjpeg_parser_release_frame() or the
+// next mjpeg_parser_add_data(), which drops the frame and overwrites its
+// bytes when the ring is full.
+int mjpeg_parser_next_frame(MJPEGParser *parser, MJPEGFrameView *view);
+void mjpeg_parser_release_frame(MJPEGParser *parser);
+
+// Copying interface: frame_out must hold MAX_JPEG_SIZE bytes
 int mjpeg_parser_get_frame(MJPEGParser *parser, uint8_t *frame_out, int *frame_size);
 
 #endif // MJPEG_PARSER_H
@@ -0,0 +1,88 @@
+#ifndef MKV_WRITER_H
+#define MKV_WRITER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Matroska (.mkv) muxer for the camera's MJPEG frames: the JPEGs are
+// stored as they came off the wire (codec V_MJPEG), nothing is decoded.
+//
+// File layout:
+//
+//   EBML header
+//   Segment (size patched at close)
+//     Void        reserved, becomes the SeekHead at close
+//     Info        timestamp scale 1 ms, Duration patched at close
+//     Tracks      one video track, size from the first frame's SOF
+//     Cluster...  one SimpleBlock (key frame) per JPEG
+//     Cues        one cue point per cluster, written at close
+//
+// Sizes that are not known yet are written as "unknown" (all ones), which
+// Matroska allows for live streams, and patched with pwrite() when they
+// are. A file cut off by a crash therefore still plays up to its last
+// complete frame; mkv_recover() trims the tail and writes the index.
+
+#define MKV_CLUSTER_MS      1000    // new cluster (and cue point) every second
+#define MKV_MAX_PARTS       512     // iovecs per frame (zero-copy URB slices)
+
+// Where a sink-mode writer's bytes go: write the iovecs at offset, which
+// is either the append position or a patch of bytes written earlier.
+// Returns 0 or -1.
+typedef int (*MkvWriteFn)(void *ctx, uint64_t offset, const struct iovec *iov, int n);
+
+typedef struct {
+    uint64_t time_ms;
+    uint64_t cluster_pos;           // relative to the segment data
+} MkvCuePoint;
+
+typedef struct {
+    int fd;                         // -1 in sink mode
+    MkvWriteFn write;               // sink mode only
+    void *write_ctx;
+    uint64_t pos;                   // file offset of the next write
+    uint64_t segment_data;          // first byte inside the Segment
+    uint64_t seekhead_pos;          // the reserved Void
+    uint64_t info_pos;
+    uint64_t duration_pos;          // Duration float payload
+    uint64_t tracks_pos;
+    int header_written;
+
+    uint64_t cluster_pos;           // open cluster, 0 if none
+    uint64_t cluster_time_ms;
+    uint64_t first_ts_ns;
+    uint64_t last_time_ms;
+    uint64_t prev_time_ms;
+
+    MkvCuePoint *cues;              // the index, one entry per cluster
+    int num_cues;
+    int cues_capacity;
+
+    int width;
+    int height;
+    uint64_t frames;
+    uint64_t bytes;
+} MkvWriter;
+
+int mkv_writer_open(MkvWriter *w, const char *path);
+// Same file layout, written through write() instead of a file of its own
+// (the segment ring). Offsets start at 0.
+int mkv_writer_open_sink(MkvWriter *w, MkvWriteFn write, void *ctx);
+
+// Append one JPEG, given as num_parts pieces (a whole buffer, or URB
+// slices) that are written with one writev(). timestamp_ns is the capture
+// time; the file's timeline starts at the first frame. The headers are
+// written with the first frame, once its size is known.
+int mkv_writer_add_frame(MkvWriter *w, const struct iovec *parts, int num_parts, uint64_t timestamp_ns);
+
+// Close the last cluster, write the cues, SeekHead, duration and segment
+// size, and close the file (sink mode: nothing to close)
+int mkv_writer_close(MkvWriter *w);
+
+// Repair a file mkv_writer left unfinished (killed, crashed, power loss):
+// drops a partly written trailing frame, sizes the open cluster, rebuilds
+// the cues from the clusters and finalizes like mkv_writer_close(). Safe
+// to run on a complete file. Returns the number of frames kept, or -1.
+long mkv_recover(const char *path);
+
+#endif // MKV_WRITER_H
@@ -0,0 +1,54 @@
+#ifndef OVERLAY_H
+#define OVERLAY_H
+
+#include <stdint.h>
+#include "image_processing.h"
+
+// Rows drawn together: every shape touching a band is drawn before the
+// next band, so the band stays in cache (16 rows of 1080p RGB ~ 92 KB)
+#define OVERLAY_BAND_ROWS   16
+
+typedef enum {
+    OVERLAY_RECT,           // outline, thickness inward
+    OVERLAY_FILL,           // solid rectangle
+    OVERLAY_LINE
+} OverlayShapeType;
+
+typedef struct {
+    OverlayShapeType type;
+    int x1, y1, x2, y2;     // rect/fill: x, y, w, h; line: endpoints
+    int thickness;
+    uint8_t r, g, b;
+    int top, bottom;        // rows covered
+    int seq;                // insertion order: overlapping shapes paint in it
+    ImageLineWalk walk;     // line state while rendering
+} OverlayShape;
+
+// Shapes collected for one frame (e.g. detection boxes) and rendered in a
+// single top-to-bottom pass. The result is the same as calling
+// image_draw_rect() / image_fill_rect() / image_draw_line() in add order,
+// except that lines are walked from their top end (ImageLineWalk): one
+// added bottom end first can differ from image_draw_line()'s at ties.
+typedef struct {
+    OverlayShape *shapes;
+    OverlayShape **active;  // shapes crossing the current band, by seq
+    int count;
+    int capacity;
+} OverlayBatch;
+
+int overlay_init(OverlayBatch *ov, int capacity);
+void overlay_destroy(OverlayBatch *ov);
+void overlay_clear(OverlayBatch *ov);
+
+// Queue a shape. Returns 0, or -1 when the batch is full.
+int overlay_add_rect(OverlayBatch *ov, int x, int y, int w, int h,
+                     uint8_t r, uint8_t g, uint8_t b, int thickness);
+int overlay_add_fill(OverlayBatch *ov, int x, int y, int w, int h,
+                     uint8_t r, uint8_t g, uint8_t b);
+int overlay_add_line(OverlayBatch *ov, int x1, int y1, int x2, int y2,
+                     uint8_t r, uint8_t g, uint8_t b);
+
+// Draw every queued shape; the batch can be rendered again or cleared
+void overlay_render(OverlayBatch *ov, Image *img);
+
+#endif // OVERLAY_H
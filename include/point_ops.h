@@ -0,0 +1,49 @@
+#ifndef POINT_OPS_H
+#define POINT_OPS_H
+
+#include <stdint.h>
+#include "image_processing.h"
+
+#define POINT_OPS_MAX       16
+#define POINT_OPS_ALL       0x7     // channel mask: every channel
+
+typedef enum {
+    POINT_OP_BRIGHTNESS,    // value: delta added, clamped (image_adjust_brightness)
+    POINT_OP_CONTRAST,      // value: factor around 128 (image_adjust_contrast)
+    POINT_OP_GAMMA,         // value: gamma; out = 255 * (in / 255) ^ (1 / gamma)
+    POINT_OP_INVERT,        // out = 255 - in
+    POINT_OP_THRESHOLD      // value: level; out = in >= level ? 255 : 0
+} PointOpType;
+
+typedef struct {
+    PointOpType type;
+    float value;
+    unsigned channels;      // bit c set: applies to channel c
+} PointOp;
+
+// A chain of per-pixel operations, compiled into one 256-entry table per
+// channel and applied in a single pass. Results are identical to running
+// the scalar image_adjust_* functions one after the other.
+typedef struct {
+    PointOp ops[POINT_OPS_MAX];
+    int num_ops;
+    uint8_t lut[3][256] __attribute__((aligned(64)));
+    int per_channel;        // the channels ended up with different tables
+    int compiled;
+} PointOpPipeline;
+
+void point_ops_init(PointOpPipeline *p);
+
+// Queue a step. Returns 0, or -1 when the pipeline is full.
+int point_ops_add(PointOpPipeline *p, PointOpType type, float value, unsigned channels);
+int point_ops_brightness(PointOpPipeline *p, int delta);
+int point_ops_contrast(PointOpPipeline *p, float factor);
+int point_ops_gamma(PointOpPipeline *p, float gamma);
+int point_ops_invert(PointOpPipeline *p);
+int point_ops_threshold(PointOpPipeline *p, int level);
+
+// Builds the tables; point_ops_apply() does it too if needed
+void point_ops_compile(PointOpPipeline *p);
+void point_ops_apply(PointOpPipeline *p, Image *img);
+
+#endif // POINT_OPS_H
@@ -0,0 +1,60 @@
+#ifndef SCENE_DETECT_H
+#define SCENE_DETECT_H
+
+#include <stdint.h>
+#include "frame.h"
+#include "frame_pool.h"
+#include "jpeg_decoder.h"
+
+// Static-scene detection ahead of the full decode. Two checks, cheapest first:
+//   1. Compressed size: a JPEG more than SCENE_SIZE_DELTA larger or smaller
+//      than the reference frame's has changed; nothing is decoded.
+//   2. DC thumbnail: a 1/8-scale luma-only decode (each 8x8 block reduced
+//      to its DC term, jpeg_decoder_set_scale()), compared with the
+//      reference's by mean absolute difference.
+// The reference is the last frame found changed. Keep-alive frames do not
+// replace it, so slow drift adds up until it counts as a change. A frame
+// that changed by size has no thumbnail, so the next one is compared with
+// nothing, kept, and becomes the reference. A thumbnail costs about half a
+// full decode (the entropy decoding remains): detection pays off when the
+// scene is still more often than not, and costs extra when it never is.
+
+#define SCENE_SIZE_DELTA    0.10    // relative JPEG size change that is a change
+
+typedef enum {
+    SCENE_CHANGED,                  // decode it
+    SCENE_KEEPALIVE,                // unchanged, but kept for the minimum rate
+    SCENE_STATIC                    // unchanged: skip it
+} SceneResult;
+
+typedef struct {
+    JpegDecoder decoder;            // 1/8, luma only, fast IDCT
+    FramePool pool;                 // the two thumbnails
+    Frame *ref;                     // thumbnail of the reference frame, NULL if none
+    Frame *cur;
+    int ref_size;                   // JPEG size of the reference frame, 0: none yet
+    uint64_t last_kept_ns;          // frame timestamps
+    double threshold;               // mean absolute luma difference, 0..255
+    uint64_t keepalive_ns;          // longest run of skipped frames, 0: no limit
+
+    // Statistics, read by scene_detect_print_stats()
+    uint64_t frames;
+    uint64_t skipped;
+    uint64_t changed_size;
+    uint64_t changed_content;
+    uint64_t keepalive;
+    uint64_t thumbnails;
+    uint64_t detect_ns;             // thumbnails and comparisons
+} SceneDetector;
+
+int scene_detect_init(SceneDetector *sd, double threshold, double keepalive_secs);
+void scene_detect_destroy(SceneDetector *sd);
+
+// Classifies f (its JPEG, as assembled) against the reference, by its
+// timestamp_ns for the keep-alive
+SceneResult scene_detect(SceneDetector *sd, const Frame *f);
+
+// "[Static] ..." line; the caller reports what the skipped frames saved
+void scene_detect_print_stats(const SceneDetector *sd);
+
+#endif // SCENE_DETECT_H
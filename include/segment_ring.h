@@ -0,0 +1,59 @@
+#ifndef SEGMENT_RING_H
+#define SEGMENT_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/uio.h>
+#include "async_io.h"
+#include "mkv_writer.h"
+
+// DVR-style recorder: a fixed set of preallocated segment files,
+// <prefix>_000.mkv .. <prefix>_NNN.mkv, written round-robin. When the
+// current segment is full it is finalized and recording moves on to the
+// next file, overwriting the oldest recording; disk usage never grows
+// past num_segments * segment_size.
+//
+// Every segment is a complete MJPEG Matroska file (mkv_writer in sink
+// mode), followed by a top-level Void that pads it to segment_size so the
+// blocks stay allocated for the next round. Writes go through AsyncIo:
+// recording never waits on the disk. If the staging ring is full the frame
+// is dropped and counted instead.
+
+#define SEGMENT_RING_STAGING    (32 * 1024 * 1024)   // AsyncIo staging bytes
+#define SEGMENT_RING_MIN_SIZE   (1024 * 1024)
+
+typedef struct {
+    const char *prefix;             // caller's string, kept
+    int num_segments;
+    uint64_t segment_size;
+    int *fds;
+    uint8_t *created;               // file did not exist before this run
+    uint8_t *written;               // holds a recording from this run
+
+    int current;                    // segment being written, -1 before the first frame
+    int open;                       // mkv is open on current
+    int block;                      // wait for the disk instead of dropping (offline replay)
+    MkvWriter mkv;                  // sink mode, writes to fds[current]
+    uint64_t segments_started;
+
+    AsyncIo io;
+
+    uint64_t frames;
+    uint64_t frames_dropped;
+    uint64_t bytes;
+} SegmentRing;
+
+// Creates (or reuses) and preallocates the segment files
+int segment_ring_open(SegmentRing *r, const char *prefix, int num_segments, uint64_t segment_size);
+
+// Append one JPEG, as for mkv_writer_add_frame(). Returns 0 when written
+// or dropped because the disk is behind (unless block is set), -1 on error.
+int segment_ring_add_frame(SegmentRing *r, const struct iovec *parts, int num_parts, uint64_t timestamp_ns);
+
+// Finalizes the current segment and waits for the disk
+int segment_ring_close(SegmentRing *r);
+
+// After segment_ring_close(), for the final numbers
+void segment_ring_print_stats(SegmentRing *r);
+
+#endif // SEGMENT_RING_H
@@ -0,0 +1,77 @@
+#ifndef STREAM_MANAGER_H
+#define STREAM_MANAGER_H
+
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+
+// Event loop for several capture sources at once. Every source is a file
+// descriptor the loop waits on with epoll; when it is ready, the source's
+// ready() callback drains whatever is available without blocking. usbfs
+// reports completed URBs as POLLOUT (drained with USBDEVFS_REAPURBNDELAY);
+// replayed streams use a timerfd.
+//
+// Sources are spread over num_threads loop threads, round-robin. A source
+// always runs on the same thread, so its callback never races itself.
+
+#define STREAM_MANAGER_MAX_SOURCES  16
+#define STREAM_MANAGER_MAX_THREADS  8
+#define STREAM_MANAGER_TICK_MS      100     // longest wait, so stop flags are seen
+
+typedef struct StreamSource StreamSource;
+
+// Drain the source without blocking. Returns the number of items (URBs)
+// handled, possibly 0. A finished source (end of file, device gone,
+// error) sets src->stop.
+typedef int (*StreamReadyFn)(StreamSource *src);
+
+struct StreamSource {
+    const char *name;
+    int fd;
+    uint32_t events;                // EPOLLIN / EPOLLOUT
+    StreamReadyFn ready;
+    void *ctx;
+
+    // Set from any thread: the loop drops the source at its next wakeup
+    volatile sig_atomic_t stop;
+
+    // Stats, written by the source's loop thread
+    int thread;
+    int finished;
+    uint64_t wakeups;
+    uint64_t items;
+    uint32_t max_batch;             // most items handled in one wakeup
+};
+
+typedef struct StreamManager StreamManager;
+
+typedef struct {
+    StreamManager *mgr;
+    int index;
+    int epoll_fd;
+    int active;                     // sources still registered
+    pthread_t thread;
+    uint64_t waits;
+    uint64_t events;
+} StreamLoop;
+
+struct StreamManager {
+    StreamSource *sources[STREAM_MANAGER_MAX_SOURCES];
+    int num_sources;
+    StreamLoop loops[STREAM_MANAGER_MAX_THREADS];
+    int num_threads;
+    volatile sig_atomic_t *stop;    // global stop (signal handler)
+    void (*tick)(void);             // called by loop 0 after every wait
+};
+
+int stream_manager_init(StreamManager *m, int num_threads);
+int stream_manager_add(StreamManager *m, StreamSource *src);
+
+// Run until every source has finished or *stop is set. Loop 0 runs on the
+// calling thread, the others on their own.
+int stream_manager_run(StreamManager *m, volatile sig_atomic_t *stop);
+
+void stream_manager_destroy(StreamManager *m);
+void stream_manager_print_stats(const StreamManager *m);
+
+#endif // STREAM_MANAGER_H
@@ -0,0 +1,86 @@
+#ifndef STREAM_RECORD_H
+#define STREAM_RECORD_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/usbdevice_fs.h>
+
+// Recorded stream file layout (fields in host byte order, little-endian on
+// every supported target):
+//
+//   StreamFileHeader
+//   repeat for every reaped URB:
+//     StreamURBRecord
+//     StreamPacketRecord[number_of_packets]
+//     payload bytes of every packet, back to back (actual_length each)
+//
+// Only the bytes the device actually sent are stored, so a file is roughly
+// the size of the raw USB payload.
+
+#define STREAM_FILE_MAGIC     "UVCS"
+#define STREAM_FILE_VERSION   1
+#define STREAM_MAX_PACKETS    1024    // per URB record; larger ones are corrupt
+#define STREAM_MAX_PACKET_SIZE 65536  // SuperSpeed iso tops out at 48 KiB
+
+typedef struct __attribute__((packed)) {
+    char magic[4];
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t packet_size;       // iso packet stride inside the URB buffer
+    uint32_t endpoint;
+} StreamFileHeader;
+
+typedef struct __attribute__((packed)) {
+    uint64_t timestamp_ns;      // CLOCK_MONOTONIC when the URB was reaped
+    uint32_t number_of_packets;
+    uint32_t payload_bytes;     // sum of actual_length over all packets
+} StreamURBRecord;
+
+typedef struct __attribute__((packed)) {
+    int32_t status;
+    uint32_t actual_length;
+} StreamPacketRecord;
+
+typedef struct {
+    FILE *file;
+    int packet_size;
+    StreamPacketRecord *packets;    // STREAM_MAX_PACKETS entries
+    uint64_t urbs_written;
+    uint64_t bytes_written;
+} StreamRecorder;
+
+typedef struct {
+    FILE *file;
+    int packet_size;
+    int realtime;               // 1 = reproduce the recorded pacing
+    int no_sleep;               // realtime: the caller waits, see stream_replay_due_ns()
+    uint64_t first_ts;
+    uint64_t start_ns;
+    uint64_t urbs_read;
+    uint64_t last_ts;           // timestamp of the URB most recently returned
+
+    // Stand-in for a reaped URB: same layout the live loop sees
+    struct usbdevfs_urb *urb;
+    int max_packets;
+    uint8_t *buffer;
+    StreamPacketRecord *packets;    // packet table read, STREAM_MAX_PACKETS entries
+} StreamReplay;
+
+uint64_t stream_now_ns(void);
+
+int stream_recorder_open(StreamRecorder *rec, const char *path, int packet_size, int endpoint);
+int stream_recorder_write_urb(StreamRecorder *rec, const struct usbdevfs_urb *urb, uint64_t timestamp_ns);
+void stream_recorder_close(StreamRecorder *rec);
+
+int stream_replay_open(StreamReplay *rp, const char *path, int realtime);
+// Returns an internal stand-in URB, valid until the next call; NULL at EOF
+struct usbdevfs_urb *stream_replay_next_urb(StreamReplay *rp);
+// Read the next URB into a caller-owned URB/buffer (buffer holds
+// max_packets * packet_size bytes); -1 at EOF. urb->usercontext is kept.
+int stream_replay_read_urb(StreamReplay *rp, struct usbdevfs_urb *urb, uint8_t *buffer, int max_packets);
+// Realtime with no_sleep set: when the URB read last is due, on the
+// stream_now_ns() clock (0 if not realtime)
+uint64_t stream_replay_due_ns(const StreamReplay *rp);
+void stream_replay_close(StreamReplay *rp);
+
+#endif // STREAM_RECORD_H
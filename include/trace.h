@@ -0,0 +1,88 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+
+// Binary flight recorder for hot-path events. Recording an event is one
+// atomic add plus four stores; nothing is formatted until the ring is
+// dumped. The ring keeps the newest TRACE_RING_SIZE events.
+#define TRACE_RING_SIZE     4096    // power of two
+
+// Build with -DTRACE_ENABLED=0 to compile every trace_event() out
+#ifndef TRACE_ENABLED
+#define TRACE_ENABLED       1
+#endif
+
+typedef enum {
+    TRACE_URB_SUBMIT,       // a: packets,        b: bytes
+    TRACE_URB_REAP,         // a: packets,        b: payload bytes
+    TRACE_URB_ERROR,        // a: errno
+    TRACE_URB_DEPTH,        // a: new depth,      b: longest reap wait ns
+    TRACE_PARSER_SOI,       // a: ring position
+    TRACE_PARSER_EOI,       // a: ring position
+    TRACE_PARSER_FRAME,     // a: frame number,   b: size
+    TRACE_PARSER_DROP,      // a: size (0 = overwritten)
+    TRACE_PAYLOAD_EOF,      // a: payload bytes
+    TRACE_FRAME_SUBMIT,     // a: seq,            b: size
+    TRACE_FRAME_DROP,       // a: seq
+    TRACE_FRAME_DECODED,    // a: seq,            b: decode ns
+    TRACE_FRAME_STATIC,     // a: seq,            b: detector ns (not decoded)
+    TRACE_FRAME_ENCODED,    // a: seq,            b: sink write ns
+    TRACE_PREVIEW_DECODED,  // a: seq,            b: decode ns
+    TRACE_FRAME_ARCHIVED,   // a: seq,            b: mkv write ns
+    TRACE_NUM_EVENTS
+} TraceEventId;
+
+typedef struct {
+    _Atomic uint64_t seq;   // 1 + ring index once complete, 0 while written
+    uint64_t ts_ns;         // CLOCK_MONOTONIC
+    uint16_t id;
+    uint16_t thread;        // small per-thread number, in order of first event
+    uint32_t a;
+    uint64_t b;
+} TraceEvent;
+
+typedef struct {
+    _Alignas(64) _Atomic uint64_t next;
+    _Alignas(64) TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+extern TraceRing g_trace;
+
+uint16_t trace_thread_id(void);
+
+static inline void trace_event(TraceEventId id, uint32_t a, uint64_t b) {
+#if TRACE_ENABLED
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t idx = atomic_fetch_add_explicit(&g_trace.next, 1, memory_order_relaxed);
+    TraceEvent *e = &g_trace.events[idx & (TRACE_RING_SIZE - 1)];
+
+    atomic_store_explicit(&e->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    e->ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    e->id = id;
+    e->thread = trace_thread_id();
+    e->a = a;
+    e->b = b;
+    atomic_store_explicit(&e->seq, idx + 1, memory_order_release);
+#else
+    (void)id; (void)a; (void)b;
+#endif
+}
+
+const char *trace_event_name(int id);
+
+// Copy out the events still in the ring, oldest first. Slots being
+// rewritten during the copy are skipped. Returns the number copied.
+int trace_snapshot(TraceEvent *out, int max);
+
+// Text dump: one line per event, times relative to the oldest one
+void trace_dump(FILE *out);
+int trace_dump_file(const char *path);
+
+#endif // TRACE_H
@@ -3,22 +3,97 @@
 
 #include <linux/usbdevice_fs.h>
 #include <stdint.h>
+#include <pthread.h>
 #include "config.h"
 
-typedef struct {
-    struct usbdevfs_urb urb;
-    struct usbdevfs_iso_packet_desc iso_packets[MAX_ISO_PACKETS];
-    uint8_t buffer[URB_BUFFER_SIZE];
-    int active;
-} URBBuffer;
+// Isochronous URBs for one streaming endpoint, sized at runtime: depth URBs
+// of packets_per_urb packets each are kept in flight. URBs are allocated
+// when the depth first needs them. When the depth shrinks, the surplus is
+// parked on resubmit rather than cancelled.
+//
+// Buffers are mmap'd from the usbfs fd where the kernel supports it (Linux
+// 4.6+): DMA-coherent memory the controller fills directly. Heap buffers
+// make usbfs allocate a kernel buffer on every submit and copy the data out
+// on every reap. UVC_NO_USB_MMAP=1 forces heap buffers. The CPU time the
+// submit and reap ioctls take is recorded per MB, to compare the two.
+//
+// Autotune picks the depth from what the reaps show. Each URB covers
+// packets_per_urb service intervals (125 us at high speed), so after a reap
+// the URBs still queued cover (depth - 1) URB times. A longer wait until
+// the next reap means the controller ran dry and packets were lost, and so
+// do packets reaped with an error status (-EXDEV: scheduled too late).
+// Either grows the depth at once. The depth shrinks by one after
+// URB_TUNE_CLEAN_WINDOWS clean windows in which one URB fewer would still
+// have covered the longest wait, but never back down to a depth that lost
+// packets: it settles on the smallest depth that does not.
+
+#define URB_TUNE_WINDOW_NS      1000000000ull
+#define URB_TUNE_CLEAN_WINDOWS  5
+#define URB_TUNE_MIN_DEPTH      2
 
 typedef struct {
-    URBBuffer urbs[NUM_URBS];
-    int num_active;
+    int fd;
+    int endpoint;
+    int packet_size;
+    int packets_per_urb;
+    uint64_t urb_ns;                // bus time one URB covers
+
+    struct usbdevfs_urb **urbs;     // allocated so far, up to max_urbs
+    int num_urbs;
+    int max_urbs;
+    int use_mmap;                   // still trying usbfs mmap for new buffers
+    int num_mmapped;                // URBs with an mmap'd buffer
+    struct usbdevfs_urb **parked;   // allocated, neither in flight nor in use
+    int num_parked;
+    pthread_mutex_t lock;           // zero-copy resubmits from the decode thread
+
+    int depth;                      // URBs to keep in flight
+    int in_flight;
+    int (*init_urb)(struct usbdevfs_urb *urb, void *ctx);   // called on allocation, -1 drops the URB
+    void *ctx;
+
+    // Autotune, on the reaping thread
+    int autotune;
+    int fail_depth;                 // largest depth that lost packets
+    int settle;                     // reaps to ignore after a change (queued before it)
+    int clean_windows;
+    uint64_t window_start_ns;
+    uint64_t window_max_wait_ns;
+    uint64_t last_reap_ns;
+
+    // Stats
+    uint64_t reaped;
+    uint64_t bytes;                 // payload reaped
+    uint64_t ioctl_cpu_ns;          // thread CPU time in submit and reap ioctls
+    uint64_t packets;
+    uint64_t packet_errors;
+    uint64_t underruns;             // reap waits longer than the queued URBs covered
+    uint64_t max_wait_ns;
+    int min_depth_used;
+    int max_depth_used;
+    int depth_changes;
 } URBManager;
 
-void urb_manager_init(URBManager *mgr);
-int urb_submit(int fd, URBBuffer *buffer, int end_point, int num_packets, int packet_size);
+// Nothing is submitted yet; set init_urb/ctx before urb_manager_start()
+int urb_manager_init(URBManager *m, int fd, int endpoint, int packet_size, int packets_per_urb, int max_urbs);
+int urb_manager_start(URBManager *m, int depth, int autotune);
+
+// For every reaped URB, before it is resubmitted: stats and autotune
+void urb_manager_reaped(URBManager *m, const struct usbdevfs_urb *urb, uint64_t now_ns);
+
+// Back to the kernel, or parked if depth URBs are already in flight
+int urb_manager_resubmit(URBManager *m, struct usbdevfs_urb *urb);
+
+// One completed URB without blocking, NULL with errno set (EAGAIN: none)
+struct usbdevfs_urb *urb_manager_reap(URBManager *m);
+
+// Submit parked or new URBs until depth are in flight; after a batch of
+// reaps, and whenever URBs are held elsewhere (zero-copy frames)
+void urb_manager_fill(URBManager *m);
+
+void urb_manager_print_stats(const URBManager *m);
+
+// Blocking reap of one URB, NULL on error
 struct usbdevfs_urb *urb_reap(int fd);
 
 #endif  // URB_MANAGER_H
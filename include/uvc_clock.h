@@ -0,0 +1,76 @@
+#ifndef UVC_CLOCK_H
+#define UVC_CLOCK_H
+
+#include <stdint.h>
+
+// UVC payload header (UVC 1.5, 2.4.3.3): HLE, BFH, then the optional
+// 4-byte PTS and 6-byte SCR, in that order
+#define UVC_HDR_FID     0x01
+#define UVC_HDR_EOF     0x02
+#define UVC_HDR_PTS     0x04
+#define UVC_HDR_SCR     0x08
+#define UVC_HDR_ERR     0x40
+#define UVC_HDR_EOH     0x80
+
+typedef struct {
+    int length;                 // HLE, header bytes before the payload
+    uint8_t flags;              // BFH
+    int has_pts;
+    int has_scr;
+    uint32_t pts;               // device clock when the frame's capture began
+    uint32_t scr_stc;           // device clock when this payload was sent
+    uint16_t scr_sof;           // 11-bit USB frame number, same moment
+} UvcPayloadHeader;
+
+// Returns -1 if the header is malformed or shorter than its flags require
+int uvc_header_parse(const uint8_t *p, int len, UvcPayloadHeader *h);
+
+// Maps the device clock (PTS/SCR ticks) to CLOCK_MONOTONIC. Every SCR is a
+// (device ticks, host time) pair; the host time is when the packet
+// carrying it was reaped, so it is late by a varying amount and never
+// early. The model is
+//
+//   host = first_host + ns_per_tick * (ticks - first_ticks) + offset
+//
+// with ns_per_tick from dwClockFrequency, or, when that is unknown
+// (replay), fitted over the whole run so far (the baseline only grows,
+// so host jitter matters less and less). offset is the lower envelope of
+// the recent samples: the pair that arrived with the least delay.
+// The SOF part of the SCR is not used.
+
+#define UVC_CLOCK_WINDOW        32              // recent samples for the offset
+#define UVC_CLOCK_SAMPLE_NS     10000000ull     // at most one sample per 10 ms
+#define UVC_CLOCK_MIN_SPAN_NS   250000000ull    // before fitting the frequency
+
+typedef struct {
+    uint32_t clock_hz;          // dwClockFrequency, 0 if unknown
+    double ns_per_tick;         // 0 until known or fitted
+
+    // Device clock, extended past its 32-bit wrap
+    uint32_t last_raw;
+    int64_t ticks;              // last_raw, relative to the first sample
+
+    uint64_t first_host;
+    int64_t last_ticks;         // newest sample, for the fit
+    uint64_t last_host;
+
+    int64_t win_ticks[UVC_CLOCK_WINDOW];
+    uint64_t win_host[UVC_CLOCK_WINDOW];
+    int win_count;
+    int win_next;
+    double offset_ns;
+
+    uint64_t samples;
+} UvcClock;
+
+void uvc_clock_init(UvcClock *c, uint32_t clock_hz);
+void uvc_clock_add_scr(UvcClock *c, uint32_t stc, uint64_t host_ns);
+
+// A PTS (same device clock) on CLOCK_MONOTONIC; 0 while the model has too
+// little to go on
+uint64_t uvc_clock_to_host(const UvcClock *c, uint32_t pts);
+
+// Device clock frequency, given or fitted; 0 if not known yet
+double uvc_clock_frequency(const UvcClock *c);
+
+#endif // UVC_CLOCK_H
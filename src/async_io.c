@@ -0,0 +1,358 @@
+#define _GNU_SOURCE     // fallocate()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/falloc.h>
+#include <linux/io_uring.h>
+#include "async_io.h"
+#include "log.h"
+
+#define SLOT_MASK   (ASYNC_IO_SLOTS - 1)
+
+static uint64_t async_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// --- Completion (either backend) ---
+
+static void complete(AsyncIo *io, AsyncRequest *r, long res) {
+    if (r->op != ASYNC_OP_STOP) {
+        uint64_t dt = async_now_ns() - r->submit_ns;
+        atomic_fetch_add_explicit(&io->latency_total_ns, dt, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&io->latency_max_ns, memory_order_relaxed);
+        while (dt > max && !atomic_compare_exchange_weak(&io->latency_max_ns, &max, dt)) {}
+        if (res < 0) {
+            atomic_fetch_add_explicit(&io->errors, 1, memory_order_relaxed);
+            LOG_ERROR("async_io: %s failed: %s", r->op == ASYNC_OP_WRITE ? "write" : "zero", strerror((int)-res));
+        }
+        else if (r->op == ASYNC_OP_WRITE) {
+            atomic_fetch_add_explicit(&io->bytes, r->length, memory_order_relaxed);
+        }
+        atomic_fetch_add_explicit(&io->completed, 1, memory_order_relaxed);
+    }
+    atomic_store_explicit(&r->done, 1, memory_order_release);
+
+    pthread_mutex_lock(&io->lock);
+    pthread_cond_broadcast(&io->cond);
+    pthread_mutex_unlock(&io->lock);
+}
+
+// pwrite() until done; returns bytes written or -errno
+static long write_rest(const AsyncRequest *r, uint64_t done) {
+    while (done < r->length) {
+        ssize_t n = pwrite(r->fd, r->data + done, r->length - done, r->offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -errno;
+        }
+        done += n;
+    }
+    return (long)done;
+}
+
+static long run_request(const AsyncRequest *r) {
+    if (r->op == ASYNC_OP_WRITE) return write_rest(r, 0);
+    if (fallocate(r->fd, FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE, r->offset, r->length) < 0) return -errno;
+    return 0;
+}
+
+// --- Thread backend: one writer, requests in queue order ---
+
+static void *writer_thread(void *arg) {
+    AsyncIo *io = arg;
+    uint32_t next = 0;
+    for (;;) {
+        pthread_mutex_lock(&io->lock);
+        while (next == io->published) pthread_cond_wait(&io->cond, &io->lock);
+        pthread_mutex_unlock(&io->lock);
+
+        AsyncRequest *r = &io->slots[next++ & SLOT_MASK];
+        if (r->op == ASYNC_OP_STOP) {
+            complete(io, r, 0);
+            break;
+        }
+        complete(io, r, run_request(r));
+    }
+    return NULL;
+}
+
+// --- io_uring backend ---
+
+static long uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_setup(AsyncIo *io) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = (int)syscall(__NR_io_uring_setup, ASYNC_IO_SLOTS, &p);
+    if (fd < 0) return -1;
+
+    // IORING_OP_WRITE and IORING_OP_FALLOCATE came with 5.6, as did this flag
+    if (!(p.features & IORING_FEAT_RW_CUR_POS)) {
+        close(fd);
+        return -1;
+    }
+
+    io->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    io->cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    int single = p.features & IORING_FEAT_SINGLE_MMAP;
+    if (single && io->cq_ring_size > io->sq_ring_size) io->sq_ring_size = io->cq_ring_size;
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_SQ_RING);
+    io->cq_ring = single ? io->sq_ring :
+                  mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       fd, IORING_OFF_CQ_RING);
+    io->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQES);
+    if (io->sq_ring == MAP_FAILED || io->cq_ring == MAP_FAILED || io->sqes == MAP_FAILED) {
+        LOG_WARN("async_io: io_uring mmap failed, using the writer thread");
+        if (io->sqes != MAP_FAILED) munmap(io->sqes, io->sqes_size);
+        if (!single && io->cq_ring != MAP_FAILED) munmap(io->cq_ring, io->cq_ring_size);
+        if (io->sq_ring != MAP_FAILED) munmap(io->sq_ring, io->sq_ring_size);
+        close(fd);
+        return -1;
+    }
+    if (single) io->cq_ring_size = 0;   // one mapping, unmapped once
+
+    uint8_t *sq = io->sq_ring, *cq = io->cq_ring;
+    io->sq_tail = (_Atomic uint32_t *)(sq + p.sq_off.tail);
+    io->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+    io->sq_array = (uint32_t *)(sq + p.sq_off.array);
+    io->cq_head = (_Atomic uint32_t *)(cq + p.cq_off.head);
+    io->cq_tail = (_Atomic uint32_t *)(cq + p.cq_off.tail);
+    io->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    io->ring_fd = fd;
+    return 0;
+}
+
+static void uring_submit(AsyncIo *io, const AsyncRequest *r, uint32_t slot) {
+    uint32_t tail = atomic_load_explicit(io->sq_tail, memory_order_relaxed);
+    uint32_t idx = tail & io->sq_mask;
+    struct io_uring_sqe *sqe = &io->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->fd = r->fd;
+    sqe->off = r->offset;
+    switch (r->op) {
+    case ASYNC_OP_WRITE:
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->addr = (uintptr_t)r->data;
+        sqe->len = (uint32_t)r->length;
+        break;
+    case ASYNC_OP_ZERO:
+        sqe->opcode = IORING_OP_FALLOCATE;     // len carries the mode, addr the length
+        sqe->addr = r->length;
+        sqe->len = FALLOC_FL_ZERO_RANGE | FALLOC_FL_KEEP_SIZE;
+        break;
+    case ASYNC_OP_STOP:
+        sqe->opcode = IORING_OP_NOP;
+        break;
+    }
+    if (r->ordered) sqe->flags = IOSQE_IO_DRAIN;
+    sqe->user_data = slot;
+
+    io->sq_array[idx] = idx;
+    atomic_store_explicit(io->sq_tail, tail + 1, memory_order_release);
+    while (uring_enter(io->ring_fd, 1, 0, 0) < 0 && errno == EINTR) {}
+}
+
+static void *completion_thread(void *arg) {
+    AsyncIo *io = arg;
+    int stop = 0;
+    while (!stop) {
+        if (uring_enter(io->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) {
+            LOG_ERROR("async_io: io_uring_enter: %s", strerror(errno));
+            break;
+        }
+        uint32_t head = atomic_load_explicit(io->cq_head, memory_order_relaxed);
+        uint32_t tail = atomic_load_explicit(io->cq_tail, memory_order_acquire);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &io->cqes[head & io->cq_mask];
+            AsyncRequest *r = &io->slots[cqe->user_data & SLOT_MASK];
+            long res = cqe->res;
+            if (r->op == ASYNC_OP_STOP) stop = 1;
+            // Short writes are rare (disk full, signals); finish them here
+            else if (r->op == ASYNC_OP_WRITE && res >= 0 && (uint64_t)res < r->length) res = write_rest(r, res);
+            complete(io, r, res);
+        }
+        atomic_store_explicit(io->cq_head, head, memory_order_release);
+    }
+    return NULL;
+}
+
+// --- Queueing (submitting thread only) ---
+
+static void reclaim(AsyncIo *io) {
+    while (io->tail != io->head) {
+        AsyncRequest *r = &io->slots[io->tail & SLOT_MASK];
+        if (!atomic_load_explicit(&r->done, memory_order_acquire)) break;
+        io->staging_tail += r->staged;
+        io->tail++;
+    }
+}
+
+static size_t staging_pad(const AsyncIo *io, size_t len) {
+    size_t pos = io->staging_head % io->staging_size;
+    return pos + len > io->staging_size ? io->staging_size - pos : 0;
+}
+
+static int fits(const AsyncIo *io, size_t len, int requests) {
+    size_t used = io->staging_head - io->staging_tail;
+    return io->head - io->tail + requests <= ASYNC_IO_SLOTS &&
+           used + staging_pad(io, len) + len <= io->staging_size;
+}
+
+// Wait until the oldest request completes
+static void wait_oldest(AsyncIo *io) {
+    AsyncRequest *r = &io->slots[io->tail & SLOT_MASK];
+    pthread_mutex_lock(&io->lock);
+    while (!atomic_load_explicit(&r->done, memory_order_acquire)) pthread_cond_wait(&io->cond, &io->lock);
+    pthread_mutex_unlock(&io->lock);
+}
+
+// Next slot, with len contiguous staging bytes (data may not wrap)
+static AsyncRequest *reserve(AsyncIo *io, size_t len) {
+    if (len > io->staging_size) return NULL;
+    for (reclaim(io); !fits(io, len, 1); reclaim(io)) wait_oldest(io);
+
+    AsyncRequest *r = &io->slots[io->head & SLOT_MASK];
+    size_t pad = staging_pad(io, len);
+    r->data = io->staging + (pad ? 0 : io->staging_head % io->staging_size);
+    r->staged = pad + len;
+    r->length = len;
+    io->staging_head += r->staged;
+    size_t used = io->staging_head - io->staging_tail;
+    if (used > io->queued_max) io->queued_max = used;
+    atomic_store_explicit(&r->done, 0, memory_order_relaxed);
+    return r;
+}
+
+static void submit(AsyncIo *io, AsyncRequest *r) {
+    uint32_t slot = io->head++;
+    r->submit_ns = async_now_ns();
+    if (io->backend == ASYNC_IO_URING) {
+        uring_submit(io, r, slot);
+        return;
+    }
+    pthread_mutex_lock(&io->lock);
+    io->published = io->head;
+    pthread_cond_broadcast(&io->cond);
+    pthread_mutex_unlock(&io->lock);
+}
+
+int async_io_write(AsyncIo *io, int fd, uint64_t offset, const struct iovec *iov, int n, int ordered) {
+    size_t len = 0;
+    for (int i = 0; i < n; i++) len += iov[i].iov_len;
+
+    AsyncRequest *r = reserve(io, len);
+    if (!r) return -1;
+    uint8_t *dst = r->data;
+    for (int i = 0; i < n; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+    r->op = ASYNC_OP_WRITE;
+    r->fd = fd;
+    r->offset = offset;
+    r->ordered = ordered;
+    submit(io, r);
+    return 0;
+}
+
+static int queue_op(AsyncIo *io, AsyncOp op, int fd, uint64_t length) {
+    AsyncRequest *r = reserve(io, 0);
+    r->op = op;
+    r->fd = fd;
+    r->offset = 0;
+    r->length = length;
+    r->ordered = 1;
+    submit(io, r);
+    return 0;
+}
+
+int async_io_zero(AsyncIo *io, int fd, uint64_t length) {
+    return queue_op(io, ASYNC_OP_ZERO, fd, length);
+}
+
+int async_io_can_queue(AsyncIo *io, size_t bytes, int requests) {
+    reclaim(io);
+    return fits(io, bytes, requests);
+}
+
+size_t async_io_queued_bytes(AsyncIo *io) {
+    reclaim(io);
+    return io->staging_head - io->staging_tail;
+}
+
+void async_io_wait_idle(AsyncIo *io) {
+    for (reclaim(io); io->tail != io->head; reclaim(io)) wait_oldest(io);
+}
+
+// --- Setup ---
+
+int async_io_init(AsyncIo *io, size_t staging_size) {
+    memset(io, 0, sizeof(*io));
+    io->ring_fd = -1;
+    io->staging_size = staging_size;
+    io->staging = malloc(staging_size);
+    if (!io->staging) {
+        LOG_ERROR("async_io_init: out of memory");
+        return -1;
+    }
+    pthread_mutex_init(&io->lock, NULL);
+    pthread_cond_init(&io->cond, NULL);
+
+    const char *env = getenv("UVC_NO_IO_URING");
+    int use_uring = !(env && env[0] == '1') && uring_setup(io) == 0;
+    io->backend = use_uring ? ASYNC_IO_URING : ASYNC_IO_THREAD;
+    if (pthread_create(&io->thread, NULL, use_uring ? completion_thread : writer_thread, io) != 0) {
+        LOG_ERROR("async_io_init: failed to create thread");
+        return -1;
+    }
+    return 0;
+}
+
+void async_io_destroy(AsyncIo *io) {
+    if (!io->staging) return;
+    queue_op(io, ASYNC_OP_STOP, -1, 0);     // ordered: runs after everything queued
+    pthread_join(io->thread, NULL);
+    reclaim(io);
+
+    if (io->ring_fd >= 0) {
+        munmap(io->sqes, io->sqes_size);
+        if (io->cq_ring_size) munmap(io->cq_ring, io->cq_ring_size);
+        munmap(io->sq_ring, io->sq_ring_size);
+        close(io->ring_fd);
+        io->ring_fd = -1;
+    }
+    pthread_mutex_destroy(&io->lock);
+    pthread_cond_destroy(&io->cond);
+    free(io->staging);
+    io->staging = NULL;
+}
+
+const char *async_io_backend_name(const AsyncIo *io) {
+    return io->backend == ASYNC_IO_URING ? "io_uring" : "thread";
+}
+
+void async_io_print_stats(AsyncIo *io, const char *name) {
+    uint64_t n = atomic_load(&io->completed);
+    printf("[AsyncIO %s] %s: %llu requests, %.1f MB, %llu errors, latency avg %.2f ms max %.2f ms, "
+           "queued %.1f MB (max %.1f of %.1f MB)\n",
+           name, async_io_backend_name(io), (unsigned long long)n, atomic_load(&io->bytes) / 1e6,
+           (unsigned long long)atomic_load(&io->errors),
+           n ? atomic_load(&io->latency_total_ns) / 1e6 / n : 0.0, atomic_load(&io->latency_max_ns) / 1e6,
+           async_io_queued_bytes(io) / 1e6, io->queued_max / 1e6, io->staging_size / 1e6);
+}
@@ -0,0 +1,48 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "cpu_features.h"
+
+static unsigned detect_features(void) {
+    unsigned f = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))  f |= CPU_FEATURE_SSE2;
+    if (__builtin_cpu_supports("ssse3")) f |= CPU_FEATURE_SSSE3;
+    if (__builtin_cpu_supports("avx2"))  f |= CPU_FEATURE_AVX2;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    f |= CPU_FEATURE_NEON;
+#endif
+
+    const char *env = getenv("UVC_NO_SIMD");
+    if (env && strcmp(env, "0") != 0) f = 0;
+
+    return f;
+}
+
+static pthread_once_t g_features_once = PTHREAD_ONCE_INIT;
+static unsigned g_features;
+
+static void init_features(void) {
+    g_features = detect_features();
+}
+
+unsigned cpu_features(void) {
+    pthread_once(&g_features_once, init_features);
+    return g_features;
+}
+
+const char *cpu_features_string(void) {
+    static char buf[64];
+    unsigned f = cpu_features();
+
+    buf[0] = '\0';
+    if (f & CPU_FEATURE_SSE2)  strcat(buf, "sse2 ");
+    if (f & CPU_FEATURE_SSSE3) strcat(buf, "ssse3 ");
+    if (f & CPU_FEATURE_AVX2)  strcat(buf, "avx2 ");
+    if (f & CPU_FEATURE_NEON)  strcat(buf, "neon ");
+    if (!f) strcpy(buf, "scalar");
+    else buf[strlen(buf) - 1] = '\0';
+    return buf;
+}
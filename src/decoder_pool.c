@@ -0,0 +1,176 @@
+#define _GNU_SOURCE     // pthread_setaffinity_np()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "decoder_pool.h"
+#include "frame_pool.h"
+#include "log.h"
+#include "trace.h"
+
+static uint64_t decoder_pool_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Called with the lock held by the worker that found nobody delivering;
+// the callback itself runs unlocked, so other workers keep completing
+static void deliver_ready(DecoderPool *p) {
+    p->delivering = 1;
+    for (;;) {
+        DecoderPoolSlot *slot = &p->slots[p->next_deliver % p->max_in_flight];
+        if (p->next_deliver == p->next_ticket || !slot->done) break;
+        Frame *f = slot->frame;
+        int ret = slot->ret;
+        slot->frame = NULL;
+        slot->done = 0;
+        p->next_deliver++;
+        pthread_cond_signal(&p->space);
+
+        pthread_mutex_unlock(&p->lock);
+        p->deliver(f, ret, p->ctx);
+        pthread_mutex_lock(&p->lock);
+    }
+    p->delivering = 0;
+}
+
+static void complete(DecoderPool *p, DecoderPoolSlot *slot, int ret) {
+    pthread_mutex_lock(&p->lock);
+    slot->ret = ret;
+    slot->done = 1;
+    if (slot != &p->slots[p->next_deliver % p->max_in_flight]) {
+        // An older frame is still decoding: this one waits for it
+        p->held++;
+        int held = 0;
+        for (uint64_t t = p->next_deliver; t < p->next_ticket; t++) held += p->slots[t % p->max_in_flight].done;
+        if (held > p->max_held) p->max_held = held;
+    }
+    if (!p->delivering) deliver_ready(p);
+    pthread_mutex_unlock(&p->lock);
+}
+
+static void *worker_run(void *arg) {
+    DecoderPoolWorker *w = arg;
+    DecoderPool *p = w->pool;
+
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOG_WARN("decoder_pool: worker %d: cannot pin to CPU %d", w->index, w->cpu);
+        }
+    }
+
+    DecoderPoolSlot *slot;
+    while ((slot = frame_queue_pop(&p->jobs)) != NULL) {
+        Frame *f = slot->frame;
+        if (f->duplicate) {
+            complete(p, slot, 0);   // only keeps its place in the order
+            continue;
+        }
+        uint64_t t0 = decoder_pool_now_ns();
+        int ret = jpeg_decoder_decode(&w->decoder, f, p->format);
+        f->decoded_ns = decoder_pool_now_ns();
+        trace_event(TRACE_FRAME_DECODED, f->seq, f->decoded_ns - t0);
+        frame_jpeg_done(f);         // URBs can go back to the kernel now
+        complete(p, slot, ret);
+    }
+    return NULL;
+}
+
+int decoder_pool_start(DecoderPool *p, int num_workers, int max_in_flight, int first_cpu,
+                       FrameFormat format, DecoderPoolDeliverFn deliver, void *ctx) {
+    memset(p, 0, sizeof(*p));
+    if (num_workers < 1) num_workers = 1;
+    if (num_workers > DECODER_POOL_MAX_WORKERS) num_workers = DECODER_POOL_MAX_WORKERS;
+    if (max_in_flight < num_workers) max_in_flight = num_workers;
+    p->format = format;
+    p->deliver = deliver;
+    p->ctx = ctx;
+    p->max_in_flight = max_in_flight;
+
+    p->slots = calloc(max_in_flight, sizeof(DecoderPoolSlot));
+    if (!p->slots) return -1;
+    if (frame_queue_init(&p->jobs, "decode jobs", max_in_flight) < 0) return -1;
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->space, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    for (int i = 0; i < num_workers; i++) {
+        DecoderPoolWorker *w = &p->workers[i];
+        w->pool = p;
+        w->index = i;
+        w->cpu = first_cpu >= 0 ? (int)((first_cpu + i) % cpus) : -1;
+        if (jpeg_decoder_init(&w->decoder) < 0) return -1;
+        if (pthread_create(&w->thread, NULL, worker_run, w) != 0) {
+            LOG_ERROR("decoder_pool_start: failed to create worker %d", i);
+            jpeg_decoder_destroy(&w->decoder);
+            return -1;
+        }
+        p->num_workers++;
+    }
+    return 0;
+}
+
+int decoder_pool_submit(DecoderPool *p, Frame *f) {
+    pthread_mutex_lock(&p->lock);
+    if (p->next_ticket - p->next_deliver == (uint64_t)p->max_in_flight) {
+        uint64_t t0 = decoder_pool_now_ns();
+        while (p->next_ticket - p->next_deliver == (uint64_t)p->max_in_flight) {
+            pthread_cond_wait(&p->space, &p->lock);
+        }
+        p->submit_stall_ns += decoder_pool_now_ns() - t0;
+    }
+    DecoderPoolSlot *slot = &p->slots[p->next_ticket % p->max_in_flight];
+    slot->frame = f;
+    slot->done = 0;
+    p->next_ticket++;
+    int in_flight = (int)(p->next_ticket - p->next_deliver);
+    if (in_flight > p->max_in_flight_seen) p->max_in_flight_seen = in_flight;
+    pthread_mutex_unlock(&p->lock);
+
+    // Never full: the queue holds max_in_flight and so many slots are out at most
+    return frame_queue_push(&p->jobs, slot);
+}
+
+void decoder_pool_stop(DecoderPool *p) {
+    if (!p->slots) return;
+    // The workers drain the jobs first; the last to finish delivers what is left
+    frame_queue_close(&p->jobs);
+    for (int i = 0; i < p->num_workers; i++) {
+        pthread_join(p->workers[i].thread, NULL);
+        jpeg_decoder_destroy(&p->workers[i].decoder);
+    }
+    frame_queue_destroy(&p->jobs);
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->space);
+    free(p->slots);
+    p->slots = NULL;
+}
+
+void decoder_pool_print_stats(const DecoderPool *p, const char *name) {
+    JpegDecoder sum;
+    memset(&sum, 0, sizeof(sum));
+    char per_worker[16 * DECODER_POOL_MAX_WORKERS] = "";
+    size_t len = 0;
+    for (int i = 0; i < p->num_workers; i++) {
+        const JpegDecoder *d = &p->workers[i].decoder;
+        sum.frames += d->frames;
+        sum.errors += d->errors;
+        sum.total_ns += d->total_ns;
+        if (d->max_ns > sum.max_ns) sum.max_ns = d->max_ns;
+        len += snprintf(per_worker + len, sizeof(per_worker) - len, i ? "/%llu" : "%llu",
+                        (unsigned long long)d->frames);
+    }
+    jpeg_decoder_print_stats(&sum, name);
+    printf("[Decoder pool] %d workers%s, frames per worker %s, %d of %d in flight max, "
+           "%llu finished ahead of an older frame (%d held max), submit stalled %.1f ms\n",
+           p->num_workers, p->workers[0].cpu >= 0 ? " pinned" : "", per_worker,
+           p->max_in_flight_seen, p->max_in_flight, (unsigned long long)p->held, p->max_held,
+           p->submit_stall_ns / 1e6);
+}
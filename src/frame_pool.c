@@ -0,0 +1,176 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "frame_pool.h"
+#include "image_processing.h"
+
+static uint64_t pool_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int frame_pool_init(FramePool *pool, int count, int jpeg_capacity, PoolPolicy policy) {
+    memset(pool, 0, sizeof(FramePool));
+
+    pool->frames = calloc(count, sizeof(Frame));
+    if (!pool->frames) goto fail;
+    if (jpeg_capacity > 0) {
+        pool->jpeg_storage = malloc((size_t)count * jpeg_capacity);
+        if (!pool->jpeg_storage) goto fail;
+    }
+    if (frame_queue_init(&pool->free_list, "pool", count) < 0) goto fail;
+
+    pool->count = count;
+    pool->jpeg_capacity = jpeg_capacity;
+    pool->policy = policy;
+    pthread_mutex_init(&pool->reserve_lock, NULL);
+
+    for (int i = 0; i < count; i++) {
+        Frame *f = &pool->frames[i];
+        f->pool = pool;
+        f->jpeg = pool->jpeg_storage ? pool->jpeg_storage + (size_t)i * jpeg_capacity : NULL;
+        f->jpeg_capacity = jpeg_capacity;
+        atomic_init(&f->refs, 0);
+        frame_queue_try_push(&pool->free_list, f);
+    }
+    return 0;
+
+fail:
+    printf("frame_pool_init: out of memory (%d frames)\n", count);
+    frame_pool_destroy(pool);
+    return -1;
+}
+
+void frame_pool_destroy(FramePool *pool) {
+    frame_queue_destroy(&pool->free_list);
+    free(pool->frames);
+    free(pool->jpeg_storage);
+    free(pool->pixel_storage);
+    pool->frames = NULL;
+    pool->jpeg_storage = NULL;
+    pool->pixel_storage = NULL;
+}
+
+void frame_pool_set_victim(FramePool *pool, FrameQueue *victim) {
+    pool->victim = victim;
+}
+
+int frame_pool_reserve_pixels(FramePool *pool, size_t bytes) {
+    int ret = 0;
+
+    // Every frame's pixels start on an IMAGE_ALIGN boundary
+    bytes = (bytes + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+
+    pthread_mutex_lock(&pool->reserve_lock);
+    if (!pool->pixel_storage) {
+        pool->pixel_storage = aligned_alloc(IMAGE_ALIGN, (size_t)pool->count * bytes);
+        if (pool->pixel_storage) {
+            pool->pixel_capacity = bytes;
+            for (int i = 0; i < pool->count; i++) {
+                pool->frames[i].pixels = pool->pixel_storage + (size_t)i * bytes;
+            }
+        }
+    }
+    if (bytes > pool->pixel_capacity) ret = -1;
+    pthread_mutex_unlock(&pool->reserve_lock);
+
+    return ret;
+}
+
+Frame *frame_pool_acquire(FramePool *pool) {
+    Frame *f = frame_queue_try_pop(&pool->free_list);
+
+    if (!f) {
+        switch (pool->policy) {
+        case POOL_DROP_NEWEST:
+            atomic_fetch_add_explicit(&pool->dropped_newest, 1, memory_order_relaxed);
+            return NULL;
+
+        case POOL_DROP_OLDEST:
+            while (!f) {
+                Frame *old = pool->victim ? frame_queue_try_pop(pool->victim) : NULL;
+                if (!old) {
+                    // Everything is past the victim queue (being decoded/encoded)
+                    atomic_fetch_add_explicit(&pool->dropped_newest, 1, memory_order_relaxed);
+                    return NULL;
+                }
+                atomic_fetch_add_explicit(&pool->dropped_oldest, 1, memory_order_relaxed);
+                frame_release(old);
+                f = frame_queue_try_pop(&pool->free_list);
+            }
+            break;
+
+        case POOL_BLOCK: {
+            uint64_t t0 = pool_now_ns();
+            atomic_fetch_add_explicit(&pool->blocked, 1, memory_order_relaxed);
+            f = frame_queue_pop(&pool->free_list);
+            atomic_fetch_add_explicit(&pool->block_ns, pool_now_ns() - t0, memory_order_relaxed);
+            if (!f) return NULL;
+            break;
+        }
+        }
+    }
+
+    atomic_store_explicit(&f->refs, 1, memory_order_relaxed);
+    atomic_store_explicit(&f->jpeg_readers, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pool->acquired, 1, memory_order_relaxed);
+    return f;
+}
+
+void frame_ref(Frame *f) {
+    atomic_fetch_add_explicit(&f->refs, 1, memory_order_relaxed);
+}
+
+void frame_add_jpeg_reader(Frame *f) {
+    atomic_fetch_add_explicit(&f->jpeg_readers, 1, memory_order_relaxed);
+}
+
+void frame_jpeg_done(Frame *f) {
+    if (atomic_fetch_sub_explicit(&f->jpeg_readers, 1, memory_order_acq_rel) == 1) {
+        slice_list_release(&f->slices);
+    }
+}
+
+void frame_release(Frame *f) {
+    if (!f) return;
+    if (atomic_fetch_sub_explicit(&f->refs, 1, memory_order_acq_rel) != 1) return;
+
+    slice_list_release(&f->slices);
+    f->seq = 0;
+    f->capture_ns = f->assembled_ns = f->decoded_ns = f->written_ns = 0;
+    f->duplicate = 0;
+    f->jpeg_size = 0;
+    f->width = 0;
+    f->height = 0;
+    frame_queue_push(&f->pool->free_list, f);
+}
+
+const char *frame_pool_policy_name(PoolPolicy policy) {
+    switch (policy) {
+    case POOL_DROP_OLDEST: return "drop-oldest";
+    case POOL_DROP_NEWEST: return "drop-newest";
+    case POOL_BLOCK:       return "block";
+    }
+    return "?";
+}
+
+int frame_pool_parse_policy(const char *name, PoolPolicy *policy) {
+    if (strcmp(name, "drop-oldest") == 0) *policy = POOL_DROP_OLDEST;
+    else if (strcmp(name, "drop-newest") == 0) *policy = POOL_DROP_NEWEST;
+    else if (strcmp(name, "block") == 0) *policy = POOL_BLOCK;
+    else return -1;
+    return 0;
+}
+
+void frame_pool_print_stats(FramePool *pool) {
+    printf("[Pool] %d frames, policy %s: acquired %llu, dropped oldest %llu, "
+           "dropped newest %llu, blocked %llu (%.1f ms)\n",
+           pool->count, frame_pool_policy_name(pool->policy),
+           (unsigned long long)atomic_load(&pool->acquired),
+           (unsigned long long)atomic_load(&pool->dropped_oldest),
+           (unsigned long long)atomic_load(&pool->dropped_newest),
+           (unsigned long long)atomic_load(&pool->blocked),
+           atomic_load(&pool->block_ns) / 1e6);
+}
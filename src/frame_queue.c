@@ -0,0 +1,223 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+#include "frame_queue.h"
+
+static uint64_t queue_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Spin briefly, then yield; returns 0 once the caller should sleep instead
+static int queue_backoff(int attempt) {
+    if (attempt < 64) return 1;
+    if (attempt < 128) {
+        sched_yield();
+        return 1;
+    }
+    return 0;
+}
+
+static int queue_full(FrameQueue *q) {
+    return frame_queue_depth(q) > q->mask;
+}
+
+// Sleeps until a waiting pop (want_item) may find an item, a waiting push
+// may find room, or the queue is closed, so an idle stage costs nothing.
+// Whoever changes the queue wakes sleepers only if it sees one registered
+// (queue_wake()); the fences on both sides ensure that either the sleeper
+// sees the change or the changer sees the sleeper. The check is redone
+// under the lock the waker takes, so no wakeup is lost in between.
+static void queue_park(FrameQueue *q, int want_item) {
+    atomic_int *waiters = want_item ? &q->pop_waiters : &q->push_waiters;
+    pthread_cond_t *cond = want_item ? &q->not_empty : &q->not_full;
+
+    pthread_mutex_lock(&q->lock);
+    atomic_fetch_add_explicit(waiters, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (!atomic_load_explicit(&q->closed, memory_order_acquire) &&
+           (want_item ? frame_queue_depth(q) == 0 : queue_full(q))) {
+        pthread_cond_wait(cond, &q->lock);
+    }
+    atomic_fetch_sub_explicit(waiters, 1, memory_order_relaxed);
+    pthread_mutex_unlock(&q->lock);
+}
+
+static void queue_wake(FrameQueue *q, atomic_int *waiters, pthread_cond_t *cond, int all) {
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(waiters, memory_order_relaxed) == 0) return;
+    pthread_mutex_lock(&q->lock);
+    if (all) pthread_cond_broadcast(cond);
+    else pthread_cond_signal(cond);
+    pthread_mutex_unlock(&q->lock);
+}
+
+int frame_queue_init(FrameQueue *q, const char *name, size_t capacity) {
+    memset(q, 0, sizeof(FrameQueue));
+
+    size_t cap = 2;
+    while (cap < capacity) cap <<= 1;
+
+    q->cells = malloc(cap * sizeof(FrameQueueCell));
+    if (!q->cells) {
+        printf("frame_queue_init: out of memory\n");
+        return -1;
+    }
+    for (size_t i = 0; i < cap; i++) {
+        atomic_init(&q->cells[i].seq, i);
+        q->cells[i].item = NULL;
+    }
+
+    q->mask = cap - 1;
+    q->name = name;
+    atomic_init(&q->enqueue_pos, 0);
+    atomic_init(&q->dequeue_pos, 0);
+    atomic_init(&q->closed, 0);
+    atomic_init(&q->pop_waiters, 0);
+    atomic_init(&q->push_waiters, 0);
+    pthread_mutex_init(&q->lock, NULL);
+    pthread_cond_init(&q->not_empty, NULL);
+    pthread_cond_init(&q->not_full, NULL);
+    return 0;
+}
+
+void frame_queue_destroy(FrameQueue *q) {
+    if (!q->cells) return;
+    free(q->cells);
+    q->cells = NULL;
+    pthread_mutex_destroy(&q->lock);
+    pthread_cond_destroy(&q->not_empty);
+    pthread_cond_destroy(&q->not_full);
+}
+
+static int queue_try_push(FrameQueue *q, void *item) {
+    FrameQueueCell *cell;
+    size_t pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->enqueue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return -1;  // Full
+        }
+        else {
+            pos = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+        }
+    }
+
+    cell->item = item;
+    atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+    queue_wake(q, &q->pop_waiters, &q->not_empty, 0);
+
+    atomic_fetch_add_explicit(&q->pushes, 1, memory_order_relaxed);
+    size_t depth = frame_queue_depth(q);
+    size_t max = atomic_load_explicit(&q->max_depth, memory_order_relaxed);
+    while (depth > max &&
+           !atomic_compare_exchange_weak_explicit(&q->max_depth, &max, depth,
+                                                  memory_order_relaxed, memory_order_relaxed)) {}
+    return 0;
+}
+
+int frame_queue_try_push(FrameQueue *q, void *item) {
+    if (queue_try_push(q, item) == 0) return 0;
+    atomic_fetch_add_explicit(&q->push_full, 1, memory_order_relaxed);
+    return -1;
+}
+
+void *frame_queue_try_pop(FrameQueue *q) {
+    FrameQueueCell *cell;
+    size_t pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+
+    for (;;) {
+        cell = &q->cells[pos & q->mask];
+        size_t seq = atomic_load_explicit(&cell->seq, memory_order_acquire);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&q->dequeue_pos, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        }
+        else if (diff < 0) {
+            return NULL;    // Empty
+        }
+        else {
+            pos = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+        }
+    }
+
+    void *item = cell->item;
+    atomic_store_explicit(&cell->seq, pos + q->mask + 1, memory_order_release);
+    queue_wake(q, &q->push_waiters, &q->not_full, 0);
+    return item;
+}
+
+int frame_queue_push(FrameQueue *q, void *item) {
+    if (frame_queue_try_push(q, item) == 0) return 0;
+
+    uint64_t t0 = queue_now_ns();
+    int attempt = 0;
+    int ret = 0;
+    while (queue_try_push(q, item) < 0) {
+        if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            ret = -1;
+            break;
+        }
+        if (!queue_backoff(attempt++)) queue_park(q, 0);
+    }
+    atomic_fetch_add_explicit(&q->push_stall_ns, queue_now_ns() - t0, memory_order_relaxed);
+    return ret;
+}
+
+void *frame_queue_pop(FrameQueue *q) {
+    void *item = frame_queue_try_pop(q);
+    if (item) return item;
+
+    uint64_t t0 = queue_now_ns();
+    int attempt = 0;
+    while ((item = frame_queue_try_pop(q)) == NULL) {
+        if (atomic_load_explicit(&q->closed, memory_order_acquire)) {
+            // Closed: one last look in case a push raced with close
+            item = frame_queue_try_pop(q);
+            break;
+        }
+        if (!queue_backoff(attempt++)) queue_park(q, 1);
+    }
+    atomic_fetch_add_explicit(&q->pop_stall_ns, queue_now_ns() - t0, memory_order_relaxed);
+    return item;
+}
+
+void frame_queue_close(FrameQueue *q) {
+    atomic_store_explicit(&q->closed, 1, memory_order_release);
+    queue_wake(q, &q->pop_waiters, &q->not_empty, 1);
+    queue_wake(q, &q->push_waiters, &q->not_full, 1);
+}
+
+size_t frame_queue_depth(FrameQueue *q) {
+    size_t head = atomic_load_explicit(&q->dequeue_pos, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&q->enqueue_pos, memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+}
+
+void frame_queue_print_stats(FrameQueue *q) {
+    printf("[Queue %-7s] depth %zu/%zu (max %zu), pushes %llu, full %llu, "
+           "push stall %.1f ms, pop stall %.1f ms\n",
+           q->name, frame_queue_depth(q), q->mask + 1,
+           (size_t)atomic_load(&q->max_depth),
+           (unsigned long long)atomic_load(&q->pushes),
+           (unsigned long long)atomic_load(&q->push_full),
+           atomic_load(&q->push_stall_ns) / 1e6,
+           atomic_load(&q->pop_stall_ns) / 1e6);
+}
@@ -0,0 +1,130 @@
+#include <string.h>
+#include <stdio.h>
+#include <jerror.h>
+#include "frame_slices.h"
+
+void urb_ref_init(URBRef *ref, struct usbdevfs_urb *urb, void (*recycle)(URBRef *), void *ctx) {
+    ref->urb = urb;
+    ref->recycle = recycle;
+    ref->ctx = ctx;
+    atomic_init(&ref->refs, 0);
+    urb->usercontext = ref;
+}
+
+void urb_ref_get(URBRef *ref) {
+    atomic_fetch_add_explicit(&ref->refs, 1, memory_order_relaxed);
+}
+
+void urb_ref_put(URBRef *ref) {
+    if (atomic_fetch_sub_explicit(&ref->refs, 1, memory_order_acq_rel) == 1) {
+        ref->recycle(ref);
+    }
+}
+
+int slice_list_append(SliceList *list, URBRef *ref, const uint8_t *data, int length) {
+    if (list->num_slices >= MAX_FRAME_SLICES) return -1;
+
+    FrameSlice *s = &list->slices[list->num_slices++];
+    s->ref = ref;
+    s->data = data;
+    s->length = length;
+    list->total_size += length;
+    urb_ref_get(ref);
+    return 0;
+}
+
+void slice_list_release(SliceList *list) {
+    for (int i = 0; i < list->num_slices; i++) {
+        urb_ref_put(list->slices[i].ref);
+    }
+    list->num_slices = 0;
+    list->total_size = 0;
+}
+
+void slice_list_move(SliceList *dst, SliceList *src) {
+    memcpy(dst->slices, src->slices, src->num_slices * sizeof(FrameSlice));
+    dst->num_slices = src->num_slices;
+    dst->total_size = src->total_size;
+    src->num_slices = 0;
+    src->total_size = 0;
+}
+
+int slice_list_copy(const SliceList *list, uint8_t *dst, int capacity) {
+    if (list->total_size > capacity) return -1;
+
+    int pos = 0;
+    for (int i = 0; i < list->num_slices; i++) {
+        memcpy(dst + pos, list->slices[i].data, list->slices[i].length);
+        pos += list->slices[i].length;
+    }
+    return pos;
+}
+
+// --- libjpeg source manager over a SliceList ---
+
+typedef struct {
+    struct jpeg_source_mgr pub;
+    const SliceList *list;
+    int next;
+} slice_source_mgr;
+
+static void slice_init_source(j_decompress_ptr cinfo) {
+    (void)cinfo;
+}
+
+static boolean slice_fill_input_buffer(j_decompress_ptr cinfo) {
+    static const JOCTET fake_eoi[2] = { 0xFF, JPEG_EOI };
+    slice_source_mgr *src = (slice_source_mgr *)cinfo->src;
+
+    // Skip empty slices; once out of data, insert an EOI like jpeg_mem_src does
+    while (src->next < src->list->num_slices) {
+        const FrameSlice *s = &src->list->slices[src->next++];
+        if (s->length > 0) {
+            src->pub.next_input_byte = s->data;
+            src->pub.bytes_in_buffer = s->length;
+            return TRUE;
+        }
+    }
+
+    WARNMS(cinfo, JWRN_JPEG_EOF);
+    src->pub.next_input_byte = fake_eoi;
+    src->pub.bytes_in_buffer = 2;
+    return TRUE;
+}
+
+static void slice_skip_input_data(j_decompress_ptr cinfo, long num_bytes) {
+    struct jpeg_source_mgr *src = cinfo->src;
+    if (num_bytes <= 0) return;
+
+    while (num_bytes > (long)src->bytes_in_buffer) {
+        num_bytes -= (long)src->bytes_in_buffer;
+        src->fill_input_buffer(cinfo);
+    }
+    src->next_input_byte += num_bytes;
+    src->bytes_in_buffer -= num_bytes;
+}
+
+static void slice_term_source(j_decompress_ptr cinfo) {
+    (void)cinfo;
+}
+
+void jpeg_slice_src(j_decompress_ptr cinfo, const SliceList *list) {
+    slice_source_mgr *src;
+
+    // Allocated from the permanent pool so a reused decompressor keeps it
+    if (cinfo->src == NULL || cinfo->src->init_source != slice_init_source) {
+        cinfo->src = (struct jpeg_source_mgr *)
+            (*cinfo->mem->alloc_small)((j_common_ptr)cinfo, JPOOL_PERMANENT, sizeof(slice_source_mgr));
+    }
+
+    src = (slice_source_mgr *)cinfo->src;
+    src->pub.init_source = slice_init_source;
+    src->pub.fill_input_buffer = slice_fill_input_buffer;
+    src->pub.skip_input_data = slice_skip_input_data;
+    src->pub.resync_to_restart = jpeg_resync_to_restart;
+    src->pub.term_source = slice_term_source;
+    src->pub.next_input_byte = NULL;
+    src->pub.bytes_in_buffer = 0;
+    src->list = list;
+    src->next = 0;
+}
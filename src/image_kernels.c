@@ -0,0 +1,588 @@
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
+#include "cpu_features.h"
+#include "image_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+// Fixed-point grayscale: Q14 weights for 0.299, 0.587, 0.114 (sum 16384)
+#define GRAY_WR     4899
+#define GRAY_WG     9617
+#define GRAY_WB     1868
+#define GRAY_SHIFT  14
+
+// Contrast factor in Q9; |(v - 128) * factor| then fits in 16 bits
+#define CONTRAST_SHIFT  9
+#define CONTRAST_MAX    64.0f
+
+// --- Scalar reference ---
+
+static void gray_rgb_scalar(uint8_t *p, int pixels) {
+    for (int x = 0; x < pixels; x++, p += 3) {
+        uint8_t gray = (uint8_t)((p[0] * 299 + p[1] * 587 + p[2] * 114) / 1000);
+        p[0] = gray;
+        p[1] = gray;
+        p[2] = gray;
+    }
+}
+
+static void brightness_scalar(uint8_t *p, int n, int delta) {
+    for (int i = 0; i < n; i++) {
+        int val = p[i] + delta;
+        if (val < 0) val = 0;
+        if (val > 255) val = 255;
+        p[i] = (uint8_t)val;
+    }
+}
+
+static void contrast_scalar(uint8_t *p, int n, float factor) {
+    for (int i = 0; i < n; i++) {
+        int val = (int)((p[i] - 128) * factor + 128);
+        if (val < 0) val = 0;
+        if (val > 255) val = 255;
+        p[i] = (uint8_t)val;
+    }
+}
+
+static void lut_scalar(uint8_t *p, int n, const uint8_t table[256]) {
+    for (int i = 0; i < n; i++) p[i] = table[p[i]];
+}
+
+static void fill_rgb_scalar(uint8_t *p, int pixels, uint8_t r, uint8_t g, uint8_t b) {
+    if (r == g && g == b) {
+        memset(p, r, (size_t)pixels * 3);
+        return;
+    }
+    for (int x = 0; x < pixels; x++, p += 3) {
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+    }
+}
+
+static void average_scalar(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n) {
+    for (int i = 0; i < n; i++) dst[i] = (uint8_t)((a[i] + b[i] + 1) >> 1);
+}
+
+const ImageKernels image_kernels_scalar = {
+    "scalar", 0, gray_rgb_scalar, brightness_scalar, contrast_scalar, lut_scalar, fill_rgb_scalar,
+    average_scalar
+};
+
+// --- Fixed-point scalar: exactly what the SIMD lanes compute, for tails ---
+
+static void gray_rgb_fixed(uint8_t *p, int pixels) {
+    for (int x = 0; x < pixels; x++, p += 3) {
+        uint8_t gray = (uint8_t)((p[0] * GRAY_WR + p[1] * GRAY_WG + p[2] * GRAY_WB) >> GRAY_SHIFT);
+        p[0] = gray;
+        p[1] = gray;
+        p[2] = gray;
+    }
+}
+
+static void contrast_fixed(uint8_t *p, int n, int f) {
+    for (int i = 0; i < n; i++) {
+        int val = (((p[i] - 128) * f) >> CONTRAST_SHIFT) + 128;
+        if (val < 0) val = 0;
+        if (val > 255) val = 255;
+        p[i] = (uint8_t)val;
+    }
+}
+
+// Q9 contrast factor, or 0 if the factor is out of the fixed-point range
+static int contrast_q9(float factor, int *f) {
+    if (!(factor >= -CONTRAST_MAX && factor < CONTRAST_MAX)) return 0;
+    long q = lrintf(factor * (1 << CONTRAST_SHIFT));
+    if (q > 32767) q = 32767;
+    *f = (int)q;
+    return 1;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+// pshufb masks gathering channel c of 16 RGB pixels out of 48 bytes
+// (3 loads), and spreading 16 gray bytes back over 48
+static const int8_t deinterleave_mask[3][3][16] __attribute__((aligned(16))) = {
+    { {  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  1,  4,  7, 10, 13 } },
+    { {  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  2,  5,  8, 11, 14 } },
+    { {  2,  5,  8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1,  1,  4,  7, 10, 13, -1, -1, -1, -1, -1, -1 },
+      { -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  0,  3,  6,  9, 12, 15 } },
+};
+
+static const int8_t interleave_mask[3][16] __attribute__((aligned(16))) = {
+    {  0,  0,  0,  1,  1,  1,  2,  2,  2,  3,  3,  3,  4,  4,  4,  5 },
+    {  5,  5,  6,  6,  6,  7,  7,  7,  8,  8,  8,  9,  9,  9, 10, 10 },
+    { 10, 11, 11, 11, 12, 12, 12, 13, 13, 13, 14, 14, 14, 15, 15, 15 },
+};
+
+// --- SSE2 / SSSE3 ---
+
+// Q14 luma of 16 pixels: 32-bit sums via pmaddwd on (r, g) and (b, 0) pairs
+__attribute__((target("sse2")))
+static inline __m128i gray16_sse2(__m128i r, __m128i g, __m128i b) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i w_rg = _mm_set1_epi32((GRAY_WG << 16) | GRAY_WR);
+    const __m128i w_b = _mm_set1_epi32(GRAY_WB);
+
+    __m128i rg_lo = _mm_unpacklo_epi8(r, g);
+    __m128i rg_hi = _mm_unpackhi_epi8(r, g);
+    __m128i b_lo = _mm_unpacklo_epi8(b, zero);
+    __m128i b_hi = _mm_unpackhi_epi8(b, zero);
+
+    __m128i s0 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(rg_lo, zero), w_rg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(b_lo, zero), w_b));
+    __m128i s1 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi8(rg_lo, zero), w_rg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(b_lo, zero), w_b));
+    __m128i s2 = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi8(rg_hi, zero), w_rg),
+                               _mm_madd_epi16(_mm_unpacklo_epi16(b_hi, zero), w_b));
+    __m128i s3 = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi8(rg_hi, zero), w_rg),
+                               _mm_madd_epi16(_mm_unpackhi_epi16(b_hi, zero), w_b));
+
+    __m128i lo = _mm_packs_epi32(_mm_srli_epi32(s0, GRAY_SHIFT), _mm_srli_epi32(s1, GRAY_SHIFT));
+    __m128i hi = _mm_packs_epi32(_mm_srli_epi32(s2, GRAY_SHIFT), _mm_srli_epi32(s3, GRAY_SHIFT));
+    return _mm_packus_epi16(lo, hi);
+}
+
+__attribute__((target("ssse3")))
+static void gray_rgb_ssse3(uint8_t *p, int pixels) {
+    __m128i m[3][3], o[3];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) m[c][k] = _mm_load_si128((const __m128i *)deinterleave_mask[c][k]);
+        o[c] = _mm_load_si128((const __m128i *)interleave_mask[c]);
+    }
+
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16, p += 48) {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)p);
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(p + 16));
+        __m128i a2 = _mm_loadu_si128((const __m128i *)(p + 32));
+        __m128i ch[3];
+        for (int c = 0; c < 3; c++) {
+            ch[c] = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a0, m[c][0]), _mm_shuffle_epi8(a1, m[c][1])),
+                                 _mm_shuffle_epi8(a2, m[c][2]));
+        }
+        __m128i gray = gray16_sse2(ch[0], ch[1], ch[2]);
+        _mm_storeu_si128((__m128i *)p, _mm_shuffle_epi8(gray, o[0]));
+        _mm_storeu_si128((__m128i *)(p + 16), _mm_shuffle_epi8(gray, o[1]));
+        _mm_storeu_si128((__m128i *)(p + 32), _mm_shuffle_epi8(gray, o[2]));
+    }
+    gray_rgb_fixed(p, pixels - x);
+}
+
+__attribute__((target("sse2")))
+static void brightness_sse2(uint8_t *p, int n, int delta) {
+    if (delta > 255) delta = 255;
+    if (delta < -255) delta = -255;
+    __m128i d = _mm_set1_epi8((char)(delta < 0 ? -delta : delta));
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        v = delta < 0 ? _mm_subs_epu8(v, d) : _mm_adds_epu8(v, d);
+        _mm_storeu_si128((__m128i *)(p + i), v);
+    }
+    brightness_scalar(p + i, n - i, delta);
+}
+
+__attribute__((target("sse2")))
+static void contrast_sse2(uint8_t *p, int n, float factor) {
+    int f;
+    if (!contrast_q9(factor, &f)) {
+        contrast_scalar(p, n, factor);
+        return;
+    }
+
+    // (x << 7) * f >> 16 == x * f >> 9, and x << 7 still fits in 16 bits
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi16(128);
+    const __m128i fq = _mm_set1_epi16((short)f);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i lo = _mm_slli_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(v, zero), bias), 16 - CONTRAST_SHIFT);
+        __m128i hi = _mm_slli_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(v, zero), bias), 16 - CONTRAST_SHIFT);
+        lo = _mm_add_epi16(_mm_mulhi_epi16(lo, fq), bias);
+        hi = _mm_add_epi16(_mm_mulhi_epi16(hi, fq), bias);
+        _mm_storeu_si128((__m128i *)(p + i), _mm_packus_epi16(lo, hi));
+    }
+    contrast_fixed(p + i, n - i, f);
+}
+
+// 256-entry lookup as 16 pshufb over 16-entry slices. pshufb returns 0 for
+// an index with bit 7 set, else entry (index & 15). For slice h of the
+// lower half, v + 16 * (7 - h) (saturating) has bit 7 clear exactly when
+// v < 16 * (h + 1); the upper half does the same on v ^ 0x80. A value in
+// slice j thus hits slices j .. 7 (or j .. 15), all at its low nibble, and
+// XOR-ing the results gives table[v] if slice h holds T[h] ^ T[h + 1].
+static void lut_suffix_slices(const uint8_t table[256], uint8_t d[256]) {
+    for (int h = 0; h < 16; h++) {
+        for (int i = 0; i < 16; i++) {
+            uint8_t v = table[h * 16 + i];
+            if (h != 7 && h != 15) v ^= table[(h + 1) * 16 + i];
+            d[h * 16 + i] = v;
+        }
+    }
+}
+
+// 16 pixels are 48 bytes: three stores of a repeating pattern
+__attribute__((target("sse2")))
+static void fill_rgb_sse2(uint8_t *p, int pixels, uint8_t r, uint8_t g, uint8_t b) {
+    if (r == g && g == b) {
+        memset(p, r, (size_t)pixels * 3);
+        return;
+    }
+    uint8_t pat[48];
+    fill_rgb_scalar(pat, 16, r, g, b);
+    __m128i v0 = _mm_loadu_si128((const __m128i *)pat);
+    __m128i v1 = _mm_loadu_si128((const __m128i *)(pat + 16));
+    __m128i v2 = _mm_loadu_si128((const __m128i *)(pat + 32));
+
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16, p += 48) {
+        _mm_storeu_si128((__m128i *)p, v0);
+        _mm_storeu_si128((__m128i *)(p + 16), v1);
+        _mm_storeu_si128((__m128i *)(p + 32), v2);
+    }
+    fill_rgb_scalar(p, pixels - x, r, g, b);
+}
+
+// pavgb rounds up, like the scalar (a + b + 1) >> 1
+__attribute__((target("sse2")))
+static void average_sse2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_avg_epu8(va, vb));
+    }
+    average_scalar(a + i, b + i, dst + i, n - i);
+}
+
+// 16-byte pshufb lookups measured slower than the scalar table walk, so the
+// SSSE3 set keeps it
+const ImageKernels image_kernels_ssse3 = {
+    "ssse3", CPU_FEATURE_SSE2 | CPU_FEATURE_SSSE3, gray_rgb_ssse3, brightness_sse2, contrast_sse2, lut_scalar,
+    fill_rgb_sse2, average_sse2
+};
+
+// --- AVX2: same arithmetic, one 16-pixel group per 128-bit lane ---
+
+__attribute__((target("avx2")))
+static inline __m256i gray32_avx2(__m256i r, __m256i g, __m256i b) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i w_rg = _mm256_set1_epi32((GRAY_WG << 16) | GRAY_WR);
+    const __m256i w_b = _mm256_set1_epi32(GRAY_WB);
+
+    __m256i rg_lo = _mm256_unpacklo_epi8(r, g);
+    __m256i rg_hi = _mm256_unpackhi_epi8(r, g);
+    __m256i b_lo = _mm256_unpacklo_epi8(b, zero);
+    __m256i b_hi = _mm256_unpackhi_epi8(b, zero);
+
+    __m256i s0 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(rg_lo, zero), w_rg),
+                                  _mm256_madd_epi16(_mm256_unpacklo_epi16(b_lo, zero), w_b));
+    __m256i s1 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi8(rg_lo, zero), w_rg),
+                                  _mm256_madd_epi16(_mm256_unpackhi_epi16(b_lo, zero), w_b));
+    __m256i s2 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpacklo_epi8(rg_hi, zero), w_rg),
+                                  _mm256_madd_epi16(_mm256_unpacklo_epi16(b_hi, zero), w_b));
+    __m256i s3 = _mm256_add_epi32(_mm256_madd_epi16(_mm256_unpackhi_epi8(rg_hi, zero), w_rg),
+                                  _mm256_madd_epi16(_mm256_unpackhi_epi16(b_hi, zero), w_b));
+
+    __m256i lo = _mm256_packs_epi32(_mm256_srli_epi32(s0, GRAY_SHIFT), _mm256_srli_epi32(s1, GRAY_SHIFT));
+    __m256i hi = _mm256_packs_epi32(_mm256_srli_epi32(s2, GRAY_SHIFT), _mm256_srli_epi32(s3, GRAY_SHIFT));
+    return _mm256_packus_epi16(lo, hi);
+}
+
+// Loads bytes [off, off+16) of both 48-byte groups into the two lanes
+__attribute__((target("avx2")))
+static inline __m256i load_lanes(const uint8_t *p, int off) {
+    return _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(p + off))),
+                                   _mm_loadu_si128((const __m128i *)(p + 48 + off)), 1);
+}
+
+__attribute__((target("avx2")))
+static inline void store_lanes(uint8_t *p, int off, __m256i v) {
+    _mm_storeu_si128((__m128i *)(p + off), _mm256_castsi256_si128(v));
+    _mm_storeu_si128((__m128i *)(p + 48 + off), _mm256_extracti128_si256(v, 1));
+}
+
+__attribute__((target("avx2")))
+static void gray_rgb_avx2(uint8_t *p, int pixels) {
+    __m256i m[3][3], o[3];
+    for (int c = 0; c < 3; c++) {
+        for (int k = 0; k < 3; k++) {
+            m[c][k] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)deinterleave_mask[c][k]));
+        }
+        o[c] = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *)interleave_mask[c]));
+    }
+
+    int x = 0;
+    for (; x + 32 <= pixels; x += 32, p += 96) {
+        __m256i a0 = load_lanes(p, 0);
+        __m256i a1 = load_lanes(p, 16);
+        __m256i a2 = load_lanes(p, 32);
+        __m256i ch[3];
+        for (int c = 0; c < 3; c++) {
+            ch[c] = _mm256_or_si256(_mm256_or_si256(_mm256_shuffle_epi8(a0, m[c][0]),
+                                                    _mm256_shuffle_epi8(a1, m[c][1])),
+                                    _mm256_shuffle_epi8(a2, m[c][2]));
+        }
+        __m256i gray = gray32_avx2(ch[0], ch[1], ch[2]);
+        store_lanes(p, 0, _mm256_shuffle_epi8(gray, o[0]));
+        store_lanes(p, 16, _mm256_shuffle_epi8(gray, o[1]));
+        store_lanes(p, 32, _mm256_shuffle_epi8(gray, o[2]));
+    }
+    gray_rgb_fixed(p, pixels - x);
+}
+
+__attribute__((target("avx2")))
+static void brightness_avx2(uint8_t *p, int n, int delta) {
+    if (delta > 255) delta = 255;
+    if (delta < -255) delta = -255;
+    __m256i d = _mm256_set1_epi8((char)(delta < 0 ? -delta : delta));
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        v = delta < 0 ? _mm256_subs_epu8(v, d) : _mm256_adds_epu8(v, d);
+        _mm256_storeu_si256((__m256i *)(p + i), v);
+    }
+    brightness_scalar(p + i, n - i, delta);
+}
+
+__attribute__((target("avx2")))
+static void contrast_avx2(uint8_t *p, int n, float factor) {
+    int f;
+    if (!contrast_q9(factor, &f)) {
+        contrast_scalar(p, n, factor);
+        return;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i bias = _mm256_set1_epi16(128);
+    const __m256i fq = _mm256_set1_epi16((short)f);
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i lo = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_unpacklo_epi8(v, zero), bias), 16 - CONTRAST_SHIFT);
+        __m256i hi = _mm256_slli_epi16(_mm256_sub_epi16(_mm256_unpackhi_epi8(v, zero), bias), 16 - CONTRAST_SHIFT);
+        lo = _mm256_add_epi16(_mm256_mulhi_epi16(lo, fq), bias);
+        hi = _mm256_add_epi16(_mm256_mulhi_epi16(hi, fq), bias);
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_packus_epi16(lo, hi));
+    }
+    contrast_fixed(p + i, n - i, f);
+}
+
+__attribute__((target("avx2")))
+static void lut_avx2(uint8_t *p, int n, const uint8_t table[256]) {
+    uint8_t d[256];
+    lut_suffix_slices(table, d);
+
+    __m256i t[16], c[8];
+    for (int h = 0; h < 16; h++) {
+        t[h] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(d + h * 16)));
+    }
+    for (int h = 0; h < 8; h++) c[h] = _mm256_set1_epi8((char)(16 * (7 - h)));
+    const __m256i top = _mm256_set1_epi8((char)0x80);
+
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i lo = _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hi = _mm256_xor_si256(lo, top);
+        __m256i r = _mm256_setzero_si256();
+        for (int h = 0; h < 8; h++) {
+            r = _mm256_xor_si256(r, _mm256_shuffle_epi8(t[h], _mm256_adds_epu8(lo, c[h])));
+            r = _mm256_xor_si256(r, _mm256_shuffle_epi8(t[h + 8], _mm256_adds_epu8(hi, c[h])));
+        }
+        _mm256_storeu_si256((__m256i *)(p + i), r);
+    }
+    lut_scalar(p + i, n - i, table);
+}
+
+__attribute__((target("avx2")))
+static void fill_rgb_avx2(uint8_t *p, int pixels, uint8_t r, uint8_t g, uint8_t b) {
+    if (r == g && g == b) {
+        memset(p, r, (size_t)pixels * 3);
+        return;
+    }
+    uint8_t pat[96];
+    fill_rgb_scalar(pat, 32, r, g, b);
+    __m256i v0 = _mm256_loadu_si256((const __m256i *)pat);
+    __m256i v1 = _mm256_loadu_si256((const __m256i *)(pat + 32));
+    __m256i v2 = _mm256_loadu_si256((const __m256i *)(pat + 64));
+
+    int x = 0;
+    for (; x + 32 <= pixels; x += 32, p += 96) {
+        _mm256_storeu_si256((__m256i *)p, v0);
+        _mm256_storeu_si256((__m256i *)(p + 32), v1);
+        _mm256_storeu_si256((__m256i *)(p + 64), v2);
+    }
+    fill_rgb_sse2(p, pixels - x, r, g, b);
+}
+
+__attribute__((target("avx2")))
+static void average_avx2(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_avg_epu8(va, vb));
+    }
+    average_sse2(a + i, b + i, dst + i, n - i);
+}
+
+const ImageKernels image_kernels_avx2 = {
+    "avx2", CPU_FEATURE_AVX2, gray_rgb_avx2, brightness_avx2, contrast_avx2, lut_avx2, fill_rgb_avx2,
+    average_avx2
+};
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+static inline uint16x8_t gray8_neon(uint8x8_t r, uint8x8_t g, uint8x8_t b) {
+    uint16x8_t r16 = vmovl_u8(r), g16 = vmovl_u8(g), b16 = vmovl_u8(b);
+
+    uint32x4_t lo = vmull_n_u16(vget_low_u16(r16), GRAY_WR);
+    lo = vmlal_n_u16(lo, vget_low_u16(g16), GRAY_WG);
+    lo = vmlal_n_u16(lo, vget_low_u16(b16), GRAY_WB);
+    uint32x4_t hi = vmull_n_u16(vget_high_u16(r16), GRAY_WR);
+    hi = vmlal_n_u16(hi, vget_high_u16(g16), GRAY_WG);
+    hi = vmlal_n_u16(hi, vget_high_u16(b16), GRAY_WB);
+
+    return vcombine_u16(vshrn_n_u32(lo, GRAY_SHIFT), vshrn_n_u32(hi, GRAY_SHIFT));
+}
+
+static void gray_rgb_neon(uint8_t *p, int pixels) {
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16, p += 48) {
+        uint8x16x3_t px = vld3q_u8(p);
+        uint16x8_t lo = gray8_neon(vget_low_u8(px.val[0]), vget_low_u8(px.val[1]), vget_low_u8(px.val[2]));
+        uint16x8_t hi = gray8_neon(vget_high_u8(px.val[0]), vget_high_u8(px.val[1]), vget_high_u8(px.val[2]));
+        uint8x16_t gray = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        px.val[0] = px.val[1] = px.val[2] = gray;
+        vst3q_u8(p, px);
+    }
+    gray_rgb_fixed(p, pixels - x);
+}
+
+static void brightness_neon(uint8_t *p, int n, int delta) {
+    if (delta > 255) delta = 255;
+    if (delta < -255) delta = -255;
+    uint8x16_t d = vdupq_n_u8((uint8_t)(delta < 0 ? -delta : delta));
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        vst1q_u8(p + i, delta < 0 ? vqsubq_u8(v, d) : vqaddq_u8(v, d));
+    }
+    brightness_scalar(p + i, n - i, delta);
+}
+
+static inline uint8x8_t contrast8_neon(uint8x8_t v, int16x4_t fq) {
+    int16x8_t x = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(v)), vdupq_n_s16(128));
+    int32x4_t lo = vmull_s16(vget_low_s16(x), fq);
+    int32x4_t hi = vmull_s16(vget_high_s16(x), fq);
+    int16x8_t y = vcombine_s16(vshrn_n_s32(lo, CONTRAST_SHIFT), vshrn_n_s32(hi, CONTRAST_SHIFT));
+    return vqmovun_s16(vaddq_s16(y, vdupq_n_s16(128)));
+}
+
+static void contrast_neon(uint8_t *p, int n, float factor) {
+    int f;
+    if (!contrast_q9(factor, &f)) {
+        contrast_scalar(p, n, factor);
+        return;
+    }
+    int16x4_t fq = vdup_n_s16((int16_t)f);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        vst1q_u8(p + i, vcombine_u8(contrast8_neon(vget_low_u8(v), fq), contrast8_neon(vget_high_u8(v), fq)));
+    }
+    contrast_fixed(p + i, n - i, f);
+}
+
+#if defined(__aarch64__)
+// tbl takes four registers (64 entries); tbx leaves lanes whose index is
+// out of range alone, so four lookups cover 256 entries
+static void lut_neon(uint8_t *p, int n, const uint8_t table[256]) {
+    uint8x16x4_t t[4];
+    for (int q = 0; q < 4; q++) t[q] = vld1q_u8_x4(table + q * 64);
+    const uint8x16_t step = vdupq_n_u8(64);
+
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t v = vld1q_u8(p + i);
+        uint8x16_t r = vqtbl4q_u8(t[0], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, t[1], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, t[2], v);
+        v = vsubq_u8(v, step);
+        r = vqtbx4q_u8(r, t[3], v);
+        vst1q_u8(p + i, r);
+    }
+    lut_scalar(p + i, n - i, table);
+}
+#else
+#define lut_neon lut_scalar     // ARMv7 has no 64-entry table lookup
+#endif
+
+static void fill_rgb_neon(uint8_t *p, int pixels, uint8_t r, uint8_t g, uint8_t b) {
+    if (r == g && g == b) {
+        memset(p, r, (size_t)pixels * 3);
+        return;
+    }
+    uint8x16x3_t v = { { vdupq_n_u8(r), vdupq_n_u8(g), vdupq_n_u8(b) } };
+
+    int x = 0;
+    for (; x + 16 <= pixels; x += 16, p += 48) vst3q_u8(p, v);
+    fill_rgb_scalar(p, pixels - x, r, g, b);
+}
+
+static void average_neon(const uint8_t *a, const uint8_t *b, uint8_t *dst, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) vst1q_u8(dst + i, vrhaddq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    average_scalar(a + i, b + i, dst + i, n - i);
+}
+
+const ImageKernels image_kernels_neon = {
+    "neon", CPU_FEATURE_NEON, gray_rgb_neon, brightness_neon, contrast_neon, lut_neon, fill_rgb_neon,
+    average_neon
+};
+#endif
+
+// Picked once, by whichever thread draws or converts first
+static pthread_once_t g_image_kernels_once = PTHREAD_ONCE_INIT;
+static const ImageKernels *g_image_kernels = &image_kernels_scalar;
+
+static void resolve_image_kernels(void) {
+    unsigned f = cpu_features();
+    const ImageKernels *k = &image_kernels_scalar;
+#if defined(__x86_64__) || defined(__i386__)
+    if ((f & image_kernels_avx2.needs) == image_kernels_avx2.needs) k = &image_kernels_avx2;
+    else if ((f & image_kernels_ssse3.needs) == image_kernels_ssse3.needs) k = &image_kernels_ssse3;
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    if (f & CPU_FEATURE_NEON) k = &image_kernels_neon;
+#endif
+    (void)f;
+    g_image_kernels = k;
+}
+
+const ImageKernels *image_kernels(void) {
+    pthread_once(&g_image_kernels_once, resolve_image_kernels);
+    return g_image_kernels;
+}
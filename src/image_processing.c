@@ -1,154 +1,362 @@
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include "image_processing.h"
+#include "image_kernels.h"
+#include "log.h"
 
-void image_init(Image *img, int width, int height, int channels) {
-    if (width > MAX_FRAME_WIDTH || height > MAX_FRAME_HEIGHT) {
-        img->valid = 0;
-        printf("img init error");
-        return;
+int image_stride(int width, int channels) {
+    return (width * channels + IMAGE_ALIGN - 1) & ~(IMAGE_ALIGN - 1);
+}
+
+size_t image_buffer_size(int width, int height, int channels) {
+    return (size_t)image_stride(width, channels) * height;
+}
+
+int image_init(Image *img, int width, int height, int channels, uint8_t *mem, size_t mem_size) {
+    img->valid = 0;
+    if (width <= 0 || height <= 0 || channels <= 0 || !mem ||
+        ((uintptr_t)mem & (IMAGE_ALIGN - 1)) ||
+        mem_size < image_buffer_size(width, height, channels)) {
+        LOG_ERROR("img init error");
+        return -1;
     }
 
+    img->data = mem;
     img->width = width;
     img->height = height;
     img->channels = channels;
-    img->step = width * channels;
+    img->step = image_stride(width, channels);
+    img->is_view = 0;
     img->valid = 1;
-    memset(img->data, 0, sizeof(img->data));
+    memset(img->data, 0, (size_t)img->step * height);
+    return 0;
 }
 
 void image_clear(Image *img) {
-    memset(img->data, 0, sizeof(img->data));
+    if (img->data) {
+        for (int y = 0; y < img->height; y++) {
+            memset(img->data + (size_t)y * img->step, 0, (size_t)img->width * img->channels);
+        }
+    }
     img->valid = 0;
 }
 
-void image_copy(const Image *src, Image *dst) {
-    if (!src->valid) {
-        printf("img copy error");
-        return;
+// dst must already have memory for an image of the same size
+int image_copy(const Image *src, Image *dst) {
+    if (!src->valid || !dst->data || dst->width != src->width ||
+        dst->height != src->height || dst->channels != src->channels) {
+        LOG_ERROR("img copy error");
+        return -1;
+    }
+
+    size_t row = (size_t)src->width * src->channels;
+    for (int y = 0; y < src->height; y++) {
+        memcpy(dst->data + (size_t)y * dst->step, src->data + (size_t)y * src->step, row);
+    }
+    dst->valid = 1;
+    return 0;
+}
+
+int image_view(const Image *src, Image *view, int x, int y, int w, int h) {
+    if (!src->valid || x < 0 || y < 0 || w <= 0 || h <= 0 ||
+        x + w > src->width || y + h > src->height) {
+        LOG_ERROR("img view error");
+        return -1;
+    }
+
+    view->data = src->data + (size_t)y * src->step + (size_t)x * src->channels;
+    view->width = w;
+    view->height = h;
+    view->channels = src->channels;
+    view->step = src->step;
+    view->is_view = 1;
+    view->valid = 1;
+    return 0;
+}
+
+int image_is_aligned(const Image *img) {
+    return ((uintptr_t)img->data & (IMAGE_ALIGN - 1)) == 0 &&
+           (img->step & (IMAGE_ALIGN - 1)) == 0;
+}
+
+int image_arena_init(ImageArena *arena, size_t size) {
+    size = (size + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+    arena->base = aligned_alloc(IMAGE_ALIGN, size);
+    if (!arena->base) {
+        perror("image_arena_init");
+        return -1;
+    }
+    arena->size = size;
+    arena->used = 0;
+    return 0;
+}
+
+void image_arena_destroy(ImageArena *arena) {
+    free(arena->base);
+    arena->base = NULL;
+    arena->size = arena->used = 0;
+}
+
+int image_arena_alloc(ImageArena *arena, Image *img, int width, int height, int channels) {
+    size_t bytes = image_buffer_size(width, height, channels);  // a multiple of IMAGE_ALIGN
+    if (width <= 0 || height <= 0 || channels <= 0 || arena->size - arena->used < bytes) {
+        LOG_ERROR("img arena exhausted (%zu of %zu bytes used)", arena->used, arena->size);
+        img->valid = 0;
+        return -1;
     }
 
-    dst->width = src->width;
-    dst->height = src->height;
-    dst->channels = src->channels;
-    dst->step = src->step;
-    dst->valid = src->valid;
+    uint8_t *mem = arena->base + arena->used;
+    arena->used += bytes;
+    return image_init(img, width, height, channels, mem, bytes);
+}
 
-    int size = src->height * src->step;
-    memcpy(dst->data, src->data, size);
+void image_arena_reset(ImageArena *arena) {
+    arena->used = 0;
 }
 
+// The per-row work is done by the kernels in image_kernels.c, picked for
+// this CPU on first use
+
 void image_to_grayscale(Image *img) {
     if (!img->valid || img->channels != 3) {
-        printf("img grayscale error");
+        LOG_ERROR("img grayscale error");
         return;
     }
-    
+
+    const ImageKernels *k = image_kernels();
     for (int y = 0; y < img->height; y++) {
-        for (int x = 0; x < img->width; x++) {
-            int idx = y * img->step + x * 3;
-            uint8_t r = img->data[idx];
-            uint8_t g = img->data[idx + 1];
-            uint8_t b = img->data[idx + 2];
-
-            uint8_t gray = (uint8_t)((r * 299 + g * 587 + b * 114) / 1000);
-            img->data[idx] = gray;
-            img->data[idx + 1] = gray;
-            img->data[idx + 2] = gray;
-        }
+        k->gray_rgb(img->data + (size_t)y * img->step, img->width);
     }
 }
 
 void image_adjust_brightness(Image *img, int delta) {
     if (!img->valid) {
-        printf("img is not valid at brightness");
+        LOG_ERROR("img is not valid at brightness");
         return;
     }
 
-    int size = img->height * img->step;
-    for (int i = 0; i < size; i++) {
-        int val = img->data[i] + delta;
-        if (val < 0) val = 0;
-        if (val > 255) val = 255;
-        img->data[i] = (uint8_t)val;
+    const ImageKernels *k = image_kernels();
+    for (int y = 0; y < img->height; y++) {
+        k->brightness(img->data + (size_t)y * img->step, img->width * img->channels, delta);
     }
 }
 
 void image_adjust_contrast(Image *img, float factor) {
     if (!img->valid) {
-        printf("img is not valid at contrast");
+        LOG_ERROR("img is not valid at contrast");
         return;
     }
 
-    int size = img->height * img->step;
-    for (int i = 0; i < size; i++) {
-        int val = (int)((img->data[i] - 128) * factor + 128);
-        if (val < 0) val = 0;
-        if (val > 255) val = 255;
-        img->data[i] = (uint8_t)val;
+    const ImageKernels *k = image_kernels();
+    for (int y = 0; y < img->height; y++) {
+        k->contrast(img->data + (size_t)y * img->step, img->width * img->channels, factor);
     }
 }
 
 void image_set_pixel(Image *img, int x, int y, uint8_t r, uint8_t g, uint8_t b) {
     if (!img->valid || x < 0 || x >= img->width || y < 0 || y >= img->height) return;
     if (img->channels != 3) {
-        printf("Invalid channels when setting pixel");
+        LOG_ERROR("Invalid channels when setting pixel");
+        return;
+    }
+
+    uint8_t *p = img->data + (size_t)y * img->step + x * 3;
+    p[0] = r;
+    p[1] = g;
+    p[2] = b;
+}
+
+void image_get_pixel(const Image *img, int x, int y, uint8_t *r, uint8_t *g, uint8_t *b) {
+    if (!img->valid || x < 0 || x >= img->width || y < 0 || y >= img->height) return;
+
+    const uint8_t *p = img->data + (size_t)y * img->step + x * img->channels;
+    *r = p[0];
+    *g = img->channels >= 3 ? p[1] : p[0];
+    *b = img->channels >= 3 ? p[2] : p[0];
+}
+
+// Drawing targets RGB images; checked once per call instead of per pixel
+static int drawable(const Image *img, const char *fn) {
+    if (!img->valid) return 0;
+    if (img->channels != 3) {
+        LOG_ERROR("Invalid channels at %s", fn);
+        return 0;
+    }
+    return 1;
+}
+
+// Clip the rectangle (x, y, w, h) to the image; returns 0 if nothing is left
+static int clip_rect(const Image *img, int *x, int *y, int *w, int *h) {
+    int x0 = *x < 0 ? 0 : *x;
+    int y0 = *y < 0 ? 0 : *y;
+    long x1 = (long)*x + *w, y1 = (long)*y + *h;
+    if (x1 > img->width) x1 = img->width;
+    if (y1 > img->height) y1 = img->height;
+    if (x1 <= x0 || y1 <= y0) return 0;
+    *x = x0;
+    *y = y0;
+    *w = (int)(x1 - x0);
+    *h = (int)(y1 - y0);
+    return 1;
+}
+
+// Below this many pixels plain stores beat a call through the kernel table
+#define SHORT_SPAN  16
+
+static void fill_clipped(Image *img, int x, int y, int w, int h,
+                         uint8_t r, uint8_t g, uint8_t b) {
+    uint8_t *row = img->data + (size_t)y * img->step + x * 3;
+    if (w < SHORT_SPAN) {
+        for (int i = 0; i < h; i++, row += img->step) {
+            uint8_t *p = row;
+            for (int j = 0; j < w; j++, p += 3) {
+                p[0] = r;
+                p[1] = g;
+                p[2] = b;
+            }
+        }
         return;
     }
-    
-    int idx = y * img->step + x * 3;
-    img->data[idx] = r;
-    img->data[idx + 1] = g;
-    img->data[idx + 2] = b;
+    const ImageKernels *k = image_kernels();
+    for (int i = 0; i < h; i++, row += img->step) k->fill_rgb(row, w, r, g, b);
+}
+
+static void clip_and_fill(Image *img, int x, int y, int w, int h,
+                          uint8_t r, uint8_t g, uint8_t b) {
+    if (clip_rect(img, &x, &y, &w, &h)) fill_clipped(img, x, y, w, h, r, g, b);
+}
+
+void image_fill_rect(Image *img, int x, int y, int w, int h,
+                     uint8_t r, uint8_t g, uint8_t b) {
+    if (drawable(img, "image_fill_rect")) clip_and_fill(img, x, y, w, h, r, g, b);
+}
+
+void image_fill_hspan(Image *img, int x, int y, int len, uint8_t r, uint8_t g, uint8_t b) {
+    image_fill_rect(img, x, y, len, 1, r, g, b);
+}
+
+void image_fill_vspan(Image *img, int x, int y, int len, uint8_t r, uint8_t g, uint8_t b) {
+    if (drawable(img, "image_fill_vspan")) clip_and_fill(img, x, y, 1, len, r, g, b);
 }
 
 void image_draw_rect(Image *img, int x, int y, int w, int h,
                      uint8_t r, uint8_t g, uint8_t b, int thickness) {
-    if (!img->valid) return;
-    
-    for (int t = 0; t < thickness; t++) {
-        // Top and bottom
-        for (int i = x; i < x + w; i++) {
-            image_set_pixel(img, i, y + t, r, g, b);
-            image_set_pixel(img, i, y + h - t - 1, r, g, b);
+    if (!drawable(img, "image_draw_rect") || thickness <= 0) return;
+
+    // Bands of thickness t on each side, the pixels the per-pixel loop set.
+    // They are not clamped to the rectangle: a band thicker than a side
+    // spills past the opposite edge. The side bands skip the rows the top
+    // and bottom bands already cover, where those span them.
+    int t = thickness;
+    clip_and_fill(img, x, y, w, t, r, g, b);                       // top
+    clip_and_fill(img, x, y + h - t, w, t, r, g, b);               // bottom
+    int sy = y, sh = h;
+    if (h > 2 * t && t <= w) {
+        sy = y + t;
+        sh = h - 2 * t;
+    }
+    clip_and_fill(img, x, sy, t, sh, r, g, b);                     // left
+    clip_and_fill(img, x + w - t, sy, t, sh, r, g, b);             // right
+}
+
+// Pixels x0..x1 (either order) of row y, clipped
+static void fill_run(Image *img, int x0, int x1, int y, uint8_t r, uint8_t g, uint8_t b) {
+    if (x0 > x1) {
+        int t = x0;
+        x0 = x1;
+        x1 = t;
+    }
+    if (y < 0 || y >= img->height) return;
+    if (x0 < 0) x0 = 0;
+    if (x1 >= img->width) x1 = img->width - 1;
+    if (x1 >= x0) fill_clipped(img, x0, y, x1 - x0 + 1, 1, r, g, b);
+}
+
+void image_line_begin(ImageLineWalk *l, int x1, int y1, int x2, int y2) {
+    // Always walk downwards so callers can stop at a row and resume
+    if (y2 < y1) {
+        int t = x1;
+        x1 = x2;
+        x2 = t;
+        t = y1;
+        y1 = y2;
+        y2 = t;
+    }
+    l->x = x1;
+    l->y = y1;
+    l->x_end = x2;
+    l->y_end = y2;
+    l->dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    l->dy = y2 - y1;
+    l->sx = x1 < x2 ? 1 : -1;
+    l->err = l->dx - l->dy;
+    l->run_x = x1;
+    l->done = 0;
+}
+
+int image_line_draw(ImageLineWalk *l, Image *img, int y_limit,
+                    uint8_t r, uint8_t g, uint8_t b) {
+    if (!drawable(img, "image_line_draw")) return 0;
+
+    // Bresenham's line algorithm; the pixels it sets on one row are filled
+    // as one span when the line leaves that row
+    while (!l->done && l->y < y_limit) {
+        if (l->x == l->x_end && l->y == l->y_end) {
+            fill_run(img, l->run_x, l->x, l->y, r, g, b);
+            l->done = 1;
+            break;
+        }
+
+        int e2 = 2 * l->err;
+        int nx = l->x;
+        if (e2 > -l->dy) {
+            l->err -= l->dy;
+            nx += l->sx;
         }
-        
-        // Left and right
-        for (int i = y; i < y + h; i++) {
-            image_set_pixel(img, x + t, i, r, g, b);
-            image_set_pixel(img, x + w - t - 1, i, r, g, b);
+        if (e2 < l->dx) {
+            l->err += l->dx;
+            fill_run(img, l->run_x, l->x, l->y, r, g, b);
+            l->run_x = nx;
+            l->y++;
         }
+        l->x = nx;
     }
+    return !l->done;
 }
 
 void image_draw_line(Image *img, int x1, int y1, int x2, int y2,
                      uint8_t r, uint8_t g, uint8_t b) {
-    if (!img->valid) return;
+    if (!drawable(img, "image_draw_line")) return;
 
-    // Bresenham's line algorithm
-    int dx = x2 - x1;
-    int dy = y2 - y1;
-
-    if (dx < 0) dx = -dx;
-    if (dy < 0) dy = -dy;
-
-    int sx = (x1 < x2) ? 1 : -1;
-    int sy = (y1 < y2) ? 1 : -1;
+    // Bresenham's line algorithm from (x1, y1), whichever way that is: a
+    // line walked from its other end can differ at ties. The pixels set on
+    // one row are filled as one span when the line leaves that row.
+    int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int dy = y2 > y1 ? y2 - y1 : y1 - y2;
+    int sx = x1 < x2 ? 1 : -1;
+    int sy = y1 < y2 ? 1 : -1;
     int err = dx - dy;
+    int run_x = x1;
 
     while (1) {
-        image_set_pixel(img, x1, y1, r, g, b);
-
-        if (x1 == x2 && y1 == y2) break;
+        if (x1 == x2 && y1 == y2) {
+            fill_run(img, run_x, x1, y1, r, g, b);
+            break;
+        }
 
         int e2 = 2 * err;
+        int nx = x1;
         if (e2 > -dy) {
             err -= dy;
-            x1 += sx;
+            nx += sx;
         }
         if (e2 < dx) {
             err += dx;
+            fill_run(img, run_x, x1, y1, r, g, b);
+            run_x = nx;
             y1 += sy;
         }
+        x1 = nx;
     }
 }
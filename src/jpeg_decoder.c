@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "jpeg_decoder.h"
+#include "frame_pool.h"
+#include "image_processing.h"
+#include "image_kernels.h"
+#include "log.h"
+
+static uint64_t decoder_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void my_error_exit(j_common_ptr cinfo) {
+    JpegErrorMgr *myerr = (JpegErrorMgr *)cinfo->err;
+    longjmp(myerr->setjmp_buffer, 1);
+}
+
+static const char *format_names[] = { "rgb24", "yuv422p", "yuv420p", "gray" };
+static const char *ffmpeg_names[] = { "rgb24", "yuvj422p", "yuvj420p", "gray" };
+
+const char *frame_format_name(FrameFormat format) {
+    return format_names[format];
+}
+
+const char *frame_format_ffmpeg(FrameFormat format) {
+    return ffmpeg_names[format];
+}
+
+int frame_format_parse(const char *name, FrameFormat *format) {
+    for (int i = 0; i < (int)(sizeof(format_names) / sizeof(format_names[0])); i++) {
+        if (strcmp(name, format_names[i]) == 0) {
+            *format = (FrameFormat)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+int frame_num_planes(FrameFormat format) {
+    return format == FRAME_RGB24 || format == FRAME_GRAY8 ? 1 : 3;
+}
+
+static int chroma_height(FrameFormat format, int height) {
+    return format == FRAME_YUV420P ? (height + 1) / 2 : height;
+}
+
+void frame_plane_size(const Frame *f, int plane, int *width, int *height) {
+    if (plane == 0) {
+        *width = f->format == FRAME_RGB24 ? f->width * 3 : f->width;
+        *height = f->height;
+    }
+    else {
+        *width = (f->width + 1) / 2;
+        *height = chroma_height(f->format, f->height);
+    }
+}
+
+size_t frame_packed_size(const Frame *f) {
+    size_t size = 0;
+    for (int p = 0; p < frame_num_planes(f->format); p++) {
+        int width, height;
+        frame_plane_size(f, p, &width, &height);
+        size += (size_t)width * height;
+    }
+    return size;
+}
+
+const uint8_t *frame_packed(const Frame *f, uint8_t *buf) {
+    int padded = 0;
+    for (int p = 0; p < frame_num_planes(f->format); p++) {
+        int width, height;
+        frame_plane_size(f, p, &width, &height);
+        if (f->plane_stride[p] != width) padded = 1;
+    }
+    // Unpadded planes are laid out back to back already (planar_setup())
+    if (!padded) return f->pixels;
+
+    uint8_t *dst = buf;
+    for (int p = 0; p < frame_num_planes(f->format); p++) {
+        int width, height;
+        frame_plane_size(f, p, &width, &height);
+        for (int y = 0; y < height; y++, dst += width) {
+            memcpy(dst, f->planes[p] + (size_t)y * f->plane_stride[p], width);
+        }
+    }
+    return buf;
+}
+
+int jpeg_decoder_init(JpegDecoder *d) {
+    memset(d, 0, sizeof(*d));
+    d->cinfo.err = jpeg_std_error(&d->jerr.pub);
+    d->jerr.pub.error_exit = my_error_exit;
+    if (setjmp(d->jerr.setjmp_buffer)) {
+        LOG_ERROR("jpeg_decoder_init: libjpeg init failed");
+        return -1;
+    }
+    jpeg_create_decompress(&d->cinfo);
+    d->scale_denom = 1;
+    return 0;
+}
+
+int jpeg_decoder_set_scale(JpegDecoder *d, int scale_denom, int fast) {
+    if (scale_denom != 1 && scale_denom != 2 && scale_denom != 4 && scale_denom != 8) {
+        LOG_ERROR("jpeg_decoder_set_scale: unsupported scale 1/%d", scale_denom);
+        return -1;
+    }
+    d->scale_denom = scale_denom;
+    d->fast = fast;
+    return 0;
+}
+
+void jpeg_decoder_destroy(JpegDecoder *d) {
+    jpeg_destroy_decompress(&d->cinfo);
+    free(d->rows);
+    free(d->scratch);
+    free(d->strip_scratch);
+    d->rows = NULL;
+    d->scratch = NULL;
+    d->strip_scratch = NULL;
+}
+
+// Row pointer table for n rows, grown only when a frame is larger
+static int reserve_rows(JpegDecoder *d, int n) {
+    if (n <= d->rows_capacity) return 0;
+    JSAMPROW *rows = realloc(d->rows, sizeof(JSAMPROW) * n);
+    if (!rows) return -1;
+    d->rows = rows;
+    d->rows_capacity = n;
+    return 0;
+}
+
+// row0 for a decode that lays the frame out from the JPEG it decodes; a
+// strip decode writes from row row0 of a frame laid out already instead
+#define WHOLE_FRAME     -1
+
+// --- RGB24 and gray: libjpeg does the color conversion ---
+
+static int packed_setup(Frame *f, FrameFormat format, int width, int height) {
+    int stride = image_stride(width, format == FRAME_GRAY8 ? 1 : 3);     // Image-compatible
+    if (frame_pool_reserve_pixels(f->pool, (size_t)stride * height) < 0) return -1;
+    f->format = format;
+    f->width = width;
+    f->height = height;
+    f->stride = stride;
+    f->planes[0] = f->pixels;
+    f->plane_stride[0] = stride;
+    return 0;
+}
+
+static int decode_packed(JpegDecoder *d, Frame *f, FrameFormat format, int row0) {
+    struct jpeg_decompress_struct *cinfo = &d->cinfo;
+    cinfo->out_color_space = format == FRAME_GRAY8 ? JCS_GRAYSCALE : JCS_RGB;
+    jpeg_start_decompress(cinfo);
+
+    int height = cinfo->output_height;
+    if (row0 == WHOLE_FRAME) {
+        if (packed_setup(f, format, cinfo->output_width, height) < 0) return -1;
+        row0 = 0;
+    }
+    else if ((int)cinfo->output_width != f->width || row0 + height > f->height) {
+        return -1;
+    }
+    if (reserve_rows(d, height) < 0) return -1;
+
+    // Every row pointer up front: each call takes as many rows as libjpeg
+    // has ready instead of one
+    for (int y = 0; y < height; y++) d->rows[y] = f->planes[0] + (size_t)(row0 + y) * f->stride;
+    while (cinfo->output_scanline < cinfo->output_height) {
+        int y = cinfo->output_scanline;
+        jpeg_read_scanlines(cinfo, d->rows + y, height - y);
+    }
+    return 0;
+}
+
+// --- Planar YUV ---
+
+// Frame layout: Y, Cb, Cr planes, then scratch space the decode needs:
+// a row that output past the image height is sent to, and eight staged
+// chroma rows per component for the 4:2:2 -> 4:2:0 downsample
+typedef struct {
+    int width, height;
+    int chroma_width, chroma_height;
+    int y_stride, c_stride;
+    uint8_t *y, *cb, *cr;
+    uint8_t *discard;       // one luma row
+    uint8_t *stage_cb, *stage_cr;
+} PlanarLayout;
+
+static int planar_setup(Frame *f, FrameFormat format, int width, int height, PlanarLayout *l) {
+    l->width = width;
+    l->height = height;
+    l->chroma_width = (width + 1) / 2;
+    l->chroma_height = chroma_height(format, height);
+    l->y_stride = image_stride(width, 1);
+    l->c_stride = image_stride(l->chroma_width, 1);
+
+    size_t y_size = (size_t)l->y_stride * height;
+    size_t c_size = (size_t)l->c_stride * l->chroma_height;
+    size_t scratch = (size_t)l->y_stride + 2 * DCTSIZE * (size_t)l->c_stride;
+    if (frame_pool_reserve_pixels(f->pool, y_size + 2 * c_size + scratch) < 0) return -1;
+
+    l->y = f->pixels;
+    l->cb = l->y + y_size;
+    l->cr = l->cb + c_size;
+    l->discard = l->cr + c_size;
+    l->stage_cb = l->discard + l->y_stride;
+    l->stage_cr = l->stage_cb + DCTSIZE * (size_t)l->c_stride;
+
+    f->format = format;
+    f->width = width;
+    f->height = height;
+    f->stride = l->y_stride;
+    f->planes[0] = l->y;
+    f->planes[1] = l->cb;
+    f->planes[2] = l->cr;
+    f->plane_stride[0] = l->y_stride;
+    f->plane_stride[1] = l->c_stride;
+    f->plane_stride[2] = l->c_stride;
+    return 0;
+}
+
+// The layout of a frame planar_setup() has laid out, for a strip decode.
+// Strips decode at the same time, so their discard and staging rows are
+// the decoder's, not the frame's.
+static int planar_view(JpegDecoder *d, Frame *f, PlanarLayout *l) {
+    l->width = f->width;
+    l->height = f->height;
+    l->chroma_width = (f->width + 1) / 2;
+    l->chroma_height = chroma_height(f->format, f->height);
+    l->y_stride = f->plane_stride[0];
+    l->c_stride = f->plane_stride[1];
+    l->y = f->planes[0];
+    l->cb = f->planes[1];
+    l->cr = f->planes[2];
+
+    size_t scratch = (size_t)l->y_stride + 2 * DCTSIZE * (size_t)l->c_stride;
+    if (d->strip_scratch_size < scratch) {
+        uint8_t *grown = realloc(d->strip_scratch, scratch);
+        if (!grown) return -1;
+        d->strip_scratch = grown;
+        d->strip_scratch_size = scratch;
+    }
+    l->discard = d->strip_scratch;
+    l->stage_cb = l->discard + l->y_stride;
+    l->stage_cr = l->stage_cb + DCTSIZE * (size_t)l->c_stride;
+    return 0;
+}
+
+// Either lays f out for the JPEG being decoded (whole frame), or checks
+// that the strip from row0 on fits the frame as laid out
+static int planar_target(JpegDecoder *d, Frame *f, FrameFormat format, int width, int height,
+                         int row0, PlanarLayout *l) {
+    if (row0 == WHOLE_FRAME) return planar_setup(f, format, width, height, l);
+    if (width != f->width || row0 + height > f->height) return -1;
+    return planar_view(d, f, l);
+}
+
+// Y 2x1 or 2x2, Cb and Cr 1x1: what the raw path handles
+static int raw_sampling_supported(const struct jpeg_decompress_struct *cinfo) {
+    const jpeg_component_info *c = cinfo->comp_info;
+    return cinfo->jpeg_color_space == JCS_YCbCr && cinfo->num_components == 3 &&
+           c[0].h_samp_factor == 2 && (c[0].v_samp_factor == 1 || c[0].v_samp_factor == 2) &&
+           c[1].h_samp_factor == 1 && c[1].v_samp_factor == 1 &&
+           c[2].h_samp_factor == 1 && c[2].v_samp_factor == 1;
+}
+
+static uint8_t *plane_row(uint8_t *plane, int stride, int row, int rows, uint8_t *discard) {
+    return row < rows ? plane + (size_t)row * stride : discard;
+}
+
+// jpeg_read_raw_data() returns one iMCU row per call: 8 (4:2:2) or 16
+// (4:2:0) luma rows and 8 chroma rows, written through row pointers into
+// the planes. Rows past the image edge go to the discard row.
+static int decode_raw(JpegDecoder *d, Frame *f, FrameFormat format, int row0) {
+    struct jpeg_decompress_struct *cinfo = &d->cinfo;
+    PlanarLayout l;
+    if (planar_target(d, f, format, cinfo->image_width, cinfo->image_height, row0, &l) < 0) return -1;
+    if (row0 == WHOLE_FRAME) row0 = 0;
+
+    cinfo->raw_data_out = TRUE;
+    jpeg_start_decompress(cinfo);
+
+    const ImageKernels *k = image_kernels();
+    int src_420 = cinfo->comp_info[0].v_samp_factor == 2;
+    int luma_rows = cinfo->max_v_samp_factor * DCTSIZE;
+    JSAMPROW y_rows[2 * DCTSIZE], cb_rows[DCTSIZE], cr_rows[DCTSIZE];
+    JSAMPARRAY planes[3] = { y_rows, cb_rows, cr_rows };
+
+    while (cinfo->output_scanline < cinfo->output_height) {
+        int y0 = row0 + cinfo->output_scanline;
+        int c0 = src_420 ? y0 / 2 : y0;         // first chroma row of this iMCU row
+
+        for (int i = 0; i < luma_rows; i++) {
+            y_rows[i] = plane_row(l.y, l.y_stride, y0 + i, l.height, l.discard);
+        }
+        for (int i = 0; i < DCTSIZE; i++) {
+            if (format == FRAME_YUV420P && !src_420) {
+                // 4:2:2 -> 4:2:0: stage, then average row pairs below
+                cb_rows[i] = l.stage_cb + (size_t)i * l.c_stride;
+                cr_rows[i] = l.stage_cr + (size_t)i * l.c_stride;
+            }
+            else {
+                // Same sampling, or 4:2:0 -> 4:2:2 into every other row
+                int row = format == FRAME_YUV422P && src_420 ? 2 * (c0 + i) : c0 + i;
+                cb_rows[i] = plane_row(l.cb, l.c_stride, row, l.chroma_height, l.discard);
+                cr_rows[i] = plane_row(l.cr, l.c_stride, row, l.chroma_height, l.discard);
+            }
+        }
+
+        jpeg_read_raw_data(cinfo, planes, luma_rows);
+
+        if (format == FRAME_YUV420P && !src_420) {
+            for (int i = 0; i < DCTSIZE / 2 && c0 / 2 + i < l.chroma_height; i++) {
+                size_t out = (size_t)(c0 / 2 + i) * l.c_stride;
+                k->average(cb_rows[2 * i], cb_rows[2 * i + 1], l.cb + out, l.chroma_width);
+                k->average(cr_rows[2 * i], cr_rows[2 * i + 1], l.cr + out, l.chroma_width);
+            }
+        }
+        else if (format == FRAME_YUV422P && src_420) {
+            for (int i = 0; i < DCTSIZE && 2 * (c0 + i) + 1 < l.chroma_height; i++) {
+                size_t row = (size_t)2 * (c0 + i) * l.c_stride;
+                memcpy(l.cb + row + l.c_stride, l.cb + row, l.chroma_width);
+                memcpy(l.cr + row + l.c_stride, l.cr + row, l.chroma_width);
+            }
+        }
+    }
+    return 0;
+}
+
+// Any other sampling: YCbCr scanlines (libjpeg upsamples the chroma),
+// read rec_outbuf_height at a time into the scratch buffer, then split
+// into planes and subsampled here
+static void ycc_to_planes(const PlanarLayout *l, FrameFormat format, const uint8_t *line, int y) {
+    uint8_t *yp = l->y + (size_t)y * l->y_stride;
+    for (int x = 0; x < l->width; x++) yp[x] = line[x * 3];
+
+    int crow = format == FRAME_YUV420P ? y / 2 : y;
+    int second = format == FRAME_YUV420P && (y & 1);
+    uint8_t *cb = l->cb + (size_t)crow * l->c_stride;
+    uint8_t *cr = l->cr + (size_t)crow * l->c_stride;
+    for (int x = 0; x < l->chroma_width; x++) {
+        const uint8_t *p = line + x * 6;
+        int last = 2 * x + 1 >= l->width;      // odd width: no right neighbour
+        int u = last ? p[1] : (p[1] + p[4] + 1) >> 1;
+        int v = last ? p[2] : (p[2] + p[5] + 1) >> 1;
+        if (second) {
+            u = (cb[x] + u + 1) >> 1;
+            v = (cr[x] + v + 1) >> 1;
+        }
+        cb[x] = (uint8_t)u;
+        cr[x] = (uint8_t)v;
+    }
+}
+
+static int decode_ycc(JpegDecoder *d, Frame *f, FrameFormat format, int row0) {
+    struct jpeg_decompress_struct *cinfo = &d->cinfo;
+    cinfo->out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(cinfo);
+    if (cinfo->output_components != 3) return -1;
+
+    PlanarLayout l;
+    if (planar_target(d, f, format, cinfo->output_width, cinfo->output_height, row0, &l) < 0) return -1;
+    if (row0 == WHOLE_FRAME) row0 = 0;
+
+    int batch = cinfo->rec_outbuf_height;
+    size_t line_size = (size_t)cinfo->output_width * 3;
+    if (d->scratch_size < line_size * batch) {
+        uint8_t *scratch = realloc(d->scratch, line_size * batch);
+        if (!scratch) return -1;
+        d->scratch = scratch;
+        d->scratch_size = line_size * batch;
+    }
+    if (reserve_rows(d, batch) < 0) return -1;
+    for (int i = 0; i < batch; i++) d->rows[i] = d->scratch + i * line_size;
+
+    while (cinfo->output_scanline < cinfo->output_height) {
+        int y = row0 + cinfo->output_scanline;
+        int n = jpeg_read_scanlines(cinfo, d->rows, batch);
+        for (int i = 0; i < n; i++) ycc_to_planes(&l, format, d->rows[i], y + i);
+    }
+    return 0;
+}
+
+// The decompressor is reused; a source manager only fits the kind of
+// source it was made for (jpeg_mem_src() refuses any other)
+static void set_mem_source(JpegDecoder *d, const uint8_t *data, size_t size) {
+    if (d->slice_source) d->cinfo.src = NULL;
+    d->slice_source = 0;
+    jpeg_mem_src(&d->cinfo, data, size);
+}
+
+static void set_source(JpegDecoder *d, const Frame *f) {
+    if (f->slices.num_slices > 0) {
+        jpeg_slice_src(&d->cinfo, &f->slices);
+        d->slice_source = 1;
+        return;
+    }
+    set_mem_source(d, f->jpeg, f->jpeg_size);
+}
+
+static int count_frame(JpegDecoder *d, uint64_t t0, int ret) {
+    uint64_t dt = decoder_now_ns() - t0;
+    d->frames++;
+    d->total_ns += dt;
+    if (dt > d->max_ns) d->max_ns = dt;
+    if (ret < 0) d->errors++;
+    return ret;
+}
+
+int jpeg_decoder_decode(JpegDecoder *d, Frame *f, FrameFormat format) {
+    return jpeg_decoder_decode_into(d, f, f, format);
+}
+
+// Source set, from the header on; row0 is WHOLE_FRAME or a strip's first row
+static int decode_from_source(JpegDecoder *d, Frame *dst, FrameFormat format, int row0, uint64_t t0) {
+    struct jpeg_decompress_struct *cinfo = &d->cinfo;
+
+    if (setjmp(d->jerr.setjmp_buffer)) {
+        // If we get here, libjpeg found a corrupt frame; the decompressor
+        // stays usable for the next one
+        jpeg_abort_decompress(cinfo);
+        return count_frame(d, t0, -1);
+    }
+
+    if (jpeg_read_header(cinfo, TRUE) != JPEG_HEADER_OK) {
+        jpeg_abort_decompress(cinfo);
+        return count_frame(d, t0, -1);
+    }
+
+    // jpeg_read_header() reset these to the defaults
+    cinfo->scale_num = 1;
+    cinfo->scale_denom = d->scale_denom;
+    if (d->fast) {
+        cinfo->dct_method = JDCT_IFAST;
+        cinfo->do_fancy_upsampling = FALSE;
+        cinfo->do_block_smoothing = FALSE;
+    }
+
+    int ret;
+    if (format == FRAME_RGB24 || format == FRAME_GRAY8) ret = decode_packed(d, dst, format, row0);
+    else if (d->scale_denom == 1 && raw_sampling_supported(cinfo)) ret = decode_raw(d, dst, format, row0);
+    else ret = decode_ycc(d, dst, format, row0);
+
+    if (ret == 0) jpeg_finish_decompress(cinfo);
+    else jpeg_abort_decompress(cinfo);
+    return count_frame(d, t0, ret);
+}
+
+int jpeg_decoder_decode_into(JpegDecoder *d, const Frame *src, Frame *dst, FrameFormat format) {
+    uint64_t t0 = decoder_now_ns();
+    set_source(d, src);
+    dst->format = format;
+    return decode_from_source(d, dst, format, WHOLE_FRAME, t0);
+}
+
+int jpeg_decoder_layout(Frame *f, FrameFormat format, int width, int height) {
+    if (format == FRAME_RGB24 || format == FRAME_GRAY8) return packed_setup(f, format, width, height);
+    PlanarLayout l;
+    return planar_setup(f, format, width, height, &l);
+}
+
+int jpeg_decoder_decode_strip(JpegDecoder *d, const uint8_t *jpeg, size_t size, Frame *f, int row0) {
+    uint64_t t0 = decoder_now_ns();
+    if (d->scale_denom != 1) return count_frame(d, t0, -1);
+    set_mem_source(d, jpeg, size);
+    return decode_from_source(d, f, f->format, row0, t0);
+}
+
+void jpeg_decoder_print_stats(const JpegDecoder *d, const char *name) {
+    printf("[Decode %s] %llu frames, %llu errors, %.2f ms/frame avg, %.2f ms max\n", name,
+           (unsigned long long)d->frames, (unsigned long long)d->errors,
+           d->frames ? d->total_ns / 1e6 / d->frames : 0.0, d->max_ns / 1e6);
+}
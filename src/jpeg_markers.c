@@ -0,0 +1,187 @@
+#include <string.h>
+#include <pthread.h>
+#include "cpu_features.h"
+#include "jpeg_markers.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+typedef long (*find_marker_fn)(const uint8_t *data, size_t len);
+
+static long find_marker_from(const uint8_t *data, size_t len, size_t i) {
+    for (; i + 1 < len; i++) {
+        if (data[i] == 0xFF && jpeg_is_marker_code(data[i + 1])) return (long)i;
+    }
+    return -1;
+}
+
+long jpeg_find_marker_scalar(const uint8_t *data, size_t len) {
+    return find_marker_from(data, len, 0);
+}
+
+// The SIMD kernels compare a block with the same block shifted by one byte:
+// hit = (data[i] == 0xFF) && code byte is not 00 / FF / D0-D7.
+// Blocks without any 0xFF (almost all of them) cost one compare + movemask.
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("sse2")))
+long jpeg_find_marker_sse2(const uint8_t *data, size_t len) {
+    const __m128i ff = _mm_set1_epi8((char)0xFF);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i f8 = _mm_set1_epi8((char)0xF8);
+    const __m128i d0 = _mm_set1_epi8((char)0xD0);
+    size_t i = 0;
+
+    for (; i + 17 <= len; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i is_ff = _mm_cmpeq_epi8(a, ff);
+        if (!_mm_movemask_epi8(is_ff)) continue;
+
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + 1));
+        __m128i bad = _mm_or_si128(_mm_cmpeq_epi8(b, zero), _mm_cmpeq_epi8(b, ff));
+        bad = _mm_or_si128(bad, _mm_cmpeq_epi8(_mm_and_si128(b, f8), d0));
+        int mask = _mm_movemask_epi8(_mm_andnot_si128(bad, is_ff));
+        if (mask) return (long)(i + __builtin_ctz(mask));
+    }
+    return find_marker_from(data, len, i);
+}
+
+__attribute__((target("avx2")))
+long jpeg_find_marker_avx2(const uint8_t *data, size_t len) {
+    const __m256i ff = _mm256_set1_epi8((char)0xFF);
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i f8 = _mm256_set1_epi8((char)0xF8);
+    const __m256i d0 = _mm256_set1_epi8((char)0xD0);
+    size_t i = 0;
+
+    for (; i + 33 <= len; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i is_ff = _mm256_cmpeq_epi8(a, ff);
+        if (!_mm256_movemask_epi8(is_ff)) continue;
+
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + 1));
+        __m256i bad = _mm256_or_si256(_mm256_cmpeq_epi8(b, zero), _mm256_cmpeq_epi8(b, ff));
+        bad = _mm256_or_si256(bad, _mm256_cmpeq_epi8(_mm256_and_si256(b, f8), d0));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(_mm256_andnot_si256(bad, is_ff));
+        if (mask) return (long)(i + __builtin_ctz(mask));
+    }
+    return find_marker_from(data, len, i);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+// NEON has no movemask: narrowing each 16-bit lane by 4 packs one nibble
+// per byte into a 64-bit word, so ctz / 4 is the byte index
+static inline uint64_t neon_nibble_mask(uint8x16_t v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+
+long jpeg_find_marker_neon(const uint8_t *data, size_t len) {
+    const uint8x16_t ff = vdupq_n_u8(0xFF);
+    const uint8x16_t zero = vdupq_n_u8(0x00);
+    const uint8x16_t f8 = vdupq_n_u8(0xF8);
+    const uint8x16_t d0 = vdupq_n_u8(0xD0);
+    size_t i = 0;
+
+    for (; i + 17 <= len; i += 16) {
+        uint8x16_t a = vld1q_u8(data + i);
+        uint8x16_t is_ff = vceqq_u8(a, ff);
+        if (!neon_nibble_mask(is_ff)) continue;
+
+        uint8x16_t b = vld1q_u8(data + i + 1);
+        uint8x16_t bad = vorrq_u8(vceqq_u8(b, zero), vceqq_u8(b, ff));
+        bad = vorrq_u8(bad, vceqq_u8(vandq_u8(b, f8), d0));
+        uint64_t mask = neon_nibble_mask(vbicq_u8(is_ff, bad));
+        if (mask) return (long)(i + (__builtin_ctzll(mask) >> 2));
+    }
+    return find_marker_from(data, len, i);
+}
+#endif
+
+// Picked once, by whichever thread scans first (loop threads, decode
+// threads and decoder pool workers all do)
+static pthread_once_t g_find_marker_once = PTHREAD_ONCE_INIT;
+static find_marker_fn g_find_marker = jpeg_find_marker_scalar;
+static const char *g_find_marker_name = "scalar";
+
+static void resolve_find_marker(void) {
+    unsigned f = cpu_features();
+    (void)f;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (f & CPU_FEATURE_AVX2) {
+        g_find_marker_name = "avx2";
+        g_find_marker = jpeg_find_marker_avx2;
+        return;
+    }
+    if (f & CPU_FEATURE_SSE2) {
+        g_find_marker_name = "sse2";
+        g_find_marker = jpeg_find_marker_sse2;
+        return;
+    }
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    if (f & CPU_FEATURE_NEON) {
+        g_find_marker_name = "neon";
+        g_find_marker = jpeg_find_marker_neon;
+        return;
+    }
+#endif
+}
+
+long jpeg_find_marker(const uint8_t *data, size_t len) {
+    pthread_once(&g_find_marker_once, resolve_find_marker);
+    return g_find_marker(data, len);
+}
+
+long jpeg_find_marker_code(const uint8_t *data, size_t len, uint8_t code) {
+    size_t pos = 0;
+
+    while (pos + 1 < len) {
+        long m = jpeg_find_marker(data + pos, len - pos);
+        if (m < 0) return -1;
+        pos += m;
+        if (data[pos + 1] == code) return (long)pos;
+        pos += 2;   // A marker code is never 0xFF, so it cannot start the next one
+    }
+    return -1;
+}
+
+const char *jpeg_find_marker_impl(void) {
+    pthread_once(&g_find_marker_once, resolve_find_marker);
+    return g_find_marker_name;
+}
+
+// SOF0-SOF15, minus the DHT, JPG and DAC codes that share the range
+static int is_sof(uint8_t code) {
+    return (code & 0xF0) == 0xC0 && code != 0xC4 && code != 0xC8 && code != 0xCC;
+}
+
+int jpeg_frame_size(const uint8_t *data, size_t len, int *width, int *height) {
+    if (len < 2 || data[0] != 0xFF || data[1] != JPEG_MARKER_SOI) return -1;
+
+    size_t pos = 2;
+    while (pos + 4 <= len) {
+        if (data[pos] != 0xFF) return -1;
+        uint8_t code = data[pos + 1];
+        if (code == 0xFF) {             // fill byte before a marker
+            pos++;
+            continue;
+        }
+        size_t seg_len = ((size_t)data[pos + 2] << 8) | data[pos + 3];
+        if (is_sof(code)) {
+            // length, precision, height, width
+            if (pos + 9 > len) return -1;
+            *height = (data[pos + 5] << 8) | data[pos + 6];
+            *width = (data[pos + 7] << 8) | data[pos + 8];
+            return 0;
+        }
+        if (code == 0xDA || code == JPEG_MARKER_EOI) return -1;     // scan before any SOF
+        pos += 2 + seg_len;
+    }
+    return -1;
+}
@@ -0,0 +1,392 @@
+#define _GNU_SOURCE     // pthread_setaffinity_np()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+#include "jpeg_strips.h"
+#include "log.h"
+
+#define MARKER_SOF0     0xC0        // baseline
+#define MARKER_SOF1     0xC1        // extended sequential, Huffman
+#define MARKER_DRI      0xDD
+#define MARKER_SOS      0xDA
+#define MARKER_RST0     0xD0
+
+static uint64_t strips_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int is_sof(uint8_t code) {
+    return (code & 0xF0) == 0xC0 && code != 0xC4 && code != 0xC8 && code != 0xCC;
+}
+
+static int read_u16(const uint8_t *p) {
+    return (p[0] << 8) | p[1];
+}
+
+// --- Restart map ---
+
+static int parse_sof(JpegRestartMap *map, const uint8_t *seg, size_t seg_len) {
+    // length, precision, height, width, components, then id / HV / table each
+    if (seg_len < 8) return -1;
+    map->height = read_u16(seg + 3);
+    map->width = read_u16(seg + 5);
+    map->num_components = seg[7];
+    if (map->width == 0 || map->height == 0) return -1;     // height in a DNL: not handled
+    if (map->num_components < 1 || map->num_components > 3) return -1;
+    if (seg_len < 8 + 3 * (size_t)map->num_components) return -1;
+
+    int h_max = 1, v_max = 1;
+    for (int c = 0; c < map->num_components; c++) {
+        map->h_samp[c] = seg[9 + 3 * c] >> 4;
+        map->v_samp[c] = seg[9 + 3 * c] & 15;
+        if (map->h_samp[c] < 1 || map->h_samp[c] > 4 || map->v_samp[c] < 1 || map->v_samp[c] > 4) return -1;
+        if (map->h_samp[c] > h_max) h_max = map->h_samp[c];
+        if (map->v_samp[c] > v_max) v_max = map->v_samp[c];
+    }
+    // A single-component scan is not interleaved: one block per MCU
+    map->mcu_width = map->num_components == 1 ? 8 : 8 * h_max;
+    map->mcu_height = map->num_components == 1 ? 8 : 8 * v_max;
+    map->mcus_per_row = (map->width + map->mcu_width - 1) / map->mcu_width;
+    map->mcu_rows = (map->height + map->mcu_height - 1) / map->mcu_height;
+    return 0;
+}
+
+static int add_restart(JpegRestartMap *map, size_t pos) {
+    if (map->num_restarts == map->restarts_capacity) {
+        int capacity = map->restarts_capacity ? map->restarts_capacity * 2 : 256;
+        uint32_t *grown = realloc(map->restarts, capacity * sizeof(*grown));
+        if (!grown) return -1;
+        map->restarts = grown;
+        map->restarts_capacity = capacity;
+    }
+    map->restarts[map->num_restarts++] = (uint32_t)pos;
+    return 0;
+}
+
+// RST markers up to the marker that ends the scan. Inside entropy-coded
+// data 0xFF is followed by 0x00 (stuffing), more 0xFF (fill) or a marker.
+static int scan_restarts(JpegRestartMap *map, const uint8_t *jpeg, size_t size) {
+    size_t pos = map->scan_pos;
+    while (pos + 1 < size) {
+        const uint8_t *ff = memchr(jpeg + pos, 0xFF, size - 1 - pos);
+        if (!ff) return -1;
+        pos = ff - jpeg;
+        uint8_t code = jpeg[pos + 1];
+        if (code == 0xFF) {
+            pos++;
+            continue;
+        }
+        if (code == 0x00) {
+            pos += 2;
+            continue;
+        }
+        if ((code & 0xF8) == MARKER_RST0) {
+            if (add_restart(map, pos) < 0) return -1;
+            pos += 2;
+            continue;
+        }
+        // One scan only: what follows must be the end of the image
+        map->scan_end = pos;
+        return code == 0xD9 ? 0 : -1;
+    }
+    return -1;
+}
+
+int jpeg_restart_map(JpegRestartMap *map, const uint8_t *jpeg, size_t size) {
+    map->width = map->height = 0;
+    map->restart_interval = 0;
+    map->num_restarts = 0;
+    if (size < 4 || jpeg[0] != 0xFF || jpeg[1] != 0xD8) return -1;
+
+    size_t pos = 2;
+    while (pos + 4 <= size) {
+        if (jpeg[pos] != 0xFF) return -1;
+        uint8_t code = jpeg[pos + 1];
+        if (code == 0xFF) {             // fill byte before a marker
+            pos++;
+            continue;
+        }
+        size_t seg_len = read_u16(jpeg + pos + 2);
+        if (seg_len < 2 || pos + 2 + seg_len > size) return -1;
+        const uint8_t *seg = jpeg + pos + 2;
+
+        if (is_sof(code)) {
+            if (code != MARKER_SOF0 && code != MARKER_SOF1) return -1;    // progressive, lossless, arithmetic
+            if (parse_sof(map, seg, seg_len) < 0) return -1;
+            map->sof_height_pos = pos + 5;
+        }
+        else if (code == MARKER_DRI && seg_len >= 4) {
+            map->restart_interval = read_u16(seg + 2);
+        }
+        else if (code == MARKER_SOS) {
+            // Every component in the one scan
+            if (!map->width || seg_len < 3 || seg[2] != map->num_components) return -1;
+            map->scan_pos = pos + 2 + seg_len;
+            return scan_restarts(map, jpeg, size);
+        }
+        else if (code == 0xD9) {
+            return -1;
+        }
+        pos += 2 + seg_len;
+    }
+    return -1;
+}
+
+void jpeg_restart_map_free(JpegRestartMap *map) {
+    free(map->restarts);
+    map->restarts = NULL;
+    map->restarts_capacity = 0;
+    map->num_restarts = 0;
+}
+
+// --- Strips ---
+
+static int gcd(int a, int b) {
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+int jpeg_strips_plan(const JpegRestartMap *map, int max_strips, int *first_row) {
+    first_row[0] = 0;
+    int ri = map->restart_interval;
+    if (ri == 0 || max_strips < 2) return 1;
+
+    // Every interval must be there, or strips would start in the wrong place
+    int intervals = (map->mcus_per_row * map->mcu_rows + ri - 1) / ri;
+    if (map->num_restarts != intervals - 1) return 1;
+
+    // Intervals start an MCU row every step rows
+    int step = ri / gcd(ri, map->mcus_per_row);
+    int cuts = (map->mcu_rows - 1) / step;
+    int n = cuts + 1 < max_strips ? cuts + 1 : max_strips;
+    int strips = 1;
+    for (int i = 1; i < n; i++) {
+        int row = (i * map->mcu_rows + n / 2) / n;
+        row = (row + step / 2) / step * step;
+        if (row <= first_row[strips - 1]) row = first_row[strips - 1] + step;
+        if (row >= map->mcu_rows) break;
+        first_row[strips++] = row;
+    }
+    return strips;
+}
+
+// Whether strips decode exactly as the whole frame would: libjpeg's
+// vertical chroma upsampling reads the rows on either side, which a
+// strip edge cuts off. The raw YUV path and luma-only output do not
+// upsample.
+static int strips_exact(const JpegRestartMap *map, FrameFormat format) {
+    int v_max = 1;
+    for (int c = 0; c < map->num_components; c++) {
+        if (map->v_samp[c] > v_max) v_max = map->v_samp[c];
+    }
+    if (v_max == 1 || format == FRAME_GRAY8 || map->num_components == 1) return 1;
+    if (format == FRAME_RGB24) return 0;
+    // jpeg_decoder.c's raw path: Y 2x1 or 2x2, Cb and Cr 1x1
+    return map->num_components == 3 && map->h_samp[0] == 2 &&
+           map->h_samp[1] == 1 && map->v_samp[1] == 1 &&
+           map->h_samp[2] == 1 && map->v_samp[2] == 1;
+}
+
+// The headers, the SOF height cut down to the strip, the strip's
+// intervals with their RST markers numbered from RST0, and EOI
+static int build_strip(const JpegRestartMap *map, const uint8_t *jpeg, JpegStrip *strip) {
+    int ri = map->restart_interval;
+    int k0 = strip->first_row * map->mcus_per_row / ri;         // first interval
+    int k1 = strip->end_row == map->mcu_rows ? map->num_restarts + 1
+                                             : strip->end_row * map->mcus_per_row / ri;
+    size_t start = k0 == 0 ? map->scan_pos : map->restarts[k0 - 1] + 2;
+    size_t end = k1 - 1 < map->num_restarts ? map->restarts[k1 - 1] : map->scan_end;
+
+    size_t size = map->scan_pos + (end - start) + 2;
+    if (size > strip->capacity) {
+        uint8_t *grown = realloc(strip->data, size);
+        if (!grown) return -1;
+        strip->data = grown;
+        strip->capacity = size;
+    }
+    uint8_t *out = strip->data;
+    memcpy(out, jpeg, map->scan_pos);
+    int bottom = strip->end_row * map->mcu_height;
+    if (bottom > map->height) bottom = map->height;
+    int height = bottom - strip->first_row * map->mcu_height;
+    out[map->sof_height_pos] = (uint8_t)(height >> 8);
+    out[map->sof_height_pos + 1] = (uint8_t)height;
+
+    uint8_t *data = out + map->scan_pos;
+    memcpy(data, jpeg + start, end - start);
+    if (k0 % 8) {
+        for (int k = k0; k < k1 - 1; k++) {
+            data[map->restarts[k] - start + 1] = (uint8_t)(MARKER_RST0 + ((k - k0) & 7));
+        }
+    }
+    data[end - start] = 0xFF;
+    data[end - start + 1] = 0xD9;
+    strip->size = size;
+    return 0;
+}
+
+static void decode_strip(StripDecoder *sd, JpegDecoder *d, JpegStrip *strip, int i) {
+    strip->first_row = sd->first_row[i];
+    strip->end_row = sd->first_row[i + 1];
+    if (build_strip(&sd->map, sd->jpeg, strip) < 0) {
+        strip->ret = -1;
+        return;
+    }
+    strip->ret = jpeg_decoder_decode_strip(d, strip->data, strip->size, sd->frame,
+                                           strip->first_row * sd->map.mcu_height);
+}
+
+static void *worker_run(void *arg) {
+    StripWorker *w = arg;
+    StripDecoder *sd = w->sd;
+
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+            LOG_WARN("strip_decoder: worker %d: cannot pin to CPU %d", w->index, w->cpu);
+        }
+    }
+
+    uint64_t seen = 0;
+    pthread_mutex_lock(&sd->lock);
+    for (;;) {
+        while (!sd->stop && sd->generation == seen) pthread_cond_wait(&sd->start, &sd->lock);
+        if (sd->stop) break;
+        seen = sd->generation;
+        int i = w->index + 1;
+        if (i >= sd->num_strips) continue;
+
+        pthread_mutex_unlock(&sd->lock);
+        decode_strip(sd, &w->decoder, &w->strip, i);
+        pthread_mutex_lock(&sd->lock);
+        if (--sd->pending == 0) pthread_cond_signal(&sd->done);
+    }
+    pthread_mutex_unlock(&sd->lock);
+    return NULL;
+}
+
+int strip_decoder_init(StripDecoder *sd, int max_strips, int first_cpu) {
+    memset(sd, 0, sizeof(*sd));
+    if (max_strips < 1) max_strips = 1;
+    if (max_strips > JPEG_STRIPS_MAX) max_strips = JPEG_STRIPS_MAX;
+    if (jpeg_decoder_init(&sd->decoder) < 0) return -1;
+    pthread_mutex_init(&sd->lock, NULL);
+    pthread_cond_init(&sd->start, NULL);
+    pthread_cond_init(&sd->done, NULL);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+    for (int i = 0; i < max_strips - 1; i++) {
+        StripWorker *w = &sd->workers[i];
+        w->sd = sd;
+        w->index = i;
+        w->cpu = first_cpu >= 0 ? (int)((first_cpu + 1 + i) % cpus) : -1;
+        if (jpeg_decoder_init(&w->decoder) < 0) return -1;
+        if (pthread_create(&w->thread, NULL, worker_run, w) != 0) {
+            LOG_ERROR("strip_decoder_init: failed to create worker %d", i);
+            jpeg_decoder_destroy(&w->decoder);
+            return -1;
+        }
+        sd->num_workers++;
+    }
+    return 0;
+}
+
+void strip_decoder_destroy(StripDecoder *sd) {
+    pthread_mutex_lock(&sd->lock);
+    sd->stop = 1;
+    pthread_cond_broadcast(&sd->start);
+    pthread_mutex_unlock(&sd->lock);
+    for (int i = 0; i < sd->num_workers; i++) {
+        pthread_join(sd->workers[i].thread, NULL);
+        jpeg_decoder_destroy(&sd->workers[i].decoder);
+        free(sd->workers[i].strip.data);
+    }
+    jpeg_decoder_destroy(&sd->decoder);
+    free(sd->strip.data);
+    sd->strip.data = NULL;
+    jpeg_restart_map_free(&sd->map);
+    pthread_mutex_destroy(&sd->lock);
+    pthread_cond_destroy(&sd->start);
+    pthread_cond_destroy(&sd->done);
+}
+
+// Strip 0 here, the others on the workers, all into f
+static int decode_split(StripDecoder *sd, Frame *f, FrameFormat format, int n) {
+    if (jpeg_decoder_layout(f, format, sd->map.width, sd->map.height) < 0) return -1;
+
+    pthread_mutex_lock(&sd->lock);
+    sd->jpeg = f->jpeg;
+    sd->frame = f;
+    sd->num_strips = n;
+    sd->first_row[n] = sd->map.mcu_rows;
+    sd->pending = n - 1;
+    sd->generation++;
+    pthread_cond_broadcast(&sd->start);
+    pthread_mutex_unlock(&sd->lock);
+
+    decode_strip(sd, &sd->decoder, &sd->strip, 0);
+
+    pthread_mutex_lock(&sd->lock);
+    while (sd->pending > 0) pthread_cond_wait(&sd->done, &sd->lock);
+    pthread_mutex_unlock(&sd->lock);
+
+    int ret = sd->strip.ret;
+    for (int i = 1; i < n; i++) {
+        if (sd->workers[i - 1].strip.ret < 0) ret = -1;
+    }
+    return ret;
+}
+
+int strip_decoder_decode(StripDecoder *sd, Frame *f, FrameFormat format) {
+    uint64_t t0 = strips_now_ns();
+    int n = 1;
+    // Zero-copy frames are scattered over URBs: serial
+    int mapped = f->slices.num_slices == 0 && jpeg_restart_map(&sd->map, f->jpeg, f->jpeg_size) == 0;
+    if (mapped && sd->map.restart_interval == 0) sd->no_restarts++;
+    else if (mapped && strips_exact(&sd->map, format)) n = jpeg_strips_plan(&sd->map, sd->num_workers + 1, sd->first_row);
+    if (n < 2 && !(mapped && sd->map.restart_interval == 0)) sd->not_splittable++;
+
+    int ret;
+    if (n < 2) {
+        ret = jpeg_decoder_decode(&sd->decoder, f, format);
+    }
+    else {
+        ret = decode_split(sd, f, format, n);
+        sd->split_frames++;
+        sd->strips += n;
+    }
+
+    uint64_t dt = strips_now_ns() - t0;
+    sd->frames++;
+    sd->total_ns += dt;
+    if (dt > sd->max_ns) sd->max_ns = dt;
+    if (ret < 0) sd->errors++;
+    return ret;
+}
+
+void strip_decoder_print_stats(const StripDecoder *sd, const char *name) {
+    JpegDecoder sum;
+    memset(&sum, 0, sizeof(sum));
+    sum.frames = sd->frames;
+    sum.errors = sd->errors;
+    sum.total_ns = sd->total_ns;
+    sum.max_ns = sd->max_ns;
+    jpeg_decoder_print_stats(&sum, name);
+    printf("[Strips] up to %d per frame: %llu frames split (%.1f strips avg), %llu serial without DRI, "
+           "%llu serial not splittable\n", sd->num_workers + 1,
+           (unsigned long long)sd->split_frames,
+           sd->split_frames ? (double)sd->strips / sd->split_frames : 0.0,
+           (unsigned long long)sd->no_restarts, (unsigned long long)sd->not_splittable);
+}
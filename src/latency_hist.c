@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include "latency_hist.h"
+#include "log.h"
+
+#define SUB_COUNT   (1u << LATENCY_HIST_SUB_BITS)
+
+static int bucket_index(uint64_t v) {
+    if (v >= (1ull << LATENCY_HIST_MAX_BITS)) return LATENCY_HIST_BUCKETS - 1;
+    if (v < 2 * SUB_COUNT) return (int)v;
+    int shift = (63 - __builtin_clzll(v)) - LATENCY_HIST_SUB_BITS;
+    return ((shift + 1) << LATENCY_HIST_SUB_BITS) + (int)((v >> shift) & (SUB_COUNT - 1));
+}
+
+// Largest value that lands in bucket i
+static uint64_t bucket_high(int i) {
+    if (i < (int)(2 * SUB_COUNT)) return i;
+    int shift = (i >> LATENCY_HIST_SUB_BITS) - 1;
+    uint64_t low = (uint64_t)((i & (SUB_COUNT - 1)) | SUB_COUNT) << shift;
+    return low + (1ull << shift) - 1;
+}
+
+void latency_hist_reset(LatencyHistogram *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void latency_hist_record(LatencyHistogram *h, uint64_t ns) {
+    h->counts[bucket_index(ns)]++;
+    if (h->total == 0 || ns < h->min) h->min = ns;
+    if (ns > h->max) h->max = ns;
+    h->total++;
+    h->sum += ns;
+    h->sum_sq += (double)ns * ns;
+}
+
+uint64_t latency_hist_percentile(const LatencyHistogram *h, double percent) {
+    if (h->total == 0) return 0;
+    uint64_t rank = (uint64_t)ceil(percent / 100.0 * h->total);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) return bucket_high(i) < h->max ? bucket_high(i) : h->max;
+    }
+    return h->max;
+}
+
+void latency_hist_print(const LatencyHistogram *h, const char *name) {
+    printf("[Latency %-6s] p50 %7.2f  p90 %7.2f  p99 %7.2f  p99.9 %7.2f  max %7.2f ms (%llu frames)\n",
+           name, latency_hist_percentile(h, 50) / 1e6, latency_hist_percentile(h, 90) / 1e6,
+           latency_hist_percentile(h, 99) / 1e6, latency_hist_percentile(h, 99.9) / 1e6,
+           h->max / 1e6, (unsigned long long)h->total);
+}
+
+int latency_hist_write_hgrm(const LatencyHistogram *h, const char *path) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOG_ERROR("latency_hist_write_hgrm: cannot open %s", path);
+        return -1;
+    }
+    fprintf(fp, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_HIST_BUCKETS && seen < h->total; i++) {
+        if (!h->counts[i]) continue;
+        seen += h->counts[i];
+        uint64_t value = bucket_high(i) < h->max ? bucket_high(i) : h->max;
+        double p = (double)seen / h->total;
+        if (seen < h->total) {
+            fprintf(fp, "%12.3f %1.12f %10llu %14.2f\n", value / 1e6, p, (unsigned long long)seen, 1 / (1 - p));
+        }
+        else {
+            fprintf(fp, "%12.3f %1.12f %10llu\n", value / 1e6, p, (unsigned long long)seen);
+        }
+    }
+
+    double mean = h->total ? h->sum / h->total : 0;
+    double var = h->total ? h->sum_sq / h->total - mean * mean : 0;
+    fprintf(fp, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean / 1e6, (var > 0 ? sqrt(var) : 0) / 1e6);
+    fprintf(fp, "#[Max     = %12.3f, Total count    = %12llu]\n", h->max / 1e6, (unsigned long long)h->total);
+    fprintf(fp, "#[Buckets = %12d, SubBuckets     = %12d]\n",
+            LATENCY_HIST_MAX_BITS - LATENCY_HIST_SUB_BITS + 1, SUB_COUNT);
+    return fclose(fp) == 0 ? 0 : -1;
+}
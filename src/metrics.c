@@ -0,0 +1,224 @@
+#define _GNU_SOURCE     // accept4()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "metrics.h"
+#include "log.h"
+
+#define METRICS_POLL_MS         200     // how soon metrics_server_stop() is seen
+#define METRICS_REQUEST_MS      100     // wait for a request before sending bare text
+#define METRICS_REQUEST_MAX     4096
+
+typedef struct {
+    const char *name;
+    const char *label;          // tells the counters of one family apart
+    const char *help;
+} MetricInfo;
+
+static const MetricInfo metric_info[METRIC_NUM_COUNTERS] = {
+    [METRIC_URBS]             = { "uvc_urbs_total", NULL, "URBs reaped, or replayed" },
+    [METRIC_PACKETS_OK]       = { "uvc_iso_packets_total", "status=\"ok\"", "Isochronous packets by completion status" },
+    [METRIC_PACKETS_EMPTY]    = { "uvc_iso_packets_total", "status=\"empty\"", NULL },
+    [METRIC_PACKETS_MISSED]   = { "uvc_iso_packets_total", "status=\"missed\"", NULL },
+    [METRIC_PACKETS_OVERFLOW] = { "uvc_iso_packets_total", "status=\"overflow\"", NULL },
+    [METRIC_PACKETS_PROTO]    = { "uvc_iso_packets_total", "status=\"protocol\"", NULL },
+    [METRIC_PACKETS_OTHER]    = { "uvc_iso_packets_total", "status=\"other\"", NULL },
+    [METRIC_BYTES]            = { "uvc_payload_bytes_total", NULL, "Bytes in good isochronous packets, payload headers included" },
+    [METRIC_FID_NO_EOF]       = { "uvc_fid_toggles_without_eof_total", NULL, "Frames ended by an FID toggle because their EOF packet was lost" },
+    [METRIC_FRAMES_ASSEMBLED] = { "uvc_frames_assembled_total", NULL, "Frames assembled and handed to the decode stage" },
+    [METRIC_REJECT_OVERSIZED] = { "uvc_frames_rejected_total", "reason=\"oversized\"", "Frames discarded during assembly" },
+    [METRIC_REJECT_FRAGMENT]  = { "uvc_frames_rejected_total", "reason=\"fragment\"", NULL },
+    [METRIC_DROP_POOL]        = { "uvc_frames_dropped_total", "reason=\"pool_empty\"", "Frames dropped for lack of room in the pipeline" },
+    [METRIC_DROP_HANDOFF]     = { "uvc_frames_dropped_total", "reason=\"decode_queue_full\"", NULL },
+    [METRIC_PREVIEW_SKIPPED]  = { "uvc_preview_skipped_total", NULL, "Frames that skipped the preview while it was busy" },
+    [METRIC_STATIC_SKIPPED]   = { "uvc_frames_static_total", NULL, "Frames found unchanged and not decoded" },
+    [METRIC_DECODE_ERRORS]    = { "uvc_decode_errors_total", "decoder=\"full\"", "Frames libjpeg could not decode" },
+    [METRIC_PREVIEW_ERRORS]   = { "uvc_decode_errors_total", "decoder=\"preview\"", NULL },
+    [METRIC_ARCHIVE_ERRORS]   = { "uvc_archive_errors_total", NULL, "Frames the MKV archive or segment ring failed to write" },
+};
+
+uint64_t metrics_get(const StreamMetrics *m, MetricId id) {
+    uint64_t sum = 0;
+    for (int i = 0; i < METRICS_NUM_SHARDS; i++) {
+        sum += atomic_load_explicit(&m->shards[i].counts[id], memory_order_relaxed);
+    }
+    return sum;
+}
+
+void metrics_escape(char *out, size_t size, const char *value) {
+    size_t n = 0;
+    for (; *value && n + 3 < size; value++) {
+        if (*value == '\\' || *value == '"') out[n++] = '\\';
+        if (*value == '\n') {
+            out[n++] = '\\';
+            out[n++] = 'n';
+            continue;
+        }
+        out[n++] = *value;
+    }
+    out[n] = '\0';
+}
+
+void metrics_write_family(FILE *fp, const char *name, const char *type, const char *help) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_write_sample(FILE *fp, const char *name, const char *labels, const char *extra, uint64_t value) {
+    if (labels && extra) fprintf(fp, "%s{%s,%s} %llu\n", name, labels, extra, (unsigned long long)value);
+    else if (labels || extra) fprintf(fp, "%s{%s} %llu\n", name, labels ? labels : extra, (unsigned long long)value);
+    else fprintf(fp, "%s %llu\n", name, (unsigned long long)value);
+}
+
+void metrics_write_counters(FILE *fp, StreamMetrics *const *m, const char *const *labels, int n) {
+    for (int first = 0, last; first < METRIC_NUM_COUNTERS; first = last) {
+        const char *name = metric_info[first].name;
+        for (last = first; last < METRIC_NUM_COUNTERS && strcmp(metric_info[last].name, name) == 0; last++) {}
+
+        metrics_write_family(fp, name, "counter", metric_info[first].help);
+        for (int s = 0; s < n; s++) {
+            for (int id = first; id < last; id++) {
+                metrics_write_sample(fp, name, labels[s], metric_info[id].label, metrics_get(m[s], id));
+            }
+        }
+    }
+}
+
+// --- Server ---
+
+static int listen_tcp(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port),
+                                .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int listen_unix(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);           // left behind by a previous run
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void send_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+// Read the request head, if the client sends one; returns whether it is HTTP
+static int read_request(int fd) {
+    char req[METRICS_REQUEST_MAX + 1];
+    size_t len = 0;
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    while (len < METRICS_REQUEST_MAX && poll(&pfd, 1, METRICS_REQUEST_MS) > 0) {
+        ssize_t n = recv(fd, req + len, METRICS_REQUEST_MAX - len, 0);
+        if (n <= 0) break;
+        len += n;
+        req[len] = '\0';
+        if (strstr(req, "\r\n\r\n") || strstr(req, "\n\n")) break;
+    }
+    return len >= 4 && memcmp(req, "GET ", 4) == 0;
+}
+
+static void serve_client(MetricsServer *srv, int fd) {
+    int http = read_request(fd);
+
+    char *body = NULL;
+    size_t body_len = 0;
+    FILE *fp = open_memstream(&body, &body_len);
+    if (!fp) return;
+    srv->collect(fp, srv->ctx);
+    fclose(fp);
+
+    if (http) {
+        char head[160];
+        int n = snprintf(head, sizeof(head), "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: text/plain; version=0.0.4\r\n"
+                         "Content-Length: %zu\r\n\r\n", body_len);
+        send_all(fd, head, n);
+    }
+    send_all(fd, body, body_len);
+    free(body);
+    srv->scrapes++;
+}
+
+static void *server_thread(void *arg) {
+    MetricsServer *srv = arg;
+    struct pollfd pfd = { .fd = srv->listen_fd, .events = POLLIN };
+    while (!srv->stop) {
+        if (poll(&pfd, 1, METRICS_POLL_MS) <= 0) continue;
+        int fd = accept4(srv->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0) continue;
+        serve_client(srv, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+int metrics_server_start(MetricsServer *srv, const char *addr, MetricsCollectFn collect, void *ctx) {
+    memset(srv, 0, sizeof(*srv));
+    srv->collect = collect;
+    srv->ctx = ctx;
+
+    int is_port = *addr != '\0';
+    for (const char *p = addr; *p; p++) {
+        if (!isdigit((unsigned char)*p)) is_port = 0;
+    }
+    if (is_port) {
+        srv->listen_fd = listen_tcp(atoi(addr));
+    }
+    else {
+        srv->listen_fd = listen_unix(addr);
+        if (srv->listen_fd >= 0) snprintf(srv->unix_path, sizeof(srv->unix_path), "%s", addr);
+    }
+    if (srv->listen_fd < 0) {
+        LOG_ERROR("metrics_server_start: %s: %s", addr, strerror(errno));
+        return -1;
+    }
+
+    if (pthread_create(&srv->thread, NULL, server_thread, srv) != 0) {
+        LOG_ERROR("metrics_server_start: cannot start the server thread");
+        close(srv->listen_fd);
+        srv->listen_fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+void metrics_server_stop(MetricsServer *srv) {
+    if (srv->listen_fd < 0) return;
+    srv->stop = 1;
+    pthread_join(srv->thread, NULL);
+    close(srv->listen_fd);
+    srv->listen_fd = -1;
+    if (srv->unix_path[0]) unlink(srv->unix_path);
+}
@@ -1,115 +1,192 @@
 #include <string.h>
 #include <stdio.h>
 #include "mjpeg_parser.h"
+#include "jpeg_markers.h"
+#include "log.h"
+#include "trace.h"
 
 void mjpeg_parser_init(MJPEGParser *parser) {
     memset(parser, 0, sizeof(MJPEGParser));
-    parser->buffer_head = 0;
-    parser->buffer_size = 0;
+    parser->head = 0;
+    parser->tail = 0;
+    parser->scan = 0;
+    parser->state = MJPEG_SEARCH_SOI;
     parser->frame_count = 0;
 }
 
 int mjpeg_parser_add_data(MJPEGParser *parser, const uint8_t *data, int length) {
     if (!parser || !data) {
-        printf("mjpeg_parser_add_data error\n");
+        LOG_ERROR("mjpeg_parser_add_data error");
         return -1;
     }
+    if (length <= 0) return 0;
+
+    // Only the newest MJPEG_BUFFER_SIZE bytes can be kept
+    if (length > MJPEG_BUFFER_SIZE) {
+        data += length - MJPEG_BUFFER_SIZE;
+        length = MJPEG_BUFFER_SIZE;
+    }
 
     // Check if buffer has space
-    if (parser->buffer_size + length > MJPEG_BUFFER_SIZE) {
+    uint32_t used = parser->tail - parser->head;
+    if (used + length > MJPEG_BUFFER_SIZE) {
         // Buffer full, discard oldest data
-        int discard = (parser->buffer_head + length) - MJPEG_BUFFER_SIZE;
-        if (discard < parser->buffer_size) {
-            memmove(parser->buffer, parser->buffer + discard, parser->buffer_size - discard);
-            parser->buffer_size -= discard;
-        }
-        else {
-            parser->buffer_size = 0;
+        parser->head += used + length - MJPEG_BUFFER_SIZE;
+
+        if (parser->state != MJPEG_SEARCH_SOI && (int32_t)(parser->head - parser->frame_start) > 0) {
+            LOG_DEBUG("Frame overwritten before EOI/consumption, dropping it");
+            trace_event(TRACE_PARSER_DROP, 0, 0);
+            parser->dropped_frames++;
+            parser->state = MJPEG_SEARCH_SOI;
         }
+        if ((int32_t)(parser->scan - parser->head) < 0) parser->scan = parser->head;
     }
 
-    // Add new data
-    memcpy(parser->buffer + parser->buffer_size, data, length);
-    parser->buffer_size += length;
+    // Add new data, wrapping around the end of the ring
+    uint32_t off = parser->tail & MJPEG_RING_MASK;
+    int first = MJPEG_BUFFER_SIZE - off;
+    if (first > length) first = length;
+    memcpy(parser->buffer + off, data, first);
+    memcpy(parser->buffer, data + first, length - first);
+    parser->tail += length;
 
     return 0;
 }
 
-int mjpeg_parser_get_frame(MJPEGParser *parser, uint8_t *frame_out, int *frame_size) {
-    if (!parser) {
-        printf("parser get frame error\n");
+// Look for 0xFF <code> in [from, tail). On success *pos is the 0xFF position;
+// otherwise it is where the next scan should resume (a trailing 0xFF is kept).
+// Stuffed 0xFF00 and RSTn never match, so entropy data is skipped in bulk.
+static int ring_find_marker(const MJPEGParser *parser, uint32_t from, uint8_t code, uint32_t *pos) {
+    const uint8_t *buf = parser->buffer;
+    uint32_t p = from;
+
+    while ((int32_t)(parser->tail - p) >= 2) {
+        uint32_t off = p & MJPEG_RING_MASK;
+        uint32_t avail = parser->tail - p;
+        uint32_t contig = MJPEG_BUFFER_SIZE - off;
+        long m;
+
+        if (avail <= contig) {
+            m = jpeg_find_marker(buf + off, avail);
+            if (m < 0) {
+                p += avail - 1;
+                break;
+            }
+        } else {
+            // The span wraps: the last physical byte pairs with buffer[0]
+            m = jpeg_find_marker(buf + off, contig);
+            if (m < 0) {
+                if (buf[MJPEG_BUFFER_SIZE - 1] != 0xFF || !jpeg_is_marker_code(buf[0])) {
+                    p += contig;
+                    continue;
+                }
+                m = contig - 1;
+            }
+        }
+
+        p += m;
+        if (buf[(p + 1) & MJPEG_RING_MASK] == code) {
+            *pos = p;
+            return 1;
+        }
+        p += 2;     // Skip the whole marker, its code byte is never 0xFF
+    }
+
+    *pos = p;
+    return 0;
+}
+
+int mjpeg_parser_next_frame(MJPEGParser *parser, MJPEGFrameView *view) {
+    if (!parser || !view) {
+        LOG_ERROR("parser next frame error");
         return -1;
     }
-    
+
+    uint32_t pos;
+
     // Find JPEG markers: SOI(0xFFD8) and EOI(0xFFD9)
-    int soi = -1, eoi = -1;
-    
-    for (int i = 0; i < parser->buffer_size - 1; i++) {
-        if (parser->buffer[i] == 0xFF && parser->buffer[i + 1] == 0xD8) {
-            soi = i;
-            printf("Found SOI at position %d\n", soi);  // DEBUG
-            break;
+    if (parser->state == MJPEG_SEARCH_SOI) {
+        if (!ring_find_marker(parser, parser->scan, JPEG_MARKER_SOI, &pos)) {
+            // Nothing before pos can start a frame
+            parser->head = pos;
+            parser->scan = pos;
+            return 0;  // No SOI found
         }
+        trace_event(TRACE_PARSER_SOI, pos, 0);
+        parser->head = pos;
+        parser->frame_start = pos;
+        parser->scan = pos + 2;
+        parser->state = MJPEG_IN_FRAME;
     }
 
-    if (soi < 0) {
-        printf("parser get frame: can't find soi\n");
-        // Debug: show first few bytes of buffer
-        if (parser->buffer_size >= 16) {
-            printf("parser get frame: can't find SOI. Buffer has %d bytes. First 16 bytes: ",
-                   parser->buffer_size);
-            for (int i = 0; i < 16; i++) {
-                printf("%02X ", parser->buffer[i]);
-            }
-            printf("\n");
-        } else {
-            printf("parser get frame: can't find SOI. Buffer only has %d bytes\n",
-                   parser->buffer_size);
+    if (parser->state == MJPEG_IN_FRAME) {
+        if (!ring_find_marker(parser, parser->scan, JPEG_MARKER_EOI, &pos)) {
+            parser->scan = pos;
+            LOG_TRACE("Found SOI but no EOI yet (buffer: %u bytes)", parser->tail - parser->head);
+            return 0;  // No EOI yet
         }
-        return 0;  // No SOI found
+        parser->frame_end = pos + 2;
+        parser->scan = pos + 2;
+        parser->state = MJPEG_FOUND_EOI;
+        trace_event(TRACE_PARSER_EOI, pos, 0);
     }
 
-    for (int i = soi + 2; i < parser->buffer_size - 1; i++) {
-        if (parser->buffer[i] == 0xFF && parser->buffer[i + 1] == 0xD9) {
-            eoi = i + 2;
-            printf("Found EOI at position %d\n", eoi);  // DEBUG
-            break;
-        }
-    }
+    // Complete frame: describe it in place, as one or two segments
+    uint32_t off = parser->frame_start & MJPEG_RING_MASK;
+    int size = parser->frame_end - parser->frame_start;
+    int first = MJPEG_BUFFER_SIZE - off;
+    if (first > size) first = size;
 
-    if (eoi < 0) {
-        printf("Found SOI but no EOI yet (buffer: %d bytes)\n", parser->buffer_size);
-        return 0;  // No EOI yet
-    }
+    view->seg[0] = parser->buffer + off;
+    view->len[0] = first;
+    view->seg[1] = parser->buffer;
+    view->len[1] = size - first;
+    view->size = size;
 
-    if (soi >= 0 && eoi > soi) {
-        // Find complete JPEG frame
-        *frame_size = eoi - soi;
+    return 1;   // Frame found
+}
 
-        if (*frame_size > MAX_JPEG_SIZE) {
-            // Too large, skip it
-            printf("Frame too large: %d bytes, clearing buffer\n", *frame_size);
-            parser->buffer_size = 0;
-            return -1;
-        }
+// Remove processed data
+static void ring_consume_frame(MJPEGParser *parser) {
+    parser->head = parser->frame_end;
+    parser->scan = parser->frame_end;
+    parser->state = MJPEG_SEARCH_SOI;
+}
 
-        // Copy frame
-        memcpy(frame_out, parser->buffer + soi, *frame_size);
-        parser->frame_count++;
+void mjpeg_parser_release_frame(MJPEGParser *parser) {
+    if (!parser || parser->state != MJPEG_FOUND_EOI) return;
 
-        // Remove processed data
-        int remaining = parser->buffer_size - eoi;
-        if (remaining > 0) {
-            memmove(parser->buffer, parser->buffer + eoi, remaining);
-        }
+    ring_consume_frame(parser);
+    parser->frame_count++;
+}
 
-        parser->buffer_size = remaining;
+int mjpeg_parser_get_frame(MJPEGParser *parser, uint8_t *frame_out, int *frame_size) {
+    if (!parser || !frame_out || !frame_size) {
+        LOG_ERROR("parser get frame error");
+        return -1;
+    }
 
-        printf("Extracted frame %d: %d bytes, %d bytes remaining\n",
-           parser->frame_count, *frame_size, remaining);
+    MJPEGFrameView view;
+    if (mjpeg_parser_next_frame(parser, &view) != 1) {
+        return 0;   // No complete frame yet
+    }
 
-        return 1;   // Frame fount
+    if (view.size > MAX_JPEG_SIZE) {
+        // Too large, skip it
+        LOG_DEBUG("Frame too large: %d bytes, skipping", view.size);
+        trace_event(TRACE_PARSER_DROP, view.size, 0);
+        ring_consume_frame(parser);
+        parser->dropped_frames++;
+        return -1;
     }
 
-    return 0;   // No complete frame yet
+    // Copy frame
+    memcpy(frame_out, view.seg[0], view.len[0]);
+    memcpy(frame_out + view.len[0], view.seg[1], view.len[1]);
+    *frame_size = view.size;
+    mjpeg_parser_release_frame(parser);
+
+    trace_event(TRACE_PARSER_FRAME, parser->frame_count, *frame_size);
+
+    return 1;   // Frame found
 }
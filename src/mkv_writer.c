@@ -0,0 +1,576 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "mkv_writer.h"
+#include "jpeg_markers.h"
+#include "log.h"
+
+// Element IDs (with their length marker bits, as stored)
+#define ID_EBML                 0x1A45DFA3
+#define ID_EBML_VERSION         0x4286
+#define ID_EBML_READ_VERSION    0x42F7
+#define ID_EBML_MAX_ID_LENGTH   0x42F2
+#define ID_EBML_MAX_SIZE_LENGTH 0x42F3
+#define ID_DOC_TYPE             0x4282
+#define ID_DOC_TYPE_VERSION     0x4287
+#define ID_DOC_TYPE_READ_VERSION 0x4285
+#define ID_SEGMENT              0x18538067
+#define ID_SEEK_HEAD            0x114D9B74
+#define ID_SEEK                 0x4DBB
+#define ID_SEEK_ID              0x53AB
+#define ID_SEEK_POSITION        0x53AC
+#define ID_VOID                 0xEC
+#define ID_INFO                 0x1549A966
+#define ID_TIMESTAMP_SCALE      0x2AD7B1
+#define ID_DURATION             0x4489
+#define ID_MUXING_APP           0x4D80
+#define ID_WRITING_APP          0x5741
+#define ID_TRACKS               0x1654AE6B
+#define ID_TRACK_ENTRY          0xAE
+#define ID_TRACK_NUMBER         0xD7
+#define ID_TRACK_UID            0x73C5
+#define ID_TRACK_TYPE           0x83
+#define ID_FLAG_LACING          0x9C
+#define ID_CODEC_ID             0x86
+#define ID_VIDEO                0xE0
+#define ID_PIXEL_WIDTH          0xB0
+#define ID_PIXEL_HEIGHT         0xBA
+#define ID_CLUSTER              0x1F43B675
+#define ID_CLUSTER_TIMESTAMP    0xE7
+#define ID_SIMPLE_BLOCK         0xA3
+#define ID_CUES                 0x1C53BB6B
+#define ID_CUE_POINT            0xBB
+#define ID_CUE_TIME             0xB3
+#define ID_CUE_TRACK_POSITIONS  0xB7
+#define ID_CUE_TRACK            0xF7
+#define ID_CUE_CLUSTER_POSITION 0xF1
+
+#define SIZE_UNKNOWN        0x00FFFFFFFFFFFFFFull   // 8-byte size, all value bits set
+#define SIZE8_LEN           8
+#define SEEKHEAD_RESERVE    96      // SeekHead (68 bytes, fixed) plus a Void
+#define SOF_SCAN_BYTES      4096    // JPEG header bytes searched for the SOF
+#define APP_NAME            "uvc_camera"
+
+// --- EBML encoding into a growable buffer ---
+
+typedef struct {
+    uint8_t *data;
+    size_t len;
+    size_t cap;
+    int failed;
+} EbmlBuf;
+
+static void buf_put(EbmlBuf *b, const void *p, size_t n) {
+    if (b->len + n > b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 256;
+        while (cap < b->len + n) cap *= 2;
+        uint8_t *data = realloc(b->data, cap);
+        if (!data) {
+            b->failed = 1;
+            return;
+        }
+        b->data = data;
+        b->cap = cap;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void put_be(EbmlBuf *b, uint64_t v, int n) {
+    uint8_t bytes[8];
+    for (int i = 0; i < n; i++) bytes[i] = (uint8_t)(v >> (8 * (n - 1 - i)));
+    buf_put(b, bytes, n);
+}
+
+static void put_id(EbmlBuf *b, uint32_t id) {
+    int n = id > 0xFFFFFF ? 4 : id > 0xFFFF ? 3 : id > 0xFF ? 2 : 1;
+    put_be(b, id, n);
+}
+
+// Shortest vint; all-ones values are reserved for "unknown"
+static void put_size(EbmlBuf *b, uint64_t size) {
+    int n = 1;
+    while (n < 8 && size >= (1ull << (7 * n)) - 1) n++;
+    put_be(b, size | (1ull << (7 * n)), n);
+}
+
+static void put_size8(EbmlBuf *b, uint64_t size) {
+    put_be(b, size | (1ull << 56), SIZE8_LEN);
+}
+
+static void put_uint_n(EbmlBuf *b, uint32_t id, uint64_t v, int n) {
+    put_id(b, id);
+    put_size(b, n);
+    put_be(b, v, n);
+}
+
+static void put_uint(EbmlBuf *b, uint32_t id, uint64_t v) {
+    int n = 1;
+    while (n < 8 && (v >> (8 * n))) n++;
+    put_uint_n(b, id, v, n);
+}
+
+static void put_float(EbmlBuf *b, uint32_t id, double v) {
+    uint64_t bits;
+    memcpy(&bits, &v, sizeof(bits));
+    put_uint_n(b, id, bits, 8);
+}
+
+static void put_string(EbmlBuf *b, uint32_t id, const char *s) {
+    put_id(b, id);
+    put_size(b, strlen(s));
+    buf_put(b, s, strlen(s));
+}
+
+static void put_master(EbmlBuf *b, uint32_t id, const EbmlBuf *content) {
+    put_id(b, id);
+    put_size(b, content->len);
+    buf_put(b, content->data, content->len);
+}
+
+// Void element of exactly total bytes (total >= 2)
+static void put_void(EbmlBuf *b, size_t total) {
+    static const uint8_t zeros[SEEKHEAD_RESERVE];
+    put_id(b, ID_VOID);
+    if (total - 2 < 127) {
+        put_size(b, total - 2);
+        buf_put(b, zeros, total - 2);
+    }
+    else {
+        put_size8(b, total - 1 - SIZE8_LEN);
+        buf_put(b, zeros, total - 1 - SIZE8_LEN);
+    }
+}
+
+// --- File I/O ---
+
+static int write_at(MkvWriter *w, uint64_t off, const void *data, size_t n) {
+    if (w->write) {
+        struct iovec iov = { (void *)data, n };
+        return w->write(w->write_ctx, off, &iov, 1);
+    }
+    const uint8_t *p = data;
+    while (n > 0) {
+        ssize_t ret = pwrite(w->fd, p, n, off);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("mkv_writer: write failed: %s", strerror(errno));
+            return -1;
+        }
+        p += ret;
+        off += ret;
+        n -= ret;
+    }
+    return 0;
+}
+
+static int append(MkvWriter *w, const EbmlBuf *b) {
+    if (b->failed) return -1;
+    if (write_at(w, w->pos, b->data, b->len) < 0) return -1;
+    w->pos += b->len;
+    return 0;
+}
+
+// writev() until everything is out; iov is consumed
+static int append_iov(MkvWriter *w, struct iovec *iov, int n) {
+    if (w->write) {
+        size_t len = 0;
+        for (int i = 0; i < n; i++) len += iov[i].iov_len;
+        if (w->write(w->write_ctx, w->pos, iov, n) < 0) return -1;
+        w->pos += len;
+        return 0;
+    }
+    while (n > 0) {
+        ssize_t ret = pwritev(w->fd, iov, n, w->pos);
+        if (ret < 0) {
+            if (errno == EINTR) continue;
+            LOG_ERROR("mkv_writer: write failed: %s", strerror(errno));
+            return -1;
+        }
+        w->pos += ret;
+        while (n > 0 && (size_t)ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            n--;
+        }
+        if (n > 0) {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return 0;
+}
+
+// --- Writer ---
+
+int mkv_writer_open(MkvWriter *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    w->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (w->fd < 0) {
+        LOG_ERROR("mkv_writer_open: cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+int mkv_writer_open_sink(MkvWriter *w, MkvWriteFn write, void *ctx) {
+    memset(w, 0, sizeof(*w));
+    w->fd = -1;
+    w->write = write;
+    w->write_ctx = ctx;
+    return 0;
+}
+
+static int write_header(MkvWriter *w) {
+    EbmlBuf h = { 0 }, c = { 0 }, entry = { 0 }, video = { 0 };
+
+    put_uint(&c, ID_EBML_VERSION, 1);
+    put_uint(&c, ID_EBML_READ_VERSION, 1);
+    put_uint(&c, ID_EBML_MAX_ID_LENGTH, 4);
+    put_uint(&c, ID_EBML_MAX_SIZE_LENGTH, 8);
+    put_string(&c, ID_DOC_TYPE, "matroska");
+    put_uint(&c, ID_DOC_TYPE_VERSION, 4);
+    put_uint(&c, ID_DOC_TYPE_READ_VERSION, 2);
+    put_master(&h, ID_EBML, &c);
+
+    put_id(&h, ID_SEGMENT);
+    put_size8(&h, SIZE_UNKNOWN);
+    w->segment_data = h.len;
+
+    w->seekhead_pos = h.len;
+    put_void(&h, SEEKHEAD_RESERVE);
+
+    // Duration is the last child so its payload ends the Info element
+    c.len = 0;
+    put_uint(&c, ID_TIMESTAMP_SCALE, 1000000);     // timestamps in ms
+    put_string(&c, ID_MUXING_APP, APP_NAME);
+    put_string(&c, ID_WRITING_APP, APP_NAME);
+    put_float(&c, ID_DURATION, 0.0);
+    w->info_pos = h.len;
+    put_master(&h, ID_INFO, &c);
+    w->duration_pos = h.len - 8;
+
+    put_uint(&video, ID_PIXEL_WIDTH, w->width);
+    put_uint(&video, ID_PIXEL_HEIGHT, w->height);
+    put_uint(&entry, ID_TRACK_NUMBER, 1);
+    put_uint(&entry, ID_TRACK_UID, 1);
+    put_uint(&entry, ID_TRACK_TYPE, 1);            // video
+    put_uint(&entry, ID_FLAG_LACING, 0);
+    put_string(&entry, ID_CODEC_ID, "V_MJPEG");
+    put_master(&entry, ID_VIDEO, &video);
+    c.len = 0;
+    put_master(&c, ID_TRACK_ENTRY, &entry);
+    w->tracks_pos = h.len;
+    put_master(&h, ID_TRACKS, &c);
+
+    int ret = c.failed || entry.failed || video.failed ? -1 : append(w, &h);
+    free(h.data);
+    free(c.data);
+    free(entry.data);
+    free(video.data);
+    if (ret == 0) w->header_written = 1;
+    return ret;
+}
+
+// Size the open cluster now that its last block is written
+static int close_cluster(MkvWriter *w) {
+    if (!w->cluster_pos) return 0;
+    EbmlBuf b = { 0 };
+    put_size8(&b, w->pos - (w->cluster_pos + 4 + SIZE8_LEN));
+    int ret = b.failed ? -1 : write_at(w, w->cluster_pos + 4, b.data, b.len);
+    free(b.data);
+    w->cluster_pos = 0;
+    return ret;
+}
+
+static int add_cue(MkvWriter *w, uint64_t time_ms, uint64_t cluster_pos) {
+    if (w->num_cues == w->cues_capacity) {
+        int cap = w->cues_capacity ? w->cues_capacity * 2 : 64;
+        MkvCuePoint *cues = realloc(w->cues, sizeof(MkvCuePoint) * cap);
+        if (!cues) return -1;
+        w->cues = cues;
+        w->cues_capacity = cap;
+    }
+    w->cues[w->num_cues].time_ms = time_ms;
+    w->cues[w->num_cues].cluster_pos = cluster_pos - w->segment_data;
+    w->num_cues++;
+    return 0;
+}
+
+// Cluster size starts out unknown: a crash leaves a file that still plays
+static int open_cluster(MkvWriter *w, uint64_t time_ms) {
+    if (close_cluster(w) < 0) return -1;
+
+    EbmlBuf b = { 0 };
+    put_id(&b, ID_CLUSTER);
+    put_size8(&b, SIZE_UNKNOWN);
+    put_uint(&b, ID_CLUSTER_TIMESTAMP, time_ms);
+    uint64_t pos = w->pos;
+    int ret = append(w, &b);
+    free(b.data);
+    if (ret < 0 || add_cue(w, time_ms, pos) < 0) return -1;
+
+    w->cluster_pos = pos;
+    w->cluster_time_ms = time_ms;
+    return 0;
+}
+
+// The SOF is in the first few hundred bytes; gather enough of the parts
+static int frame_dimensions(const struct iovec *parts, int num_parts, int *width, int *height) {
+    uint8_t head[SOF_SCAN_BYTES];
+    size_t len = 0;
+    for (int i = 0; i < num_parts && len < sizeof(head); i++) {
+        size_t n = parts[i].iov_len;
+        if (n > sizeof(head) - len) n = sizeof(head) - len;
+        memcpy(head + len, parts[i].iov_base, n);
+        len += n;
+    }
+    return jpeg_frame_size(head, len, width, height);
+}
+
+int mkv_writer_add_frame(MkvWriter *w, const struct iovec *parts, int num_parts, uint64_t timestamp_ns) {
+    if ((w->fd < 0 && !w->write) || num_parts > MKV_MAX_PARTS) return -1;
+
+    if (!w->header_written) {
+        if (frame_dimensions(parts, num_parts, &w->width, &w->height) < 0) {
+            LOG_WARN("mkv_writer: no SOF in the first frame, skipping it");
+            return -1;
+        }
+        if (write_header(w) < 0) return -1;
+        w->first_ts_ns = timestamp_ns;
+    }
+
+    // Block timestamps must not go backwards
+    uint64_t time_ms = timestamp_ns > w->first_ts_ns ? (timestamp_ns - w->first_ts_ns) / 1000000 : 0;
+    if (w->frames && time_ms < w->last_time_ms) time_ms = w->last_time_ms;
+    if (!w->cluster_pos || time_ms - w->cluster_time_ms >= MKV_CLUSTER_MS) {
+        if (open_cluster(w, time_ms) < 0) return -1;
+    }
+
+    size_t size = 0;
+    for (int i = 0; i < num_parts; i++) size += parts[i].iov_len;
+
+    // SimpleBlock: track 1, timestamp relative to the cluster, key frame.
+    // ID, 8-byte size and 4 header bytes at most: fits in hdr.
+    uint8_t hdr[16];
+    EbmlBuf b = { .data = hdr, .cap = sizeof(hdr) };
+    int16_t rel = (int16_t)(time_ms - w->cluster_time_ms);
+    put_id(&b, ID_SIMPLE_BLOCK);
+    put_size(&b, 4 + size);
+    put_be(&b, 0x81, 1);
+    put_be(&b, (uint16_t)rel, 2);
+    put_be(&b, 0x80, 1);
+
+    struct iovec iov[MKV_MAX_PARTS + 1];
+    iov[0].iov_base = hdr;
+    iov[0].iov_len = b.len;
+    memcpy(iov + 1, parts, sizeof(struct iovec) * num_parts);
+    if (append_iov(w, iov, num_parts + 1) < 0) return -1;
+
+    w->prev_time_ms = w->frames ? w->last_time_ms : time_ms;
+    w->last_time_ms = time_ms;
+    w->frames++;
+    w->bytes += size;
+    return 0;
+}
+
+// Cues, SeekHead, Duration and Segment size: everything left unknown
+static int finalize(MkvWriter *w) {
+    if (close_cluster(w) < 0) return -1;
+
+    EbmlBuf all = { 0 }, entry = { 0 }, inner = { 0 }, b = { 0 };
+    for (int i = 0; i < w->num_cues; i++) {
+        inner.len = 0;
+        put_uint(&inner, ID_CUE_TRACK, 1);
+        put_uint(&inner, ID_CUE_CLUSTER_POSITION, w->cues[i].cluster_pos);
+        entry.len = 0;
+        put_uint(&entry, ID_CUE_TIME, w->cues[i].time_ms);
+        put_master(&entry, ID_CUE_TRACK_POSITIONS, &inner);
+        put_master(&all, ID_CUE_POINT, &entry);
+    }
+    put_master(&b, ID_CUES, &all);
+    uint64_t cues_pos = w->pos;
+    int ret = append(w, &b);
+
+    // SeekHead: fixed-size entries (4-byte IDs, 8-byte positions)
+    static const uint32_t seek_ids[3] = { ID_INFO, ID_TRACKS, ID_CUES };
+    uint64_t seek_pos[3] = { w->info_pos, w->tracks_pos, cues_pos };
+    all.len = 0;
+    for (int i = 0; i < 3; i++) {
+        entry.len = 0;
+        put_id(&entry, ID_SEEK_ID);
+        put_size(&entry, 4);
+        put_be(&entry, seek_ids[i], 4);
+        put_uint_n(&entry, ID_SEEK_POSITION, seek_pos[i] - w->segment_data, 8);
+        put_master(&all, ID_SEEK, &entry);
+    }
+    b.len = 0;
+    put_master(&b, ID_SEEK_HEAD, &all);
+    put_void(&b, SEEKHEAD_RESERVE - b.len);
+    if (ret == 0) ret = b.failed ? -1 : write_at(w, w->seekhead_pos, b.data, b.len);
+
+    // Last frame shown for as long as the one before it
+    double duration = (double)(2 * w->last_time_ms - w->prev_time_ms);
+    uint64_t bits;
+    memcpy(&bits, &duration, sizeof(bits));
+    b.len = 0;
+    put_be(&b, bits, 8);
+    if (ret == 0) ret = b.failed ? -1 : write_at(w, w->duration_pos, b.data, b.len);
+
+    b.len = 0;
+    put_size8(&b, w->pos - w->segment_data);
+    if (ret == 0) ret = b.failed ? -1 : write_at(w, w->segment_data - SIZE8_LEN, b.data, b.len);
+
+    if (all.failed || entry.failed || inner.failed) ret = -1;
+    free(all.data);
+    free(entry.data);
+    free(inner.data);
+    free(b.data);
+    return ret;
+}
+
+int mkv_writer_close(MkvWriter *w) {
+    if (w->fd < 0 && !w->write) return -1;
+    int ret = w->header_written ? finalize(w) : 0;
+    if (w->fd >= 0 && close(w->fd) < 0) ret = -1;
+    w->fd = -1;
+    w->write = NULL;
+    free(w->cues);
+    w->cues = NULL;
+    return ret;
+}
+
+// --- Recovery ---
+
+// One element header: ID and size vints. Returns the header length, or -1
+// if it is cut off or not valid EBML (e.g. zeros left by a power loss).
+static int read_element(int fd, uint64_t off, uint64_t end, uint32_t *id, uint64_t *size) {
+    uint8_t h[12];
+    if (off >= end) return -1;
+    size_t avail = end - off < sizeof(h) ? end - off : sizeof(h);
+    if (pread(fd, h, avail, off) != (ssize_t)avail) return -1;
+
+    int id_len = h[0] ? __builtin_clz(h[0]) - 23 : 0;       // leading zeros of the byte, + 1
+    if (id_len < 1 || id_len > 4 || (size_t)id_len >= avail) return -1;
+    *id = 0;
+    for (int i = 0; i < id_len; i++) *id = (*id << 8) | h[i];
+
+    uint8_t first = h[id_len];
+    int size_len = first ? __builtin_clz(first) - 23 : 0;
+    if (size_len < 1 || size_len > 8 || (size_t)(id_len + size_len) > avail) return -1;
+    uint64_t v = first & (0xFF >> size_len);
+    int all_ones = v == (uint64_t)(0xFF >> size_len);
+    for (int i = 1; i < size_len; i++) {
+        v = (v << 8) | h[id_len + i];
+        all_ones &= h[id_len + i] == 0xFF;
+    }
+    *size = all_ones ? SIZE_UNKNOWN : v;
+    return id_len + size_len;
+}
+
+static uint64_t read_uint(int fd, uint64_t off, uint64_t size) {
+    uint8_t b[8];
+    if (size > 8 || pread(fd, b, size, off) != (ssize_t)size) return 0;
+    uint64_t v = 0;
+    for (uint64_t i = 0; i < size; i++) v = (v << 8) | b[i];
+    return v;
+}
+
+// Walk the blocks of the cluster at pos up to limit. Returns the end of
+// the last complete child; a trailing partial block is left out.
+static uint64_t scan_cluster(MkvWriter *w, uint64_t pos, int hdr, uint64_t limit) {
+    uint64_t child = pos + hdr;
+    int have_time = 0;
+    while (child < limit) {
+        uint32_t id;
+        uint64_t size;
+        int chdr = read_element(w->fd, child, limit, &id, &size);
+        if (chdr < 0 || size == SIZE_UNKNOWN || child + chdr + size > limit) break;
+        if (id == ID_CLUSTER || id == ID_CUES) break;
+
+        if (id == ID_CLUSTER_TIMESTAMP) {
+            w->cluster_time_ms = read_uint(w->fd, child + chdr, size);
+            have_time = 1;
+        }
+        else if (id == ID_SIMPLE_BLOCK && have_time && size >= 4) {
+            uint8_t bh[4];
+            if (pread(w->fd, bh, 4, child + chdr) != 4) break;
+            uint64_t time_ms = w->cluster_time_ms + (int16_t)((bh[1] << 8) | bh[2]);
+            w->prev_time_ms = w->frames ? w->last_time_ms : time_ms;
+            w->last_time_ms = time_ms;
+            w->frames++;
+            w->bytes += size - 4;
+        }
+        child += chdr + size;
+    }
+    return have_time ? child : pos;
+}
+
+long mkv_recover(const char *path) {
+    MkvWriter w;
+    memset(&w, 0, sizeof(w));
+    w.fd = open(path, O_RDWR);
+    if (w.fd < 0) {
+        LOG_ERROR("mkv_recover: cannot open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    struct stat st;
+    if (fstat(w.fd, &st) < 0) {
+        close(w.fd);
+        return -1;
+    }
+    uint64_t end = st.st_size;
+
+    uint32_t id;
+    uint64_t size;
+    int hdr = read_element(w.fd, 0, end, &id, &size);
+    if (hdr < 0 || id != ID_EBML) goto bad;
+    uint64_t pos = hdr + size;
+    hdr = read_element(w.fd, pos, end, &id, &size);
+    if (hdr != 4 + SIZE8_LEN || id != ID_SEGMENT) goto bad;
+    w.segment_data = pos + hdr;
+
+    // Header elements, then clusters until the first incomplete one
+    pos = w.segment_data;
+    while ((hdr = read_element(w.fd, pos, end, &id, &size)) >= 0) {
+        if (id == ID_CLUSTER) {
+            if (!w.tracks_pos) goto bad;
+            uint64_t limit = size == SIZE_UNKNOWN || pos + hdr + size > end ? end : pos + hdr + size;
+            uint64_t cluster_end = scan_cluster(&w, pos, hdr, limit);
+            if (cluster_end == pos) break;
+            if (add_cue(&w, w.cluster_time_ms, pos) < 0) goto bad;
+            w.cluster_pos = pos;        // finalize() rewrites its size
+            w.pos = cluster_end;
+            if (cluster_end != pos + hdr + size) break;
+            pos = cluster_end;
+            continue;
+        }
+        if (id == ID_CUES || size == SIZE_UNKNOWN || pos + hdr + size > end) break;
+
+        if ((id == ID_VOID || id == ID_SEEK_HEAD) && !w.seekhead_pos) w.seekhead_pos = pos;
+        else if (id == ID_INFO) {
+            w.info_pos = pos;
+            w.duration_pos = pos + hdr + size - 8;      // written last, see write_header()
+        }
+        else if (id == ID_TRACKS) w.tracks_pos = pos;
+        pos += hdr + size;
+        w.pos = pos;
+    }
+    if (!w.seekhead_pos || !w.info_pos || !w.tracks_pos) goto bad;
+
+    // Drop the partial tail (and any old cues), then finish the file
+    if (ftruncate(w.fd, w.pos) < 0) goto bad;
+    w.header_written = 1;
+    if (mkv_writer_close(&w) < 0) return -1;
+    return (long)w.frames;
+
+bad:
+    LOG_ERROR("mkv_recover: %s has no complete mkv_writer header", path);
+    close(w.fd);
+    free(w.cues);
+    return -1;
+}
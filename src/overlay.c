@@ -0,0 +1,154 @@
+#include <stdlib.h>
+#include "overlay.h"
+#include "log.h"
+
+int overlay_init(OverlayBatch *ov, int capacity) {
+    ov->shapes = malloc(sizeof(OverlayShape) * capacity);
+    ov->active = malloc(sizeof(OverlayShape *) * capacity);
+    ov->count = 0;
+    ov->capacity = capacity;
+    if (!ov->shapes || !ov->active) {
+        LOG_ERROR("overlay_init: out of memory for %d shapes", capacity);
+        overlay_destroy(ov);
+        return -1;
+    }
+    return 0;
+}
+
+void overlay_destroy(OverlayBatch *ov) {
+    free(ov->shapes);
+    free(ov->active);
+    ov->shapes = NULL;
+    ov->active = NULL;
+    ov->count = 0;
+    ov->capacity = 0;
+}
+
+void overlay_clear(OverlayBatch *ov) {
+    ov->count = 0;
+}
+
+static OverlayShape *add_shape(OverlayBatch *ov, OverlayShapeType type, int x1, int y1, int x2, int y2,
+                               uint8_t r, uint8_t g, uint8_t b) {
+    if (ov->count >= ov->capacity) {
+        LOG_ERROR("overlay: batch full (%d shapes)", ov->capacity);
+        return NULL;
+    }
+    OverlayShape *s = &ov->shapes[ov->count];
+    s->type = type;
+    s->x1 = x1;
+    s->y1 = y1;
+    s->x2 = x2;
+    s->y2 = y2;
+    s->thickness = 0;
+    s->r = r;
+    s->g = g;
+    s->b = b;
+    s->seq = ov->count++;
+    return s;
+}
+
+int overlay_add_rect(OverlayBatch *ov, int x, int y, int w, int h,
+                     uint8_t r, uint8_t g, uint8_t b, int thickness) {
+    if (thickness <= 0) return 0;
+    OverlayShape *s = add_shape(ov, OVERLAY_RECT, x, y, w, h, r, g, b);
+    if (!s) return -1;
+    s->thickness = thickness;
+    // A band thicker than the rect spills past it (see image_draw_rect())
+    s->top = y + h - thickness < y ? y + h - thickness : y;
+    s->bottom = y + thickness > y + h ? y + thickness - 1 : y + h - 1;
+    return 0;
+}
+
+int overlay_add_fill(OverlayBatch *ov, int x, int y, int w, int h,
+                     uint8_t r, uint8_t g, uint8_t b) {
+    if (w <= 0 || h <= 0) return 0;
+    OverlayShape *s = add_shape(ov, OVERLAY_FILL, x, y, w, h, r, g, b);
+    if (!s) return -1;
+    s->top = y;
+    s->bottom = y + h - 1;
+    return 0;
+}
+
+int overlay_add_line(OverlayBatch *ov, int x1, int y1, int x2, int y2,
+                     uint8_t r, uint8_t g, uint8_t b) {
+    OverlayShape *s = add_shape(ov, OVERLAY_LINE, x1, y1, x2, y2, r, g, b);
+    if (!s) return -1;
+    s->top = y1 < y2 ? y1 : y2;
+    s->bottom = y1 < y2 ? y2 : y1;
+    return 0;
+}
+
+static int by_top(const void *a, const void *b) {
+    const OverlayShape *sa = a, *sb = b;
+    if (sa->top != sb->top) return sa->top < sb->top ? -1 : 1;
+    return sa->seq - sb->seq;
+}
+
+// Rows [y, y + h) of the rectangle that fall in the band [b0, b1)
+static void fill_in_band(Image *img, int x, int y, int w, int h, int b0, int b1,
+                         uint8_t r, uint8_t g, uint8_t b) {
+    int y0 = y > b0 ? y : b0;
+    int y1 = y + h < b1 ? y + h : b1;
+    if (y1 > y0) image_fill_rect(img, x, y0, w, y1 - y0, r, g, b);
+}
+
+static void draw_in_band(OverlayShape *s, Image *img, int b0, int b1) {
+    int x = s->x1, y = s->y1, w = s->x2, h = s->y2;
+
+    switch (s->type) {
+    case OVERLAY_FILL:
+        fill_in_band(img, x, y, w, h, b0, b1, s->r, s->g, s->b);
+        break;
+    case OVERLAY_RECT: {
+        // Same bands as image_draw_rect()
+        int t = s->thickness;
+        fill_in_band(img, x, y, w, t, b0, b1, s->r, s->g, s->b);
+        fill_in_band(img, x, y + h - t, w, t, b0, b1, s->r, s->g, s->b);
+        int sy = y, sh = h;
+        if (h > 2 * t && t <= w) {
+            sy = y + t;
+            sh = h - 2 * t;
+        }
+        fill_in_band(img, x, sy, t, sh, b0, b1, s->r, s->g, s->b);
+        fill_in_band(img, x + w - t, sy, t, sh, b0, b1, s->r, s->g, s->b);
+        break;
+    }
+    case OVERLAY_LINE:
+        image_line_draw(&s->walk, img, b1, s->r, s->g, s->b);
+        break;
+    }
+}
+
+void overlay_render(OverlayBatch *ov, Image *img) {
+    if (!img->valid || !ov->count) return;
+    if (img->channels != 3) {
+        LOG_ERROR("Invalid channels at overlay_render");
+        return;
+    }
+
+    qsort(ov->shapes, ov->count, sizeof(OverlayShape), by_top);
+
+    int next = 0, num_active = 0;
+    for (int b0 = 0; b0 < img->height && (next < ov->count || num_active); b0 += OVERLAY_BAND_ROWS) {
+        int b1 = b0 + OVERLAY_BAND_ROWS < img->height ? b0 + OVERLAY_BAND_ROWS : img->height;
+
+        // Shapes starting above this band join the active list, kept in
+        // add order so overlaps come out as with one-by-one drawing
+        while (next < ov->count && ov->shapes[next].top < b1) {
+            OverlayShape *s = &ov->shapes[next++];
+            if (s->type == OVERLAY_LINE) image_line_begin(&s->walk, s->x1, s->y1, s->x2, s->y2);
+            int i = num_active++;
+            for (; i > 0 && ov->active[i - 1]->seq > s->seq; i--) ov->active[i] = ov->active[i - 1];
+            ov->active[i] = s;
+        }
+
+        int kept = 0;
+        for (int i = 0; i < num_active; i++) {
+            OverlayShape *s = ov->active[i];
+            draw_in_band(s, img, b0, b1);
+            if (s->bottom >= b1) ov->active[kept++] = s;
+        }
+        num_active = kept;
+    }
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "scene_detect.h"
+#include "log.h"
+
+static uint64_t scene_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int scene_detect_init(SceneDetector *sd, double threshold, double keepalive_secs) {
+    memset(sd, 0, sizeof(*sd));
+    sd->threshold = threshold;
+    sd->keepalive_ns = keepalive_secs > 0 ? (uint64_t)(keepalive_secs * 1e9) : 0;
+    if (jpeg_decoder_init(&sd->decoder) < 0) return -1;
+    if (jpeg_decoder_set_scale(&sd->decoder, 8, 1) < 0) return -1;
+    if (frame_pool_init(&sd->pool, 2, 0, POOL_BLOCK) < 0) return -1;
+    sd->cur = frame_pool_acquire(&sd->pool);     // ref is taken when there is one
+    return 0;
+}
+
+void scene_detect_destroy(SceneDetector *sd) {
+    jpeg_decoder_destroy(&sd->decoder);
+    if (sd->cur) frame_release(sd->cur);
+    if (sd->ref) frame_release(sd->ref);
+    frame_pool_destroy(&sd->pool);
+}
+
+// Mean absolute difference of two thumbnails, or -1 if their sizes differ
+static double thumbnail_diff(const Frame *a, const Frame *b) {
+    if (a->width != b->width || a->height != b->height) return -1;
+    uint64_t sum = 0;
+    for (int y = 0; y < a->height; y++) {
+        const uint8_t *pa = a->planes[0] + (size_t)y * a->plane_stride[0];
+        const uint8_t *pb = b->planes[0] + (size_t)y * b->plane_stride[0];
+        for (int x = 0; x < a->width; x++) sum += abs(pa[x] - pb[x]);
+    }
+    return (double)sum / ((double)a->width * a->height);
+}
+
+static int keepalive_due(const SceneDetector *sd, const Frame *f) {
+    return sd->keepalive_ns && f->timestamp_ns - sd->last_kept_ns >= sd->keepalive_ns;
+}
+
+static SceneResult keep(SceneDetector *sd, const Frame *f, SceneResult result) {
+    sd->last_kept_ns = f->timestamp_ns;
+    return result;
+}
+
+SceneResult scene_detect(SceneDetector *sd, const Frame *f) {
+    uint64_t t0 = scene_now_ns();
+    sd->frames++;
+
+    int delta = f->jpeg_size - sd->ref_size;
+    if (sd->ref_size == 0 || abs(delta) > sd->ref_size * SCENE_SIZE_DELTA) {
+        sd->changed_size++;
+        sd->ref_size = f->jpeg_size;
+        if (sd->ref) {
+            frame_release(sd->ref);
+            sd->ref = NULL;
+        }
+        sd->detect_ns += scene_now_ns() - t0;
+        return keep(sd, f, SCENE_CHANGED);
+    }
+
+    sd->thumbnails++;
+    SceneResult result;
+    double diff = -1;
+    if (jpeg_decoder_decode_into(&sd->decoder, f, sd->cur, FRAME_GRAY8) < 0) {
+        result = SCENE_CHANGED;     // let the full decode count the error
+        sd->changed_content++;
+    }
+    else if (!sd->ref || (diff = thumbnail_diff(sd->cur, sd->ref)) < 0 || diff > sd->threshold) {
+        Frame *old = sd->ref;
+        sd->ref = sd->cur;
+        sd->cur = old ? old : frame_pool_acquire(&sd->pool);
+        sd->ref_size = f->jpeg_size;
+        result = SCENE_CHANGED;
+        sd->changed_content++;
+    }
+    else if (keepalive_due(sd, f)) {
+        result = SCENE_KEEPALIVE;
+        sd->keepalive++;
+    }
+    else {
+        result = SCENE_STATIC;
+        sd->skipped++;
+    }
+    sd->detect_ns += scene_now_ns() - t0;
+    return result == SCENE_STATIC ? result : keep(sd, f, result);
+}
+
+void scene_detect_print_stats(const SceneDetector *sd) {
+    uint64_t kept = sd->frames - sd->skipped;
+    printf("[Static] %llu of %llu frames unchanged and skipped; %llu kept: %llu changed size, "
+           "%llu changed content, %llu keep-alive; detector %.3f ms/frame (%llu thumbnails)\n",
+           (unsigned long long)sd->skipped, (unsigned long long)sd->frames, (unsigned long long)kept,
+           (unsigned long long)sd->changed_size, (unsigned long long)sd->changed_content,
+           (unsigned long long)sd->keepalive,
+           sd->frames ? sd->detect_ns / 1e6 / sd->frames : 0.0, (unsigned long long)sd->thumbnails);
+}
@@ -0,0 +1,185 @@
+#define _GNU_SOURCE     // fallocate()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "segment_ring.h"
+#include "log.h"
+
+#define RING_FRAME_OVERHEAD     1024    // headers (first frame), cluster, SimpleBlock header
+#define RING_META_RESERVE       4096    // finalize: SeekHead, duration, sizes, trailing Void
+#define RING_CUE_BYTES          48      // per cue point, generous
+
+static char *segment_path(const SegmentRing *r, int i) {
+    size_t len = strlen(r->prefix) + 16;
+    char *path = malloc(len);
+    if (path) snprintf(path, len, "%s_%03d.mkv", r->prefix, i);
+    return path;
+}
+
+// Full size on disk; a sparse file if the filesystem cannot preallocate
+static int preallocate(int fd, uint64_t size) {
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (uint64_t)st.st_size > size && ftruncate(fd, size) < 0) return -1;
+    if (fallocate(fd, 0, 0, size) == 0) return 0;
+    if (errno != EOPNOTSUPP && errno != ENOSYS) return -1;
+    LOG_WARN("segment_ring: fallocate not supported, segment files will be sparse");
+    return ftruncate(fd, size);
+}
+
+int segment_ring_open(SegmentRing *r, const char *prefix, int num_segments, uint64_t segment_size) {
+    memset(r, 0, sizeof(*r));
+    r->current = -1;
+    if (num_segments < 2 || segment_size < SEGMENT_RING_MIN_SIZE) {
+        LOG_ERROR("segment_ring_open: need at least 2 segments of %d MB", SEGMENT_RING_MIN_SIZE >> 20);
+        return -1;
+    }
+    r->prefix = prefix;
+    r->num_segments = num_segments;
+    r->segment_size = segment_size;
+    r->fds = malloc(sizeof(int) * num_segments);
+    r->created = calloc(num_segments, 1);
+    r->written = calloc(num_segments, 1);
+    if (!r->fds || !r->created || !r->written) {
+        LOG_ERROR("segment_ring_open: out of memory");
+        return -1;
+    }
+    for (int i = 0; i < num_segments; i++) r->fds[i] = -1;
+
+    // Start over the oldest segment, so a restart keeps the latest recordings
+    struct timespec oldest = { 0, 0 };
+    int start = 0;
+    for (int i = 0; i < num_segments; i++) {
+        char *path = segment_path(r, i);
+        if (!path) return -1;
+        int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0) r->created[i] = 1;
+        else if (errno == EEXIST) fd = open(path, O_RDWR);
+
+        // Before preallocate(), which touches the mtime when it grows the file
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && (i == 0 || st.st_mtim.tv_sec < oldest.tv_sec ||
+            (st.st_mtim.tv_sec == oldest.tv_sec && st.st_mtim.tv_nsec < oldest.tv_nsec))) {
+            oldest = st.st_mtim;
+            start = i;
+        }
+        if (fd < 0 || preallocate(fd, segment_size) < 0) {
+            LOG_ERROR("segment_ring_open: %s: %s", path, strerror(errno));
+            if (fd >= 0) close(fd);
+            free(path);
+            return -1;
+        }
+        free(path);
+        r->fds[i] = fd;
+    }
+    r->current = start - 1;     // the first frame moves on to start
+
+    if (async_io_init(&r->io, SEGMENT_RING_STAGING) < 0) return -1;
+    return 0;
+}
+
+// MkvWriteFn: patches rewrite earlier bytes and must land after them
+static int ring_write(void *ctx, uint64_t offset, const struct iovec *iov, int n) {
+    SegmentRing *r = ctx;
+    return async_io_write(&r->io, r->fds[r->current], offset, iov, n, offset < r->mkv.pos);
+}
+
+static uint64_t meta_reserve(const SegmentRing *r) {
+    return RING_META_RESERVE + (uint64_t)(r->mkv.num_cues + 1) * RING_CUE_BYTES;
+}
+
+// Finalize the mkv, then a top-level Void from its end to segment_size
+static int finish_segment(SegmentRing *r) {
+    int ret = mkv_writer_close(&r->mkv);
+    r->open = 0;
+
+    uint64_t end = r->mkv.pos, rest = r->segment_size - end;
+    uint8_t hdr[9] = { 0xEC };
+    size_t len;
+    if (rest >= sizeof(hdr)) {
+        uint64_t size = rest - sizeof(hdr);
+        hdr[1] = 0x01;          // 8-byte size
+        for (int i = 0; i < 7; i++) hdr[2 + i] = (uint8_t)(size >> (48 - 8 * i));
+        len = sizeof(hdr);
+    }
+    else {
+        hdr[1] = 0x80 | (uint8_t)(rest - 2);
+        len = 2;
+    }
+    // The Void's body is already zero (async_io_zero at segment start)
+    struct iovec iov = { hdr, len };
+    if (rest >= 2 && async_io_write(&r->io, r->fds[r->current], end, &iov, 1, 0) < 0) ret = -1;
+    return ret;
+}
+
+static void start_segment(SegmentRing *r) {
+    r->current = (r->current + 1) % r->num_segments;
+    // Clear the old recording first, so a crash in this segment cannot
+    // leave stale clusters behind the new ones
+    async_io_zero(&r->io, r->fds[r->current], r->segment_size);
+    mkv_writer_open_sink(&r->mkv, ring_write, r);
+    r->open = 1;
+    r->written[r->current] = 1;
+    r->segments_started++;
+}
+
+int segment_ring_add_frame(SegmentRing *r, const struct iovec *parts, int num_parts, uint64_t timestamp_ns) {
+    size_t size = 0;
+    for (int i = 0; i < num_parts; i++) size += parts[i].iov_len;
+    uint64_t need = size + RING_FRAME_OVERHEAD;
+
+    if (need + RING_META_RESERVE > r->segment_size || need > SEGMENT_RING_STAGING / 2) {
+        if (!r->frames_dropped) LOG_WARN("segment_ring: %zu byte frame does not fit a segment", size);
+        r->frames_dropped++;
+        return 0;
+    }
+    // Drop rather than wait if the disk is behind
+    if (!r->block && !async_io_can_queue(&r->io, need + meta_reserve(r), 4)) {
+        r->frames_dropped++;
+        return 0;
+    }
+
+    if (r->open && r->mkv.pos + need + meta_reserve(r) > r->segment_size && finish_segment(r) < 0) {
+        LOG_ERROR("segment_ring: failed to finalize segment %d", r->current);
+    }
+    if (!r->open) start_segment(r);
+
+    if (mkv_writer_add_frame(&r->mkv, parts, num_parts, timestamp_ns) < 0) return -1;
+    r->frames++;
+    r->bytes += size;
+    return 0;
+}
+
+// Also waits for the disk: the stats are final afterwards
+int segment_ring_close(SegmentRing *r) {
+    int ret = 0;
+    if (r->open && finish_segment(r) < 0) ret = -1;
+    async_io_destroy(&r->io);
+
+    for (int i = 0; i < r->num_segments && r->fds; i++) {
+        if (r->fds[i] < 0) continue;
+        if (fdatasync(r->fds[i]) < 0 || close(r->fds[i]) < 0) ret = -1;
+        // Preallocated this run but never used: leave nothing behind
+        if (r->created[i] && !r->written[i]) {
+            char *path = segment_path(r, i);
+            if (path) unlink(path);
+            free(path);
+        }
+    }
+    free(r->fds);
+    free(r->created);
+    free(r->written);
+    r->fds = NULL;
+    r->created = r->written = NULL;
+    return ret;
+}
+
+void segment_ring_print_stats(SegmentRing *r) {
+    printf("[Ring] %s_*.mkv: %d x %.0f MB, %llu frames (%.1f MB), %llu dropped, %llu segments started\n",
+           r->prefix, r->num_segments, r->segment_size / 1048576.0, (unsigned long long)r->frames,
+           r->bytes / 1e6, (unsigned long long)r->frames_dropped, (unsigned long long)r->segments_started);
+    async_io_print_stats(&r->io, "ring");
+}
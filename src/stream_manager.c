@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include "stream_manager.h"
+#include "log.h"
+
+int stream_manager_init(StreamManager *m, int num_threads) {
+    memset(m, 0, sizeof(*m));
+    if (num_threads < 1) num_threads = 1;
+    if (num_threads > STREAM_MANAGER_MAX_THREADS) num_threads = STREAM_MANAGER_MAX_THREADS;
+    m->num_threads = num_threads;
+    for (int i = 0; i < num_threads; i++) {
+        StreamLoop *loop = &m->loops[i];
+        loop->mgr = m;
+        loop->index = i;
+        loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (loop->epoll_fd < 0) {
+            LOG_ERROR("stream_manager_init: epoll_create1: %s", strerror(errno));
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int stream_manager_add(StreamManager *m, StreamSource *src) {
+    if (m->num_sources == STREAM_MANAGER_MAX_SOURCES) {
+        LOG_ERROR("stream_manager_add: more than %d sources", STREAM_MANAGER_MAX_SOURCES);
+        return -1;
+    }
+    src->thread = m->num_sources % m->num_threads;
+    StreamLoop *loop = &m->loops[src->thread];
+    struct epoll_event ev = { .events = src->events, .data.ptr = src };
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, src->fd, &ev) < 0) {
+        LOG_ERROR("stream_manager_add: %s: %s", src->name, strerror(errno));
+        return -1;
+    }
+    m->sources[m->num_sources++] = src;
+    loop->active++;
+    return 0;
+}
+
+static void finish_source(StreamLoop *loop, StreamSource *src) {
+    if (src->finished) return;
+    epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, src->fd, NULL);
+    src->finished = 1;
+    loop->active--;
+}
+
+static void *loop_run(void *arg) {
+    StreamLoop *loop = arg;
+    StreamManager *m = loop->mgr;
+    struct epoll_event events[STREAM_MANAGER_MAX_SOURCES];
+
+    while (loop->active > 0 && !*m->stop) {
+        int n = epoll_wait(loop->epoll_fd, events, STREAM_MANAGER_MAX_SOURCES, STREAM_MANAGER_TICK_MS);
+        if (n < 0 && errno != EINTR) {
+            LOG_ERROR("stream_manager: epoll_wait: %s", strerror(errno));
+            break;
+        }
+        loop->waits++;
+        for (int i = 0; i < n; i++) {
+            StreamSource *src = events[i].data.ptr;
+            if (src->finished) continue;
+            loop->events++;
+            src->wakeups++;
+            int items = src->stop ? 0 : src->ready(src);
+            src->items += items;
+            if ((uint32_t)items > src->max_batch) src->max_batch = items;
+        }
+        // Finished sources, and stop requests from other threads
+        for (int i = 0; i < m->num_sources; i++) {
+            StreamSource *src = m->sources[i];
+            if (src->thread == loop->index && src->stop) finish_source(loop, src);
+        }
+        if (loop->index == 0 && m->tick) m->tick();
+    }
+    return NULL;
+}
+
+int stream_manager_run(StreamManager *m, volatile sig_atomic_t *stop) {
+    m->stop = stop;
+    for (int i = 1; i < m->num_threads; i++) {
+        if (pthread_create(&m->loops[i].thread, NULL, loop_run, &m->loops[i]) != 0) {
+            LOG_ERROR("stream_manager_run: failed to create thread");
+            return -1;
+        }
+    }
+    loop_run(&m->loops[0]);
+    for (int i = 1; i < m->num_threads; i++) pthread_join(m->loops[i].thread, NULL);
+    return 0;
+}
+
+void stream_manager_destroy(StreamManager *m) {
+    for (int i = 0; i < m->num_threads; i++) {
+        if (m->loops[i].epoll_fd >= 0) close(m->loops[i].epoll_fd);
+        m->loops[i].epoll_fd = -1;
+    }
+}
+
+void stream_manager_print_stats(const StreamManager *m) {
+    for (int i = 0; i < m->num_threads; i++) {
+        const StreamLoop *loop = &m->loops[i];
+        printf("[Loop %d] %llu waits, %llu events\n", i,
+               (unsigned long long)loop->waits, (unsigned long long)loop->events);
+    }
+    for (int i = 0; i < m->num_sources; i++) {
+        const StreamSource *src = m->sources[i];
+        printf("[Source %d] %s: loop %d, %llu wakeups, %llu URBs (%.1f per wakeup, max %u)\n",
+               i, src->name, src->thread, (unsigned long long)src->wakeups, (unsigned long long)src->items,
+               src->wakeups ? (double)src->items / src->wakeups : 0.0, src->max_batch);
+    }
+}
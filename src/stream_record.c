@@ -0,0 +1,263 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <errno.h>
+#include "stream_record.h"
+
+uint64_t stream_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+int stream_recorder_open(StreamRecorder *rec, const char *path, int packet_size, int endpoint) {
+    memset(rec, 0, sizeof(StreamRecorder));
+
+    rec->file = fopen(path, "wb");
+    if (!rec->file) {
+        perror("Failed to open record file");
+        return -1;
+    }
+    // Large stdio buffer so recording costs one write() per ~1MB
+    setvbuf(rec->file, NULL, _IOFBF, 1024 * 1024);
+    rec->packet_size = packet_size;
+    rec->packets = malloc(STREAM_MAX_PACKETS * sizeof(StreamPacketRecord));
+    if (!rec->packets) {
+        stream_recorder_close(rec);
+        return -1;
+    }
+
+    StreamFileHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, STREAM_FILE_MAGIC, 4);
+    hdr.version = STREAM_FILE_VERSION;
+    hdr.packet_size = packet_size;
+    hdr.endpoint = endpoint;
+
+    if (fwrite(&hdr, sizeof(hdr), 1, rec->file) != 1) {
+        printf("stream_recorder_open: header write failed\n");
+        stream_recorder_close(rec);
+        return -1;
+    }
+
+    return 0;
+}
+
+int stream_recorder_write_urb(StreamRecorder *rec, const struct usbdevfs_urb *urb, uint64_t timestamp_ns) {
+    if (!rec || !rec->file || !urb) return -1;
+    if (urb->number_of_packets < 0 || urb->number_of_packets > STREAM_MAX_PACKETS) {
+        printf("stream_recorder_write_urb: %d packets, at most %d can be replayed\n",
+               urb->number_of_packets, STREAM_MAX_PACKETS);
+        return -1;
+    }
+
+    StreamURBRecord ur;
+    ur.timestamp_ns = timestamp_ns;
+    ur.number_of_packets = urb->number_of_packets;
+    ur.payload_bytes = 0;
+
+    StreamPacketRecord *pkts = rec->packets;
+    for (int p = 0; p < urb->number_of_packets; p++) {
+        pkts[p].status = urb->iso_frame_desc[p].status;
+        pkts[p].actual_length = urb->iso_frame_desc[p].actual_length;
+        ur.payload_bytes += pkts[p].actual_length;
+    }
+
+    if (fwrite(&ur, sizeof(ur), 1, rec->file) != 1) return -1;
+    if (fwrite(pkts, sizeof(StreamPacketRecord), urb->number_of_packets, rec->file) !=
+        (size_t)urb->number_of_packets) return -1;
+
+    for (int p = 0; p < urb->number_of_packets; p++) {
+        if (pkts[p].actual_length == 0) continue;
+        const uint8_t *src = (const uint8_t *)urb->buffer + (size_t)p * rec->packet_size;
+        if (fwrite(src, 1, pkts[p].actual_length, rec->file) != pkts[p].actual_length) return -1;
+    }
+
+    rec->urbs_written++;
+    rec->bytes_written += ur.payload_bytes;
+    return 0;
+}
+
+void stream_recorder_close(StreamRecorder *rec) {
+    if (!rec) return;
+    if (rec->file) fclose(rec->file);
+    free(rec->packets);
+    rec->file = NULL;
+    rec->packets = NULL;
+}
+
+// Grow the stand-in URB so it can hold num_packets packets
+static int replay_reserve(StreamReplay *rp, int num_packets) {
+    if (num_packets <= rp->max_packets) return 0;
+
+    size_t urb_size = sizeof(struct usbdevfs_urb) +
+                      num_packets * sizeof(struct usbdevfs_iso_packet_desc);
+    struct usbdevfs_urb *urb = realloc(rp->urb, urb_size);
+    if (!urb) return -1;
+    rp->urb = urb;
+
+    uint8_t *buffer = realloc(rp->buffer, (size_t)num_packets * rp->packet_size);
+    if (!buffer) return -1;
+    rp->buffer = buffer;
+
+    if (!rp->max_packets) memset(urb, 0, sizeof(struct usbdevfs_urb));
+    rp->max_packets = num_packets;
+    return 0;
+}
+
+int stream_replay_open(StreamReplay *rp, const char *path, int realtime) {
+    memset(rp, 0, sizeof(StreamReplay));
+
+    rp->file = fopen(path, "rb");
+    if (!rp->file) {
+        perror("Failed to open replay file");
+        return -1;
+    }
+    setvbuf(rp->file, NULL, _IOFBF, 1024 * 1024);
+
+    StreamFileHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, rp->file) != 1 ||
+        memcmp(hdr.magic, STREAM_FILE_MAGIC, 4) != 0 ||
+        hdr.version != STREAM_FILE_VERSION ||
+        hdr.packet_size == 0 || hdr.packet_size > STREAM_MAX_PACKET_SIZE) {
+        printf("stream_replay_open: %s is not a stream recording\n", path);
+        fclose(rp->file);
+        rp->file = NULL;
+        return -1;
+    }
+
+    rp->packet_size = hdr.packet_size;
+    rp->realtime = realtime;
+
+    rp->packets = malloc(STREAM_MAX_PACKETS * sizeof(StreamPacketRecord));
+    if (!rp->packets || replay_reserve(rp, 32) < 0) {
+        stream_replay_close(rp);
+        return -1;
+    }
+    return 0;
+}
+
+static void replay_pace(StreamReplay *rp, uint64_t ts) {
+    if (rp->urbs_read == 0) {
+        rp->first_ts = ts;
+        rp->start_ns = stream_now_ns();
+        return;
+    }
+    if (rp->no_sleep) return;
+
+    uint64_t due = rp->start_ns + (ts - rp->first_ts);
+    uint64_t now = stream_now_ns();
+    if (due > now) {
+        struct timespec req;
+        req.tv_sec = (due - now) / 1000000000ull;
+        req.tv_nsec = (due - now) % 1000000000ull;
+        while (nanosleep(&req, &req) < 0 && errno == EINTR) {}
+    }
+}
+
+// Read the packet table and payload that follow an already-read URB record
+static int replay_read_body(StreamReplay *rp, const StreamURBRecord *rec,
+                            struct usbdevfs_urb *urb, uint8_t *buffer) {
+    StreamURBRecord ur = *rec;
+    StreamPacketRecord *pkts = rp->packets;
+    if (fread(pkts, sizeof(StreamPacketRecord), ur.number_of_packets, rp->file) != ur.number_of_packets) {
+        return -1;
+    }
+
+    // The payload that follows is sized by the table: check both agree
+    // before trusting either
+    uint64_t payload = 0;
+    for (uint32_t p = 0; p < ur.number_of_packets; p++) {
+        if (pkts[p].actual_length > (uint32_t)rp->packet_size) {
+            printf("stream_replay: corrupt packet length %u\n", pkts[p].actual_length);
+            return -1;
+        }
+        payload += pkts[p].actual_length;
+    }
+    if (payload != ur.payload_bytes) {
+        printf("stream_replay: corrupt record, %u payload bytes but the packets hold %llu\n",
+               ur.payload_bytes, (unsigned long long)payload);
+        return -1;
+    }
+
+    void *usercontext = urb->usercontext;
+    memset(urb, 0, sizeof(struct usbdevfs_urb));
+    urb->type = USBDEVFS_URB_TYPE_ISO;
+    urb->buffer = buffer;
+    urb->buffer_length = (int)((size_t)ur.number_of_packets * rp->packet_size);
+    urb->number_of_packets = ur.number_of_packets;
+    urb->usercontext = usercontext;
+
+    for (uint32_t p = 0; p < ur.number_of_packets; p++) {
+        uint32_t len = pkts[p].actual_length;
+        urb->iso_frame_desc[p].length = rp->packet_size;
+        urb->iso_frame_desc[p].actual_length = len;
+        urb->iso_frame_desc[p].status = pkts[p].status;
+
+        if (len > 0 && fread(buffer + (size_t)p * rp->packet_size, 1, len, rp->file) != len) {
+            return -1;      // Truncated recording
+        }
+    }
+
+    if (rp->realtime) replay_pace(rp, ur.timestamp_ns);
+    else if (rp->urbs_read == 0) rp->first_ts = ur.timestamp_ns;
+
+    rp->last_ts = ur.timestamp_ns;
+    rp->urbs_read++;
+    return 0;
+}
+
+int stream_replay_read_urb(StreamReplay *rp, struct usbdevfs_urb *urb, uint8_t *buffer, int max_packets) {
+    if (!rp || !rp->file) return -1;
+
+    StreamURBRecord ur;
+    if (fread(&ur, sizeof(ur), 1, rp->file) != 1) return -1;  // EOF
+
+    if (ur.number_of_packets > STREAM_MAX_PACKETS) {
+        printf("stream_replay_read_urb: corrupt record, %u packets\n", ur.number_of_packets);
+        return -1;
+    }
+    if (ur.number_of_packets > (uint32_t)max_packets) {
+        printf("stream_replay_read_urb: %u packets do not fit in %d\n", ur.number_of_packets, max_packets);
+        return -1;
+    }
+    return replay_read_body(rp, &ur, urb, buffer);
+}
+
+struct usbdevfs_urb *stream_replay_next_urb(StreamReplay *rp) {
+    if (!rp || !rp->file) return NULL;
+
+    StreamURBRecord ur;
+    if (fread(&ur, sizeof(ur), 1, rp->file) != 1) return NULL;  // EOF
+
+    if (ur.number_of_packets > STREAM_MAX_PACKETS) {
+        printf("stream_replay_next_urb: corrupt record, %u packets\n", ur.number_of_packets);
+        return NULL;
+    }
+    if (replay_reserve(rp, ur.number_of_packets) < 0) {
+        printf("stream_replay_next_urb: out of memory (%u packets)\n", ur.number_of_packets);
+        return NULL;
+    }
+
+    if (replay_read_body(rp, &ur, rp->urb, rp->buffer) < 0) return NULL;
+    return rp->urb;
+}
+
+uint64_t stream_replay_due_ns(const StreamReplay *rp) {
+    if (!rp->realtime || rp->urbs_read == 0) return 0;
+    return rp->start_ns + (rp->last_ts - rp->first_ts);
+}
+
+void stream_replay_close(StreamReplay *rp) {
+    if (!rp) return;
+    if (rp->file) fclose(rp->file);
+    free(rp->urb);
+    free(rp->buffer);
+    free(rp->packets);
+    rp->file = NULL;
+    rp->urb = NULL;
+    rp->buffer = NULL;
+    rp->packets = NULL;
+    rp->max_packets = 0;
+}
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <string.h>
+#include "trace.h"
+
+TraceRing g_trace;
+
+static const char *event_names[TRACE_NUM_EVENTS] = {
+    [TRACE_URB_SUBMIT]        = "urb_submit",
+    [TRACE_URB_REAP]          = "urb_reap",
+    [TRACE_URB_ERROR]         = "urb_error",
+    [TRACE_URB_DEPTH]         = "urb_depth",
+    [TRACE_PARSER_SOI]        = "parser_soi",
+    [TRACE_PARSER_EOI]        = "parser_eoi",
+    [TRACE_PARSER_FRAME]      = "parser_frame",
+    [TRACE_PARSER_DROP]       = "parser_drop",
+    [TRACE_PAYLOAD_EOF]       = "payload_eof",
+    [TRACE_FRAME_SUBMIT]      = "frame_submit",
+    [TRACE_FRAME_DROP]        = "frame_drop",
+    [TRACE_FRAME_DECODED]     = "frame_decoded",
+    [TRACE_FRAME_STATIC]      = "frame_static",
+    [TRACE_FRAME_ENCODED]     = "frame_encoded",
+    [TRACE_PREVIEW_DECODED]   = "preview_decoded",
+    [TRACE_FRAME_ARCHIVED]    = "frame_archived",
+};
+
+static atomic_int g_next_thread = 1;
+static __thread uint16_t t_thread_id;
+
+uint16_t trace_thread_id(void) {
+    if (!t_thread_id) t_thread_id = (uint16_t)atomic_fetch_add(&g_next_thread, 1);
+    return t_thread_id;
+}
+
+const char *trace_event_name(int id) {
+    if (id < 0 || id >= TRACE_NUM_EVENTS || !event_names[id]) return "?";
+    return event_names[id];
+}
+
+int trace_snapshot(TraceEvent *out, int max) {
+    uint64_t end = atomic_load_explicit(&g_trace.next, memory_order_acquire);
+    uint64_t start = end > TRACE_RING_SIZE ? end - TRACE_RING_SIZE : 0;
+    int n = 0;
+
+    for (uint64_t idx = start; idx < end && n < max; idx++) {
+        TraceEvent *e = &g_trace.events[idx & (TRACE_RING_SIZE - 1)];
+
+        // Seqlock-style read: keep the copy only if the slot still holds
+        // this index after copying it
+        uint64_t seq = atomic_load_explicit(&e->seq, memory_order_acquire);
+        if (seq != idx + 1) continue;
+        out[n].ts_ns = e->ts_ns;
+        out[n].id = e->id;
+        out[n].thread = e->thread;
+        out[n].a = e->a;
+        out[n].b = e->b;
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&e->seq, memory_order_relaxed) != seq) continue;
+        atomic_store_explicit(&out[n].seq, seq, memory_order_relaxed);
+        n++;
+    }
+    return n;
+}
+
+void trace_dump(FILE *out) {
+    static TraceEvent snap[TRACE_RING_SIZE];   // too big for a thread stack
+    int n = trace_snapshot(snap, TRACE_RING_SIZE);
+    uint64_t total = atomic_load(&g_trace.next);
+
+    fprintf(out, "# trace: %d of %llu events\n", n, (unsigned long long)total);
+    fprintf(out, "# seq time_us thread event a b\n");
+    for (int i = 0; i < n; i++) {
+        fprintf(out, "%llu %.3f %u %s %u %llu\n",
+                (unsigned long long)atomic_load_explicit(&snap[i].seq, memory_order_relaxed) - 1,
+                (snap[i].ts_ns - snap[0].ts_ns) / 1000.0, snap[i].thread,
+                trace_event_name(snap[i].id), snap[i].a, (unsigned long long)snap[i].b);
+    }
+    fflush(out);
+}
+
+int trace_dump_file(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        perror("trace_dump_file");
+        return -1;
+    }
+    trace_dump(f);
+    fclose(f);
+    return 0;
+}
@@ -1,57 +1,272 @@
 #include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
 #include <errno.h>
 #include <stdio.h>
+#include <linux/usb/ch9.h>
 #include "urb_manager.h"
+#include "log.h"
+#include "trace.h"
 
-void urb_manager_init(URBManager *mgr) {
-    memset(mgr, 0, sizeof(URBManager));
-    mgr->num_active = 0;
+static uint64_t thread_cpu_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
 
-    for (int i = 0; i < NUM_URBS; i++) {
-        mgr->urbs[i].active = 0;
+int urb_manager_init(URBManager *mgr, int fd, int endpoint, int packet_size, int packets_per_urb, int max_urbs) {
+    memset(mgr, 0, sizeof(URBManager));
+    mgr->fd = fd;
+    mgr->endpoint = endpoint;
+    mgr->packet_size = packet_size;
+    mgr->packets_per_urb = packets_per_urb;
+    mgr->max_urbs = max_urbs;
+    mgr->urbs = calloc(max_urbs, sizeof(*mgr->urbs));
+    mgr->parked = calloc(max_urbs, sizeof(*mgr->parked));
+    if (!mgr->urbs || !mgr->parked) {
+        LOG_ERROR("urb_manager_init: out of memory");
+        return -1;
     }
+    pthread_mutex_init(&mgr->lock, NULL);
+    const char *env = getenv("UVC_NO_USB_MMAP");
+    mgr->use_mmap = !(env && env[0] == '1');
+
+    // One iso packet per (micro)frame: 125 us from high speed up, else 1 ms
+    int speed = ioctl(fd, USBDEVFS_GET_SPEED);
+    uint64_t interval_ns = (speed == USB_SPEED_LOW || speed == USB_SPEED_FULL) ? 1000000 : 125000;
+    mgr->urb_ns = interval_ns * packets_per_urb;
+    return 0;
 }
 
-int urb_submit(int fd, URBBuffer *urb_buf, int endpoint, int num_packets, int packet_size) {
-    memset(&urb_buf->urb, 0, sizeof(struct usbdevfs_urb));
+// usbfs mmap gives DMA-coherent memory; the heap is the fallback when the
+// kernel (before 4.6) or the controller cannot provide it
+static void *alloc_buffer(URBManager *mgr, size_t size) {
+    if (mgr->use_mmap) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        void *buf = mmap(NULL, (size + page - 1) & ~(page - 1), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, mgr->fd, 0);
+        if (buf != MAP_FAILED) {
+            mgr->num_mmapped++;
+            return buf;
+        }
+        LOG_WARN("urb_manager: usbfs mmap failed (%s), heap URB buffers from here on", strerror(errno));
+        mgr->use_mmap = 0;
+    }
+    return malloc(size);
+}
 
-    urb_buf->urb.type = USBDEVFS_URB_TYPE_ISO;
-    urb_buf->urb.endpoint = endpoint;
-    urb_buf->urb.buffer = urb_buf->buffer;
-    urb_buf->urb.buffer_length = num_packets * packet_size;
-    urb_buf->urb.number_of_packets = num_packets;
+// Only right after alloc_buffer(): use_mmap still tells how buf was allocated
+static void free_buffer(URBManager *mgr, void *buf, size_t size) {
+    if (mgr->use_mmap) {
+        size_t page = sysconf(_SC_PAGESIZE);
+        munmap(buf, (size + page - 1) & ~(page - 1));
+        mgr->num_mmapped--;
+    }
+    else free(buf);
+}
 
-    for (int i = 0; i < num_packets; i++) {
-        urb_buf->iso_packets[i].length = packet_size;
-        urb_buf->iso_packets[i].actual_length = 0;
-        urb_buf->iso_packets[i].status = 0;
+static struct usbdevfs_urb *alloc_urb(URBManager *mgr) {
+    size_t sz = sizeof(struct usbdevfs_urb) + mgr->packets_per_urb * sizeof(struct usbdevfs_iso_packet_desc);
+    struct usbdevfs_urb *urb = calloc(1, sz);
+    if (!urb) return NULL;
+    urb->buffer = alloc_buffer(mgr, (size_t)mgr->packet_size * mgr->packets_per_urb);
+    if (!urb->buffer) {
+        free(urb);
+        return NULL;
+    }
+    urb->type = USBDEVFS_URB_TYPE_ISO;
+    urb->endpoint = mgr->endpoint;
+    urb->buffer_length = mgr->packet_size * mgr->packets_per_urb;
+    urb->number_of_packets = mgr->packets_per_urb;
+    for (int i = 0; i < mgr->packets_per_urb; i++) urb->iso_frame_desc[i].length = mgr->packet_size;
+    if (mgr->init_urb && mgr->init_urb(urb, mgr->ctx) < 0) {
+        free_buffer(mgr, urb->buffer, (size_t)mgr->packet_size * mgr->packets_per_urb);
+        free(urb);
+        return NULL;
     }
+    mgr->urbs[mgr->num_urbs++] = urb;
+    return urb;
+}
 
-    if (ioctl(fd, USBDEVFS_SUBMITURB, &urb_buf->urb) < 0) {
+// With the lock held
+static int submit(URBManager *mgr, struct usbdevfs_urb *urb) {
+    uint64_t t0 = thread_cpu_ns();
+    int ret = ioctl(mgr->fd, USBDEVFS_SUBMITURB, urb);
+    mgr->ioctl_cpu_ns += thread_cpu_ns() - t0;
+    if (ret < 0) {
+        trace_event(TRACE_URB_ERROR, errno, 0);
+        mgr->parked[mgr->num_parked++] = urb;
         return -1;
     }
+    mgr->in_flight++;
+    trace_event(TRACE_URB_SUBMIT, urb->number_of_packets, urb->buffer_length);
+    return 0;
+}
+
+static void fill_locked(URBManager *mgr) {
+    while (mgr->in_flight < mgr->depth) {
+        struct usbdevfs_urb *urb = mgr->num_parked > 0 ? mgr->parked[--mgr->num_parked] : NULL;
+        if (!urb && (mgr->num_urbs == mgr->max_urbs || !(urb = alloc_urb(mgr)))) return;
+        if (submit(mgr, urb) < 0) return;
+    }
+}
+
+void urb_manager_fill(URBManager *mgr) {
+    pthread_mutex_lock(&mgr->lock);
+    fill_locked(mgr);
+    pthread_mutex_unlock(&mgr->lock);
+}
+
+static void set_depth(URBManager *mgr, int depth, uint64_t wait_ns) {
+    if (depth > URB_MAX_DEPTH) depth = URB_MAX_DEPTH;
+    if (depth > mgr->max_urbs) depth = mgr->max_urbs;
+    if (depth < URB_TUNE_MIN_DEPTH) depth = URB_TUNE_MIN_DEPTH;
+    if (depth == mgr->depth) return;
+
+    mgr->depth = depth;
+    mgr->depth_changes++;
+    if (depth < mgr->min_depth_used) mgr->min_depth_used = depth;
+    if (depth > mgr->max_depth_used) mgr->max_depth_used = depth;
+    // URBs queued before the change still show the old depth's timing
+    mgr->settle = mgr->in_flight + 1;
+    mgr->clean_windows = 0;
+    trace_event(TRACE_URB_DEPTH, depth, wait_ns);
+    LOG_DEBUG("urb_manager: depth %d (longest wait %.2f ms)", depth, wait_ns / 1e6);
+}
 
-    urb_buf->active = 1;
-    
+int urb_manager_start(URBManager *mgr, int depth, int autotune) {
+    if (depth < 1) depth = 1;
+    if (depth > URB_MAX_DEPTH) depth = URB_MAX_DEPTH;
+    if (depth > mgr->max_urbs) depth = mgr->max_urbs;
+    mgr->depth = depth;
+    mgr->min_depth_used = mgr->max_depth_used = depth;
+    mgr->autotune = autotune;
+
+    pthread_mutex_lock(&mgr->lock);
+    fill_locked(mgr);
+    int submitted = mgr->in_flight;
+    pthread_mutex_unlock(&mgr->lock);
+    if (submitted == 0) {
+        LOG_ERROR("urb_manager_start: cannot submit URBs: %s", strerror(errno));
+        return -1;
+    }
     return 0;
 }
 
+// Grow at once on a loss; shrink one step after enough clean windows
+static void autotune(URBManager *mgr, int lost, uint64_t wait_ns, uint64_t now_ns) {
+    if (mgr->settle > 0) {
+        mgr->settle--;
+        mgr->window_start_ns = now_ns;
+        mgr->window_max_wait_ns = 0;
+        return;
+    }
+    if (lost) {
+        if (mgr->depth > mgr->fail_depth) mgr->fail_depth = mgr->depth;
+        // Enough URBs to have covered this wait, plus the one being reaped
+        int need = (int)(wait_ns / mgr->urb_ns) + 2;
+        set_depth(mgr, need > mgr->depth + 1 ? need : mgr->depth + 1, wait_ns);
+        mgr->window_start_ns = now_ns;
+        mgr->window_max_wait_ns = 0;
+        return;
+    }
+
+    if (wait_ns > mgr->window_max_wait_ns) mgr->window_max_wait_ns = wait_ns;
+    if (now_ns - mgr->window_start_ns < URB_TUNE_WINDOW_NS) return;
+
+    // Would one URB fewer still have covered the longest wait?
+    int smaller = mgr->depth - 1;
+    if (smaller > mgr->fail_depth && smaller >= URB_TUNE_MIN_DEPTH &&
+        mgr->window_max_wait_ns < (uint64_t)(smaller - 1) * mgr->urb_ns) {
+        if (++mgr->clean_windows >= URB_TUNE_CLEAN_WINDOWS) set_depth(mgr, smaller, mgr->window_max_wait_ns);
+    }
+    else {
+        mgr->clean_windows = 0;
+    }
+    mgr->window_start_ns = now_ns;
+    mgr->window_max_wait_ns = 0;
+}
+
+void urb_manager_reaped(URBManager *mgr, const struct usbdevfs_urb *urb, uint64_t now_ns) {
+    pthread_mutex_lock(&mgr->lock);
+    if (mgr->in_flight > 0) mgr->in_flight--;
+
+    int errors = 0;
+    for (int i = 0; i < urb->number_of_packets; i++) {
+        if (urb->iso_frame_desc[i].status != 0) errors++;
+        else mgr->bytes += urb->iso_frame_desc[i].actual_length;
+    }
+    mgr->reaped++;
+    mgr->packets += urb->number_of_packets;
+    mgr->packet_errors += errors;
+
+    // The URBs still queued at the last reap covered depth - 1 URB times
+    uint64_t wait_ns = mgr->last_reap_ns ? now_ns - mgr->last_reap_ns : 0;
+    int underrun = mgr->last_reap_ns && wait_ns > (uint64_t)(mgr->depth - 1) * mgr->urb_ns;
+    if (underrun) mgr->underruns++;
+    if (wait_ns > mgr->max_wait_ns) mgr->max_wait_ns = wait_ns;
+    if (!mgr->last_reap_ns) mgr->window_start_ns = now_ns;
+    mgr->last_reap_ns = now_ns;
+
+    if (mgr->autotune) autotune(mgr, errors > 0 || underrun, wait_ns, now_ns);
+    pthread_mutex_unlock(&mgr->lock);
+}
+
+int urb_manager_resubmit(URBManager *mgr, struct usbdevfs_urb *urb) {
+    int ret = 0;
+    pthread_mutex_lock(&mgr->lock);
+    if (mgr->in_flight < mgr->depth) ret = submit(mgr, urb);
+    else mgr->parked[mgr->num_parked++] = urb;
+    pthread_mutex_unlock(&mgr->lock);
+    return ret;
+}
+
+struct usbdevfs_urb *urb_manager_reap(URBManager *mgr) {
+    struct usbdevfs_urb *urb;
+    uint64_t t0 = thread_cpu_ns();
+    int ret = ioctl(mgr->fd, USBDEVFS_REAPURBNDELAY, &urb);
+    uint64_t cpu_ns = thread_cpu_ns() - t0;
+
+    int saved_errno = errno;
+    pthread_mutex_lock(&mgr->lock);
+    mgr->ioctl_cpu_ns += cpu_ns;
+    pthread_mutex_unlock(&mgr->lock);
+    errno = saved_errno;
+    return ret < 0 ? NULL : urb;
+}
+
+void urb_manager_print_stats(const URBManager *mgr) {
+    printf("[URB] depth %d%s (%d..%d, %d changes), %d x %d B packets per URB (%.2f ms), "
+           "%d allocated (%.1f MB)\n",
+           mgr->depth, mgr->autotune ? " auto" : "", mgr->min_depth_used, mgr->max_depth_used,
+           mgr->depth_changes, mgr->packets_per_urb, mgr->packet_size, mgr->urb_ns / 1e6,
+           mgr->num_urbs, (double)mgr->num_urbs * mgr->packets_per_urb * mgr->packet_size / 1e6);
+    printf("[URB] %llu reaped, %llu of %llu packets in error, %llu underruns, longest reap wait %.2f ms\n",
+           (unsigned long long)mgr->reaped, (unsigned long long)mgr->packet_errors,
+           (unsigned long long)mgr->packets, (unsigned long long)mgr->underruns, mgr->max_wait_ns / 1e6);
+    printf("[URB] buffers: %d of %d mmap'd (%s), submit+reap CPU %.3f ms per MB (%.1f MB)\n",
+           mgr->num_mmapped, mgr->num_urbs, mgr->num_mmapped ? "usbfs DMA" : "heap, kernel copies",
+           mgr->bytes ? mgr->ioctl_cpu_ns / 1e6 / (mgr->bytes / 1e6) : 0.0, mgr->bytes / 1e6);
+}
+
 struct usbdevfs_urb* urb_reap(int fd) {
     struct usbdevfs_urb *urb;
 
     if (ioctl(fd, USBDEVFS_REAPURB, &urb) < 0) {
-        if (errno == EAGAIN) {
-            printf("Resource temporarily unavailable\n");
-        }
-        else if (errno == ENODEV) {
-            printf("Operation not supported by device\n");
+        // EAGAIN (nothing completed yet) is routine, so it is only traced
+        trace_event(TRACE_URB_ERROR, errno, 0);
+        if (errno == ENODEV) {
+            LOG_ERROR("urb_reap: device disconnected");
         }
-        else {
-            printf("Other errors\n");
+        else if (errno != EAGAIN && errno != EINTR) {
+            LOG_ERROR("urb_reap: %s", strerror(errno));
         }
         return NULL;
     }
 
+    trace_event(TRACE_URB_REAP, urb->number_of_packets, urb->actual_length);
     return urb;
 }
@@ -6,6 +6,8 @@
 #include <linux/usb/ch9.h>
 #include <linux/usb/video.h>
 #include <errno.h>
+#include "log.h"
+#include "trace.h"
 
 void print_streaming_control(struct uvc_streaming_control *ctrl) {
     printf("Streaming Control:\n");
@@ -115,8 +117,9 @@ int submit_iso_urb(int fd, struct usbdevfs_urb *urb, unsigned char *buffer,
         urb->iso_frame_desc[i].status = 0;
     }
 
-    printf("Submitting URB: endpoint=0x%02x, packets=%d, size=%d, total=%d\n",
-           endpoint, num_packets, packet_size, num_packets * packet_size);
+    LOG_DEBUG("Submitting URB: endpoint=0x%02x, packets=%d, size=%d, total=%d",
+              endpoint, num_packets, packet_size, num_packets * packet_size);
+    trace_event(TRACE_URB_SUBMIT, num_packets, urb->buffer_length);
 
     if (ioctl(fd, USBDEVFS_SUBMITURB, urb) < 0) {
         perror("Failed to submit URB");
@@ -154,8 +157,7 @@ void process_video_data(unsigned char *data, int length, FILE *output) {
         
         // Check End of Frame bit
         if (header_info & 0x02) {
-            printf(".");
-            fflush(stdout);
+            trace_event(TRACE_PAYLOAD_EOF, length - header_len, 0);
         }
     }
 }
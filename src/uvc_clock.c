@@ -0,0 +1,82 @@
+#include <string.h>
+#include "uvc_clock.h"
+
+static uint32_t get_le32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+int uvc_header_parse(const uint8_t *p, int len, UvcPayloadHeader *h) {
+    memset(h, 0, sizeof(*h));
+    if (len < 2 || p[0] < 2 || p[0] > len) return -1;
+
+    h->length = p[0];
+    h->flags = p[1];
+    int pos = 2;
+    if (h->flags & UVC_HDR_PTS) {
+        if (pos + 4 > h->length) return -1;
+        h->pts = get_le32(p + pos);
+        h->has_pts = 1;
+        pos += 4;
+    }
+    if (h->flags & UVC_HDR_SCR) {
+        if (pos + 6 > h->length) return -1;
+        h->scr_stc = get_le32(p + pos);
+        h->scr_sof = (p[pos + 4] | (p[pos + 5] << 8)) & 0x7ff;
+        h->has_scr = 1;
+    }
+    return 0;
+}
+
+void uvc_clock_init(UvcClock *c, uint32_t clock_hz) {
+    memset(c, 0, sizeof(*c));
+    c->clock_hz = clock_hz;
+    if (clock_hz) c->ns_per_tick = 1e9 / clock_hz;
+}
+
+// Lower envelope of host - model over the window
+static void update_offset(UvcClock *c) {
+    double best = 0;
+    for (int i = 0; i < c->win_count; i++) {
+        double off = (double)(c->win_host[i] - c->first_host) - c->ns_per_tick * c->win_ticks[i];
+        if (i == 0 || off < best) best = off;
+    }
+    c->offset_ns = best;
+}
+
+void uvc_clock_add_scr(UvcClock *c, uint32_t stc, uint64_t host_ns) {
+    if (c->samples == 0) {
+        c->last_raw = stc;
+        c->ticks = 0;
+        c->first_host = host_ns;
+    }
+    else {
+        // Wraps forward; a slightly older STC (reordered packet) goes back
+        c->ticks += (int32_t)(stc - c->last_raw);
+        c->last_raw = stc;
+        if (host_ns - c->last_host < UVC_CLOCK_SAMPLE_NS) return;
+    }
+    c->last_ticks = c->ticks;
+    c->last_host = host_ns;
+    c->samples++;
+
+    c->win_ticks[c->win_next] = c->ticks;
+    c->win_host[c->win_next] = host_ns;
+    c->win_next = (c->win_next + 1) % UVC_CLOCK_WINDOW;
+    if (c->win_count < UVC_CLOCK_WINDOW) c->win_count++;
+
+    if (!c->clock_hz && c->ticks > 0 && host_ns - c->first_host >= UVC_CLOCK_MIN_SPAN_NS) {
+        c->ns_per_tick = (double)(host_ns - c->first_host) / c->ticks;
+    }
+    if (c->ns_per_tick > 0) update_offset(c);
+}
+
+uint64_t uvc_clock_to_host(const UvcClock *c, uint32_t pts) {
+    if (c->samples == 0 || c->ns_per_tick <= 0) return 0;
+    int64_t ticks = c->ticks + (int32_t)(pts - c->last_raw);
+    double host = (double)c->first_host + c->ns_per_tick * ticks + c->offset_ns;
+    return host > 0 ? (uint64_t)host : 0;
+}
+
+double uvc_clock_frequency(const UvcClock *c) {
+    return c->ns_per_tick > 0 ? 1e9 / c->ns_per_tick : 0.0;
+}
@@ -7,6 +7,7 @@
 #include <errno.h>
 #include <sys/ioctl.h>
 #include <linux/usbdevice_fs.h>
+#include "jpeg_markers.h"
 
 // --- UVC Definitions ---
 #define VIDEO_CONTROL_INTERFACE   0
@@ -42,25 +43,41 @@ int g_frame_pos = 0;
 int g_is_capturing = 0;
 
 // --- Helper: SOI/EOI Parser ---
+static void append_payload(const uint8_t *data, int len) {
+    if (!g_is_capturing || len <= 0) return;
+    if (g_frame_pos + len < MAX_FRAME_SIZE) {
+        memcpy(g_frame_buffer + g_frame_pos, data, len);
+        g_frame_pos += len;
+    } else {
+        g_is_capturing = 0; // Overflow
+    }
+}
+
 void process_mjpeg_payload(uint8_t *data, int len) {
     if (len <= 0) return;
 
-    for (int i = 0; i < len - 1; i++) {
+    int copied = 0;     // payload bytes before this are already in the frame
+    int i = 0;
+
+    while (i < len - 1) {
+        long m = jpeg_find_marker(data + i, len - i);
+        if (m < 0) break;
+        i += m;
+
         // Start of Image (SOI)
-        if (data[i] == 0xFF && data[i+1] == 0xD8) {
+        if (data[i+1] == JPEG_MARKER_SOI) {
             g_frame_pos = 0;
             g_is_capturing = 1;
+            copied = i;
             printf("[Parser] SOI Found. Capturing...\n");
         }
-        
+
         // End of Image (EOI)
-        if (g_is_capturing && data[i] == 0xFF && data[i+1] == 0xD9) {
-            if (g_frame_pos + 2 < MAX_FRAME_SIZE) {
-                g_frame_buffer[g_frame_pos++] = data[i];
-                g_frame_buffer[g_frame_pos++] = data[i+1];
-            }
+        if (g_is_capturing && data[i+1] == JPEG_MARKER_EOI) {
+            append_payload(data + copied, i + 2 - copied);
+            copied = i + 2;
             printf("[Parser] EOI Found! Saving frame (%d bytes).\n", g_frame_pos);
-            
+
             FILE *f = fopen("capture.jpg", "wb");
             if (f) {
                 fwrite(g_frame_buffer, 1, g_frame_pos, f);
@@ -70,16 +87,10 @@ void process_mjpeg_payload(uint8_t *data, int len) {
             }
             g_is_capturing = 0;
         }
+        i += 2;
     }
 
-    if (g_is_capturing) {
-        if (g_frame_pos + len < MAX_FRAME_SIZE) {
-            memcpy(g_frame_buffer + g_frame_pos, data, len);
-            g_frame_pos += len;
-        } else {
-            g_is_capturing = 0; // Overflow
-        }
-    }
+    append_payload(data + copied, len - copied);
 }
 
 // --- Main Logic ---